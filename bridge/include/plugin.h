@@ -0,0 +1,168 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#ifndef BRIDGE_INCLUDE_PLUGIN_H_
+#define BRIDGE_INCLUDE_PLUGIN_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <HAP.h>
+#include <HAPPlatformFileHandle.h>
+#include <HAPPlatformTimer.h>
+
+/**
+ * Native plugin ABI.
+ *
+ * A native plugin is a shared object "<name>/plugin.so" in the working directory,
+ * loaded instead of "<name>/plugin.lua". It exports a bridge_plugin structure named
+ * BRIDGE_PLUGIN_SYMBOL, registers its accessories with C callbacks in init() and
+ * serves requests without any Lua involvement.
+ *
+ * The bridge does not export its symbols, all services are provided by the
+ * bridge_plugin_api table passed to init(). Plugins only use the types and the
+ * inline functions of the ADK headers, the ADK data such as the service and
+ * characteristic type UUIDs are looked up through the table.
+ *
+ * See example/native/plugin.c for a light bulb served by a native plugin.
+ */
+
+/**
+ * Version of the plugin ABI.
+ *
+ * Incremented on every incompatible change of bridge_plugin or bridge_plugin_api,
+ * plugins built for another version are rejected.
+ */
+#define BRIDGE_PLUGIN_ABI_VERSION 2
+
+/**
+ * Name of the symbol exported by the plugin.
+ */
+#define BRIDGE_PLUGIN_SYMBOL "bridge_plugin"
+
+/**
+ * Services provided by the bridge to native plugins.
+ *
+ * All functions must be called in the run loop thread.
+ */
+typedef struct bridge_plugin_api {
+    uint32_t abi_version;   /**< BRIDGE_PLUGIN_ABI_VERSION of the bridge. */
+
+    /**
+     * Add a bridged accessory, only allowed in init().
+     *
+     * The accessory is not copied and must be valid until the plugin is unloaded.
+     */
+    HAPError (*add_bridged_accessory)(const HAPAccessory *accessory);
+
+    /**
+     * Get a new instance ID for bridged accessory.
+     */
+    uint64_t (*get_new_bridged_aid)(void);
+
+    /**
+     * Get a new instance ID for service or characteristic.
+     */
+    uint64_t (*get_new_iid)(void);
+
+    /**
+     * Raise an event for a characteristic.
+     *
+     * @returns false if the server is not running or the characteristic is not found.
+     */
+    bool (*raise_event)(uint64_t aid, uint64_t sid, uint64_t cid);
+
+    /**
+     * Accessory Information service serving the information of the accessory,
+     * every bridged accessory must include it.
+     */
+    const HAPService *accessory_information_service;
+
+    /**
+     * Look up a service type by name.
+     *
+     * @param name Type name, the same as "type" of a lua service, such as "LightBulb".
+     * @param debug_description Filled with the debug description of the type if not NULL.
+     * @returns the type, or NULL if the name is unknown.
+     */
+    const HAPUUID *(*get_service_type)(const char *name, const char **debug_description);
+
+    /**
+     * Look up a characteristic type by name.
+     *
+     * @param name Type name, the same as "type" of a lua characteristic, such as "On".
+     * @param debug_description Filled with the debug description of the type if not NULL.
+     * @returns the type, or NULL if the name is unknown.
+     */
+    const HAPUUID *(*get_characteristic_type)(const char *name, const char **debug_description);
+
+    /**
+     * Write a log message.
+     */
+    void (*log)(HAPLogType type, const char *plugin, const char *format, ...) HAP_PRINTFLIKE(3, 4);
+
+    /* Run loop services. */
+    HAPTime (*clock_get_current)(void);
+    HAPError (*timer_register)(HAPPlatformTimerRef *timer, HAPTime deadline,
+        HAPPlatformTimerCallback callback, void *context);
+    void (*timer_deregister)(HAPPlatformTimerRef timer);
+    HAPError (*file_handle_register)(HAPPlatformFileHandleRef *fileHandle, int fileDescriptor,
+        HAPPlatformFileHandleEvent interests, HAPPlatformFileHandleCallback callback, void *context);
+    void (*file_handle_update_interests)(HAPPlatformFileHandleRef fileHandle,
+        HAPPlatformFileHandleEvent interests, HAPPlatformFileHandleCallback callback, void *context);
+    void (*file_handle_deregister)(HAPPlatformFileHandleRef fileHandle);
+} bridge_plugin_api;
+
+/**
+ * Native plugin.
+ */
+typedef struct bridge_plugin {
+    uint32_t abi_version;   /**< BRIDGE_PLUGIN_ABI_VERSION the plugin is built for. */
+    const char *name;       /**< Plugin name. */
+
+    /**
+     * Initialize the plugin and add its bridged accessories.
+     *
+     * @param api Services provided by the bridge, valid until the plugin is unloaded.
+     * @param conf Plugin configuration encoded in JSON.
+     * @returns true on success, false otherwise.
+     */
+    bool (*init)(const bridge_plugin_api *api, const char *conf);
+
+    /**
+     * Handle HAP server state, optional.
+     */
+    void (*handle_state)(HAPAccessoryServerState state);
+
+    /**
+     * De-initialize the plugin before it is unloaded, optional.
+     */
+    void (*deinit)(void);
+} bridge_plugin;
+
+/**
+ * Define the plugin exported to the bridge.
+ *
+ * @code{.c}
+ * BRIDGE_PLUGIN_DEFINE(
+ *     .name = "sensor",
+ *     .init = sensor_init,
+ *     .handle_state = sensor_handle_state,
+ * );
+ * @endcode
+ */
+#define BRIDGE_PLUGIN_DEFINE(...) \
+    __attribute__((visibility("default"))) const bridge_plugin bridge_plugin = { \
+        .abi_version = BRIDGE_PLUGIN_ABI_VERSION, \
+        __VA_ARGS__ \
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // BRIDGE_INCLUDE_PLUGIN_H_
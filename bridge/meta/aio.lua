@@ -0,0 +1,41 @@
+---@meta
+
+---Asynchronous file I/O.
+---
+---The operations are performed on a worker thread, the calling coroutine
+---is suspended until the operation completes, so the disk latency never
+---blocks the run loop.
+---@class aiolib
+local aio = {}
+
+---@class AioFileStat:table File status.
+---
+---@field type '"file"'|'"directory"'|'"other"' File type.
+---@field size integer Size in bytes.
+---@field mtime integer Last modification time in seconds since the Epoch.
+
+---Read a file.
+---@param path string File path.
+---@param offset? integer The offset to start reading from, default 0.
+---@param len? integer The max length to read, read until the end of the file by default.
+---@return string data
+---@nodiscard
+function aio.read(path, offset, len) end
+
+---Write data to a file, the file is created if it does not exist, or truncated if it exists.
+---@param path string File path.
+---@param data string Data.
+function aio.write(path, data) end
+
+---Append data to the end of a file, the file is created if it does not exist.
+---@param path string File path.
+---@param data string Data.
+function aio.append(path, data) end
+
+---Get the status of a file.
+---@param path string File path.
+---@return AioFileStat|nil st The file status, or nil if the file does not exist.
+---@nodiscard
+function aio.stat(path) end
+
+return aio
@@ -15,4 +15,23 @@ local chip = {}
 ---@nodiscard
 function chip.getInfo(type) end
 
+---@class ChipResourceUsage:table Resource usage, fields not available on the platform are nil.
+---
+---@field cpuUser integer User CPU time of the process, in milliseconds.
+---@field cpuSys integer System CPU time of the process, in milliseconds.
+---@field cpuUsage integer CPU usage of the process since the previous sample, in percent.
+---@field rss integer Resident set size of the process, in bytes. Linux only.
+---@field heapUsed integer Used heap of the system, in bytes. ESP only, there is no process.
+---@field fds integer Number of open file descriptors.
+---@field ncpus integer Number of online CPUs.
+---@field loadavg number[] System load average over 1, 5 and 15 minutes.
+---@field temp number Chip temperature, in degrees Celsius.
+
+---Get resource usage.
+---
+---The usage is sampled at most once per second.
+---@return ChipResourceUsage|nil usage
+---@nodiscard
+function chip.getResourceUsage() end
+
 return chip
@@ -0,0 +1,64 @@
+---@meta
+
+---Streaming deflate compression.
+---
+---Compression is not supported on ESP32, where only decompression is available.
+---@class compresslib
+local compress = {}
+
+---@alias CompressFormat
+---| '"raw"'  # Raw deflate stream (RFC 1951).
+---| '"zlib"' # zlib stream (RFC 1950).
+---| '"gzip"' # gzip stream (RFC 1952).
+
+---@class CompressStream:userdata Compression or decompression stream.
+local stream = {}
+
+---Compress data.
+---@param data string Data.
+---@param level? integer Compression level from 0 to 9.
+---@param format? CompressFormat Compressed data format, default "zlib".
+---@return string data Compressed data.
+---@nodiscard
+function compress.deflate(data, level, format) end
+
+---Decompress data.
+---@param data string Compressed data.
+---@param format? CompressFormat Compressed data format, default "zlib".
+---@param maxsize? integer Max size of the decompressed data, unlimited by default.
+---@return string data Decompressed data.
+---@nodiscard
+function compress.inflate(data, format, maxsize) end
+
+---Create a compression stream.
+---@param format? CompressFormat Compressed data format, default "zlib".
+---@param level? integer Compression level from 0 to 9.
+---@return CompressStream stream
+---@nodiscard
+function compress.deflater(format, level) end
+
+---Create a decompression stream.
+---@param format? CompressFormat Compressed data format, default "zlib".
+---@param maxsize? integer Max size of the decompressed data, unlimited by default.
+---@return CompressStream stream
+---@nodiscard
+function compress.inflater(format, maxsize) end
+
+---Feed a chunk of data.
+---@param data string Input data.
+---@return string output Output data, may be empty.
+function stream:update(data) end
+
+---Feed the last chunk of data and close the stream.
+---
+---A decompression stream raises an error if the compressed data is truncated.
+---@param data? string Input data.
+---@return string output Output data.
+function stream:finish(data) end
+
+---Whether the end of the stream is reached.
+---@return boolean finished
+---@nodiscard
+function stream:finished() end
+
+return compress
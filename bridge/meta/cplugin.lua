@@ -0,0 +1,24 @@
+---@meta
+
+---@class cpluginlib
+local cplugin = {}
+
+---Whether native plugins are supported on this platform.
+---@type boolean
+cplugin.supported = nil
+
+---@class NativePlugin:table Native plugin.
+---
+---@field name string Plugin name.
+---@field handleState fun(state: HapServerState) Handle HAP server state.
+
+---Load a native plugin and initialize it.
+---
+---The plugin registers its accessories with C callbacks, so requests are served
+---without calling lua. See ``bridge/include/plugin.h`` for the ABI.
+---@param path string Path of the shared object.
+---@param conf? string Plugin configuration encoded in JSON.
+---@return NativePlugin plugin
+function cplugin.load(path, conf) end
+
+return cplugin
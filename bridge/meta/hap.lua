@@ -64,6 +64,9 @@ local hap = {}
 ---@field units HapCharacteristicUnits The units of the values for the characteristic. Format: UInt8|UInt16|UInt32|UInt64|Int|Float
 ---@field constraints HapStringCharacteristiConstraints|HapNumberCharacteristiConstraints|HapUInt8CharacteristiConstraints Value constraints.
 ---@field cbs HapCharacteristicCallbacks Callbacks.
+---@field slot boolean Serve the value from the slot written by an external process, ``cbs.read`` is only called until the slot is written. Format: all but TLV8
+---@field binding HapCharacteristicBinding Bind the characteristic to a property of the accessory context, replaces ``cbs.read`` and ``cbs.write``. Format: Bool, UInt8, UInt16, UInt32, UInt64, Int, Float
+---@field derivedFrom integer[] Instance IDs of the characteristics of the accessory this characteristic is derived from. When an event is raised for any of them, the event of this characteristic is raised once at the end of the tick.
 
 ---@class HapStringCharacteristiConstraints:table Format: String|Data
 ---
@@ -122,6 +125,19 @@ local hap = {}
 ---@field sub async fun(request:HapCharacteristicSubscriptionRequest, context?:any) The callback used to handle subscribe requests.
 ---@field unsub async fun(request:HapCharacteristicSubscriptionRequest, context?:any) The callback used to handle unsubscribe requests.
 
+---@class HapCharacteristicBinding:table Binding between a characteristic and a property of the accessory context.
+---
+---The binding is compiled when the accessory is added, the read and write requests
+---call ``context:getProp(prop)`` and ``context:setProp(prop, value)`` and map the value in C.
+---The write handler is only installed if the characteristic is writable.
+---
+---@field prop string Property name.
+---@field map? table<string|number|boolean, number|boolean> Property value -> characteristic value, characteristic values must be unique.
+---@field default? number|boolean Characteristic value of the unmapped property values, the read fails if it is not set.
+---@field scale? number Characteristic value = property value * scale + offset, only used without ``map``. Default: 1
+---@field offset? number Default: 0
+---@field event? boolean Raise an event after writing, ignored if the characteristic is not writable. Default: true
+
 ---@class HapCharacteristicProperties:table Properties that HomeKit characteristics can have.
 ---
 ---@field readable boolean The characteristic is readable.
@@ -386,6 +402,54 @@ hap.HapProtocolInformationService = {}
 ---@type lightuserdata
 hap.PairingService = {}
 
+---@class HapTestEvent:table Event recorded by the test hooks.
+---
+---@field aid integer Accessory instance ID.
+---@field iid integer Characteristic instance ID.
+---@field session integer Index of the session.
+
+---@class HapTestHooks:table Test hooks, only built with ``BRIDGE_TEST_HOOKS``.
+---
+---The server is not started, the requests are made on behalf of fake sessions
+---and the events are recorded instead of being sent. The handlers must not yield.
+local test = {}
+
+---Start HAP without the accessory server.
+---@param nsessions integer Number of the fake sessions.
+function test.start(nsessions) end
+
+---Stop HAP started by ``hap.test.start()``.
+function test.stop() end
+
+---Read the characteristic.
+---@param aid integer Accessory instance ID.
+---@param iid integer Characteristic instance ID.
+---@param session integer Index of the session.
+---@return HapError err
+---@return any value
+function test.read(aid, iid, session) end
+
+---Write the characteristic.
+---@param aid integer Accessory instance ID.
+---@param iid integer Characteristic instance ID.
+---@param value any
+---@param session integer Index of the session.
+---@return HapError err
+function test.write(aid, iid, value, session) end
+
+---Write the slot of the characteristic and ring the doorbell, as an external writer does.
+---@param aid integer Accessory instance ID.
+---@param iid integer Characteristic instance ID.
+---@param value boolean|number|string
+function test.writeSlot(aid, iid, value) end
+
+---Get and clear the recorded events.
+---@return HapTestEvent[]
+function test.events() end
+
+---@type HapTestHooks?
+hap.test = test
+
 ---Initialize HAP.
 ---@param primaryAccessory HapAccessory Primary accessory to serve.
 ---@param serverCallbacks HapServerCallbacks Accessory server callbacks.
@@ -407,6 +471,7 @@ function hap.stop() end
 
 ---Raises an event notification for a given characteristic in a given service provided by a given accessory.
 ---If has session, it raises event on a given session.
+---If raised from the write handler of the characteristic, the controller that wrote it is not notified.
 ---@overload fun(aid: integer, sid: integer, cid: integer)
 ---@param aid integer Accessory instance ID.
 ---@param sid integer Service instance ID.
@@ -414,14 +479,38 @@ function hap.stop() end
 ---@param session? HapSession The session on which to raise the event.
 function hap.raiseEvent(aid, sid, cid, session) end
 
+---Open a shared-memory region of value slots.
+---
+---External processes attach to the region by name and write characteristic
+---values into slots keyed by (aid, iid). Reads of characteristics with
+---``slot = true`` are served from the slots without calling lua, and events are
+---raised for the changed slots when the writer rings the doorbell.
+---@param name string Region name.
+---@param nslots integer Number of slots.
+function hap.openSlots(name, nslots) end
+
 ---Get a new Instance ID for bridged accessory.
+---
+---With ``key``, the ID is looked up in a mapping persisted in NVS and only allocated
+---the first time the key is seen, so the accessory keeps its ID across restarts
+---regardless of the order and the availability of the devices.
+---@param key? string Unique key of 1 to 128 bytes, such as ``"<plugin>:<device unique ID>"``.
 ---@return integer iid Instance ID.
 ---@nodiscard
-function hap.getNewBridgedAccessoryID() end
+function hap.getNewBridgedAccessoryID(key) end
 
 ---Get a new Instance ID for service or characteristic.
+---@param key? string Unique key, such as ``"<accessory key>:<service/characteristic name>"``, see ``hap.getNewBridgedAccessoryID``.
 ---@return integer iid Instance ID.
 ---@nodiscard
-function hap.getNewInstanceID() end
+function hap.getNewInstanceID(key) end
+
+---Remove the persisted IDs of the keys not requested since ``hap.init()``.
+---
+---Call it after all the accessories are added, e.g. when the configuration is changed.
+---The IDs of the devices unavailable at that time are removed as well. The removed IDs
+---are not reused.
+---@return integer pruned The number of the removed IDs.
+function hap.pruneIDs() end
 
 return hap
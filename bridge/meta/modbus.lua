@@ -0,0 +1,76 @@
+---@meta
+
+---Modbus TCP/RTU client.
+---
+---The requests issued in the same run loop iteration are queued per unit, the reads
+---of the same function with the overlapping or adjoining ranges are merged into one
+---request, up to 125 registers. The reads are never merged across a write.
+---
+---A TCP client keeps multiple requests in flight and matches the responses by
+---the transaction identifier, a RTU client has one request on the bus at a time.
+---@class modbuslib
+local modbus = {}
+
+---@class ModbusClient:userdata
+local _client = {}
+
+---@class ModbusTcpOptions:table Modbus TCP client options.
+---
+---@field timeout? integer Timeout of the connecting and the requests in milliseconds, default 3000.
+---@field pipeline? integer The max number of the in-flight requests, 1 ~ 32, default 8.
+
+---@class ModbusRtuOptions:SerialPortConfig Modbus RTU client options, default 9600 8E1.
+---
+---@field timeout? integer Timeout of the requests in milliseconds, default 3000.
+
+---Connect to a Modbus TCP server.
+---@param addr string IPv4 or IPv6 address.
+---@param port integer Port, usually 502.
+---@param opts? ModbusTcpOptions Options.
+---@return ModbusClient client
+---@nodiscard
+function modbus.tcp(addr, port, opts) end
+
+---Open a Modbus RTU client on a serial port.
+---@param path string The path of the tty device, such as "/dev/ttyUSB0".
+---@param opts? ModbusRtuOptions Serial port configuration and options.
+---@return ModbusClient client
+---@nodiscard
+function modbus.rtu(path, opts) end
+
+---Read the holding registers.
+---@param unit integer Unit identifier, 1 ~ 247 for RTU.
+---@param addr integer The address of the first register.
+---@param cnt integer The number of registers, 1 ~ 125.
+---@return integer[] regs The values of the registers.
+---@nodiscard
+function _client:readholding(unit, addr, cnt) end
+
+---Read the input registers.
+---@param unit integer Unit identifier, 1 ~ 247 for RTU.
+---@param addr integer The address of the first register.
+---@param cnt integer The number of registers, 1 ~ 125.
+---@return integer[] regs The values of the registers.
+---@nodiscard
+function _client:readinput(unit, addr, cnt) end
+
+---Write a single holding register.
+---@param unit integer Unit identifier, 1 ~ 247 for RTU.
+---@param addr integer The address of the register.
+---@param value integer The value, 0 ~ 65535.
+function _client:writeregister(unit, addr, value) end
+
+---Write multiple holding registers.
+---@param unit integer Unit identifier, 1 ~ 247 for RTU.
+---@param addr integer The address of the first register.
+---@param values integer[] The values, 1 ~ 123 registers.
+function _client:writeregisters(unit, addr, values) end
+
+---Set the timeout of the requests.
+---@param ms integer Timeout in milliseconds, 0 means no timeout.
+function _client:settimeout(ms) end
+
+---Close the client, the pending requests are dropped.
+function _client:close() end
+
+return modbus
@@ -0,0 +1,32 @@
+---@meta
+
+---Network interface watcher.
+---
+---The link and address changes are reported as they happen, the states before
+---the first handler is added are not reported.
+---@class netiflib
+local netif = {}
+
+---@alias NetifEventType
+---|'"up"'          # The link is up and running.
+---|'"down"'        # The link is down or removed.
+---|'"newaddr"'     # An address is added.
+---|'"deladdr"'     # An address is removed.
+
+---@class NetifEvent:table Network interface event.
+---
+---@field type NetifEventType Event type.
+---@field name string Interface name, may be empty if the interface is removed.
+---@field index integer Interface index.
+---@field family? AddressFamily Address family, only for the address events.
+---@field addr? string Address, only for the address events.
+
+---Add a handler called when a network interface changes.
+---@param cb async fun(event: NetifEvent)
+function netif.onChange(cb) end
+
+---Remove a handler added by ``netif.onChange()``.
+---@param cb async fun(event: NetifEvent)
+function netif.offChange(cb) end
+
+return netif
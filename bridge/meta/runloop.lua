@@ -0,0 +1,42 @@
+---@meta
+
+---@class runlooplib
+local runloop = {}
+
+---@alias RunLoopPressure
+---|'"normal"'      # The run loop keeps up.
+---|'"moderate"'    # The run loop falls behind, defer background work.
+---|'"critical"'    # The run loop is saturated, skip background work.
+
+---@class RunLoopStats:table Run loop statistics, in milliseconds.
+---
+---@field pressure RunLoopPressure Current pressure level.
+---@field lag integer Smoothed timer lag.
+---@field maxLag integer Max timer lag since the previous call.
+---@field iteration integer Smoothed time per iteration.
+---@field maxIteration integer Max time per iteration since the previous call.
+
+---Get the current pressure level.
+---@return RunLoopPressure pressure
+---@nodiscard
+function runloop.pressure() end
+
+---Get statistics.
+---@return RunLoopStats stats
+---@nodiscard
+function runloop.stats() end
+
+---Set the lag thresholds of the pressure levels.
+---@param moderate integer Threshold of the moderate level in milliseconds, default 50.
+---@param critical integer Threshold of the critical level in milliseconds, default 200.
+function runloop.setThresholds(moderate, critical) end
+
+---Add a handler called when the pressure level changes.
+---@param cb async fun(pressure: RunLoopPressure)
+function runloop.onPressureChange(cb) end
+
+---Remove a handler added by ``runloop.onPressureChange()``.
+---@param cb async fun(pressure: RunLoopPressure)
+function runloop.offPressureChange(cb) end
+
+return runloop
@@ -0,0 +1,68 @@
+---@meta
+
+---Asynchronous serial port.
+---
+---The port is read and written on the run loop, the calling coroutine
+---is suspended until the operation completes.
+---@class seriallib
+local serial = {}
+
+---@class SerialPort:userdata
+local _port = {}
+
+---@class SerialPortConfig:table Serial port configuration.
+---
+---@field baudrate? integer Baud rate, default 115200.
+---@field databits? integer Data bits, 5 ~ 8, default 8.
+---@field parity? '"none"'|'"odd"'|'"even"' Parity, default "none".
+---@field stopbits? integer Stop bits, 1 or 2, default 1.
+
+---Open a serial port in raw mode.
+---@param path string The path of the tty device, such as "/dev/ttyUSB0".
+---@param cfg? SerialPortConfig Configuration.
+---@return SerialPort port Serial port object.
+---@nodiscard
+function serial.open(path, cfg) end
+
+---Open the master side of a pseudo-terminal pair, Linux only.
+---@return SerialPort port Serial port object of the master side.
+---@return string path The path of the slave side, open it with ``serial.open()``.
+---@nodiscard
+function serial.openpty() end
+
+---Set the timeout of the reads.
+---@param ms integer Maximum time blocked in milliseconds, 0 means no timeout.
+function _port:settimeout(ms) end
+
+---Write all the data.
+---
+---This function will return after all the data written.
+---@param data string The data to be written.
+function _port:write(data) end
+
+---Read the available data, at least 1 byte.
+---@param maxlen integer The max length of the data.
+---@return string data
+---@nodiscard
+function _port:read(maxlen) end
+
+---Read exactly ``len`` bytes.
+---@param len integer The length of the data.
+---@return string data
+---@nodiscard
+function _port:readexactly(len) end
+
+---Read until the delimiter, the delimiter is included in the returned data.
+---
+---If the delimiter is not found in the first ``maxlen`` bytes, an error is raised
+---and the bytes are kept, read them with ``port:read()`` to skip them.
+---@param delim string The delimiter, 1 ~ 16 bytes.
+---@param maxlen integer The max length of the data.
+---@return string data
+---@nodiscard
+function _port:readuntil(delim, maxlen) end
+
+---Close the serial port.
+function _port:destroy() end
+
+return serial
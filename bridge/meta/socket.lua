@@ -20,6 +20,11 @@ function _socket:settimeout(ms) end
 ---Enable broadcast.
 function _socket:enablebroadcast() end
 
+---Join a multicast group, only for UDP sockets.
+---@param maddr string Multicast group address.
+---@param ifaddr? string Address of the local interface, IPv4 only.
+function _socket:joingroup(maddr, ifaddr) end
+
 ---Bind a socket to a local IP address and port.
 ---@param addr string Local address to use.
 ---@param port integer Local port number, in host order.
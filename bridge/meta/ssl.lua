@@ -8,8 +8,13 @@ local ctx = {}
 ---Create a SSL context.
 ---@param endpoint '"client"'|'"server"' SSL endpoint.
 ---@param hostname? string host name, only valid when the SSL endpoint is "client".
+---@param alpn? string[] Protocols advertised by ALPN in order of preference, only valid when the SSL endpoint is "client".
 ---@return SSLCtx context
-function ssl.create(endpoint, hostname) end
+function ssl.create(endpoint, hostname, alpn) end
+
+---Get the protocol selected by the server with ALPN.
+---@return string|nil protocol
+function ctx:alpn() end
 
 ---Whether the handshake is finshed.
 ---@return boolean finshed
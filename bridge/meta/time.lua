@@ -10,6 +10,11 @@ local timer = {}
 ---@param ms integer Milliseconds.
 function time.sleep(ms) end
 
+---Get the time of the monotonic clock.
+---@return integer ms Milliseconds since an arbitrary point in the past.
+---@nodiscard
+function time.monotonic() end
+
 ---Create a timer.
 ---@param cb async fun(...) Function to call when the timer expires.
 ---@param ... any Arguments passed to the callback.
@@ -26,4 +31,13 @@ function timer:start(ms) end
 ---If the timer has not started, nothing will happen.
 function timer:stop() end
 
+---Mark the timer as a background timer.
+---
+---A background timer is deferred by one second while the run loop is under
+---pressure, up to 3 times under moderate pressure and up to 10 times under
+---critical pressure, see ``runloop.pressure()``. Only mark the work that can
+---be delayed, such as keepalives and periodic refreshes.
+---@param enable boolean
+function timer:setBackground(enable) end
+
 return time
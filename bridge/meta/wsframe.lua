@@ -0,0 +1,56 @@
+---@meta
+
+---WebSocket frame codec (RFC 6455).
+---@class wsframelib
+local wsframe = {}
+
+---@alias WSFrameOpcode
+---| '"continuation"'
+---| '"text"'
+---| '"binary"'
+---| '"close"'
+---| '"ping"'
+---| '"pong"'
+
+---@class WSFrameParser:userdata Incremental frame parser.
+local parser = {}
+
+---Generate a random ``Sec-WebSocket-Key``.
+---@return string key
+---@nodiscard
+function wsframe.key() end
+
+---Compute the ``Sec-WebSocket-Accept`` of a key.
+---@param key string Sec-WebSocket-Key.
+---@return string accept
+---@nodiscard
+function wsframe.accept(key) end
+
+---Encode a frame.
+---@param opcode WSFrameOpcode Frame opcode.
+---@param payload? string Payload.
+---@param fin? boolean Whether it is the final fragment of a message, default true.
+---@param mask? boolean Whether to mask the payload with a random key, default true.
+---@return string frame
+---@nodiscard
+function wsframe.encode(opcode, payload, fin, mask) end
+
+---Create a frame parser.
+---@param maxsize? integer Max size of a message, default 65536.
+---@return WSFrameParser parser
+---@nodiscard
+function wsframe.parser(maxsize) end
+
+---Feed the received bytes.
+---@param data string
+function parser:feed(data) end
+
+---Get the next message from the fed bytes.
+---
+---The fragments of a message are joined, and masked payloads are unmasked.
+---Control frames are returned as soon as they are parsed.
+---@return WSFrameOpcode|nil opcode Message opcode, or nil if more bytes are needed.
+---@return string payload Message payload.
+function parser:next() end
+
+return wsframe
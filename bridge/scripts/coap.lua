@@ -0,0 +1,697 @@
+local socket = require "socket"
+local dns = require "dns"
+local mq = require "mq"
+local time = require "time"
+local pack = string.pack
+local unpack = string.unpack
+local concat = table.concat
+local traceback = debug.traceback
+local random = math.random
+local assert = assert
+local error = error
+local type = type
+
+---
+--- CoAP client (RFC 7252) with Observe (RFC 7641) and block-wise
+--- transfer (RFC 7959).
+---
+--- Each client owns one UDP socket connected to the server, and a reader
+--- coroutine matches the incoming messages to the pending requests by
+--- message ID and token. Confirmable requests are retransmitted with
+--- exponential back-off from timers. Observations deliver notifications
+--- to a callback, which can update the state and raise HAP events instead
+--- of polling the device.
+---
+
+local coap = {}
+local logger = log.getLogger("coap")
+
+---Message types.
+local TYPE_CON = 0
+local TYPE_NON = 1
+local TYPE_ACK = 2
+local TYPE_RST = 3
+
+---Options.
+local OPTION_OBSERVE = 6
+local OPTION_URI_PATH = 11
+local OPTION_CONTENT_FORMAT = 12
+local OPTION_URI_QUERY = 15
+local OPTION_BLOCK2 = 23
+
+---Transmission parameters.
+local ACK_TIMEOUT = 2000
+local ACK_TIMEOUT_MAX = 3000    -- ACK_TIMEOUT * ACK_RANDOM_FACTOR
+local MAX_RETRANSMIT = 4
+
+---Number of message IDs remembered to detect duplicates.
+local DEDUP_SIZE = 32
+
+---Size exponent of the blocks requested by the client, 2^(6+4) = 1024 bytes.
+local BLOCK_SZX = 6
+
+local methods = {
+    GET = 1,
+    POST = 2,
+    PUT = 3,
+    DELETE = 4,
+}
+
+---Wait until ``o`` is notified, the caller must check its condition again.
+---@param o CoapExchange
+local function wait(o)
+    o.waiting = true
+    o.mq:recv()
+end
+
+---Wake up the coroutine waiting on ``o``.
+---@param o CoapExchange
+local function notify(o)
+    if o.waiting then
+        o.waiting = false
+        o.mq:send(true)
+    end
+end
+
+---Encode an unsigned integer option value.
+---@param v integer
+---@return string
+local function encodeUint(v)
+    local s = pack(">I4", v):gsub("^%z+", "")
+    return s
+end
+
+---Decode an unsigned integer option value.
+---@param s string
+---@return integer
+local function decodeUint(s)
+    local v = 0
+    for i = 1, #s do
+        v = (v << 8) | s:byte(i)
+    end
+    return v
+end
+
+---Format a code as "c.dd".
+---@param code integer
+---@return string
+local function formatCode(code)
+    return ("%d.%02d"):format(code >> 5, code & 0x1f)
+end
+
+---@class CoapMessage:table CoAP message.
+---
+---@field type integer Message type.
+---@field code integer Code, class in the higher 3 bits.
+---@field mid integer Message ID.
+---@field token string Token.
+---@field options { [1]: integer, [2]: string }[] Options sorted by number.
+---@field payload string Payload.
+
+---Encode a message.
+---@param msg CoapMessage
+---@return string
+function coap.encode(msg)
+    local token = msg.token or ""
+    local parts = {
+        pack(">BBI2", 0x40 | (msg.type << 4) | #token, msg.code, msg.mid),
+        token,
+    }
+    local last = 0
+    for _, opt in ipairs(msg.options or {}) do
+        local num, value = opt[1], opt[2]
+        local delta, len = num - last, #value
+        assert(delta >= 0, "options must be sorted")
+        last = num
+        local ext = ""
+        local function nibble(v)
+            if v < 13 then
+                return v
+            elseif v < 269 then
+                ext = ext .. pack("B", v - 13)
+                return 13
+            else
+                ext = ext .. pack(">I2", v - 269)
+                return 14
+            end
+        end
+        local d = nibble(delta)
+        local l = nibble(len)
+        parts[#parts + 1] = pack("B", (d << 4) | l) .. ext .. value
+    end
+    if msg.payload and msg.payload ~= "" then
+        parts[#parts + 1] = "\xff" .. msg.payload
+    end
+    return concat(parts)
+end
+
+---Decode a message.
+---@param data string
+---@return CoapMessage msg
+function coap.decode(data)
+    if #data < 4 then
+        error("message too short")
+    end
+    local b, code, mid = unpack(">BBI2", data)
+    if b >> 6 ~= 1 then
+        error("unknown version")
+    end
+    local tkl = b & 0xf
+    if tkl > 8 or 4 + tkl > #data then
+        error("invalid token length")
+    end
+    local msg = {
+        type = (b >> 4) & 0x3,
+        code = code,
+        mid = mid,
+        token = data:sub(5, 4 + tkl),
+        options = {},
+        payload = "",
+    }
+    local pos = 5 + tkl
+    local num = 0
+    local function ext(v)
+        if v == 13 then
+            v = data:byte(pos) + 13
+            pos = pos + 1
+        elseif v == 14 then
+            v = unpack(">I2", data, pos) + 269
+            pos = pos + 2
+        elseif v == 15 then
+            error("invalid option")
+        end
+        return v
+    end
+    while pos <= #data do
+        local b = data:byte(pos)
+        pos = pos + 1
+        if b == 0xff then
+            if pos > #data then
+                error("empty payload")
+            end
+            msg.payload = data:sub(pos)
+            break
+        end
+        num = num + ext(b >> 4)
+        local len = ext(b & 0xf)
+        if pos + len - 1 > #data then
+            error("option too long")
+        end
+        msg.options[#msg.options + 1] = { num, data:sub(pos, pos + len - 1) }
+        pos = pos + len
+    end
+    return msg
+end
+
+---Get the first value of an option.
+---@param msg CoapMessage
+---@param num integer
+---@return string|nil
+local function getOption(msg, num)
+    for _, opt in ipairs(msg.options) do
+        if opt[1] == num then
+            return opt[2]
+        end
+    end
+    return nil
+end
+
+---Build the request options of a path.
+---@param path string Path with an optional query, such as "/a/b?c=d".
+---@param extra? { [1]: integer, [2]: string }[] Extra options.
+---@return { [1]: integer, [2]: string }[]
+local function buildOptions(path, extra)
+    local options = {}
+    local p, q = path:match("^([^?]*)%??(.*)$")
+    for seg in p:gmatch("[^/]+") do
+        options[#options + 1] = { OPTION_URI_PATH, seg }
+    end
+    for seg in q:gmatch("[^&]+") do
+        options[#options + 1] = { OPTION_URI_QUERY, seg }
+    end
+    for _, opt in ipairs(extra or {}) do
+        options[#options + 1] = opt
+    end
+    -- Stable sort by option number.
+    for i = 2, #options do
+        local opt = options[i]
+        local j = i - 1
+        while j > 0 and options[j][1] > opt[1] do
+            options[j + 1] = options[j]
+            j = j - 1
+        end
+        options[j + 1] = opt
+    end
+    return options
+end
+
+---@class CoapExchange:table Request waiting for its response.
+---
+---@field mid integer Message ID.
+---@field token string Token.
+---@field mq MessageQueue
+---@field waiting boolean
+---@field acked boolean The request is acknowledged.
+---@field resp? CoapMessage Response.
+---@field err? string Error.
+---@field timer? Timer Retransmission timer.
+
+---@class CoapObservation:CoapObservationMethods Observation of a resource.
+---
+---@field client CoapClient
+---@field path string
+---@field token string
+---@field seq? integer Last sequence number.
+---@field updated integer Time the last notification is received.
+---@field cb fun(payload: string, code: string)
+---@field cancelled boolean
+
+---@class CoapClient:CoapClientPriv CoAP client.
+local _client = {}
+
+---@class CoapObservationMethods
+local _obs = {}
+
+---Cancel the observation.
+function _obs:cancel()
+    self.client:cancelObservation(self)
+end
+
+---Allocate a message ID.
+---@return integer
+function _client:newMid()
+    local mid = self.nextMid
+    self.nextMid = (mid + 1) & 0xffff
+    return mid
+end
+
+---Allocate a token.
+---@return string
+function _client:newToken()
+    local token = self.nextToken
+    self.nextToken = (token + 1) & 0xffffffff
+    return pack(">I4", token)
+end
+
+---Send an empty ACK or RST.
+---@param type integer
+---@param mid integer
+function _client:sendEmpty(type, mid)
+    self.sock:send(coap.encode({ type = type, code = 0, mid = mid }))
+end
+
+---Remember a received message with the type of the empty message replied to it,
+---so its duplicates get the same reply.
+---@param mid integer
+---@param reply integer|false Type of the reply, ``false`` if not replied.
+function _client:remember(mid, reply)
+    local seen = self.seen
+    local ring = self.seenRing
+    local old = ring[ring.pos]
+    if old then
+        seen[old] = nil
+    end
+    ring[ring.pos] = mid
+    ring.pos = ring.pos % DEDUP_SIZE + 1
+    seen[mid] = reply
+end
+
+---Handle a notification of an observation.
+---@param obs CoapObservation
+---@param msg CoapMessage
+function _client:handleNotification(obs, msg)
+    if obs.cancelled then
+        return
+    end
+    local observe = getOption(msg, OPTION_OBSERVE)
+    if observe then
+        -- Drop the reordered notifications (RFC 7641 3.4).
+        local seq = decodeUint(observe)
+        local now = time.monotonic()
+        local last = obs.seq
+        if last and not ((last < seq and seq - last < 1 << 23) or
+            (last > seq and last - seq > 1 << 23) or now > obs.updated + 128000) then
+            return
+        end
+        obs.seq = seq
+        obs.updated = now
+    else
+        -- The server removed the observation.
+        obs.cancelled = true
+        self.exchanges[obs.token] = nil
+    end
+
+    local code = formatCode(msg.code)
+    local block2 = getOption(msg, OPTION_BLOCK2)
+    time.createTimer(function ()
+        local payload = msg.payload
+        if block2 and decodeUint(block2) & 0x8 ~= 0 then
+            -- Fetch the rest of the representation.
+            local success, _, rest = pcall(self.request, self, "GET", obs.path, nil, {
+                block = decodeUint(block2),
+            })
+            if success == false then
+                logger:error(("%s: failed to fetch %s: %s"):format(self.key, obs.path, _))
+                return
+            end
+            payload = payload .. rest
+        end
+        local success, err = xpcall(obs.cb, traceback, payload, code)
+        if success == false then
+            logger:error(err)
+        end
+    end):start(0)
+end
+
+---Handle a received message.
+---@param msg CoapMessage
+function _client:handleMessage(msg)
+    if msg.type == TYPE_ACK or msg.type == TYPE_RST then
+        local exchange = self.pending[msg.mid]
+        if exchange == nil then
+            return
+        end
+        self.pending[msg.mid] = nil
+        exchange.acked = true
+        if exchange.timer then
+            exchange.timer:stop()
+        end
+        if msg.type == TYPE_RST then
+            exchange.err = "reset by server"
+        elseif msg.code ~= 0 then
+            if msg.token ~= exchange.token then
+                exchange.err = "token mismatch"
+            else
+                exchange.resp = msg
+            end
+        end
+        notify(exchange)
+        return
+    end
+
+    -- A separate response or a notification, a duplicate gets the reply of the first one.
+    local reply = self.seen[msg.mid]
+    if reply ~= nil then
+        if reply then
+            self:sendEmpty(reply, msg.mid)
+        end
+        return
+    end
+    -- Reject the empty messages, such as the pings, and the messages of the unknown exchanges.
+    local exchange = msg.code ~= 0 and self.exchanges[msg.token] or nil
+    if exchange == nil then
+        self:remember(msg.mid, TYPE_RST)
+        self:sendEmpty(TYPE_RST, msg.mid)
+        return
+    end
+    reply = msg.type == TYPE_CON and TYPE_ACK
+    self:remember(msg.mid, reply)
+    if reply then
+        self:sendEmpty(reply, msg.mid)
+    end
+    if exchange.obs and exchange.resp then
+        self:handleNotification(exchange.obs, msg)
+        return
+    end
+    exchange.acked = true
+    exchange.resp = msg
+    notify(exchange)
+end
+
+---Read and dispatch the messages until the client is closed.
+---@param self CoapClient
+local function readLoop(self)
+    while not self.closed do
+        local success, data = pcall(self.sock.recv, self.sock, 1152)
+        if self.closed then
+            return
+        end
+        if success == false then
+            logger:error(("%s: %s"):format(self.key, data))
+            self:close()
+            return
+        end
+        local ok, msg = pcall(coap.decode, data)
+        if ok then
+            local success, err = xpcall(self.handleMessage, traceback, self, msg)
+            if success == false then
+                logger:error(err)
+            end
+        else
+            logger:debug(("%s: invalid message: %s"):format(self.key, msg))
+        end
+    end
+end
+
+---Send a request and wait for the response.
+---@param exchange CoapExchange
+---@param msg CoapMessage
+---@param timeout integer
+---@return CoapMessage resp
+function _client:exchange(exchange, msg, timeout)
+    msg.token = exchange.token
+    local data = coap.encode(msg)
+    self.exchanges[exchange.token] = exchange
+    if msg.type == TYPE_CON then
+        self.pending[msg.mid] = exchange
+        local retransmit = 0
+        local interval = random(ACK_TIMEOUT, ACK_TIMEOUT_MAX)
+        exchange.timer = time.createTimer(function ()
+            if exchange.acked or exchange.err then
+                return
+            end
+            if retransmit == MAX_RETRANSMIT then
+                exchange.err = "timed out"
+                notify(exchange)
+                return
+            end
+            retransmit = retransmit + 1
+            interval = interval * 2
+            exchange.timer:start(interval)
+            local success, err = pcall(self.sock.send, self.sock, data)
+            if success == false then
+                exchange.err = err
+                notify(exchange)
+            end
+        end)
+        exchange.timer:start(interval)
+    else
+        exchange.acked = true
+    end
+
+    -- Wait for the separate response.
+    local timer = time.createTimer(function ()
+        if exchange.acked and not exchange.resp then
+            exchange.err = "timed out"
+            notify(exchange)
+        end
+    end)
+    local timerStarted = false
+
+    local success, err = pcall(function ()
+        self.sock:send(data)
+        while not exchange.resp and not exchange.err and not self.closed do
+            if exchange.acked and not timerStarted then
+                timerStarted = true
+                timer:start(timeout)
+            end
+            wait(exchange)
+        end
+    end)
+    timer:stop()
+    if exchange.timer then
+        exchange.timer:stop()
+    end
+    self.pending[msg.mid] = nil
+    if not exchange.obs or not exchange.resp then
+        self.exchanges[exchange.token] = nil
+    end
+
+    if success == false then
+        error(err, 0)
+    elseif exchange.err then
+        error(exchange.err, 0)
+    elseif self.closed then
+        error("client is closed", 0)
+    end
+    return exchange.resp
+end
+
+---@class CoapRequestOptions:table Request options.
+---
+---@field confirmable? boolean Send a confirmable request, default true.
+---@field contentFormat? integer Content format of the payload.
+---@field timeout? integer Timeout period of waiting for a separate response (in milliseconds), default 10000.
+---@field block? integer Block2 value of the first response block, used to continue a transfer.
+
+---Send a request, the blocks of a large response are fetched and joined.
+---@param method '"GET"'|'"POST"'|'"PUT"'|'"DELETE"' Request method.
+---@param path string Resource path with an optional query, such as "/a/b?c=d".
+---@param payload? string Request payload.
+---@param opts? CoapRequestOptions Request options.
+---@return string code Response code, such as "2.05".
+---@return string payload Response payload.
+function _client:request(method, path, payload, opts)
+    assert(methods[method], "invalid method")
+    assert(type(path) == "string")
+    if self.closed then
+        error("client is closed")
+    end
+    opts = opts or {}
+
+    local body = {}
+    local num = opts.block and ((opts.block >> 4) + 1) or 0
+    local szx = opts.block and math.min(opts.block & 0x7, BLOCK_SZX) or nil
+    while true do
+        local extra = {}
+        if opts.contentFormat then
+            extra[#extra + 1] = { OPTION_CONTENT_FORMAT, encodeUint(opts.contentFormat) }
+        end
+        if num > 0 then
+            extra[#extra + 1] = { OPTION_BLOCK2, encodeUint((num << 4) | szx) }
+        end
+        local resp = self:exchange({
+            token = self:newToken(),
+            mq = mq.create(1),
+            waiting = false,
+            acked = false,
+        }, {
+            type = opts.confirmable == false and TYPE_NON or TYPE_CON,
+            code = methods[method],
+            mid = self:newMid(),
+            options = buildOptions(path, extra),
+            payload = payload,
+        }, opts.timeout or 10000)
+
+        body[#body + 1] = resp.payload
+        local block2 = getOption(resp, OPTION_BLOCK2)
+        if not block2 or resp.code >> 5 ~= 2 then
+            return formatCode(resp.code), concat(body)
+        end
+        local v = decodeUint(block2)
+        if v & 0x8 == 0 then
+            return formatCode(resp.code), concat(body)
+        end
+        -- Keep the block size chosen by the server, it may only shrink.
+        szx = v & 0x7
+        num = (v >> 4) + 1
+        payload = nil
+    end
+end
+
+---Observe a resource.
+---@param path string Resource path.
+---@param cb fun(payload: string, code: string) Called with the current state and each notification.
+---@return CoapObservation obs
+function _client:observe(path, cb)
+    assert(type(path) == "string")
+    assert(type(cb) == "function")
+    if self.closed then
+        error("client is closed")
+    end
+
+    local token = self:newToken()
+    ---@type CoapObservation
+    local obs = {
+        client = self,
+        path = path,
+        token = token,
+        seq = nil,
+        updated = time.monotonic(),
+        cb = cb,
+        cancelled = false,
+    }
+    local exchange = {
+        token = token,
+        mq = mq.create(1),
+        waiting = false,
+        acked = false,
+        obs = obs,
+    }
+    local resp = self:exchange(exchange, {
+        type = TYPE_CON,
+        code = methods.GET,
+        mid = self:newMid(),
+        options = buildOptions(path, { { OPTION_OBSERVE, encodeUint(0) } }),
+    }, 10000)
+    -- Notifications are dispatched to the observation from now on.
+    self:handleNotification(obs, resp)
+    return setmetatable(obs, {
+        __index = _obs
+    })
+end
+
+---Cancel an observation.
+---@param obs CoapObservation
+function _client:cancelObservation(obs)
+    if obs.cancelled then
+        return
+    end
+    obs.cancelled = true
+    self.exchanges[obs.token] = nil
+    if self.closed then
+        return
+    end
+    -- Deregister with the same token (RFC 7641 3.6).
+    local success, err = pcall(self.exchange, self, {
+        token = obs.token,
+        mq = mq.create(1),
+        waiting = false,
+        acked = false,
+    }, {
+        type = TYPE_CON,
+        code = methods.GET,
+        mid = self:newMid(),
+        options = buildOptions(obs.path, { { OPTION_OBSERVE, encodeUint(1) } }),
+    }, 10000)
+    if success == false then
+        logger:debug(("%s: failed to deregister %s: %s"):format(self.key, obs.path, err))
+    end
+end
+
+---Close the client.
+function _client:close()
+    if self.closed then
+        return
+    end
+    self.closed = true
+    for _, exchange in pairs(self.exchanges) do
+        notify(exchange)
+    end
+    self.sock:destroy()
+end
+
+---Create a CoAP client.
+---@param host string Server host name or IP address.
+---@param port? integer Server port, default 5683.
+---@return CoapClient client
+---@nodiscard
+function coap.connect(host, port)
+    assert(type(host) == "string")
+    port = port or 5683
+
+    local addr = dns.resolve(host)
+    local sock = socket.create("UDP", addr:find(":", 1, true) and "IPV6" or "IPV4")
+    sock:connect(addr, port)
+
+    ---@class CoapClientPriv
+    local o = {
+        key = ("%s:%d"):format(host, port),
+        sock = sock,
+        closed = false,
+        nextMid = random(0, 0xffff),
+        nextToken = random(0, 0xffffffff),
+        pending = {}, ---@type table<integer, CoapExchange> Exchanges waiting for ACK by message ID.
+        exchanges = {}, ---@type table<string, CoapExchange> Exchanges by token.
+        seen = {}, ---@type table<integer, integer|false>
+        seenRing = { pos = 1 },
+    }
+    setmetatable(o, {
+        __index = _client
+    })
+
+    time.createTimer(readLoop, o):start(0)
+    return o
+end
+
+return coap
@@ -0,0 +1,14 @@
+---New a characteristic bound to a property of the accessory context.
+---
+---The property is only written if the characteristic is writable, such as ``hap.char.Active``,
+---the read-only characteristics, such as ``hap.char.CurrentTemperature``, are only read.
+---@param char table Characteristic module, such as ``hap.char.Active``.
+---@param iid integer Instance ID.
+---@param binding HapCharacteristicBinding Binding.
+---@param ... any Extra arguments of ``char.new``.
+---@return HapCharacteristic characteristic
+return function (char, iid, binding, ...)
+    local c = char.new(iid, nil, nil, ...)
+    c.binding = binding
+    return c
+end
@@ -0,0 +1,30 @@
+return {
+    value = {
+        Detected = 0,
+        NotDetected = 1
+    },
+    ---New a ``ContactSensorState`` characteristic.
+    ---@param iid integer Instance ID.
+    ---@param read fun(request:HapCharacteristicReadRequest, context?:any): any, HapError
+    ---@return HapCharacteristic characteristic
+    new = function (iid, read)
+        return {
+            format = "UInt8",
+            iid = iid,
+            type = "ContactSensorState",
+            props = {
+                readable = true,
+                writable = false,
+                supportsEventNotification = true
+            },
+            constraints = {
+                minVal = 0,
+                maxVal = 1,
+                stepVal = 1,
+            },
+            cbs = {
+                read = read
+            }
+        }
+    end
+}
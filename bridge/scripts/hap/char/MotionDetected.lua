@@ -0,0 +1,21 @@
+return {
+    ---New a ``MotionDetected`` characteristic.
+    ---@param iid integer Instance ID.
+    ---@param read fun(request:HapCharacteristicReadRequest, context?:any): any, HapError
+    ---@return HapCharacteristic characteristic
+    new = function (iid, read)
+        return {
+            format = "Bool",
+            iid = iid,
+            type = "MotionDetected",
+            props = {
+                readable = true,
+                writable = false,
+                supportsEventNotification = true
+            },
+            cbs = {
+                read = read
+            }
+        }
+    end
+}
@@ -0,0 +1,11 @@
+---Declare a characteristic derived from other characteristics of the accessory.
+---
+---When an event is raised for any of them, the event of the derived characteristic
+---is raised once at the end of the tick.
+---@param c HapCharacteristic Characteristic.
+---@param ... integer Instance IDs of the characteristics it is derived from.
+---@return HapCharacteristic characteristic
+return function (c, ...)
+    c.derivedFrom = { ... }
+    return c
+end
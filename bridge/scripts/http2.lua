@@ -0,0 +1,702 @@
+local socket = require "socket"
+local ssl = require "ssl"
+local dns = require "dns"
+local mq = require "mq"
+local time = require "time"
+local hpack = require "http2.hpack"
+local compress = require "compress"
+local pack = string.pack
+local unpack = string.unpack
+local concat = table.concat
+local traceback = debug.traceback
+local tostring = tostring
+local assert = assert
+local error = error
+
+---
+--- HTTP/2 client (RFC 7540).
+---
+--- One connection is kept per host, and the requests issued by different
+--- coroutines are multiplexed over it as concurrent streams. A request
+--- blocks the calling coroutine until its response is complete.
+---
+--- The connection is negotiated by ALPN over TLS, or by prior knowledge over
+--- plain TCP. Server push is disabled.
+---
+--- If the request asks for a gzip or deflate encoded response with
+--- ``accept-encoding``, the body is decoded as the DATA frames arrive and
+--- ``content-encoding`` is removed from the response headers.
+---
+
+local http2 = {}
+local logger = log.getLogger("http2")
+
+local PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+
+---Frame types.
+local FRAME_DATA = 0x0
+local FRAME_HEADERS = 0x1
+local FRAME_RST_STREAM = 0x3
+local FRAME_SETTINGS = 0x4
+local FRAME_PUSH_PROMISE = 0x5
+local FRAME_PING = 0x6
+local FRAME_GOAWAY = 0x7
+local FRAME_WINDOW_UPDATE = 0x8
+local FRAME_CONTINUATION = 0x9
+
+---Frame flags.
+local FLAG_END_STREAM = 0x1
+local FLAG_ACK = 0x1
+local FLAG_END_HEADERS = 0x4
+local FLAG_PADDED = 0x8
+local FLAG_PRIORITY = 0x20
+
+---Settings.
+local SETTINGS_HEADER_TABLE_SIZE = 0x1
+local SETTINGS_ENABLE_PUSH = 0x2
+local SETTINGS_MAX_CONCURRENT_STREAMS = 0x3
+local SETTINGS_INITIAL_WINDOW_SIZE = 0x4
+local SETTINGS_MAX_FRAME_SIZE = 0x5
+
+---Error codes.
+local ERR_NO_ERROR = 0x0
+local ERR_PROTOCOL_ERROR = 0x1
+local ERR_CANCEL = 0x8
+
+local DEFAULT_WINDOW_SIZE = 65535
+local DEFAULT_MAX_FRAME_SIZE = 16384
+
+---Send a WINDOW_UPDATE when this number of received bytes are consumed.
+local WINDOW_UPDATE_THRESHOLD = DEFAULT_WINDOW_SIZE // 2
+
+---Content codings that can be decoded, and their compressed data format.
+local contentCodings = {
+    gzip = "gzip",
+    ["x-gzip"] = "gzip",
+    deflate = "zlib",
+}
+
+---Headers not allowed in HTTP/2, or replaced by pseudo-headers.
+local ignoredHeaders = {
+    connection = true,
+    ["keep-alive"] = true,
+    ["proxy-connection"] = true,
+    ["transfer-encoding"] = true,
+    upgrade = true,
+    host = true,
+}
+
+---@type table<string, Http2Connection> Connections by "host:port:tls".
+local connections = {}
+
+---Wait until ``o`` is notified, the caller must check its condition again.
+---@param o Http2Connection|Http2Stream
+local function wait(o)
+    o.waiting = true
+    o.mq:recv()
+end
+
+---Wake up the coroutines waiting on ``o``.
+---@param o Http2Connection|Http2Stream
+local function notify(o)
+    if o.waiting then
+        o.waiting = false
+        o.mq:send(true)
+    end
+end
+
+---Pack a frame.
+---@param type integer
+---@param flags integer
+---@param sid integer
+---@param payload string
+---@return string
+local function packFrame(type, flags, sid, payload)
+    return pack(">I3BBI4", #payload, type, flags, sid) .. payload
+end
+
+---Remove the padding of a DATA or HEADERS frame.
+---@param flags integer
+---@param payload string
+---@return string
+local function unpad(flags, payload)
+    if flags & FLAG_PADDED == 0 then
+        return payload
+    end
+    local padlen = payload:byte(1)
+    if padlen >= #payload then
+        error("http2: invalid padding")
+    end
+    return payload:sub(2, #payload - padlen)
+end
+
+---@class Http2Stream:table HTTP/2 stream.
+---
+---@field id integer Stream ID.
+---@field mq MessageQueue
+---@field waiting boolean
+---@field sendWindow integer Flow control window for sending.
+---@field recvConsumed integer Received bytes not acknowledged by WINDOW_UPDATE.
+---@field status? integer Response status code.
+---@field headers? table<string, string> Response headers.
+---@field body string[] Response body chunks.
+---@field acceptEncoding boolean Decode the encoded response body.
+---@field inflater? CompressStream Decoder of the response body.
+---@field done boolean The response is complete.
+---@field err? string Error.
+
+---@class Http2Connection:Http2ConnectionPriv HTTP/2 connection.
+local _conn = {}
+
+---Write raw data to the connection.
+---@param data string
+function _conn:write(data)
+    local ctx = self.ctx
+    if ctx then
+        data = ctx:encrypt(data)
+    end
+    self.sock:sendall(data)
+end
+
+---Read data to the buffer until there are at least ``n`` bytes.
+---@param n integer
+function _conn:fill(n)
+    while #self.buf - self.pos + 1 < n do
+        local data = self.sock:recv(16384)
+        if #data == 0 then
+            error("connection closed by peer", 0)
+        end
+        if self.ctx then
+            data = self.ctx:decrypt(data)
+        end
+        if data then
+            self.buf = self.buf:sub(self.pos) .. data
+            self.pos = 1
+        end
+    end
+end
+
+---Read a frame.
+---@return integer type
+---@return integer flags
+---@return integer sid
+---@return string payload
+function _conn:readFrame()
+    self:fill(9)
+    local len, type, flags, sid = unpack(">I3BBI4", self.buf, self.pos)
+    self.pos = self.pos + 9
+    if len > self.maxRecvFrameSize then
+        error("http2: frame too large")
+    end
+    self:fill(len)
+    local payload = self.buf:sub(self.pos, self.pos + len - 1)
+    self.pos = self.pos + len
+    return type, flags, sid & 0x7fffffff, payload
+end
+
+---Acknowledge the consumed bytes of the connection and the stream.
+---@param stream? Http2Stream
+---@param len integer
+function _conn:consume(stream, len)
+    local frames = {}
+    self.recvConsumed = self.recvConsumed + len
+    if self.recvConsumed >= WINDOW_UPDATE_THRESHOLD then
+        frames[#frames + 1] = packFrame(FRAME_WINDOW_UPDATE, 0, 0, pack(">I4", self.recvConsumed))
+        self.recvConsumed = 0
+    end
+    if stream and not stream.done then
+        stream.recvConsumed = stream.recvConsumed + len
+        if stream.recvConsumed >= WINDOW_UPDATE_THRESHOLD then
+            frames[#frames + 1] = packFrame(FRAME_WINDOW_UPDATE, 0, stream.id, pack(">I4", stream.recvConsumed))
+            stream.recvConsumed = 0
+        end
+    end
+    if #frames > 0 then
+        self:write(concat(frames))
+    end
+end
+
+---Handle a complete header block.
+---@param sid integer
+---@param block string
+---@param endStream boolean
+function _conn:handleHeaderBlock(sid, block, endStream)
+    -- Always decode to keep the dynamic table in sync.
+    local headers = self.decoder:decode(block)
+    local stream = self.streams[sid]
+    if stream == nil then
+        return
+    end
+    local status = tonumber(headers[":status"])
+    if stream.headers == nil then
+        if status == nil then
+            error("http2: no status in response")
+        end
+        if status >= 200 then
+            headers[":status"] = nil
+            stream.status = status
+            stream.headers = headers
+            local format = contentCodings[(headers["content-encoding"] or ""):lower()]
+            if stream.acceptEncoding and format then
+                stream.inflater = compress.inflater(format)
+                headers["content-encoding"] = nil
+                headers["content-length"] = nil
+            end
+        end
+    else
+        -- Trailers.
+        for k, v in pairs(headers) do
+            stream.headers[k] = v
+        end
+    end
+    if endStream then
+        stream.done = true
+    end
+    notify(stream)
+end
+
+---Handle a SETTINGS frame.
+---@param flags integer
+---@param payload string
+function _conn:handleSettings(flags, payload)
+    if flags & FLAG_ACK ~= 0 then
+        return
+    end
+    if #payload % 6 ~= 0 then
+        error("http2: invalid SETTINGS frame")
+    end
+    local settings = self.settings
+    for pos = 1, #payload, 6 do
+        local id, value = unpack(">I2I4", payload, pos)
+        if id == SETTINGS_INITIAL_WINDOW_SIZE then
+            local delta = value - settings.initialWindowSize
+            for _, stream in pairs(self.streams) do
+                stream.sendWindow = stream.sendWindow + delta
+            end
+            settings.initialWindowSize = value
+        elseif id == SETTINGS_MAX_CONCURRENT_STREAMS then
+            settings.maxConcurrentStreams = value
+        elseif id == SETTINGS_MAX_FRAME_SIZE then
+            settings.maxFrameSize = value
+        end
+    end
+    self:write(packFrame(FRAME_SETTINGS, FLAG_ACK, 0, ""))
+    for _, stream in pairs(self.streams) do
+        notify(stream)
+    end
+    notify(self)
+end
+
+---Handle a frame.
+---@param type integer
+---@param flags integer
+---@param sid integer
+---@param payload string
+function _conn:handleFrame(type, flags, sid, payload)
+    local block = self.headerBlock
+    if block and (type ~= FRAME_CONTINUATION or sid ~= block.sid) then
+        error("http2: expected CONTINUATION")
+    end
+
+    if type == FRAME_DATA then
+        local stream = self.streams[sid]
+        local len = #payload
+        if stream and not stream.err then
+            local data = unpad(flags, payload)
+            local inflater = stream.inflater
+            if inflater then
+                local success, result = pcall(inflater.update, inflater, data)
+                if success == false or (flags & FLAG_END_STREAM ~= 0 and not inflater:finished()) then
+                    stream.err = "http2: failed to decode the response body"
+                    self:write(packFrame(FRAME_RST_STREAM, 0, sid, pack(">I4", ERR_CANCEL)))
+                    notify(stream)
+                else
+                    data = result
+                end
+            end
+            stream.body[#stream.body + 1] = data
+            if flags & FLAG_END_STREAM ~= 0 then
+                stream.done = true
+                notify(stream)
+            end
+        end
+        if len > 0 then
+            self:consume(stream, len)
+        end
+    elseif type == FRAME_HEADERS then
+        local fragment = unpad(flags, payload)
+        if flags & FLAG_PRIORITY ~= 0 then
+            fragment = fragment:sub(6)
+        end
+        local endStream = flags & FLAG_END_STREAM ~= 0
+        if flags & FLAG_END_HEADERS ~= 0 then
+            self:handleHeaderBlock(sid, fragment, endStream)
+        else
+            self.headerBlock = { sid = sid, fragments = { fragment }, endStream = endStream }
+        end
+    elseif type == FRAME_CONTINUATION then
+        if block == nil then
+            error("http2: unexpected CONTINUATION")
+        end
+        block.fragments[#block.fragments + 1] = payload
+        if flags & FLAG_END_HEADERS ~= 0 then
+            self.headerBlock = nil
+            self:handleHeaderBlock(sid, concat(block.fragments), block.endStream)
+        end
+    elseif type == FRAME_RST_STREAM then
+        local stream = self.streams[sid]
+        if stream then
+            stream.err = "stream reset by peer, error code " .. unpack(">I4", payload)
+            notify(stream)
+        end
+    elseif type == FRAME_SETTINGS then
+        self:handleSettings(flags, payload)
+    elseif type == FRAME_PING then
+        if flags & FLAG_ACK == 0 then
+            self:write(packFrame(FRAME_PING, FLAG_ACK, 0, payload))
+        end
+    elseif type == FRAME_GOAWAY then
+        local lastSid, code = unpack(">I4I4", payload)
+        lastSid = lastSid & 0x7fffffff
+        logger:debug(("GOAWAY from %s, last stream %d, error code %d"):format(self.key, lastSid, code))
+        self:retire()
+        for id, stream in pairs(self.streams) do
+            if id > lastSid then
+                stream.err = "connection is going away"
+                notify(stream)
+            end
+        end
+        if self.active == 0 then
+            self:close()
+        end
+    elseif type == FRAME_WINDOW_UPDATE then
+        local inc = unpack(">I4", payload) & 0x7fffffff
+        if sid == 0 then
+            self.sendWindow = self.sendWindow + inc
+            for _, stream in pairs(self.streams) do
+                notify(stream)
+            end
+        else
+            local stream = self.streams[sid]
+            if stream then
+                stream.sendWindow = stream.sendWindow + inc
+                notify(stream)
+            end
+        end
+    elseif type == FRAME_PUSH_PROMISE then
+        error("http2: unexpected PUSH_PROMISE")
+    end
+    -- Ignore PRIORITY and unknown frames.
+end
+
+---Stop accepting new requests, the connection is closed when the last stream ends.
+function _conn:retire()
+    if self.retired then
+        return
+    end
+    self.retired = true
+    if connections[self.key] == self then
+        connections[self.key] = nil
+    end
+    notify(self)
+end
+
+---Abort the connection and fail all streams.
+---@param err string
+function _conn:abort(err)
+    if self.closed then
+        return
+    end
+    self:retire()
+    self.closed = true
+    self.err = err
+    self.sock:destroy()
+    for _, stream in pairs(self.streams) do
+        stream.err = err
+        notify(stream)
+    end
+    notify(self)
+end
+
+---Receive and handle the frames until the connection is closed.
+---@param self Http2Connection
+local function readLoop(self)
+    local success, err = xpcall(function ()
+        while true do
+            self:handleFrame(self:readFrame())
+        end
+    end, traceback)
+    if not self.closed then
+        logger:debug(("Connection to %s closed: %s"):format(self.key, err))
+        pcall(self.write, self, packFrame(FRAME_GOAWAY, 0, 0, pack(">I4I4", 0, ERR_PROTOCOL_ERROR)))
+        self:abort("connection closed: " .. tostring(err))
+    end
+end
+
+---Send the body in DATA frames within the flow control windows.
+---@param stream Http2Stream
+---@param body string
+function _conn:sendBody(stream, body)
+    local pos, len = 1, #body
+    while pos <= len do
+        local n = math.min(self.sendWindow, stream.sendWindow, self.settings.maxFrameSize, len - pos + 1)
+        if stream.err then
+            error(stream.err)
+        end
+        if n <= 0 then
+            wait(stream)
+        else
+            local last = pos + n > len
+            self.sendWindow = self.sendWindow - n
+            stream.sendWindow = stream.sendWindow - n
+            self:write(packFrame(FRAME_DATA, last and FLAG_END_STREAM or 0, stream.id, body:sub(pos, pos + n - 1)))
+            pos = pos + n
+        end
+    end
+end
+
+---Start a request and wait for the response.
+---@param method HTTPMethod The request method.
+---@param path string The request path.
+---@param headers? table<string, string> The request headers.
+---@param content? string The request content.
+---@param timeout? integer Timeout period (in milliseconds), default 10000.
+---@return integer statuscode The response status code.
+---@return table<string, string> headers The response headers, names are lower case.
+---@return string content The response content.
+function _conn:request(method, path, headers, content, timeout)
+    assert(type(method) == "string")
+    assert(type(path) == "string")
+
+    while not self.retired and self.active >= self.settings.maxConcurrentStreams do
+        wait(self)
+    end
+    if self.retired then
+        error(self.err or "connection is closed")
+    end
+
+    ---@type Http2Stream
+    local stream = {
+        id = self.nextSid,
+        mq = mq.create(1),
+        waiting = false,
+        sendWindow = self.settings.initialWindowSize,
+        recvConsumed = 0,
+        body = {},
+        acceptEncoding = false,
+        done = false,
+    }
+    self.nextSid = self.nextSid + 2
+    self.streams[stream.id] = stream
+    self.active = self.active + 1
+
+    local timer = time.createTimer(function ()
+        if not stream.done and not stream.err then
+            stream.err = "request timed out"
+            pcall(self.write, self, packFrame(FRAME_RST_STREAM, 0, stream.id, pack(">I4", ERR_CANCEL)))
+            notify(stream)
+        end
+    end)
+    timer:start(timeout or 10000)
+
+    local success, err = xpcall(function ()
+        local fields = {
+            { ":method", method },
+            { ":scheme", self.ctx and "https" or "http" },
+            { ":authority", self.host },
+            { ":path", path },
+        }
+        for k, v in pairs(headers or {}) do
+            k = k:lower()
+            if not ignoredHeaders[k] then
+                v = tostring(v)
+                fields[#fields + 1] = { k, v }
+                if k == "accept-encoding" then
+                    for coding in v:lower():gmatch("[^%s,;]+") do
+                        if contentCodings[coding] then
+                            stream.acceptEncoding = true
+                        end
+                    end
+                end
+            end
+        end
+        if content and content ~= "" then
+            fields[#fields + 1] = { "content-length", tostring(#content) }
+        else
+            content = nil
+        end
+
+        -- The header block must not be interleaved with other frames,
+        -- so HEADERS and CONTINUATION frames are written at once.
+        local block = hpack.encode(fields)
+        local maxFrameSize = self.settings.maxFrameSize
+        local frames = {}
+        local pos = 1
+        repeat
+            local fragment = block:sub(pos, pos + maxFrameSize - 1)
+            pos = pos + maxFrameSize
+            local flags = pos > #block and FLAG_END_HEADERS or 0
+            if #frames == 0 then
+                frames[1] = packFrame(FRAME_HEADERS, flags | (content and 0 or FLAG_END_STREAM), stream.id, fragment)
+            else
+                frames[#frames + 1] = packFrame(FRAME_CONTINUATION, flags, stream.id, fragment)
+            end
+        until pos > #block
+        self:write(concat(frames))
+
+        if content then
+            self:sendBody(stream, content)
+        end
+
+        while not stream.done and not stream.err do
+            wait(stream)
+        end
+        if stream.err then
+            error(stream.err, 0)
+        end
+    end, traceback)
+
+    timer:stop()
+    self.streams[stream.id] = nil
+    self.active = self.active - 1
+    notify(self)
+    if self.retired and self.active == 0 and not self.closed then
+        self:close()
+    end
+
+    if success == false then
+        error(err, 0)
+    end
+    return stream.status, stream.headers, concat(stream.body)
+end
+
+---Close the connection.
+function _conn:close()
+    if self.closed then
+        return
+    end
+    pcall(self.write, self, packFrame(FRAME_GOAWAY, 0, 0, pack(">I4I4", 0, ERR_NO_ERROR)))
+    self:abort("connection is closed")
+end
+
+---Create a connection and perform the handshake.
+---@param o Http2Connection
+---@param port integer
+---@param tls boolean
+---@param timeout integer
+local function handshake(o, port, tls, timeout)
+    local addr = dns.resolve(o.host)
+    local sock = socket.create("TCP", addr:find(":", 1, true) and "IPV6" or "IPV4")
+    o.sock = sock
+    sock:settimeout(timeout)
+    sock:connect(addr, port)
+
+    if tls then
+        local ctx = ssl.create("client", o.host, { "h2" })
+        local out = ctx:handshake()
+        while true do
+            if out then
+                sock:sendall(out)
+            end
+            if ctx:finshed() then
+                break
+            end
+            local data = sock:recv(4096)
+            if #data == 0 then
+                error("connection closed during handshake")
+            end
+            out = ctx:handshake(data)
+        end
+        if ctx:alpn() ~= "h2" then
+            error("server does not support HTTP/2")
+        end
+        o.ctx = ctx
+    end
+
+    -- The reader waits for frames without a timeout.
+    sock:settimeout(0)
+    o:write(PREFACE .. packFrame(FRAME_SETTINGS, 0, 0, pack(">I2I4I2I4",
+        SETTINGS_ENABLE_PUSH, 0,
+        SETTINGS_HEADER_TABLE_SIZE, 4096
+    )))
+end
+
+---Connect to a HTTP/2 server, the connection to the same host is shared.
+---@param host string Server host name or IP address.
+---@param port? integer Server port, default 443 with TLS or 80 without TLS.
+---@param tls? boolean Whether to enable TLS, default true. Without TLS, the server must support HTTP/2 with prior knowledge.
+---@param timeout? integer Timeout period of connecting (in milliseconds), default 5000.
+---@return Http2Connection connection
+---@nodiscard
+function http2.connect(host, port, tls, timeout)
+    assert(type(host) == "string")
+    if tls == nil then
+        tls = true
+    end
+    port = port or (tls and 443 or 80)
+    local key = ("%s:%d:%s"):format(host, port, tls and "tls" or "tcp")
+
+    local conn = connections[key]
+    if conn then
+        while not conn.ready and not conn.closed do
+            wait(conn)
+        end
+        if conn.ready and not conn.retired then
+            return conn
+        end
+    end
+
+    ---@class Http2ConnectionPriv
+    local o = {
+        key = key,
+        host = host,
+        sock = nil, ---@type Socket
+        ctx = nil, ---@type SSLCtx
+        buf = "",
+        pos = 1,
+        mq = mq.create(1),
+        waiting = false,
+        ready = false,
+        retired = false,
+        closed = false,
+        err = nil, ---@type string
+        streams = {}, ---@type table<integer, Http2Stream>
+        active = 0,
+        nextSid = 1,
+        decoder = hpack.decoder(),
+        headerBlock = nil,
+        sendWindow = DEFAULT_WINDOW_SIZE,
+        recvConsumed = 0,
+        maxRecvFrameSize = DEFAULT_MAX_FRAME_SIZE,
+        settings = {
+            initialWindowSize = DEFAULT_WINDOW_SIZE,
+            maxConcurrentStreams = 100,
+            maxFrameSize = DEFAULT_MAX_FRAME_SIZE,
+        },
+    }
+    setmetatable(o, {
+        __index = _conn
+    })
+    connections[key] = o
+
+    local success, err = xpcall(handshake, traceback, o, port, tls, timeout or 5000)
+    if success == false then
+        if o.sock then
+            o.sock:destroy()
+        end
+        o.closed = true
+        o.retired = true
+        if connections[key] == o then
+            connections[key] = nil
+        end
+        notify(o)
+        error(err, 0)
+    end
+
+    o.ready = true
+    time.createTimer(readLoop, o):start(0)
+    notify(o)
+    return o
+end
+
+return http2
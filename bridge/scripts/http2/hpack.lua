@@ -0,0 +1,411 @@
+local byte = string.byte
+local char = string.char
+local concat = table.concat
+local insert = table.insert
+local remove = table.remove
+local error = error
+
+---
+--- HPACK: Header Compression for HTTP/2 (RFC 7541).
+---
+--- The decoder supports the whole specification. The encoder never adds
+--- entries to the dynamic table and never uses the Huffman coding, so the
+--- header blocks can be encoded in any order by concurrent streams.
+---
+
+local hpack = {}
+
+---Static table.
+local staticTable = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+}
+
+---Index of the static table by "name\0value" and by name.
+local staticIndex = {}
+for i = #staticTable, 1, -1 do
+    local e = staticTable[i]
+    staticIndex[e[1] .. "\0" .. e[2]] = i
+    staticIndex[e[1]] = i
+end
+
+---Huffman code and its length of the symbols 0-256, 256 is EOS.
+local huffmanCodes = {
+    0x1ff8, 13, 0x7fffd8, 23, 0xfffffe2, 28, 0xfffffe3, 28,
+    0xfffffe4, 28, 0xfffffe5, 28, 0xfffffe6, 28, 0xfffffe7, 28,
+    0xfffffe8, 28, 0xffffea, 24, 0x3ffffffc, 30, 0xfffffe9, 28,
+    0xfffffea, 28, 0x3ffffffd, 30, 0xfffffeb, 28, 0xfffffec, 28,
+    0xfffffed, 28, 0xfffffee, 28, 0xfffffef, 28, 0xffffff0, 28,
+    0xffffff1, 28, 0xffffff2, 28, 0x3ffffffe, 30, 0xffffff3, 28,
+    0xffffff4, 28, 0xffffff5, 28, 0xffffff6, 28, 0xffffff7, 28,
+    0xffffff8, 28, 0xffffff9, 28, 0xffffffa, 28, 0xffffffb, 28,
+    0x14, 6, 0x3f8, 10, 0x3f9, 10, 0xffa, 12,
+    0x1ff9, 13, 0x15, 6, 0xf8, 8, 0x7fa, 11,
+    0x3fa, 10, 0x3fb, 10, 0xf9, 8, 0x7fb, 11,
+    0xfa, 8, 0x16, 6, 0x17, 6, 0x18, 6,
+    0x0, 5, 0x1, 5, 0x2, 5, 0x19, 6,
+    0x1a, 6, 0x1b, 6, 0x1c, 6, 0x1d, 6,
+    0x1e, 6, 0x1f, 6, 0x5c, 7, 0xfb, 8,
+    0x7ffc, 15, 0x20, 6, 0xffb, 12, 0x3fc, 10,
+    0x1ffa, 13, 0x21, 6, 0x5d, 7, 0x5e, 7,
+    0x5f, 7, 0x60, 7, 0x61, 7, 0x62, 7,
+    0x63, 7, 0x64, 7, 0x65, 7, 0x66, 7,
+    0x67, 7, 0x68, 7, 0x69, 7, 0x6a, 7,
+    0x6b, 7, 0x6c, 7, 0x6d, 7, 0x6e, 7,
+    0x6f, 7, 0x70, 7, 0x71, 7, 0x72, 7,
+    0xfc, 8, 0x73, 7, 0xfd, 8, 0x1ffb, 13,
+    0x7fff0, 19, 0x1ffc, 13, 0x3ffc, 14, 0x22, 6,
+    0x7ffd, 15, 0x3, 5, 0x23, 6, 0x4, 5,
+    0x24, 6, 0x5, 5, 0x25, 6, 0x26, 6,
+    0x27, 6, 0x6, 5, 0x74, 7, 0x75, 7,
+    0x28, 6, 0x29, 6, 0x2a, 6, 0x7, 5,
+    0x2b, 6, 0x76, 7, 0x2c, 6, 0x8, 5,
+    0x9, 5, 0x2d, 6, 0x77, 7, 0x78, 7,
+    0x79, 7, 0x7a, 7, 0x7b, 7, 0x7ffe, 15,
+    0x7fc, 11, 0x3ffd, 14, 0x1ffd, 13, 0xffffffc, 28,
+    0xfffe6, 20, 0x3fffd2, 22, 0xfffe7, 20, 0xfffe8, 20,
+    0x3fffd3, 22, 0x3fffd4, 22, 0x3fffd5, 22, 0x7fffd9, 23,
+    0x3fffd6, 22, 0x7fffda, 23, 0x7fffdb, 23, 0x7fffdc, 23,
+    0x7fffdd, 23, 0x7fffde, 23, 0xffffeb, 24, 0x7fffdf, 23,
+    0xffffec, 24, 0xffffed, 24, 0x3fffd7, 22, 0x7fffe0, 23,
+    0xffffee, 24, 0x7fffe1, 23, 0x7fffe2, 23, 0x7fffe3, 23,
+    0x7fffe4, 23, 0x1fffdc, 21, 0x3fffd8, 22, 0x7fffe5, 23,
+    0x3fffd9, 22, 0x7fffe6, 23, 0x7fffe7, 23, 0xffffef, 24,
+    0x3fffda, 22, 0x1fffdd, 21, 0xfffe9, 20, 0x3fffdb, 22,
+    0x3fffdc, 22, 0x7fffe8, 23, 0x7fffe9, 23, 0x1fffde, 21,
+    0x7fffea, 23, 0x3fffdd, 22, 0x3fffde, 22, 0xfffff0, 24,
+    0x1fffdf, 21, 0x3fffdf, 22, 0x7fffeb, 23, 0x7fffec, 23,
+    0x1fffe0, 21, 0x1fffe1, 21, 0x3fffe0, 22, 0x1fffe2, 21,
+    0x7fffed, 23, 0x3fffe1, 22, 0x7fffee, 23, 0x7fffef, 23,
+    0xfffea, 20, 0x3fffe2, 22, 0x3fffe3, 22, 0x3fffe4, 22,
+    0x7ffff0, 23, 0x3fffe5, 22, 0x3fffe6, 22, 0x7ffff1, 23,
+    0x3ffffe0, 26, 0x3ffffe1, 26, 0xfffeb, 20, 0x7fff1, 19,
+    0x3fffe7, 22, 0x7ffff2, 23, 0x3fffe8, 22, 0x1ffffec, 25,
+    0x3ffffe2, 26, 0x3ffffe3, 26, 0x3ffffe4, 26, 0x7ffffde, 27,
+    0x7ffffdf, 27, 0x3ffffe5, 26, 0xfffff1, 24, 0x1ffffed, 25,
+    0x7fff2, 19, 0x1fffe3, 21, 0x3ffffe6, 26, 0x7ffffe0, 27,
+    0x7ffffe1, 27, 0x3ffffe7, 26, 0x7ffffe2, 27, 0xfffff2, 24,
+    0x1fffe4, 21, 0x1fffe5, 21, 0x3ffffe8, 26, 0x3ffffe9, 26,
+    0xffffffd, 28, 0x7ffffe3, 27, 0x7ffffe4, 27, 0x7ffffe5, 27,
+    0xfffec, 20, 0xfffff3, 24, 0xfffed, 20, 0x1fffe6, 21,
+    0x3fffe9, 22, 0x1fffe7, 21, 0x1fffe8, 21, 0x7ffff3, 23,
+    0x3fffea, 22, 0x3fffeb, 22, 0x1ffffee, 25, 0x1ffffef, 25,
+    0xfffff4, 24, 0xfffff5, 24, 0x3ffffea, 26, 0x7ffff4, 23,
+    0x3ffffeb, 26, 0x7ffffe6, 27, 0x3ffffec, 26, 0x3ffffed, 26,
+    0x7ffffe7, 27, 0x7ffffe8, 27, 0x7ffffe9, 27, 0x7ffffea, 27,
+    0x7ffffeb, 27, 0xffffffe, 28, 0x7ffffec, 27, 0x7ffffed, 27,
+    0x7ffffee, 27, 0x7ffffef, 27, 0x7fffff0, 27, 0x3ffffee, 26,
+    0x3fffffff, 30,
+}
+
+---Huffman decoding map, ``[len][code] = symbol``.
+local huffmanMap = {}
+for sym = 0, 256 do
+    local code, len = huffmanCodes[sym * 2 + 1], huffmanCodes[sym * 2 + 2]
+    local map = huffmanMap[len]
+    if map == nil then
+        map = {}
+        huffmanMap[len] = map
+    end
+    map[code] = sym
+end
+
+---Decode a Huffman encoded string.
+---@param s string
+---@return string
+local function huffmanDecode(s)
+    local out = {}
+    local code, len = 0, 0
+    for i = 1, #s do
+        local b = byte(s, i)
+        for shift = 7, 0, -1 do
+            code = (code << 1) | ((b >> shift) & 1)
+            len = len + 1
+            local map = huffmanMap[len]
+            local sym = map and map[code]
+            if sym then
+                if sym == 256 then
+                    error("hpack: EOS in string literal")
+                end
+                out[#out + 1] = char(sym)
+                code, len = 0, 0
+            elseif len > 30 then
+                error("hpack: invalid huffman code")
+            end
+        end
+    end
+    -- The padding is the most significant bits of EOS.
+    if len > 7 or code ~= (1 << len) - 1 then
+        error("hpack: invalid huffman padding")
+    end
+    return concat(out)
+end
+
+---Decode an integer with a ``n`` bit prefix.
+---@param s string
+---@param pos integer
+---@param n integer
+---@return integer value
+---@return integer pos Position after the integer.
+local function decodeInt(s, pos, n)
+    local max = (1 << n) - 1
+    local v = byte(s, pos) & max
+    pos = pos + 1
+    if v < max then
+        return v, pos
+    end
+    local m = 0
+    repeat
+        local b = byte(s, pos)
+        if b == nil or m > 28 then
+            error("hpack: invalid integer")
+        end
+        pos = pos + 1
+        v = v + ((b & 0x7f) << m)
+        m = m + 7
+    until b & 0x80 == 0
+    return v, pos
+end
+
+---Encode an integer with a ``n`` bit prefix.
+---@param v integer
+---@param n integer
+---@param flags integer Bits before the prefix.
+---@return string
+local function encodeInt(v, n, flags)
+    local max = (1 << n) - 1
+    if v < max then
+        return char(flags | v)
+    end
+    local out = { char(flags | max) }
+    v = v - max
+    while v >= 0x80 do
+        out[#out + 1] = char((v & 0x7f) | 0x80)
+        v = v >> 7
+    end
+    out[#out + 1] = char(v)
+    return concat(out)
+end
+
+---Decode a string literal.
+---@param s string
+---@param pos integer
+---@return string
+---@return integer pos Position after the string.
+local function decodeStr(s, pos)
+    local huffman = byte(s, pos) & 0x80 ~= 0
+    local len
+    len, pos = decodeInt(s, pos, 7)
+    local e = pos + len - 1
+    if e > #s then
+        error("hpack: truncated string")
+    end
+    local str = s:sub(pos, e)
+    if huffman then
+        str = huffmanDecode(str)
+    end
+    return str, e + 1
+end
+
+---Encode a string literal without the Huffman coding.
+---@param s string
+---@return string
+local function encodeStr(s)
+    return encodeInt(#s, 7, 0) .. s
+end
+
+---@class HpackDecoder:HpackDecoderPriv HPACK decoder.
+local decoder = {}
+
+---Get the entry at ``index`` in the static and dynamic tables.
+---@param index integer
+---@return string name
+---@return string value
+function decoder:get(index)
+    local e = staticTable[index]
+    if e == nil then
+        e = self.entries[index - #staticTable]
+        if e == nil then
+            error("hpack: invalid index " .. index)
+        end
+    end
+    return e[1], e[2]
+end
+
+---Evict the oldest entries until the table size is at most ``max``.
+---@param max integer
+function decoder:evict(max)
+    local entries = self.entries
+    while self.size > max do
+        local e = remove(entries)
+        self.size = self.size - #e[1] - #e[2] - 32
+    end
+end
+
+---Add an entry to the dynamic table.
+---@param name string
+---@param value string
+function decoder:add(name, value)
+    local size = #name + #value + 32
+    self:evict(self.maxSize - size)
+    if size <= self.maxSize then
+        insert(self.entries, 1, { name, value })
+        self.size = self.size + size
+    end
+end
+
+---Decode a header block.
+---@param block string
+---@return table<string, string> headers Header names are lower case, values of repeated headers are joined by ", ".
+function decoder:decode(block)
+    local headers = {}
+    local pos, len = 1, #block
+    local name, value
+    while pos <= len do
+        local b = byte(block, pos)
+        if b & 0x80 ~= 0 then
+            -- Indexed header field.
+            local index
+            index, pos = decodeInt(block, pos, 7)
+            name, value = self:get(index)
+        elseif b & 0xe0 == 0x20 then
+            -- Dynamic table size update.
+            local size
+            size, pos = decodeInt(block, pos, 5)
+            if size > self.maxSizeLimit then
+                error("hpack: invalid table size " .. size)
+            end
+            self.maxSize = size
+            self:evict(size)
+            name = nil
+        else
+            -- Literal header field, with incremental indexing (01), without indexing (0000)
+            -- or never indexed (0001).
+            local indexing = b & 0xc0 == 0x40
+            local index
+            index, pos = decodeInt(block, pos, indexing and 6 or 4)
+            if index == 0 then
+                name, pos = decodeStr(block, pos)
+            else
+                name = self:get(index)
+            end
+            value, pos = decodeStr(block, pos)
+            if indexing then
+                self:add(name, value)
+            end
+        end
+        if name then
+            local prev = headers[name]
+            headers[name] = prev and (prev .. ", " .. value) or value
+        end
+    end
+    return headers
+end
+
+---Create a decoder.
+---@param maxSize? integer Maximum size of the dynamic table, default 4096.
+---@return HpackDecoder decoder
+---@nodiscard
+function hpack.decoder(maxSize)
+    maxSize = maxSize or 4096
+    ---@class HpackDecoderPriv
+    local o = {
+        entries = {},   ---@type string[][]
+        size = 0,
+        maxSize = maxSize,
+        maxSizeLimit = maxSize,
+    }
+    return setmetatable(o, { __index = decoder })
+end
+
+---Encode a header field.
+---@param name string Lower case header name.
+---@param value string
+---@return string
+local function encodeField(name, value)
+    local index = staticIndex[name .. "\0" .. value]
+    if index then
+        return encodeInt(index, 7, 0x80)
+    end
+    -- Literal header field without indexing.
+    index = staticIndex[name]
+    if index then
+        return encodeInt(index, 4, 0) .. encodeStr(value)
+    end
+    return "\0" .. encodeStr(name) .. encodeStr(value)
+end
+
+---Encode a header block.
+---@param fields string[][] Header fields ``{ name, value }`` in order, pseudo-headers first.
+---@return string block
+---@nodiscard
+function hpack.encode(fields)
+    local out = {}
+    for i, field in ipairs(fields) do
+        out[i] = encodeField(field[1], field[2])
+    end
+    return concat(out)
+end
+
+hpack.huffmanDecode = huffmanDecode
+
+return hpack
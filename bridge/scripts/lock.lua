@@ -0,0 +1,55 @@
+local mq = require "mq"
+local assert = assert
+local tremove = table.remove
+
+---
+--- FIFO lock of the coroutines.
+---
+--- A message queue resumes all its waiters at once, so it can not be used as
+--- a lock. Each waiter of the lock waits on a message queue of its own, and a
+--- release hands the lock over to exactly one waiter, in the order they came.
+---
+
+local lock = {}
+
+---@class Lock:LockPriv FIFO lock.
+local _lock = {}
+
+---Acquire the lock, wait until it is released if it is held.
+function _lock:acquire()
+    if not self.locked then
+        self.locked = true
+        return
+    end
+    local waiter = mq.create(1)
+    local waiters = self.waiters
+    waiters[#waiters + 1] = waiter
+    waiter:recv()
+end
+
+---Release the lock, the first waiter acquires it.
+function _lock:release()
+    assert(self.locked, "the lock is not held")
+    local waiter = tremove(self.waiters, 1)
+    if waiter then
+        waiter:send(true)
+    else
+        self.locked = false
+    end
+end
+
+---Create a lock.
+---@return Lock lock
+---@nodiscard
+function lock.create()
+    ---@class LockPriv
+    local o = {
+        locked = false,
+        waiters = {}, ---@type MessageQueue[]
+    }
+    return setmetatable(o, {
+        __index = _lock
+    })
+end
+
+return lock
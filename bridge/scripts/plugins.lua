@@ -1,5 +1,7 @@
 local util = require "util"
 local hap = require "hap"
+local cplugin = require "cplugin"
+local json = require "cjson"
 local traceback = debug.traceback
 
 local plugins = {}
@@ -25,6 +27,13 @@ local function loadPlugin(name, conf)
         error("Plugin is already loaded.")
     end
 
+    -- A native plugin "<name>/plugin.so" takes precedence over the lua one.
+    local path = cplugin.supported and package.searchpath(name .. ".plugin", package.cpath)
+    if path then
+        priv.plugins[name] = cplugin.load(path, json.encode(conf or {}))
+        return
+    end
+
     plugin = require(name .. ".plugin")
     if util.isEmptyTable(plugin) then
         error(("No fields in plugin '%s'."):format(name))
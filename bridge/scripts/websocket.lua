@@ -0,0 +1,430 @@
+local socket = require "socket"
+local ssl = require "ssl"
+local dns = require "dns"
+local mq = require "mq"
+local lock = require "lock"
+local time = require "time"
+local wsframe = require "wsframe"
+local pack = string.pack
+local unpack = string.unpack
+local concat = table.concat
+local traceback = debug.traceback
+local assert = assert
+local error = error
+local type = type
+
+---
+--- WebSocket client (RFC 6455).
+---
+--- Frames are parsed and masked by the native ``wsframe`` module, the
+--- connection runs over the ``socket`` and ``ssl`` modules. A reader
+--- coroutine delivers the messages to the ``onMessage`` callback, or queues
+--- them for ``recv()`` if there is no callback. Pings are sent periodically
+--- and the connection is aborted if the server stops responding.
+---
+
+local websocket = {}
+local logger = log.getLogger("websocket")
+
+---Max number of messages queued for ``recv()``, the oldest one is dropped when it is exceeded.
+local RECV_QUEUE_MAX = 64
+
+---Close status codes.
+local CLOSE_NORMAL = 1000
+local CLOSE_PROTOCOL_ERROR = 1002
+
+---@class WebSocketOptions:table WebSocket options.
+---
+---@field headers? table<string, string> Extra request headers.
+---@field protocols? string[] Subprotocols, the selected one is in ``ws.protocol``.
+---@field timeout? integer Timeout period of connecting (in milliseconds), default 5000.
+---@field pingInterval? integer Ping interval (in milliseconds), default 30000, 0 to disable.
+---@field maxMessageSize? integer Max size of a received message, default 65536.
+---@field onMessage? fun(ws: WebSocket, data: string, type: '"text"'|'"binary"') Called in the reader coroutine when a message is received, it should not block for long.
+---@field onClose? fun(ws: WebSocket, code: integer, reason: string) Called when the connection is closed.
+
+---@class WebSocket:WebSocketPriv WebSocket connection.
+local _ws = {}
+
+---Wait until ``o`` is notified, the caller must check its condition again.
+---@param o WebSocket
+local function wait(o)
+    o.waiting = true
+    o.mq:recv()
+end
+
+---Wake up the coroutines waiting on ``o``.
+---@param o WebSocket
+local function notify(o)
+    if o.waiting then
+        o.waiting = false
+        o.mq:send(true)
+    end
+end
+
+---Parse a WebSocket URL.
+---@param url string
+---@return string host
+---@return integer port
+---@return boolean tls
+---@return string path
+local function parseUrl(url)
+    local scheme, host, port, path = url:match("^(wss?)://([^/:]+):?(%d*)(.*)$")
+    if scheme == nil then
+        error("invalid websocket url: " .. url, 3)
+    end
+    local tls = scheme == "wss"
+    port = tonumber(port) or (tls and 443 or 80)
+    if path == "" then
+        path = "/"
+    end
+    return host, port, tls, path
+end
+
+---Write raw data, the writers are serialized so the TLS records and frames are never interleaved.
+---@param data string
+function _ws:write(data)
+    local lock = self.lock
+    lock:acquire()
+    local success, err = pcall(function ()
+        local ctx = self.ctx
+        if ctx then
+            data = ctx:encrypt(data)
+        end
+        self.sock:sendall(data)
+    end)
+    lock:release()
+    if success == false then
+        error(err, 0)
+    end
+end
+
+---Release the connection and notify the waiters.
+---@param code integer
+---@param reason string
+function _ws:finish(code, reason)
+    if self.closed then
+        return
+    end
+    self.closed = true
+    self.closeCode = code
+    self.closeReason = reason
+    if self.pingTimer then
+        self.pingTimer:stop()
+    end
+    if self.closeTimer then
+        self.closeTimer:stop()
+    end
+    self.sock:destroy()
+    notify(self)
+    local onClose = self.onClose
+    if onClose then
+        local success, err = xpcall(onClose, traceback, self, code, reason)
+        if success == false then
+            logger:error(err)
+        end
+    end
+end
+
+---Handle a received message.
+---@param op string
+---@param data string
+function _ws:handleMessage(op, data)
+    self.awaitingPong = false
+    if op == "text" or op == "binary" then
+        local onMessage = self.onMessage
+        if onMessage then
+            local success, err = xpcall(onMessage, traceback, self, data, op)
+            if success == false then
+                logger:error(err)
+            end
+        else
+            local queue = self.queue
+            if queue.last - queue.first + 1 >= RECV_QUEUE_MAX then
+                logger:error(("%s: receive queue is full, drop the oldest message."):format(self.url))
+                queue[queue.first] = nil
+                queue.first = queue.first + 1
+            end
+            queue.last = queue.last + 1
+            queue[queue.last] = { data, op }
+            notify(self)
+        end
+    elseif op == "ping" then
+        if not self.closing then
+            self:write(wsframe.encode("pong", data))
+        end
+    elseif op == "close" then
+        local code, reason = 1005, ""
+        if #data >= 2 then
+            code = unpack(">I2", data)
+            reason = data:sub(3)
+        end
+        if not self.closing then
+            self.closing = true
+            pcall(self.write, self, wsframe.encode("close", data:sub(1, 2)))
+        end
+        self:finish(code, reason)
+    end
+end
+
+---Read and dispatch the messages until the connection is closed.
+---@param self WebSocket
+local function readLoop(self)
+    local parser = self.parser
+    local success, err = xpcall(function ()
+        local data = self.pending
+        self.pending = nil
+        while not self.closed do
+            if data then
+                parser:feed(data)
+                while not self.closed do
+                    local op, payload = parser:next()
+                    if op == nil then
+                        break
+                    end
+                    self:handleMessage(op, payload)
+                end
+            end
+            if self.closed then
+                return
+            end
+            data = self.sock:recv(4096)
+            if #data == 0 then
+                error("connection closed by peer", 0)
+            end
+            if self.ctx then
+                data = self.ctx:decrypt(data)
+            end
+        end
+    end, traceback)
+    if success == false and not self.closed then
+        logger:error(("%s: %s"):format(self.url, err))
+        if not self.closing then
+            self.closing = true
+            pcall(self.write, self, wsframe.encode("close", pack(">I2", CLOSE_PROTOCOL_ERROR)))
+        end
+        self:finish(1006, err)
+    end
+end
+
+---Send a ping, abort the connection if nothing is received since the last ping.
+---@param self WebSocket
+local function ping(self)
+    if self.closed or self.closing then
+        return
+    end
+    if self.awaitingPong then
+        logger:error(("%s: ping timeout"):format(self.url))
+        self:finish(1006, "ping timeout")
+        return
+    end
+    self.awaitingPong = true
+    local success, err = pcall(self.write, self, wsframe.encode("ping"))
+    if success == false then
+        self:finish(1006, err)
+        return
+    end
+    self.pingTimer:start(self.pingInterval)
+end
+
+---Send a message.
+---@param data string Message data.
+---@param binary? boolean Send a binary message instead of a text message.
+function _ws:send(data, binary)
+    assert(type(data) == "string")
+    if self.closed or self.closing then
+        error("websocket is closed")
+    end
+    self:write(wsframe.encode(binary and "binary" or "text", data))
+end
+
+---Receive a message, only available without ``onMessage``.
+---@return string data Message data.
+---@return '"text"'|'"binary"' type Message type.
+function _ws:recv()
+    assert(self.onMessage == nil, "messages are delivered to onMessage")
+    local queue = self.queue
+    while queue.first > queue.last and not self.closed do
+        wait(self)
+    end
+    if queue.first > queue.last then
+        error(("websocket is closed: %d %s"):format(self.closeCode, self.closeReason))
+    end
+    local msg = queue[queue.first]
+    queue[queue.first] = nil
+    queue.first = queue.first + 1
+    return msg[1], msg[2]
+end
+
+---Close the connection.
+---@param code? integer Status code, default 1000.
+---@param reason? string Reason.
+function _ws:close(code, reason)
+    if self.closed or self.closing then
+        return
+    end
+    code = code or CLOSE_NORMAL
+    self.closing = true
+    local success = pcall(self.write, self, wsframe.encode("close", pack(">I2", code) .. (reason or "")))
+    if success == false then
+        self:finish(code, reason or "")
+        return
+    end
+    -- Wait for the close frame from the server.
+    self.closeTimer = time.createTimer(function ()
+        self:finish(code, reason or "")
+    end)
+    self.closeTimer:start(1000)
+end
+
+---Connect to the server and perform the opening handshake.
+---@param o WebSocket
+---@param opts WebSocketOptions
+local function handshake(o, host, port, tls, path, opts)
+    local addr = dns.resolve(host)
+    local sock = socket.create("TCP", addr:find(":", 1, true) and "IPV6" or "IPV4")
+    o.sock = sock
+    sock:settimeout(opts.timeout or 5000)
+    sock:connect(addr, port)
+
+    local ctx
+    if tls then
+        ctx = ssl.create("client", host)
+        local out = ctx:handshake()
+        while true do
+            if out then
+                sock:sendall(out)
+            end
+            if ctx:finshed() then
+                break
+            end
+            local data = sock:recv(4096)
+            if #data == 0 then
+                error("connection closed during handshake")
+            end
+            out = ctx:handshake(data)
+        end
+        o.ctx = ctx
+    end
+
+    local key = wsframe.key()
+    local lines = {
+        "GET " .. path .. " HTTP/1.1",
+        "Host: " .. ((port == 80 or port == 443) and host or host .. ":" .. port),
+        "Upgrade: websocket",
+        "Connection: Upgrade",
+        "Sec-WebSocket-Key: " .. key,
+        "Sec-WebSocket-Version: 13",
+    }
+    if opts.protocols then
+        lines[#lines + 1] = "Sec-WebSocket-Protocol: " .. concat(opts.protocols, ", ")
+    end
+    for k, v in pairs(opts.headers or {}) do
+        lines[#lines + 1] = k .. ": " .. v
+    end
+    lines[#lines + 1] = "\r\n"
+    o:write(concat(lines, "\r\n"))
+
+    local buf = ""
+    local last
+    while true do
+        last = buf:find("\r\n\r\n", 1, true)
+        if last then
+            break
+        end
+        if #buf > 8192 then
+            error("response header too large")
+        end
+        local data = sock:recv(4096)
+        if #data == 0 then
+            error("connection closed during handshake")
+        end
+        if ctx then
+            data = ctx:decrypt(data)
+        end
+        if data then
+            buf = buf .. data
+        end
+    end
+
+    local status = tonumber(buf:match("^HTTP/1%.1 (%d+)"))
+    if status ~= 101 then
+        error("unexpected response status " .. tostring(status))
+    end
+    local headers = {}
+    for k, v in buf:sub(1, last):gmatch("\r\n([^:\r\n]+):%s*([^\r\n]*)") do
+        headers[k:lower()] = v
+    end
+    if (headers.upgrade or ""):lower() ~= "websocket" or
+        not (headers.connection or ""):lower():find("upgrade", 1, true) then
+        error("connection is not upgraded")
+    end
+    if headers["sec-websocket-accept"] ~= wsframe.accept(key) then
+        error("invalid Sec-WebSocket-Accept")
+    end
+    o.protocol = headers["sec-websocket-protocol"]
+
+    -- Frames received along with the response.
+    if last + 3 < #buf then
+        o.pending = buf:sub(last + 4)
+    end
+
+    -- The reader waits for frames without a timeout.
+    sock:settimeout(0)
+end
+
+---Connect to a WebSocket server.
+---@param url string Server URL, ``ws://host[:port][/path]`` or ``wss://host[:port][/path]``.
+---@param opts? WebSocketOptions Options.
+---@return WebSocket ws
+---@nodiscard
+function websocket.connect(url, opts)
+    assert(type(url) == "string")
+    opts = opts or {}
+    local host, port, tls, path = parseUrl(url)
+
+    ---@class WebSocketPriv
+    local o = {
+        url = url,
+        sock = nil, ---@type Socket
+        ctx = nil, ---@type SSLCtx
+        protocol = nil, ---@type string|nil
+        parser = wsframe.parser(opts.maxMessageSize),
+        pending = nil, ---@type string|nil
+        lock = lock.create(),
+        mq = mq.create(1),
+        waiting = false,
+        queue = { first = 1, last = 0 },
+        onMessage = opts.onMessage,
+        onClose = opts.onClose,
+        pingInterval = opts.pingInterval or 30000,
+        pingTimer = nil, ---@type Timer
+        closeTimer = nil, ---@type Timer
+        awaitingPong = false,
+        closing = false,
+        closed = false,
+        closeCode = nil, ---@type integer
+        closeReason = nil, ---@type string
+    }
+    setmetatable(o, {
+        __index = _ws
+    })
+
+    local success, err = xpcall(handshake, traceback, o, host, port, tls, path, opts)
+    if success == false then
+        if o.sock then
+            o.sock:destroy()
+        end
+        error(err, 0)
+    end
+
+    time.createTimer(readLoop, o):start(0)
+    if o.pingInterval > 0 then
+        o.pingTimer = time.createTimer(ping, o)
+        o.pingTimer:setBackground(true)
+        o.pingTimer:start(o.pingInterval)
+    end
+    return o
+end
+
+return websocket
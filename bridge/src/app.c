@@ -29,6 +29,17 @@ extern const embedfs_dir BRIDGE_EMBEDFS_ROOT;
 
 static lua_State *L;
 
+static const char *app_mem_phase_strs[] = {
+    "boot",
+    "pairing",
+    "steady",
+};
+
+static struct {
+    app_mem_phase phase;
+    size_t peaks[APP_MEM_PHASE_MAX];
+} gv_app_mem;
+
 static const luaL_Reg globallibs[] = {
     {LUA_GNAME, luaopen_base},
     {LUA_LOADLIBNAME, luaopen_package},
@@ -55,6 +66,14 @@ static const luaL_Reg dynamiclibs[] = {
     {LUA_SSL_NAME, luaopen_ssl},
     {LUA_DNS_NAME, luaopen_dns},
     {LUA_NVS_NAME, luaopen_nvs},
+    {LUA_RUNLOOP_NAME, luaopen_runloop},
+    {LUA_CPLUGIN_NAME, luaopen_cplugin},
+    {LUA_WSFRAME_NAME, luaopen_wsframe},
+    {LUA_COMPRESS_NAME, luaopen_compress},
+    {LUA_AIO_NAME, luaopen_aio},
+    {LUA_SERIAL_NAME, luaopen_serial},
+    {LUA_MODBUS_NAME, luaopen_modbus},
+    {LUA_NETIF_NAME, luaopen_netif},
     {NULL, NULL}
 };
 
@@ -94,13 +113,28 @@ static int searcher_embedfs(lua_State *L) {
     gen_filename(name, filename);
     const embedfs_file *file = embedfs_find_file(&BRIDGE_EMBEDFS_ROOT, filename);
     if (file) {
-        luaL_loadbufferx(L, file->data, file->len, NULL, "const");
+        lc_load_stripped(L, file->data, file->len, "const");
     } else {
         lua_pushfstring(L, "no file '%s' in bridge embedfs", filename);
     }
     return 1;
 }
 
+// Find the line map "<name>.luam" generated together with "<name>.luac".
+static const char *app_find_linemap(const char *source, size_t *len) {
+    size_t n = HAPStringGetNumBytes(source);
+    char filename[n + sizeof("m")];
+
+    HAPRawBufferCopyBytes(filename, source, n);
+    HAPRawBufferCopyBytes(filename + n, "m", sizeof("m"));
+    const embedfs_file *file = embedfs_find_file(&BRIDGE_EMBEDFS_ROOT, filename);
+    if (!file) {
+        return NULL;
+    }
+    *len = file->len;
+    return file->data;
+}
+
 static void *app_lua_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
     (void)ud; (void)osize; /* not used */
     if (nsize == 0) {
@@ -112,6 +146,37 @@ static void *app_lua_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
 }
 
 // app_pinit(dir: lightuserdata, entry: lightuserdata)
+/* memstats() -> stats: table|nil */
+static int app_db_memstats(lua_State *L) {
+    pal_mem_stats stats;
+    if (!pal_mem_get_stats(&stats)) {
+        lua_pushnil(L);
+        return 1;
+    }
+    lua_createtable(L, 0, 6);
+    lua_pushinteger(L, stats.cap);
+    lua_setfield(L, -2, "cap");
+    lua_pushinteger(L, stats.used);
+    lua_setfield(L, -2, "used");
+    lua_pushinteger(L, stats.peak);
+    lua_setfield(L, -2, "peak");
+    lua_pushinteger(L, stats.largest_free);
+    lua_setfield(L, -2, "largestFree");
+    lua_pushinteger(L, stats.failed);
+    lua_setfield(L, -2, "failed");
+    lua_createtable(L, 0, APP_MEM_PHASE_MAX);
+    for (app_mem_phase phase = 0; phase < APP_MEM_PHASE_MAX; phase++) {
+        size_t peak = gv_app_mem.peaks[phase];
+        if (phase == gv_app_mem.phase && stats.peak > peak) {
+            peak = stats.peak;
+        }
+        lua_pushinteger(L, peak);
+        lua_setfield(L, -2, app_mem_phase_strs[phase]);
+    }
+    lua_setfield(L, -2, "phases");
+    return 1;
+}
+
 static int app_pinit(lua_State *L) {
     const char *dir = lua_touserdata(L, 1);
     const char *entry = lua_touserdata(L, 2);
@@ -124,6 +189,17 @@ static int app_pinit(lua_State *L) {
         lua_pop(L, 1);  /* remove lib */
     }
 
+    // symbolize tracebacks of the stripped bytecode in bridge embedfs
+    lc_set_linemap_finder(app_find_linemap);
+    lua_getglobal(L, LUA_DBLIBNAME);
+    lua_pushcfunction(L, lc_db_traceback);
+    lua_setfield(L, -2, "traceback");
+    lua_pushcfunction(L, lc_db_heapsnapshot);
+    lua_setfield(L, -2, "heapsnapshot");
+    lua_pushcfunction(L, app_db_memstats);
+    lua_setfield(L, -2, "memstats");
+    lua_pop(L, 1);
+
     // GC in generational mode
     lua_gc(L, LUA_GCGEN, 0, 0);
 
@@ -132,8 +208,9 @@ static int app_pinit(lua_State *L) {
     lua_pushfstring(L, "%s/?.lua;%s/?.luac", dir, dir);
     lua_setfield(L, -2, "path");
 
-    // set C path
-    lua_pushstring(L, "");
+    // set C path, only used to locate native plugins,
+    // the C searchers are removed below.
+    lua_pushfstring(L, "%s/?.so", dir);
     lua_setfield(L, -2, "cpath");
     lua_pop(L, 1);
 
@@ -175,12 +252,38 @@ static int app_pinit(lua_State *L) {
     return 0;
 }
 
+static void app_mem_record_peak(void) {
+    pal_mem_stats stats;
+    if (!pal_mem_get_stats(&stats)) {
+        return;
+    }
+    if (stats.peak > gv_app_mem.peaks[gv_app_mem.phase]) {
+        gv_app_mem.peaks[gv_app_mem.phase] = stats.peak;
+    }
+    HAPLogInfo(&kHAPLog_Default, "Memory phase %s: peak %zu, used %zu, largest free %zu, cap %zu, failed %zu",
+        app_mem_phase_strs[gv_app_mem.phase], stats.peak, stats.used, stats.largest_free, stats.cap, stats.failed);
+}
+
+void app_mem_set_phase(app_mem_phase phase) {
+    HAPPrecondition(phase < APP_MEM_PHASE_MAX);
+    if (phase == gv_app_mem.phase) {
+        return;
+    }
+    app_mem_record_peak();
+    gv_app_mem.phase = phase;
+    pal_mem_reset_peak();
+}
+
 void app_init(HAPPlatform *platform, const char *dir, const char *entry) {
     HAPPrecondition(platform);
     HAPPrecondition(dir);
     HAPPrecondition(entry);
 
+    HAPRawBufferZero(&gv_app_mem, sizeof(gv_app_mem));
+    pal_mem_reset_peak();
+
     lhap_set_platform(platform);
+    lrunloop_init();
 
     L = lua_newstate(app_lua_alloc, NULL);
     if (L == NULL) {
@@ -207,11 +310,24 @@ void app_init(HAPPlatform *platform, const char *dir, const char *entry) {
 }
 
 void app_deinit() {
+    // The peaks are only recorded on the platforms tracking the heap.
+    pal_mem_stats stats;
+    if (pal_mem_get_stats(&stats)) {
+        app_mem_record_peak();
+        for (app_mem_phase phase = 0; phase < APP_MEM_PHASE_MAX; phase++) {
+            HAPLogInfo(&kHAPLog_Default, "Memory peak of phase %s: %zu",
+                app_mem_phase_strs[phase], gv_app_mem.peaks[phase]);
+        }
+    }
+
     if (L) {
         lua_close(L);
         L = NULL;
     }
 
+    lcplugin_deinit();
+    lnetif_deinit();
+    lrunloop_deinit();
     lhap_set_platform(NULL);
 }
 
@@ -13,6 +13,7 @@ extern "C" {
 
 #include <lua.h>
 #include <HAP.h>
+#include <pal/serial.h>
 
 /**
  * Log subsystem used by the HAP Bridge implementation.
@@ -52,16 +53,136 @@ LUAMOD_API int luaopen_dns(lua_State *L);
 #define LUA_NVS_NAME "nvs"
 LUAMOD_API int luaopen_nvs(lua_State *L);
 
+#define LUA_RUNLOOP_NAME "runloop"
+LUAMOD_API int luaopen_runloop(lua_State *L);
+
+#define LUA_CPLUGIN_NAME "cplugin"
+LUAMOD_API int luaopen_cplugin(lua_State *L);
+
+#define LUA_WSFRAME_NAME "wsframe"
+LUAMOD_API int luaopen_wsframe(lua_State *L);
+
+#define LUA_COMPRESS_NAME "compress"
+LUAMOD_API int luaopen_compress(lua_State *L);
+
+#define LUA_AIO_NAME "aio"
+LUAMOD_API int luaopen_aio(lua_State *L);
+
+#define LUA_SERIAL_NAME "serial"
+LUAMOD_API int luaopen_serial(lua_State *L);
+
+#define LUA_MODBUS_NAME "modbus"
+LUAMOD_API int luaopen_modbus(lua_State *L);
+
+#define LUA_NETIF_NAME "netif"
+LUAMOD_API int luaopen_netif(lua_State *L);
+
+/**
+ * Run loop pressure level.
+ */
+typedef enum {
+    LRUNLOOP_PRESSURE_NORMAL,       /**< The run loop keeps up. */
+    LRUNLOOP_PRESSURE_MODERATE,     /**< The run loop falls behind, defer background work. */
+    LRUNLOOP_PRESSURE_CRITICAL,     /**< The run loop is saturated, skip background work. */
+} lrunloop_pressure;
+
+/**
+ * Start measuring the lag of the run loop.
+ */
+void lrunloop_init(void);
+
+/**
+ * Stop measuring the lag of the run loop.
+ */
+void lrunloop_deinit(void);
+
+/**
+ * Get the current pressure level of the run loop.
+ */
+lrunloop_pressure lrunloop_get_pressure(void);
+
+/**
+ * Check the serial port configuration table at @p idx and update @p cfg,
+ * the fields not in the table are left as they are.
+ */
+void lserial_check_cfg(lua_State *L, int idx, pal_serial_cfg *cfg);
+
+/**
+ * Unload all native plugins.
+ */
+void lcplugin_deinit(void);
+
+/**
+ * Stop watching the network interfaces.
+ */
+void lnetif_deinit(void);
+
 /**
  * Set HomeKit platform.
  */
 void lhap_set_platform(HAPPlatform *platform);
 
+/**
+ * Add a bridged accessory owned by a native plugin.
+ *
+ * The accessory is not copied and must be valid until HAP is de-initialized.
+ */
+HAPError lhap_add_native_bridged_accessory(const HAPAccessory *accessory);
+
+/**
+ * Raise an event for a characteristic, returns false if HAP is not started
+ * or the characteristic is not found.
+ */
+bool lhap_raise_native_event(uint64_t aid, uint64_t sid, uint64_t cid);
+
+/**
+ * Get a new instance ID for bridged accessory.
+ */
+uint64_t lhap_new_bridged_aid(void);
+
+/**
+ * Look up a service type by name, returns NULL if the name is unknown.
+ */
+const HAPUUID *lhap_get_service_type(const char *name, const char **debug_description);
+
+/**
+ * Look up a characteristic type by name, returns NULL if the name is unknown.
+ */
+const HAPUUID *lhap_get_characteristic_type(const char *name, const char **debug_description);
+
+/**
+ * Accessory Information service, shared by all accessories.
+ */
+extern const HAPService accessoryInformationService;
+
+/**
+ * Get a new instance ID for service or characteristic.
+ */
+uint64_t lhap_new_iid(void);
+
 /**
  * Get Lua main thread.
  */
 lua_State *app_get_lua_main_thread();
 
+/**
+ * Memory phase of the bridge.
+ */
+typedef enum {
+    APP_MEM_PHASE_BOOT,         /**< From app_init() until the server is running. */
+    APP_MEM_PHASE_PAIRING,      /**< The server is running and not paired. */
+    APP_MEM_PHASE_STEADY,       /**< The server is running and paired. */
+    APP_MEM_PHASE_MAX,
+} app_mem_phase;
+
+/**
+ * Enter a memory phase.
+ *
+ * The heap peak of the previous phase is recorded, the peaks of all phases
+ * are reported in app_deinit().
+ */
+void app_mem_set_phase(app_mem_phase phase);
+
 #ifdef __cplusplus
 }
 #endif
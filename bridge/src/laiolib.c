@@ -0,0 +1,155 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#include <string.h>
+#include <errno.h>
+#include <lauxlib.h>
+#include <pal/aio.h>
+
+#include "app_int.h"
+#include "lc.h"
+
+static const char *laio_type_strs[] = {
+    [PAL_AIO_TYPE_FILE] = "file",
+    [PAL_AIO_TYPE_DIR] = "directory",
+    [PAL_AIO_TYPE_OTHER] = "other",
+};
+
+static const HAPLogObject laio_log = {
+    .subsystem = APP_BRIDGE_LOG_SUBSYSTEM,
+    .category = "laio",
+};
+
+/*
+ * Resume the coroutine waiting for the operation with the results on its stack.
+ */
+static void laio_resume(lua_State *co, int narg) {
+    lua_State *L = app_get_lua_main_thread();
+    int status, nres;
+    status = lc_resumethread(co, L, narg, &nres);
+    if (status != LUA_OK && status != LUA_YIELD) {
+        HAPLogError(&laio_log, "%s: %s", __func__, lua_tostring(L, -1));
+    }
+
+    lua_settop(L, 0);
+    lc_collectgarbage(L);
+}
+
+static void laio_read_cb(int err, const void *buf, size_t len, void *arg) {
+    lua_State *co = arg;
+    lua_pushinteger(co, err);
+    if (err) {
+        lua_pushnil(co);
+    } else {
+        lua_pushlstring(co, buf, len);
+    }
+    laio_resume(co, 2);
+}
+
+static void laio_write_cb(int err, void *arg) {
+    lua_State *co = arg;
+    lua_pushinteger(co, err);
+    laio_resume(co, 1);
+}
+
+static void laio_stat_cb(int err, const pal_aio_file_stat *st, void *arg) {
+    lua_State *co = arg;
+    lua_pushinteger(co, err);
+    if (err) {
+        lua_pushnil(co);
+    } else {
+        lua_createtable(co, 0, 3);
+        lua_pushstring(co, laio_type_strs[st->type]);
+        lua_setfield(co, -2, "type");
+        lua_pushinteger(co, st->size);
+        lua_setfield(co, -2, "size");
+        lua_pushinteger(co, st->mtime);
+        lua_setfield(co, -2, "mtime");
+    }
+    laio_resume(co, 2);
+}
+
+/*
+ * Raise an error if the operation failed, the stack is: 1: path, ..., -2: err, -1: result.
+ */
+static void laio_check_result(lua_State *L, int idx, const char *op) {
+    int err = lua_tointeger(L, idx);
+    if (err) {
+        luaL_error(L, "failed to %s '%s': %s", op, lua_tostring(L, 1), strerror(err));
+    }
+}
+
+static int finshread(lua_State *L, int status, lua_KContext extra) {
+    laio_check_result(L, -2, "read");
+    return 1;
+}
+
+static int laio_read(lua_State *L) {
+    const char *path = luaL_checkstring(L, 1);
+    lua_Integer offset = luaL_optinteger(L, 2, 0);
+    lua_Integer len = luaL_optinteger(L, 3, 0);
+    luaL_argcheck(L, offset >= 0, 2, "offset out of range");
+    luaL_argcheck(L, len >= 0, 3, "length out of range");
+
+    if (!pal_aio_read(path, offset, len, laio_read_cb, L)) {
+        luaL_error(L, "failed to start read request");
+    }
+    return lua_yieldk(L, 0, 0, finshread);
+}
+
+static int finshwrite(lua_State *L, int status, lua_KContext extra) {
+    laio_check_result(L, -1, extra ? "append" : "write");
+    return 0;
+}
+
+static int laio_write_common(lua_State *L, bool append) {
+    const char *path = luaL_checkstring(L, 1);
+    size_t len;
+    const char *data = luaL_checklstring(L, 2, &len);
+
+    if (!pal_aio_write(path, data, len, append, laio_write_cb, L)) {
+        luaL_error(L, "failed to start write request");
+    }
+    return lua_yieldk(L, 0, append, finshwrite);
+}
+
+static int laio_write(lua_State *L) {
+    return laio_write_common(L, false);
+}
+
+static int laio_append(lua_State *L) {
+    return laio_write_common(L, true);
+}
+
+static int finshstat(lua_State *L, int status, lua_KContext extra) {
+    if (lua_tointeger(L, -2) == ENOENT) {
+        return 1;
+    }
+    laio_check_result(L, -2, "stat");
+    return 1;
+}
+
+static int laio_stat(lua_State *L) {
+    const char *path = luaL_checkstring(L, 1);
+
+    if (!pal_aio_stat(path, laio_stat_cb, L)) {
+        luaL_error(L, "failed to start stat request");
+    }
+    return lua_yieldk(L, 0, 0, finshstat);
+}
+
+static const lc_rotable_kv laio_funcs[] = {
+    LC_ROFUNC("append", laio_append),
+    LC_ROFUNC("read", laio_read),
+    LC_ROFUNC("stat", laio_stat),
+    LC_ROFUNC("write", laio_write),
+    LC_ROEND,
+};
+
+LUAMOD_API int luaopen_aio(lua_State *L) {
+    lc_push_rotable(L, laio_funcs);
+    return 1;
+}
@@ -7,6 +7,9 @@
 #include <string.h>
 #include <lauxlib.h>
 #include <lgc.h>
+#include <lstate.h>
+#include <ldebug.h>
+#include <pal/trace.h>
 
 #include "app_int.h"
 #include "lc.h"
@@ -103,30 +106,377 @@ err:
     return false;
 }
 
-void lc_create_enum_table(lua_State *L, const char *enum_array[], int len) {
-    lua_createtable(L, len, 0);
-    for (int i = 0; i < len; i++) {
-        if (enum_array[i]) {
-            lua_pushinteger(L, i);
-            lua_setfield(L, -2, enum_array[i]);
+#define LC_ROTABLE_NAME "ROTable*"
+
+typedef struct {
+    const lc_rotable_kv *kvs;
+    size_t len;     // The number of the key-values, not including LC_ROEND.
+} lc_rotable;
+
+static const lc_rotable *lc_rotable_get(lua_State *L, int idx) {
+    return luaL_checkudata(L, idx, LC_ROTABLE_NAME);
+}
+
+// Binary search, the keys are sorted.
+static const lc_rotable_kv *lc_rotable_find(const lc_rotable *t, const char *key) {
+    size_t lo = 0;
+    size_t hi = t->len;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(key, t->kvs[mid].key);
+        if (cmp == 0) {
+            return t->kvs + mid;
         }
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+static void lc_rotable_push_value(lua_State *L, const lc_rotable_kv *kv) {
+    switch (kv->type) {
+    case LUA_TBOOLEAN:
+        lua_pushboolean(L, kv->v.i);
+        break;
+    case LUA_TNUMBER:
+        lua_pushinteger(L, kv->v.i);
+        break;
+    case LUA_TLIGHTUSERDATA:
+        lua_pushlightuserdata(L, kv->v.p);
+        break;
+    case LUA_TFUNCTION:
+        lua_pushcfunction(L, kv->v.f);
+        break;
+    case LUA_TTABLE:
+        lc_push_rotable(L, kv->v.t);
+        break;
+    default:
+        HAPAssertionFailure();
+    }
+}
+
+static int lc_rotable_index(lua_State *L) {
+    const lc_rotable *t = lc_rotable_get(L, 1);
+    const lc_rotable_kv *kv = lua_type(L, 2) == LUA_TSTRING ?
+        lc_rotable_find(t, lua_tostring(L, 2)) : NULL;
+    if (kv) {
+        lc_rotable_push_value(L, kv);
+    } else {
+        lua_pushnil(L);
+    }
+    return 1;
+}
+
+static int lc_rotable_newindex(lua_State *L) {
+    return luaL_error(L, "attempt to update a read-only table");
+}
+
+static int lc_rotable_next(lua_State *L) {
+    const lc_rotable *t = lc_rotable_get(L, 1);
+    const lc_rotable_kv *kv = t->kvs;
+    if (!lua_isnoneornil(L, 2)) {
+        kv = lua_type(L, 2) == LUA_TSTRING ? lc_rotable_find(t, lua_tostring(L, 2)) : NULL;
+        if (!kv) {
+            return luaL_error(L, "invalid key to 'next'");
+        }
+        kv++;
+    }
+    if (!kv->key) {
+        lua_pushnil(L);
+        return 1;
+    }
+    lua_pushstring(L, kv->key);
+    lc_rotable_push_value(L, kv);
+    return 2;
+}
+
+static int lc_rotable_pairs(lua_State *L) {
+    lc_rotable_get(L, 1);
+    lua_pushcfunction(L, lc_rotable_next);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    return 3;
+}
+
+static int lc_rotable_tostring(lua_State *L) {
+    lua_pushfstring(L, "rotable (%p)", lc_rotable_get(L, 1)->kvs);
+    return 1;
+}
+
+/*
+ * metamethods for read-only table
+ */
+static const luaL_Reg lc_rotable_metameth[] = {
+    {"__index", lc_rotable_index},
+    {"__newindex", lc_rotable_newindex},
+    {"__pairs", lc_rotable_pairs},
+    {"__tostring", lc_rotable_tostring},
+    {NULL, NULL}
+};
+
+void lc_push_rotable(lua_State *L, const lc_rotable_kv *kvs) {
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, kvs) != LUA_TNIL) {
+        return;
     }
+    lua_pop(L, 1);
+
+    lc_rotable *t = lua_newuserdatauv(L, sizeof(*t), 0);
+    t->kvs = kvs;
+    t->len = 0;
+    for (; kvs[t->len].key; t->len++) {
+        // The lookup is a binary search.
+        HAPAssert(t->len == 0 || strcmp(kvs[t->len - 1].key, kvs[t->len].key) < 0);
+    }
+    if (luaL_newmetatable(L, LC_ROTABLE_NAME)) {
+        luaL_setfuncs(L, lc_rotable_metameth, 0);
+    }
+    lua_setmetatable(L, -2);
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, kvs);
 }
 
 void lc_collectgarbage(lua_State *L) {
+    PAL_TRACE1(gc__start, gettotalbytes(G(L)));
     luaC_fullgc(L, 0);
+    PAL_TRACE1(gc__done, gettotalbytes(G(L)));
+}
+
+// Size of the first and the last part of a long traceback.
+#define LC_TRACEBACK_LEVELS1 10
+#define LC_TRACEBACK_LEVELS2 11
+
+static lc_linemap_finder gv_lc_linemap_finder;
+
+void lc_set_linemap_finder(lc_linemap_finder finder) {
+    gv_lc_linemap_finder = finder;
+}
+
+static bool lc_linemap_parse_int(const char **p, const char *end, int *out) {
+    bool neg = false;
+    if (*p < end && **p == '-') {
+        neg = true;
+        (*p)++;
+    }
+    if (*p == end || **p < '0' || **p > '9') {
+        return false;
+    }
+    int n = 0;
+    for (; *p < end && **p >= '0' && **p <= '9'; (*p)++) {
+        n = n * 10 + (**p - '0');
+    }
+    *out = neg ? -n : n;
+    return true;
+}
+
+/*
+ * Look up the line of the pc of the function at "pos" in the line map.
+ *
+ * Each line of the map is "<linedefined>,<lastlinedefined> <pc>:<line> ...",
+ * one line per function in pre-order, see platform/linux/luac/luastrip.c.
+ */
+static int lc_linemap_lookup(const char *map, size_t len, int pos, int linedefined, int lastlinedefined, int pc) {
+    const char *p = map;
+    const char *end = map + len;
+    for (; pos > 0 && p < end; pos--) {
+        while (p < end && *p++ != '\n') {}
+    }
+    int first, last;
+    if (!lc_linemap_parse_int(&p, end, &first) || p == end || *p++ != ',' ||
+        !lc_linemap_parse_int(&p, end, &last)) {
+        return -1;
+    }
+    if (first != linedefined || last != lastlinedefined) {
+        // The line map does not match the bytecode.
+        return -1;
+    }
+    int line = -1;
+    while (p < end && *p == ' ') {
+        int start, l;
+        p++;
+        if (!lc_linemap_parse_int(&p, end, &start) || p == end || *p++ != ':' ||
+            !lc_linemap_parse_int(&p, end, &l)) {
+            return -1;
+        }
+        if (start > pc) {
+            break;
+        }
+        line = l;
+    }
+    return line;
+}
+
+// Find the position of "p" in the pre-order of the functions of "f".
+static bool lc_linemap_find_proto(const Proto *f, const Proto *p, int *pos) {
+    if (f == p) {
+        return true;
+    }
+    (*pos)++;
+    for (int i = 0; i < f->sizep; i++) {
+        if (lc_linemap_find_proto(f->p[i], p, pos)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int lc_load_stripped(lua_State *L, const char *buff, size_t sz, const char *mode) {
+    int status = luaL_loadbufferx(L, buff, sz, NULL, mode);
+    if (status != LUA_OK) {
+        return status;
+    }
+    const Proto *f = clLvalue(s2v(L->top - 1))->p;
+    if (f->lineinfo || !f->source) {
+        return status;
+    }
+
+    // Keep the main function to find the position of the functions in the line map.
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &gv_lc_linemap_finder) != LUA_TTABLE) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &gv_lc_linemap_finder);
+    }
+    lua_pushstring(L, getstr(f->source));
+    lua_pushvalue(L, -3);
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+    return status;
+}
+
+// Get the current line of a function loaded from stripped bytecode.
+static int lc_getline_stripped(lua_State *L, lua_Debug *ar) {
+    CallInfo *ci = ar->i_ci;
+    if (!gv_lc_linemap_finder || ar->source[0] != '@' || !ci || !isLua(ci)) {
+        return -1;
+    }
+    const Proto *p = ci_func(ci)->p;
+    if (!lua_checkstack(L, 2)) {
+        return -1;
+    }
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &gv_lc_linemap_finder) != LUA_TTABLE) {
+        lua_pop(L, 1);
+        return -1;
+    }
+    lua_pushstring(L, ar->source);
+    if (lua_rawget(L, -2) != LUA_TFUNCTION) {
+        lua_pop(L, 2);
+        return -1;
+    }
+    int pos = 0;
+    bool found = lc_linemap_find_proto(clLvalue(s2v(L->top - 1))->p, p, &pos);
+    lua_pop(L, 2);
+    if (!found) {
+        // Loaded again, or not loaded by lc_load_stripped().
+        return -1;
+    }
+
+    size_t len;
+    const char *map = gv_lc_linemap_finder(ar->source + 1, &len);
+    if (!map) {
+        return -1;
+    }
+    return lc_linemap_lookup(map, len, pos, ar->linedefined, ar->lastlinedefined, pcRel(ci->u.l.savedpc, p));
+}
+
+static void lc_push_funcname(lua_State *L, lua_Debug *ar) {
+    if (*ar->namewhat != '\0') {
+        lua_pushfstring(L, "%s '%s'", ar->namewhat, ar->name);
+    } else if (*ar->what == 'm') {
+        lua_pushliteral(L, "main chunk");
+    } else if (*ar->what != 'C') {
+        lua_pushfstring(L, "function <%s:%d>", ar->short_src, ar->linedefined);
+    } else {
+        lua_pushliteral(L, "?");
+    }
+}
+
+void lc_traceback(lua_State *L, lua_State *L1, const char *msg, int level) {
+    luaL_Buffer b;
+    lua_Debug ar;
+
+    // Find the last level.
+    int li = 1, le = 1;
+    while (lua_getstack(L1, le, &ar)) {
+        li = le;
+        le *= 2;
+    }
+    while (li < le) {
+        int m = (li + le) / 2;
+        if (lua_getstack(L1, m, &ar)) {
+            li = m + 1;
+        } else {
+            le = m;
+        }
+    }
+    int last = le - 1;
+    int limit2show = (last - level > LC_TRACEBACK_LEVELS1 + LC_TRACEBACK_LEVELS2) ?
+        LC_TRACEBACK_LEVELS1 : -1;
+
+    luaL_buffinit(L, &b);
+    if (msg) {
+        luaL_addstring(&b, msg);
+        luaL_addchar(&b, '\n');
+    }
+    luaL_addstring(&b, "stack traceback:");
+    while (lua_getstack(L1, level++, &ar)) {
+        if (limit2show-- == 0) {
+            int n = last - level - LC_TRACEBACK_LEVELS2 + 1;
+            lua_pushfstring(L, "\n\t...\t(skipping %d levels)", n);
+            luaL_addvalue(&b);
+            level += n;
+            continue;
+        }
+        lua_getinfo(L1, "Slnt", &ar);
+        int line = ar.currentline;
+        if (line <= 0 && *ar.what != 'C') {
+            line = lc_getline_stripped(L, &ar);
+        }
+        if (line <= 0) {
+            lua_pushfstring(L, "\n\t%s: in ", ar.short_src);
+        } else {
+            lua_pushfstring(L, "\n\t%s:%d: in ", ar.short_src, line);
+        }
+        luaL_addvalue(&b);
+        lc_push_funcname(L, &ar);
+        luaL_addvalue(&b);
+        if (ar.istailcall) {
+            luaL_addstring(&b, "\n\t(...tail calls...)");
+        }
+    }
+    luaL_pushresult(&b);
 }
 
 static int traceback(lua_State *L) {
     const char *msg = lua_tostring(L, 1);
     if (msg) {
-        luaL_traceback(L, L, msg, 1);
+        lc_traceback(L, L, msg, 1);
     } else {
         lua_pushliteral(L, "(no error message)");
     }
     return 1;
 }
 
+int lc_db_traceback(lua_State *L) {
+    lua_State *L1 = L;
+    int arg = 0;
+    if (lua_isthread(L, 1)) {
+        L1 = lua_tothread(L, 1);
+        arg = 1;
+    }
+    const char *msg = lua_tostring(L, arg + 1);
+    if (msg == NULL && !lua_isnoneornil(L, arg + 1)) {
+        // non-string 'msg' is returned untouched
+        lua_pushvalue(L, arg + 1);
+    } else {
+        int level = (int)luaL_optinteger(L, arg + 2, (L == L1) ? 1 : 0);
+        lc_traceback(L, L1, msg, level);
+    }
+    return 1;
+}
+
 void lc_push_traceback(lua_State *L) {
     lua_pushcfunction(L, traceback);
 }
@@ -138,7 +488,11 @@ static int lc_resetthread(lua_State *L) {
 }
 
 int lc_startthread(lua_State *L, lua_State *from, int narg, int *nres) {
+    PAL_TRACE1(coroutine__start, L);
     int status = lua_resume(L, from, narg, nres);
+    if (status != LUA_YIELD) {
+        PAL_TRACE2(coroutine__finish, L, status);
+    }
     switch (status) {
     case LUA_OK:
         lua_xmove(L, from, *nres);
@@ -149,7 +503,7 @@ int lc_startthread(lua_State *L, lua_State *from, int narg, int *nres) {
         lua_rawsetp(L, LUA_REGISTRYINDEX, L);
         break;
     default:
-        luaL_traceback(from, L, lua_tostring(L, -1), 1);
+        lc_traceback(from, L, lua_tostring(L, -1), 1);
         lua_resetthread(L);
         break;
     }
@@ -157,7 +511,11 @@ int lc_startthread(lua_State *L, lua_State *from, int narg, int *nres) {
 }
 
 int lc_resumethread(lua_State *L, lua_State *from, int narg, int *nres) {
+    PAL_TRACE1(coroutine__resume, L);
     int status = lua_resume(L, from, narg, nres);
+    if (status != LUA_YIELD) {
+        PAL_TRACE2(coroutine__finish, L, status);
+    }
     switch (status) {
     case LUA_OK:
         lua_xmove(L, from, *nres);
@@ -166,7 +524,7 @@ int lc_resumethread(lua_State *L, lua_State *from, int narg, int *nres) {
     case LUA_YIELD:
         break;
     default:
-        luaL_traceback(from, L, lua_tostring(L, -1), 1);
+        lc_traceback(from, L, lua_tostring(L, -1), 1);
         lc_resetthread(L);
         break;
     }
@@ -63,15 +63,85 @@ bool lc_traverse_array(lua_State *L, int idx,
                         void *arg);
 
 /**
- * Create a enum table.
+ * Read-only table key-value.
  */
-void lc_create_enum_table(lua_State *L, const char *enum_array[], int len);
+typedef struct lc_rotable_kv {
+    const char *key;    /* key */
+    /**
+     * Lua type of the value, one of LUA_TBOOLEAN, LUA_TNUMBER (integer),
+     * LUA_TLIGHTUSERDATA, LUA_TFUNCTION and LUA_TTABLE (read-only table).
+     */
+    int type;
+    union {
+        lua_Integer i;
+        void *p;
+        lua_CFunction f;
+        const struct lc_rotable_kv *t;
+    } v;
+} lc_rotable_kv;
+
+#define LC_ROBOOL(k, b)     { (k), LUA_TBOOLEAN, { .i = (b) } }
+#define LC_ROINT(k, n)      { (k), LUA_TNUMBER, { .i = (n) } }
+#define LC_ROPTR(k, ptr)    { (k), LUA_TLIGHTUSERDATA, { .p = (ptr) } }
+#define LC_ROFUNC(k, func)  { (k), LUA_TFUNCTION, { .f = (func) } }
+#define LC_ROTABLE(k, kvs)  { (k), LUA_TTABLE, { .t = (kvs) } }
+#define LC_ROEND            { NULL, LUA_TNONE, { 0 } }
+
+/**
+ * Push a read-only table.
+ *
+ * The table is a small userdata referring to the static key-values @p kvs,
+ * terminated by LC_ROEND, so the key-values cost no Lua heap and are not
+ * traversed by the GC. The keys must be sorted in strcmp() order, they are
+ * looked up by a binary search. It supports indexing and pairs(), and raises an error
+ * on assignment. The userdata is cached in the registry, pushing the same
+ * @p kvs again does not allocate.
+ */
+void lc_push_rotable(lua_State *L, const lc_rotable_kv *kvs);
 
 /**
  * Collect garbage.
  */
 void lc_collectgarbage(lua_State *L);
 
+/**
+ * Find the line map of a chunk loaded from stripped bytecode.
+ *
+ * @param source The source name of the chunk without the leading '@'.
+ * @param len The length of the line map.
+ * @returns the line map or NULL if not found.
+ */
+typedef const char *(*lc_linemap_finder)(const char *source, size_t *len);
+
+/**
+ * Set the finder used to symbolize tracebacks of stripped bytecode.
+ */
+void lc_set_linemap_finder(lc_linemap_finder finder);
+
+/**
+ * Same as luaL_loadbufferx(), but the functions of a chunk of stripped bytecode
+ * are symbolized in tracebacks with the line map of its source.
+ *
+ * The main function of the chunk is kept to find the functions in the line map.
+ */
+int lc_load_stripped(lua_State *L, const char *buff, size_t sz, const char *mode);
+
+/**
+ * Same as luaL_traceback(), but symbolizes stripped bytecode with the line map.
+ */
+void lc_traceback(lua_State *L, lua_State *L1, const char *msg, int level);
+
+/**
+ * Replacement of debug.traceback() using lc_traceback().
+ */
+int lc_db_traceback(lua_State *L);
+
+/**
+ * debug.heapsnapshot(path), write a snapshot of the Lua heap to the file,
+ * returns the number of objects and bytes in the snapshot.
+ */
+int lc_db_heapsnapshot(lua_State *L);
+
 /**
  * Push traceback function to lua stack.
  */
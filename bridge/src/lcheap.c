@@ -0,0 +1,608 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+// Lua heap snapshot.
+//
+// The heap is walked like the marking phase of the collector, starting from
+// the roots in this order:
+//
+//   - package.loaded[name], owner "module:<name>"
+//   - the globals, owner "_G"
+//   - the registry entries, owner "registry:<key type>", the coroutines
+//     started by lc_startthread() are in "registry:thread"
+//   - the stack of the main thread, owner "stack"
+//   - the metatables of the basic types, owner "metatable"
+//
+// Each object is attributed to the first root which reaches it, and to the
+// nearest Lua function which references it ("source:linedefined"), then all
+// objects of the collector lists are aggregated by (type, owner, site).
+// Objects reached from no root are reported as "<unreachable>".
+//
+// The snapshot is a text file, one aggregate per line:
+//
+//     <type>\t<count>\t<bytes>\t<owner>\t<site>
+
+#include <stdio.h>
+#include <string.h>
+#include <lauxlib.h>
+#include <lgc.h>
+#include <lstate.h>
+#include <lstring.h>
+#include <lfunc.h>
+#include <ltable.h>
+#include <pal/memory.h>
+
+#include "app_int.h"
+#include "lc.h"
+
+#define LCHEAP_SNAPSHOT_HEADER "# heapsnapshot 1\n"
+#define LCHEAP_LABEL_MAX_LEN 128
+#define LCHEAP_LABEL_NONE 0
+
+/**
+ * Open-addressing hash map from pointer/integer to integer.
+ */
+typedef struct {
+    uintptr_t *keys;
+    uint32_t *vals;
+    size_t cap;
+    size_t cnt;
+} lcheap_map;
+
+typedef struct {
+    uint32_t label;
+    uint8_t type;
+    size_t count;
+    size_t bytes;
+} lcheap_aggr;
+
+typedef struct {
+    GCObject *obj;
+    uint32_t label;
+} lcheap_work;
+
+typedef struct {
+    bool oom;
+
+    lcheap_map visited;     // GCObject -> label
+
+    // Labels, the label is "<owner>\t<site>".
+    char **labels;
+    size_t labels_cnt;
+    size_t labels_cap;
+    lcheap_map label_ids;   // hash -> first label id, collisions by linear scan
+
+    lcheap_work *stack;
+    size_t stack_top;
+    size_t stack_cap;
+
+    lcheap_map aggr_ids;    // (label, type) -> aggregate id
+    lcheap_aggr *aggrs;
+    size_t aggrs_cnt;
+    size_t aggrs_cap;
+
+    const char *owner;      // owner of the current root
+} lcheap_ctx;
+
+static bool lcheap_grow(lcheap_ctx *ctx, void **p, size_t *cap, size_t elem_size) {
+    size_t ncap = *cap ? *cap * 2 : 64;
+    void *np = pal_mem_realloc(*p, ncap * elem_size);
+    if (!np) {
+        ctx->oom = true;
+        return false;
+    }
+    *p = np;
+    *cap = ncap;
+    return true;
+}
+
+static inline size_t lcheap_hash(uintptr_t key) {
+    key ^= key >> 17;
+    key *= 0x9e3779b97f4a7c15ULL;
+    return key ^ (key >> 29);
+}
+
+static void lcheap_map_free(lcheap_map *map) {
+    pal_mem_free(map->keys);
+    pal_mem_free(map->vals);
+}
+
+static uint32_t *lcheap_map_find(lcheap_map *map, uintptr_t key) {
+    if (map->cap == 0) {
+        return NULL;
+    }
+    for (size_t i = lcheap_hash(key) & (map->cap - 1);; i = (i + 1) & (map->cap - 1)) {
+        if (map->keys[i] == key) {
+            return map->vals + i;
+        }
+        if (map->keys[i] == 0) {
+            return NULL;
+        }
+    }
+}
+
+// The key must not be 0 and not in the map.
+static bool lcheap_map_put(lcheap_ctx *ctx, lcheap_map *map, uintptr_t key, uint32_t val) {
+    if ((map->cnt + 1) * 2 > map->cap) {
+        size_t ncap = map->cap ? map->cap * 2 : 1024;
+        uintptr_t *keys = pal_mem_calloc(ncap * sizeof(*keys));
+        uint32_t *vals = pal_mem_alloc(ncap * sizeof(*vals));
+        if (!keys || !vals) {
+            pal_mem_free(keys);
+            pal_mem_free(vals);
+            ctx->oom = true;
+            return false;
+        }
+        for (size_t i = 0; i < map->cap; i++) {
+            if (map->keys[i]) {
+                size_t j = lcheap_hash(map->keys[i]) & (ncap - 1);
+                while (keys[j]) {
+                    j = (j + 1) & (ncap - 1);
+                }
+                keys[j] = map->keys[i];
+                vals[j] = map->vals[i];
+            }
+        }
+        lcheap_map_free(map);
+        map->keys = keys;
+        map->vals = vals;
+        map->cap = ncap;
+    }
+    size_t i = lcheap_hash(key) & (map->cap - 1);
+    while (map->keys[i]) {
+        i = (i + 1) & (map->cap - 1);
+    }
+    map->keys[i] = key;
+    map->vals[i] = val;
+    map->cnt++;
+    return true;
+}
+
+static uintptr_t lcheap_str_hash(const char *s) {
+    uintptr_t h = 5381;
+    while (*s) {
+        h = h * 33 + (unsigned char)*s++;
+    }
+    return h ? h : 1;
+}
+
+static uint32_t lcheap_intern(lcheap_ctx *ctx, const char *owner, const char *site) {
+    char buf[LCHEAP_LABEL_MAX_LEN];
+    snprintf(buf, sizeof(buf), "%s\t%s", owner, site);
+
+    uintptr_t h = lcheap_str_hash(buf);
+    uint32_t *first = lcheap_map_find(&ctx->label_ids, h);
+    if (first) {
+        for (size_t i = *first; i < ctx->labels_cnt; i++) {
+            if (strcmp(ctx->labels[i], buf) == 0) {
+                return i;
+            }
+        }
+    }
+
+    if (ctx->labels_cnt == ctx->labels_cap &&
+        !lcheap_grow(ctx, (void **)&ctx->labels, &ctx->labels_cap, sizeof(char *))) {
+        return LCHEAP_LABEL_NONE;
+    }
+    size_t len = strlen(buf) + 1;
+    char *label = pal_mem_alloc(len);
+    if (!label) {
+        ctx->oom = true;
+        return LCHEAP_LABEL_NONE;
+    }
+    memcpy(label, buf, len);
+    uint32_t id = ctx->labels_cnt++;
+    ctx->labels[id] = label;
+    if (!first) {
+        lcheap_map_put(ctx, &ctx->label_ids, h, id);
+    }
+    return id;
+}
+
+static uint32_t lcheap_proto_label(lcheap_ctx *ctx, const Proto *p) {
+    char site[LCHEAP_LABEL_MAX_LEN];
+    const char *source = p->source ? getstr(p->source) : "=?";
+    snprintf(site, sizeof(site), "%s:%d", (*source == '@' || *source == '=') ? source + 1 : "?",
+        p->linedefined);
+    return lcheap_intern(ctx, ctx->owner, site);
+}
+
+static void lcheap_mark(lcheap_ctx *ctx, GCObject *o, uint32_t label) {
+    if (lcheap_map_find(&ctx->visited, (uintptr_t)o)) {
+        return;
+    }
+    if (!lcheap_map_put(ctx, &ctx->visited, (uintptr_t)o, label)) {
+        return;
+    }
+    if (ctx->stack_top == ctx->stack_cap &&
+        !lcheap_grow(ctx, (void **)&ctx->stack, &ctx->stack_cap, sizeof(lcheap_work))) {
+        return;
+    }
+    ctx->stack[ctx->stack_top].obj = o;
+    ctx->stack[ctx->stack_top].label = label;
+    ctx->stack_top++;
+}
+
+static inline void lcheap_mark_value(lcheap_ctx *ctx, const TValue *v, uint32_t label) {
+    if (iscollectable(v)) {
+        lcheap_mark(ctx, gcvalue(v), label);
+    }
+}
+
+static void lcheap_traverse_table(lcheap_ctx *ctx, Table *t, uint32_t label) {
+    if (t->metatable) {
+        lcheap_mark(ctx, obj2gco(t->metatable), label);
+    }
+    unsigned int asize = luaH_realasize(t);
+    for (unsigned int i = 0; i < asize; i++) {
+        lcheap_mark_value(ctx, &t->array[i], label);
+    }
+    if (isdummy(t)) {
+        return;
+    }
+    for (Node *n = gnode(t, 0), *limit = gnode(t, sizenode(t)); n < limit; n++) {
+        if (isempty(gval(n))) {
+            continue;
+        }
+        if (keyiscollectable(n)) {
+            lcheap_mark(ctx, gckey(n), label);
+        }
+        lcheap_mark_value(ctx, gval(n), label);
+    }
+}
+
+static void lcheap_traverse_proto(lcheap_ctx *ctx, Proto *p, uint32_t label) {
+    if (p->source) {
+        lcheap_mark(ctx, obj2gco(p->source), label);
+    }
+    for (int i = 0; i < p->sizek; i++) {
+        lcheap_mark_value(ctx, &p->k[i], label);
+    }
+    for (int i = 0; i < p->sizeupvalues; i++) {
+        if (p->upvalues[i].name) {
+            lcheap_mark(ctx, obj2gco(p->upvalues[i].name), label);
+        }
+    }
+    for (int i = 0; i < p->sizep; i++) {
+        if (p->p[i]) {
+            lcheap_mark(ctx, obj2gco(p->p[i]), label);
+        }
+    }
+    for (int i = 0; i < p->sizelocvars; i++) {
+        if (p->locvars[i].varname) {
+            lcheap_mark(ctx, obj2gco(p->locvars[i].varname), label);
+        }
+    }
+}
+
+static void lcheap_traverse(lcheap_ctx *ctx, GCObject *o, uint32_t label) {
+    switch (o->tt) {
+    case LUA_VTABLE:
+        lcheap_traverse_table(ctx, gco2t(o), label);
+        break;
+    case LUA_VLCL: {
+        LClosure *cl = gco2lcl(o);
+        // Everything referenced by a Lua function is attributed to it.
+        uint32_t site = cl->p ? lcheap_proto_label(ctx, cl->p) : label;
+        if (cl->p) {
+            lcheap_mark(ctx, obj2gco(cl->p), site);
+        }
+        for (int i = 0; i < cl->nupvalues; i++) {
+            if (cl->upvals[i]) {
+                lcheap_mark(ctx, obj2gco(cl->upvals[i]), site);
+            }
+        }
+        break;
+    }
+    case LUA_VCCL: {
+        CClosure *cl = gco2ccl(o);
+        for (int i = 0; i < cl->nupvalues; i++) {
+            lcheap_mark_value(ctx, &cl->upvalue[i], label);
+        }
+        break;
+    }
+    case LUA_VPROTO:
+        lcheap_traverse_proto(ctx, gco2p(o), label);
+        break;
+    case LUA_VUPVAL:
+        lcheap_mark_value(ctx, gco2upv(o)->v, label);
+        break;
+    case LUA_VUSERDATA: {
+        Udata *u = gco2u(o);
+        if (u->metatable) {
+            lcheap_mark(ctx, obj2gco(u->metatable), label);
+        }
+        for (int i = 0; i < u->nuvalue; i++) {
+            lcheap_mark_value(ctx, &u->uv[i].uv, label);
+        }
+        break;
+    }
+    case LUA_VTHREAD: {
+        lua_State *th = gco2th(o);
+        for (StkId p = th->stack; p < th->top; p++) {
+            lcheap_mark_value(ctx, s2v(p), label);
+        }
+        for (UpVal *uv = th->openupval; uv; uv = uv->u.open.next) {
+            lcheap_mark(ctx, obj2gco(uv), label);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void lcheap_drain(lcheap_ctx *ctx) {
+    while (ctx->stack_top && !ctx->oom) {
+        lcheap_work *w = ctx->stack + --ctx->stack_top;
+        lcheap_traverse(ctx, w->obj, w->label);
+    }
+}
+
+static void lcheap_mark_root(lcheap_ctx *ctx, const TValue *v, const char *owner) {
+    if (!iscollectable(v)) {
+        return;
+    }
+    ctx->owner = owner;
+    lcheap_mark(ctx, gcvalue(v), lcheap_intern(ctx, owner, "-"));
+    lcheap_drain(ctx);
+}
+
+// Mark a table as root without attributing it, then walk its entries.
+static void lcheap_walk_root_table(lcheap_ctx *ctx, Table *t,
+    void (*entry)(lcheap_ctx *ctx, const TValue *key, const TValue *val, void *arg), void *arg) {
+    unsigned int asize = luaH_realasize(t);
+    for (unsigned int i = 0; i < asize; i++) {
+        TValue key;
+        setivalue(&key, i + 1);
+        if (!isempty(&t->array[i])) {
+            entry(ctx, &key, &t->array[i], arg);
+        }
+    }
+    if (isdummy(t)) {
+        return;
+    }
+    for (Node *n = gnode(t, 0), *limit = gnode(t, sizenode(t)); n < limit; n++) {
+        if (isempty(gval(n))) {
+            continue;
+        }
+        TValue key;
+        getnodekey(NULL, &key, n);
+        entry(ctx, &key, gval(n), arg);
+    }
+}
+
+static void lcheap_module_entry(lcheap_ctx *ctx, const TValue *key, const TValue *val, void *arg) {
+    if (!ttisstring(key) || strcmp(getstr(tsvalue(key)), LUA_GNAME) == 0) {
+        return;
+    }
+    char owner[LCHEAP_LABEL_MAX_LEN];
+    snprintf(owner, sizeof(owner), "module:%s", getstr(tsvalue(key)));
+    lcheap_mark_root(ctx, val, owner);
+}
+
+static void lcheap_global_entry(lcheap_ctx *ctx, const TValue *key, const TValue *val, void *arg) {
+    lcheap_mark_root(ctx, key, LUA_GNAME);
+    lcheap_mark_root(ctx, val, LUA_GNAME);
+}
+
+static void lcheap_registry_entry(lcheap_ctx *ctx, const TValue *key, const TValue *val, void *arg) {
+    char owner[LCHEAP_LABEL_MAX_LEN];
+    if (ttisstring(key)) {
+        snprintf(owner, sizeof(owner), "registry:%s", getstr(tsvalue(key)));
+    } else if (ttisinteger(key)) {
+        snprintf(owner, sizeof(owner), "registry:ref");
+    } else if (ttisthread(val)) {
+        snprintf(owner, sizeof(owner), "registry:thread");
+    } else {
+        snprintf(owner, sizeof(owner), "registry:%s", ttypename(ttype(key)));
+    }
+    lcheap_mark_root(ctx, key, owner);
+    lcheap_mark_root(ctx, val, owner);
+}
+
+static const char *lcheap_type_name(uint8_t type) {
+    switch (type) {
+    case LUA_VTABLE:
+        return "table";
+    case LUA_VLCL:
+        return "function";
+    case LUA_VCCL:
+        return "cfunction";
+    case LUA_VPROTO:
+        return "proto";
+    case LUA_VUPVAL:
+        return "upvalue";
+    case LUA_VUSERDATA:
+        return "userdata";
+    case LUA_VTHREAD:
+        return "thread";
+    case LUA_VSHRSTR:
+    case LUA_VLNGSTR:
+        return "string";
+    default:
+        return "other";
+    }
+}
+
+static size_t lcheap_obj_size(GCObject *o) {
+    switch (o->tt) {
+    case LUA_VTABLE: {
+        Table *t = gco2t(o);
+        return sizeof(Table) + luaH_realasize(t) * sizeof(TValue) +
+            (isdummy(t) ? 0 : sizenode(t) * sizeof(Node));
+    }
+    case LUA_VLCL:
+        return sizeLclosure(gco2lcl(o)->nupvalues);
+    case LUA_VCCL:
+        return sizeCclosure(gco2ccl(o)->nupvalues);
+    case LUA_VPROTO: {
+        Proto *p = gco2p(o);
+        return sizeof(Proto) + p->sizecode * sizeof(Instruction) + p->sizep * sizeof(Proto *) +
+            p->sizek * sizeof(TValue) + p->sizelineinfo * sizeof(ls_byte) +
+            p->sizeabslineinfo * sizeof(AbsLineInfo) + p->sizelocvars * sizeof(LocVar) +
+            p->sizeupvalues * sizeof(Upvaldesc);
+    }
+    case LUA_VUPVAL:
+        return sizeof(UpVal);
+    case LUA_VUSERDATA: {
+        Udata *u = gco2u(o);
+        return sizeudata(u->nuvalue, u->len);
+    }
+    case LUA_VTHREAD: {
+        lua_State *th = gco2th(o);
+        return sizeof(lua_State) + LUA_EXTRASPACE + (th->stack_last - th->stack + EXTRA_STACK) * sizeof(StackValue) +
+            th->nci * sizeof(CallInfo);
+    }
+    case LUA_VSHRSTR:
+    case LUA_VLNGSTR:
+        return sizelstring(tsslen(gco2ts(o)));
+    default:
+        return 0;
+    }
+}
+
+static void lcheap_aggregate(lcheap_ctx *ctx, GCObject *o, uint32_t unreachable) {
+    uint32_t *plabel = lcheap_map_find(&ctx->visited, (uintptr_t)o);
+    uint32_t label = plabel ? *plabel : unreachable;
+    uintptr_t key = ((uintptr_t)label << 8 | o->tt) + 1;
+    uint32_t *pid = lcheap_map_find(&ctx->aggr_ids, key);
+    lcheap_aggr *aggr;
+    if (pid) {
+        aggr = ctx->aggrs + *pid;
+    } else {
+        if (ctx->aggrs_cnt == ctx->aggrs_cap &&
+            !lcheap_grow(ctx, (void **)&ctx->aggrs, &ctx->aggrs_cap, sizeof(lcheap_aggr))) {
+            return;
+        }
+        if (!lcheap_map_put(ctx, &ctx->aggr_ids, key, ctx->aggrs_cnt)) {
+            return;
+        }
+        aggr = ctx->aggrs + ctx->aggrs_cnt++;
+        aggr->label = label;
+        aggr->type = o->tt;
+        aggr->count = 0;
+        aggr->bytes = 0;
+    }
+    aggr->count++;
+    aggr->bytes += lcheap_obj_size(o);
+}
+
+static void lcheap_aggregate_list(lcheap_ctx *ctx, GCObject *list, uint32_t unreachable) {
+    for (GCObject *o = list; o && !ctx->oom; o = o->next) {
+        lcheap_aggregate(ctx, o, unreachable);
+    }
+}
+
+static int lcheap_aggr_cmp(const void *a, const void *b) {
+    const lcheap_aggr *x = a;
+    const lcheap_aggr *y = b;
+    return x->bytes < y->bytes ? 1 : (x->bytes > y->bytes ? -1 : 0);
+}
+
+static void lcheap_ctx_free(lcheap_ctx *ctx) {
+    lcheap_map_free(&ctx->visited);
+    lcheap_map_free(&ctx->label_ids);
+    lcheap_map_free(&ctx->aggr_ids);
+    for (size_t i = 0; i < ctx->labels_cnt; i++) {
+        pal_mem_free(ctx->labels[i]);
+    }
+    pal_mem_free(ctx->labels);
+    pal_mem_free(ctx->stack);
+    pal_mem_free(ctx->aggrs);
+}
+
+// No Lua error is raised in the walk, the heap must not change during it.
+static bool lcheap_snapshot(lua_State *L, lcheap_ctx *ctx) {
+    global_State *g = G(L);
+    Table *registry = hvalue(&g->l_registry);
+
+    // The roots themselves are not attributed to any owner.
+    ctx->owner = "<root>";
+    uint32_t root = lcheap_intern(ctx, ctx->owner, "-");
+    lcheap_mark(ctx, obj2gco(registry), root);
+    lcheap_mark(ctx, obj2gco(g->mainthread), root);
+    ctx->stack_top = 0;
+
+    const TValue *gt = luaH_getint(registry, LUA_RIDX_GLOBALS);
+    const TValue *loaded = luaH_getshortstr(registry, luaS_new(L, LUA_LOADED_TABLE));
+    if (ttistable(loaded)) {
+        lcheap_mark(ctx, gcvalue(loaded), root);
+        ctx->stack_top = 0;
+        lcheap_walk_root_table(ctx, hvalue(loaded), lcheap_module_entry, NULL);
+    }
+    if (ttistable(gt)) {
+        lcheap_mark(ctx, gcvalue(gt), root);
+        ctx->stack_top = 0;
+        lcheap_walk_root_table(ctx, hvalue(gt), lcheap_global_entry, NULL);
+    }
+    lcheap_walk_root_table(ctx, registry, lcheap_registry_entry, NULL);
+
+    ctx->owner = "stack";
+    lcheap_traverse(ctx, obj2gco(g->mainthread), lcheap_intern(ctx, ctx->owner, "-"));
+    lcheap_drain(ctx);
+
+    for (int i = 0; i < LUA_NUMTAGS; i++) {
+        if (g->mt[i]) {
+            TValue v;
+            sethvalue(L, &v, g->mt[i]);
+            lcheap_mark_root(ctx, &v, "metatable");
+        }
+    }
+
+    uint32_t unreachable = lcheap_intern(ctx, "<unreachable>", "-");
+    uint32_t fixed = lcheap_intern(ctx, "<fixed>", "-");
+    lcheap_aggregate_list(ctx, g->allgc, unreachable);
+    lcheap_aggregate_list(ctx, g->finobj, unreachable);
+    lcheap_aggregate_list(ctx, g->tobefnz, unreachable);
+    lcheap_aggregate_list(ctx, g->fixedgc, fixed);
+    return !ctx->oom;
+}
+
+/* heapsnapshot(path: string) -> count: integer, bytes: integer */
+int lc_db_heapsnapshot(lua_State *L) {
+    const char *path = luaL_checkstring(L, 1);
+
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        return luaL_fileresult(L, 0, path);
+    }
+
+    // Walk a heap without garbage, and the collector must not run in the walk.
+    // Only restart the collector if it was running, the caller may have stopped it.
+    int running = lua_gc(L, LUA_GCISRUNNING);
+    lua_gc(L, LUA_GCCOLLECT);
+    lua_gc(L, LUA_GCSTOP);
+
+    lcheap_ctx ctx = {0};
+    bool ok = lcheap_snapshot(L, &ctx);
+    if (running) {
+        lua_gc(L, LUA_GCRESTART);
+    }
+
+    size_t count = 0;
+    size_t bytes = 0;
+    if (ok) {
+        qsort(ctx.aggrs, ctx.aggrs_cnt, sizeof(lcheap_aggr), lcheap_aggr_cmp);
+        fputs(LCHEAP_SNAPSHOT_HEADER, fp);
+        for (size_t i = 0; i < ctx.aggrs_cnt; i++) {
+            lcheap_aggr *aggr = ctx.aggrs + i;
+            fprintf(fp, "%s\t%zu\t%zu\t%s\n", lcheap_type_name(aggr->type), aggr->count, aggr->bytes,
+                ctx.labels[aggr->label]);
+            count += aggr->count;
+            bytes += aggr->bytes;
+        }
+    }
+    lcheap_ctx_free(&ctx);
+
+    if (fclose(fp) != 0 || !ok) {
+        remove(path);
+        return luaL_error(L, ok ? "Failed to write the heap snapshot." : "Failed to alloc memory.");
+    }
+    lua_pushinteger(L, count);
+    lua_pushinteger(L, bytes);
+    return 2;
+}
@@ -4,9 +4,11 @@
 // you may not use this file except in compliance with the License.
 // See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
 
+#include <math.h>
 #include <lauxlib.h>
 #include <pal/chip.h>
 
+#include "lc.h"
 #include "app_int.h"
 
 typedef enum {
@@ -36,12 +38,54 @@ static int lchip_get_info(lua_State *L) {
     return 1;
 }
 
-static const luaL_Reg lchip_funcs[] = {
-    {"getInfo", lchip_get_info},
-    {NULL, NULL},
+static void lchip_set_integer_field(lua_State *L, const char *k, lua_Integer v) {
+    if (v >= 0) {
+        lua_pushinteger(L, v);
+        lua_setfield(L, -2, k);
+    }
+}
+
+static void lchip_set_number_field(lua_State *L, const char *k, lua_Number v) {
+    if (!isnan(v)) {
+        lua_pushnumber(L, v);
+        lua_setfield(L, -2, k);
+    }
+}
+
+static int lchip_get_resource_usage(lua_State *L) {
+    pal_chip_resource_usage usage;
+    if (!pal_chip_get_resource_usage(&usage)) {
+        luaL_pushfail(L);
+        return 1;
+    }
+
+    lua_createtable(L, 0, 9);
+    lchip_set_integer_field(L, "cpuUser", usage.cpu_user_ms);
+    lchip_set_integer_field(L, "cpuSys", usage.cpu_sys_ms);
+    lchip_set_integer_field(L, "cpuUsage", usage.cpu_usage);
+    lchip_set_integer_field(L, "rss", usage.rss);
+    lchip_set_integer_field(L, "heapUsed", usage.heap_used);
+    lchip_set_integer_field(L, "fds", usage.fds);
+    lchip_set_integer_field(L, "ncpus", usage.ncpus);
+    if (usage.loadavg[0] >= 0) {
+        lua_createtable(L, 3, 0);
+        for (int i = 0; i < 3; i++) {
+            lua_pushnumber(L, usage.loadavg[i]);
+            lua_rawseti(L, -2, i + 1);
+        }
+        lua_setfield(L, -2, "loadavg");
+    }
+    lchip_set_number_field(L, "temp", usage.temp);
+    return 1;
+}
+
+static const lc_rotable_kv lchip_funcs[] = {
+    LC_ROFUNC("getInfo", lchip_get_info),
+    LC_ROFUNC("getResourceUsage", lchip_get_resource_usage),
+    LC_ROEND,
 };
 
 LUAMOD_API int luaopen_chip(lua_State *L) {
-    luaL_newlib(L, lchip_funcs);
+    lc_push_rotable(L, lchip_funcs);
     return 1;
 }
@@ -7,6 +7,8 @@
 #include <lauxlib.h>
 #include <pal/crypto/cipher.h>
 
+#include "lc.h"
+
 #define LCIPHER_CTX_NAME "CipherContext*"
 
 #define LCIPHER_GET_CTX(L, idx) \
@@ -225,9 +227,9 @@ static const luaL_Reg lcipher_ctx_meth[] = {
     {NULL, NULL},
 };
 
-static const luaL_Reg lcipher_funcs[] = {
-    {"create", lcipher_create},
-    {NULL, NULL}
+static const lc_rotable_kv lcipher_funcs[] = {
+    LC_ROFUNC("create", lcipher_create),
+    LC_ROEND,
 };
 
 static void lcipher_createmeta(lua_State *L) {
@@ -240,7 +242,7 @@ static void lcipher_createmeta(lua_State *L) {
 }
 
 LUAMOD_API int luaopen_cipher(lua_State *L) {
-    luaL_newlib(L, lcipher_funcs); /* new module */
+    lc_push_rotable(L, lcipher_funcs);
     lcipher_createmeta(L);
     return 1;
 }
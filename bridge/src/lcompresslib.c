@@ -0,0 +1,232 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#include <pal/compress.h>
+#include <lauxlib.h>
+#include <HAPBase.h>
+#include "lc.h"
+#include "app_int.h"
+
+#define LUA_COMPRESS_STREAM_NAME "CompressStream*"
+
+typedef struct {
+    pal_compress_ctx *ctx;
+    pal_compress_mode mode;
+    size_t total;   /* length of the output */
+    size_t maxsize; /* max length of the output, 0 means unlimited */
+} lcompress_stream;
+
+static const char *lcompress_format_strs[] = {
+    "raw",
+    "zlib",
+    "gzip",
+    NULL,
+};
+
+static lcompress_stream *lcompress_stream_new(lua_State *L, pal_compress_mode mode,
+    pal_compress_format format, int level, size_t maxsize) {
+    lcompress_stream *stream = lua_newuserdata(L, sizeof(*stream));
+    stream->ctx = NULL;
+    luaL_setmetatable(L, LUA_COMPRESS_STREAM_NAME);
+    stream->ctx = pal_compress_create(mode, format, level);
+    if (!stream->ctx) {
+        luaL_error(L, "failed to create %s stream", mode == PAL_COMPRESS_DEFLATE ? "deflate" : "inflate");
+    }
+    stream->mode = mode;
+    stream->total = 0;
+    stream->maxsize = maxsize;
+    return stream;
+}
+
+static int lcompress_check_level(lua_State *L, int arg) {
+    lua_Integer level = luaL_optinteger(L, arg, PAL_COMPRESS_LEVEL_DEFAULT);
+    luaL_argcheck(L, level == PAL_COMPRESS_LEVEL_DEFAULT || (level >= 0 && level <= 9), arg,
+        "level out of range");
+    return level;
+}
+
+static size_t lcompress_check_maxsize(lua_State *L, int arg) {
+    lua_Integer maxsize = luaL_optinteger(L, arg, 0);
+    luaL_argcheck(L, maxsize >= 0, arg, "maxsize out of range");
+    return maxsize;
+}
+
+/*
+ * Feed the input to the stream and push the output string.
+ */
+static void lcompress_stream_common(lua_State *L, lcompress_stream *stream,
+    const void *in, size_t ilen, bool finish) {
+    char out[512];
+    luaL_Buffer B;
+    luaL_buffinit(L, &B);
+    while (1) {
+        size_t olen = sizeof(out);
+        pal_compress_err err = pal_compress_update(stream->ctx, in, ilen, out, &olen, finish);
+        stream->total += olen;
+        if (stream->maxsize && stream->total > stream->maxsize) {
+            luaL_error(L, "output exceeds %d bytes", (int)stream->maxsize);
+        }
+        switch (err) {
+        case PAL_COMPRESS_ERR_OK:
+            luaL_addlstring(&B, out, olen);
+            luaL_pushresult(&B);
+            return;
+        case PAL_COMPRESS_ERR_AGAIN:
+            in = NULL;
+            ilen = 0;
+            luaL_addlstring(&B, out, olen);
+            break;
+        case PAL_COMPRESS_ERR_DATA:
+            luaL_error(L, "invalid compressed data");
+            break;
+        default:
+            luaL_error(L, "failed to %s", stream->mode == PAL_COMPRESS_DEFLATE ? "deflate" : "inflate");
+        }
+    }
+}
+
+static lcompress_stream *lcompress_check_stream(lua_State *L, int arg) {
+    lcompress_stream *stream = luaL_checkudata(L, arg, LUA_COMPRESS_STREAM_NAME);
+    if (!stream->ctx) {
+        luaL_error(L, "attempt to use a closed stream");
+    }
+    return stream;
+}
+
+static int lcompress_deflate(lua_State *L) {
+    size_t ilen;
+    const char *in = luaL_checklstring(L, 1, &ilen);
+    int level = lcompress_check_level(L, 2);
+    pal_compress_format format = luaL_checkoption(L, 3, "zlib", lcompress_format_strs);
+    lcompress_stream *stream = lcompress_stream_new(L, PAL_COMPRESS_DEFLATE, format, level, 0);
+    lcompress_stream_common(L, stream, in, ilen, true);
+    pal_compress_free(stream->ctx);
+    stream->ctx = NULL;
+    return 1;
+}
+
+static int lcompress_inflate(lua_State *L) {
+    size_t ilen;
+    const char *in = luaL_checklstring(L, 1, &ilen);
+    pal_compress_format format = luaL_checkoption(L, 2, "zlib", lcompress_format_strs);
+    size_t maxsize = lcompress_check_maxsize(L, 3);
+    lcompress_stream *stream = lcompress_stream_new(L, PAL_COMPRESS_INFLATE, format, 0, maxsize);
+    lcompress_stream_common(L, stream, in, ilen, true);
+    if (!pal_compress_finished(stream->ctx)) {
+        luaL_error(L, "truncated compressed data");
+    }
+    pal_compress_free(stream->ctx);
+    stream->ctx = NULL;
+    return 1;
+}
+
+static int lcompress_deflater(lua_State *L) {
+    pal_compress_format format = luaL_checkoption(L, 1, "zlib", lcompress_format_strs);
+    int level = lcompress_check_level(L, 2);
+    lcompress_stream_new(L, PAL_COMPRESS_DEFLATE, format, level, 0);
+    return 1;
+}
+
+static int lcompress_inflater(lua_State *L) {
+    pal_compress_format format = luaL_checkoption(L, 1, "zlib", lcompress_format_strs);
+    size_t maxsize = lcompress_check_maxsize(L, 2);
+    lcompress_stream_new(L, PAL_COMPRESS_INFLATE, format, 0, maxsize);
+    return 1;
+}
+
+static int lcompress_stream_update(lua_State *L) {
+    lcompress_stream *stream = lcompress_check_stream(L, 1);
+    size_t ilen;
+    const char *in = luaL_checklstring(L, 2, &ilen);
+    lcompress_stream_common(L, stream, in, ilen, false);
+    return 1;
+}
+
+static int lcompress_stream_finish(lua_State *L) {
+    lcompress_stream *stream = lcompress_check_stream(L, 1);
+    size_t ilen = 0;
+    const char *in = "";
+    if (!lua_isnoneornil(L, 2)) {
+        in = luaL_checklstring(L, 2, &ilen);
+    }
+    lcompress_stream_common(L, stream, in, ilen, true);
+    if (stream->mode == PAL_COMPRESS_INFLATE && !pal_compress_finished(stream->ctx)) {
+        luaL_error(L, "truncated compressed data");
+    }
+    pal_compress_free(stream->ctx);
+    stream->ctx = NULL;
+    return 1;
+}
+
+static int lcompress_stream_finished(lua_State *L) {
+    lcompress_stream *stream = luaL_checkudata(L, 1, LUA_COMPRESS_STREAM_NAME);
+    lua_pushboolean(L, !stream->ctx || pal_compress_finished(stream->ctx));
+    return 1;
+}
+
+static int lcompress_stream_gc(lua_State *L) {
+    lcompress_stream *stream = luaL_checkudata(L, 1, LUA_COMPRESS_STREAM_NAME);
+    if (stream->ctx) {
+        pal_compress_free(stream->ctx);
+        stream->ctx = NULL;
+    }
+    return 0;
+}
+
+static int lcompress_stream_tostring(lua_State *L) {
+    lcompress_stream *stream = luaL_checkudata(L, 1, LUA_COMPRESS_STREAM_NAME);
+    const char *name = stream->mode == PAL_COMPRESS_DEFLATE ? "deflate" : "inflate";
+    if (stream->ctx) {
+        lua_pushfstring(L, "%s stream (%p)", name, stream->ctx);
+    } else {
+        lua_pushfstring(L, "%s stream (closed)", name);
+    }
+    return 1;
+}
+
+static const lc_rotable_kv lcompress_funcs[] = {
+    LC_ROFUNC("deflate", lcompress_deflate),
+    LC_ROFUNC("deflater", lcompress_deflater),
+    LC_ROFUNC("inflate", lcompress_inflate),
+    LC_ROFUNC("inflater", lcompress_inflater),
+    LC_ROEND,
+};
+
+/*
+ * metamethods for compression stream
+ */
+static const luaL_Reg lcompress_stream_metameth[] = {
+    {"__index", NULL},  /* place holder */
+    {"__gc", lcompress_stream_gc},
+    {"__close", lcompress_stream_gc},
+    {"__tostring", lcompress_stream_tostring},
+    {NULL, NULL}
+};
+
+/*
+ * methods for compression stream
+ */
+static const luaL_Reg lcompress_stream_meth[] = {
+    {"update", lcompress_stream_update},
+    {"finish", lcompress_stream_finish},
+    {"finished", lcompress_stream_finished},
+    {NULL, NULL},
+};
+
+static void lcompress_createmeta(lua_State *L) {
+    luaL_newmetatable(L, LUA_COMPRESS_STREAM_NAME);  /* metatable for compression stream */
+    luaL_setfuncs(L, lcompress_stream_metameth, 0);  /* add metamethods to new metatable */
+    luaL_newlibtable(L, lcompress_stream_meth);  /* create method table */
+    luaL_setfuncs(L, lcompress_stream_meth, 0);  /* add stream methods to method table */
+    lua_setfield(L, -2, "__index");  /* metatable.__index = method table */
+    lua_pop(L, 1);  /* pop metatable */
+}
+
+LUAMOD_API int luaopen_compress(lua_State *L) {
+    lc_push_rotable(L, lcompress_funcs);
+    lcompress_createmeta(L);
+    return 1;
+}
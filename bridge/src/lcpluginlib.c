@@ -0,0 +1,166 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <lauxlib.h>
+#include <pal/memory.h>
+#include <HAPLog.h>
+#include <plugin.h>
+
+#include "lc.h"
+#include "app_int.h"
+
+#if defined(__linux__)
+#include <dlfcn.h>
+#define LCPLUGIN_SUPPORTED 1
+#else
+#define LCPLUGIN_SUPPORTED 0
+#endif
+
+static const HAPLogObject lcplugin_log = {
+    .subsystem = APP_BRIDGE_LOG_SUBSYSTEM,
+    .category = "lcplugin",
+};
+
+static const char *lcplugin_server_state_strs[] = {
+    "Idle",
+    "Running",
+    "Stopping",
+    NULL,
+};
+
+/**
+ * Loaded native plugin.
+ */
+typedef struct lcplugin_node {
+    void *handle;
+    const bridge_plugin *plugin;
+    struct lcplugin_node *next;
+} lcplugin_node;
+
+static lcplugin_node *gv_lcplugin_head;
+
+static void lcplugin_log_(HAPLogType type, const char *plugin, const char *format, ...) {
+    char buf[256];
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(buf, sizeof(buf), format, ap);
+    va_end(ap);
+    HAPLogWithType(&lcplugin_log, type, "%s: %s", plugin, buf);
+}
+
+static const bridge_plugin_api lcplugin_api = {
+    .abi_version = BRIDGE_PLUGIN_ABI_VERSION,
+    .add_bridged_accessory = lhap_add_native_bridged_accessory,
+    .get_new_bridged_aid = lhap_new_bridged_aid,
+    .get_new_iid = lhap_new_iid,
+    .raise_event = lhap_raise_native_event,
+    .accessory_information_service = &accessoryInformationService,
+    .get_service_type = lhap_get_service_type,
+    .get_characteristic_type = lhap_get_characteristic_type,
+    .log = lcplugin_log_,
+    .clock_get_current = HAPPlatformClockGetCurrent,
+    .timer_register = HAPPlatformTimerRegister,
+    .timer_deregister = HAPPlatformTimerDeregister,
+    .file_handle_register = HAPPlatformFileHandleRegister,
+    .file_handle_update_interests = HAPPlatformFileHandleUpdateInterests,
+    .file_handle_deregister = HAPPlatformFileHandleDeregister,
+};
+
+/* handleState(state: HapServerState) */
+static int lcplugin_handle_state(lua_State *L) {
+    const bridge_plugin *plugin = lua_touserdata(L, lua_upvalueindex(1));
+    HAPAccessoryServerState state = luaL_checkoption(L, 1, NULL, lcplugin_server_state_strs);
+    if (plugin->handle_state) {
+        plugin->handle_state(state);
+    }
+    return 0;
+}
+
+#if LCPLUGIN_SUPPORTED
+/* load(path: string, conf: string) -> Plugin */
+static int lcplugin_load(lua_State *L) {
+    const char *path = luaL_checkstring(L, 1);
+    const char *conf = luaL_optstring(L, 2, "{}");
+
+    // The plugin must not leak symbols into the following plugins.
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        luaL_error(L, "Failed to load native plugin: %s", dlerror());
+    }
+
+    const bridge_plugin *plugin = dlsym(handle, BRIDGE_PLUGIN_SYMBOL);
+    if (!plugin) {
+        dlclose(handle);
+        luaL_error(L, "No symbol '%s' in native plugin '%s'.", BRIDGE_PLUGIN_SYMBOL, path);
+    }
+    if (plugin->abi_version != BRIDGE_PLUGIN_ABI_VERSION) {
+        dlclose(handle);
+        luaL_error(L, "Native plugin '%s' is built for ABI version %d, expected %d.",
+            path, plugin->abi_version, BRIDGE_PLUGIN_ABI_VERSION);
+    }
+    if (!plugin->name || !plugin->init) {
+        dlclose(handle);
+        luaL_error(L, "Invalid native plugin '%s'.", path);
+    }
+
+    lcplugin_node *node = pal_mem_alloc(sizeof(*node));
+    if (!node) {
+        dlclose(handle);
+        luaL_error(L, "Failed to alloc memory.");
+    }
+
+    // Accessories added by a failed init() remain referenced by HAP,
+    // so the plugin is kept loaded in any case.
+    node->handle = handle;
+    node->plugin = plugin;
+    node->next = gv_lcplugin_head;
+    gv_lcplugin_head = node;
+
+    if (!plugin->init(&lcplugin_api, conf)) {
+        luaL_error(L, "Failed to initialize native plugin '%s'.", plugin->name);
+    }
+    HAPLogInfo(&lcplugin_log, "Native plugin '%s' loaded from %s.", plugin->name, path);
+
+    lua_createtable(L, 0, 2);
+    lua_pushstring(L, plugin->name);
+    lua_setfield(L, -2, "name");
+    lua_pushlightuserdata(L, (void *)plugin);
+    lua_pushcclosure(L, lcplugin_handle_state, 1);
+    lua_setfield(L, -2, "handleState");
+    return 1;
+}
+#else
+static int lcplugin_load(lua_State *L) {
+    return luaL_error(L, "Native plugins are not supported on this platform.");
+}
+#endif
+
+void lcplugin_deinit(void) {
+    while (gv_lcplugin_head) {
+        lcplugin_node *node = gv_lcplugin_head;
+        gv_lcplugin_head = node->next;
+        if (node->plugin->deinit) {
+            node->plugin->deinit();
+        }
+#if LCPLUGIN_SUPPORTED
+        dlclose(node->handle);
+#endif
+        pal_mem_free(node);
+    }
+}
+
+static const lc_rotable_kv lcplugin_funcs[] = {
+    LC_ROFUNC("load", lcplugin_load),
+    LC_ROBOOL("supported", LCPLUGIN_SUPPORTED),
+    LC_ROEND,
+};
+
+LUAMOD_API int luaopen_cplugin(lua_State *L) {
+    lc_push_rotable(L, lcplugin_funcs);
+    return 1;
+}
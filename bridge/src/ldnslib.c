@@ -57,12 +57,12 @@ static int ldns_resolve(lua_State *L) {
     return lua_yieldk(L, 0, 0, finshresolve);
 }
 
-static const luaL_Reg ldns_funcs[] = {
-    {"resolve", ldns_resolve},
-    {NULL, NULL},
+static const lc_rotable_kv ldns_funcs[] = {
+    LC_ROFUNC("resolve", ldns_resolve),
+    LC_ROEND,
 };
 
 LUAMOD_API int luaopen_dns(lua_State *L) {
-    luaL_newlib(L, ldns_funcs);
+    lc_push_rotable(L, ldns_funcs);
     return 1;
 }
@@ -4,10 +4,17 @@
 // you may not use this file except in compliance with the License.
 // See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
 #include <lualib.h>
 #include <lauxlib.h>
 #include <pal/hap.h>
 #include <pal/memory.h>
+#include <pal/nvs.h>
+#include <pal/slot.h>
+#include <pal/trace.h>
 #include <HAP.h>
 #include <HAPCharacteristic.h>
 #include <HAPAccessorySetup.h>
@@ -460,14 +467,15 @@ static const char *lhap_accessory_category_strs[] = {
     "ShowerSystems"
 };
 
-static const char *lhap_error_strs[] = {
-    "None",
-    "Unknown",
-    "InvalidState",
-    "InvalidData",
-    "OutOfResources",
-    "NotAuthorized",
-    "Busy",
+static const lc_rotable_kv lhap_error_kvs[] = {
+    LC_ROINT("Busy", kHAPError_Busy),
+    LC_ROINT("InvalidData", kHAPError_InvalidData),
+    LC_ROINT("InvalidState", kHAPError_InvalidState),
+    LC_ROINT("None", kHAPError_None),
+    LC_ROINT("NotAuthorized", kHAPError_NotAuthorized),
+    LC_ROINT("OutOfResources", kHAPError_OutOfResources),
+    LC_ROINT("Unknown", kHAPError_Unknown),
+    LC_ROEND,
 };
 
 static const char *lhap_characteristic_format_strs[] = {
@@ -511,6 +519,18 @@ static const size_t lhap_characteristic_struct_size[] = {
     sizeof(HAPTLV8Characteristic),
 };
 
+/**
+ * Flags of a characteristic created from lua, stored after its structure.
+ */
+typedef struct {
+    bool slot:1;            /* Backed by a slot. */
+} lhap_char_flags;
+
+static lhap_char_flags *lhap_char_get_flags(const HAPBaseCharacteristic *characteristic) {
+    return (lhap_char_flags *)((const uint8_t *)characteristic +
+        lhap_characteristic_struct_size[characteristic->format]);
+}
+
 // Lua light userdata.
 typedef struct {
     const char *name;
@@ -722,9 +742,31 @@ static const struct {
     [kHAPCharacteristicFormat_Int] = {INT32_MIN, INT32_MAX},
 };
 
+/**
+ * Node of the dependency graph, a characteristic derived from others.
+ */
+typedef struct {
+    const HAPAccessory *accessory;
+    const HAPService *service;
+    const HAPCharacteristic *characteristic;
+    bool pending;           /* Its event is to be raised at the end of the tick. */
+} lhap_dep_node;
+
+/**
+ * Edge of the dependency graph, from a characteristic to a node derived from it.
+ */
+typedef struct {
+    uint64_t aid;
+    uint64_t iid;           /* Instance ID of the source characteristic. */
+    size_t node;            /* Index of the derived node. */
+} lhap_dep_edge;
+
 typedef struct {
     bool inited:1;
     bool is_started:1;
+    bool ids_opened:1;
+    bool ids_used_lost:1;   /* Failed to record a requested key, do not prune. */
+    bool dep_flush_scheduled:1;
 
     size_t attribute_cnt;
     size_t bridged_aid;
@@ -733,11 +775,27 @@ typedef struct {
     HAPAccessory **bridged_accs;
     size_t bridged_accs_max;
     size_t bridged_accs_cnt;
+    const HAPAccessory **native_accs;   /* Owned by native plugins, not freed by lhap. */
+    size_t native_accs_cnt;
 
     HAPPlatform *platform;
     HAPAccessoryServerRef server;
     HAPAccessoryServerOptions server_options;
     HAPAccessoryServerCallbacks server_cbs;
+
+    pal_slot_region *slots;
+    pal_nvs_handle *ids;    /* Persisted ID mapping. */
+    uint64_t *ids_used;     /* NVS keys requested since init, (type << 56) | hash. */
+    size_t ids_used_cnt;
+    size_t ids_used_max;
+    char write_ctxs;        /* Registry key of the write coroutine to context table. */
+
+    lhap_dep_node *dep_nodes;   /* Characteristics derived from others. */
+    size_t dep_nodes_cnt;
+    lhap_dep_edge *dep_edges;   /* Sorted by the source characteristic. */
+    size_t dep_edges_cnt;
+    size_t *dep_pending;        /* Nodes whose events are to be raised. */
+    size_t dep_pending_cnt;
 } lhap_desc;
 
 static lhap_desc gv_lhap_desc = {
@@ -749,6 +807,36 @@ static lhap_desc gv_lhap_desc = {
     }
 };
 
+#if BRIDGE_TEST_HOOKS
+#define LHAP_TEST_SESSIONS_MAX 4
+#define LHAP_TEST_EVENTS_MAX 64
+
+/**
+ * Event recorded by the test hooks.
+ */
+typedef struct {
+    uint64_t aid;
+    uint64_t iid;
+    size_t session;         /* Index of the session, starting from 1. */
+} lhap_test_event;
+
+/**
+ * Test hooks descriptor.
+ *
+ * The server is not started in the tests, the events are recorded for the
+ * fake sessions instead of being sent to the controllers.
+ */
+typedef struct {
+    bool started;
+    size_t sessions_cnt;
+    HAPSessionRef sessions[LHAP_TEST_SESSIONS_MAX];
+    lhap_test_event events[LHAP_TEST_EVENTS_MAX];
+    size_t events_cnt;
+} lhap_test_desc;
+
+static lhap_test_desc gv_lhap_test_desc;
+#endif
+
 static void lhap_rawsetp_reset(lua_State *L, int idx, const void *p) {
     lua_pushnil(L);
     lua_rawsetp(L, idx, p);
@@ -895,19 +983,24 @@ lhap_service_iid_cb(lua_State *L, const lc_table_kv *kv, void *arg) {
     return true;
 }
 
-static bool
-lhap_service_type_cb(lua_State *L, const lc_table_kv *kv, void *arg) {
-    HAPService *service = arg;
-    const char *str = lua_tostring(L, -1);
+const HAPUUID *lhap_get_service_type(const char *name, const char **debug_description) {
     for (int i = 0; i < HAPArrayCount(lhap_service_type_tab);
         i++) {
-        if (HAPStringAreEqual(str, lhap_service_type_tab[i].name)) {
-            service->serviceType = lhap_service_type_tab[i].type;
-            service->debugDescription = lhap_service_type_tab[i].debugDescription;
-            return true;
+        if (HAPStringAreEqual(name, lhap_service_type_tab[i].name)) {
+            if (debug_description) {
+                *debug_description = lhap_service_type_tab[i].debugDescription;
+            }
+            return lhap_service_type_tab[i].type;
         }
     }
-    return false;
+    return NULL;
+}
+
+static bool
+lhap_service_type_cb(lua_State *L, const lc_table_kv *kv, void *arg) {
+    HAPService *service = arg;
+    service->serviceType = lhap_get_service_type(lua_tostring(L, -1), &service->debugDescription);
+    return service->serviceType != NULL;
 }
 
 static bool
@@ -965,20 +1058,28 @@ lhap_characteristic_iid_cb(lua_State *L, const lc_table_kv *kv, void *arg) {
     return true;
 }
 
-static bool
-lhap_characteristic_type_cb(lua_State *L, const lc_table_kv *kv, void *arg) {
-    HAPBaseCharacteristic *c = arg;
-    const char *str = lua_tostring(L, -1);
+const HAPUUID *lhap_get_characteristic_type(const char *name, const char **debug_description) {
     for (int i = 0; i < HAPArrayCount(lhap_characteristic_type_tab);
         i++) {
-        if (HAPStringAreEqual(str, lhap_characteristic_type_tab[i].name)) {
-            c->characteristicType = lhap_characteristic_type_tab[i].type;
-            c->debugDescription = lhap_characteristic_type_tab[i].debugDescription;
-            return true;
+        if (HAPStringAreEqual(name, lhap_characteristic_type_tab[i].name)) {
+            if (debug_description) {
+                *debug_description = lhap_characteristic_type_tab[i].debugDescription;
+            }
+            return lhap_characteristic_type_tab[i].type;
         }
     }
-    HAPLogError(&lhap_log, "%s: error type.", __func__);
-    return false;
+    return NULL;
+}
+
+static bool
+lhap_characteristic_type_cb(lua_State *L, const lc_table_kv *kv, void *arg) {
+    HAPBaseCharacteristic *c = arg;
+    c->characteristicType = lhap_get_characteristic_type(lua_tostring(L, -1), &c->debugDescription);
+    if (!c->characteristicType) {
+        HAPLogError(&lhap_log, "%s: error type.", __func__);
+        return false;
+    }
+    return true;
 }
 
 static bool
@@ -1476,6 +1577,8 @@ int finsh_call_handle_read(lua_State *L, int status, lua_KContext _ctx) {
     if (ctx->in_progress == false) {
         return 2;
     }
+    PAL_TRACE4(hap__read__done, ctx->accessory->aid, ((HAPBaseCharacteristic *)ctx->characteristic)->iid,
+        err, ctx->session);
     switch (((HAPBaseCharacteristic *)ctx->characteristic)->format) {
     case kHAPCharacteristicFormat_Bool:
         err = HAPBoolCharacteristicResponseReadRequest(ctx->server, ctx->transportType,
@@ -1539,6 +1642,45 @@ static int lhap_char_call_handle_read(lua_State *L) {
     return finsh_call_handle_read(L, lua_pcallk(L, 2, 2, 2, call_ctx, finsh_call_handle_read), call_ctx);
 }
 
+// Push the value of the slot of the characteristic.
+static bool lhap_char_push_slot_value(
+        lua_State *L,
+        const HAPAccessory *accessory,
+        const HAPBaseCharacteristic *characteristic) {
+    pal_slot_value v;
+    if (!lhap_char_get_flags(characteristic)->slot || !gv_lhap_desc.slots ||
+        !pal_slot_read(gv_lhap_desc.slots, accessory->aid, characteristic->iid, &v)) {
+        return false;
+    }
+
+    switch (characteristic->format) {
+    case kHAPCharacteristicFormat_Bool:
+        lua_pushboolean(L, v.b);
+        break;
+    case kHAPCharacteristicFormat_UInt8:
+    case kHAPCharacteristicFormat_UInt16:
+    case kHAPCharacteristicFormat_UInt32:
+    case kHAPCharacteristicFormat_UInt64:
+    case kHAPCharacteristicFormat_Int:
+        lua_pushinteger(L, v.i);
+        break;
+    case kHAPCharacteristicFormat_Float:
+        lua_pushnumber(L, v.f);
+        break;
+    case kHAPCharacteristicFormat_Data:
+    case kHAPCharacteristicFormat_String:
+        if (v.len > sizeof(v.s)) {
+            HAPLogError(&lhap_log, "%s: Invalid length of the slot value.", __func__);
+            return false;
+        }
+        lua_pushlstring(L, v.s, v.len);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
 static HAP_RESULT_USE_CHECK
 HAPError lhap_char_base_handleRead(
         lua_State *L,
@@ -1549,6 +1691,22 @@ HAPError lhap_char_base_handleRead(
         const HAPService *service,
         const HAPBaseCharacteristic *characteristic,
         const void *pfunc) {
+    PAL_TRACE3(hap__read__start, accessory->aid, characteristic->iid, session);
+
+    // Serve the value written by an external process without calling lua.
+    if (lhap_char_push_slot_value(L, accessory, characteristic)) {
+        lua_pushinteger(L, kHAPError_None);
+        PAL_TRACE4(hap__read__done, accessory->aid, characteristic->iid, kHAPError_None, session);
+        return kHAPError_None;
+    }
+
+    // The characteristic is only backed by a slot which has not been written yet.
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, pfunc) != LUA_TFUNCTION) {
+        PAL_TRACE4(hap__read__done, accessory->aid, characteristic->iid, kHAPError_Busy, session);
+        return kHAPError_Busy;
+    }
+    lua_pop(L, 1);
+
     HAPError err = kHAPError_Unknown;
     lua_State *co = lua_newthread(L);
     lua_pushcfunction(co, lhap_char_call_handle_read);
@@ -1582,13 +1740,13 @@ HAPError lhap_char_base_handleRead(
         break;
     case LUA_YIELD:
         call_ctx->in_progress = true;
-        err = kHAPError_InProgress;
-        break;
+        return kHAPError_InProgress;
     default:
         HAPLogError(&lhap_log, "%s: %s", __func__, lua_tostring(L, -1));
         break;
     }
 
+    PAL_TRACE4(hap__read__done, accessory->aid, characteristic->iid, err, session);
     return err;
 }
 
@@ -1778,6 +1936,47 @@ end:
     return err;
 }
 
+// Bind the write context at the top of "co" to "co", so that the events raised
+// from the write handler know the originating session.
+static void lhap_bind_write_ctx(lua_State *L, lua_State *co) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &gv_lhap_desc.write_ctxs);
+    lua_pushthread(co);
+    lua_xmove(co, L, 1);
+    lua_pushvalue(co, -1);
+    lua_xmove(co, L, 1);
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+}
+
+static void lhap_unbind_write_ctx(lua_State *L, lua_State *co) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &gv_lhap_desc.write_ctxs);
+    lua_pushthread(co);
+    lua_xmove(co, L, 1);
+    lua_pushnil(L);
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+}
+
+// Get the context of the write being handled by the running coroutine.
+static lhap_call_context *lhap_get_write_ctx(lua_State *L) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &gv_lhap_desc.write_ctxs);
+    lua_pushthread(L);
+    lua_rawget(L, -2);
+    lhap_call_context *ctx = lua_touserdata(L, -1);
+    lua_pop(L, 2);
+    return ctx;
+}
+
+// Get the session writing the characteristic in the running coroutine, the writer
+// already knows the value and is not notified of it.
+static HAPSessionRef *lhap_get_writer_session(lua_State *L, const HAPCharacteristic *characteristic) {
+    lhap_call_context *ctx = lhap_get_write_ctx(L);
+    if (ctx && ctx->characteristic == characteristic && ctx->transportType == kHAPTransportType_IP) {
+        return ctx->session;
+    }
+    return NULL;
+}
+
 int finsh_call_handle_write(lua_State *L, int status, lua_KContext _ctx) {
     lhap_call_context *ctx = (lhap_call_context *)_ctx;
     if (status != LUA_OK && status != LUA_YIELD) {
@@ -1791,6 +1990,9 @@ int finsh_call_handle_write(lua_State *L, int status, lua_KContext _ctx) {
         return 1;
     }
     HAPError err = lua_tointeger(L, -1);
+    lhap_unbind_write_ctx(L, L);
+    PAL_TRACE4(hap__write__done, ctx->accessory->aid, ((HAPBaseCharacteristic *)ctx->characteristic)->iid,
+        err, ctx->session);
     err = HAPCharacteristicResponseWriteRequest(ctx->server, ctx->transportType,
         ctx->session, ctx->accessory, ctx->service, ctx->characteristic, err);
     if (err != kHAPError_None) {
@@ -1815,6 +2017,8 @@ static lua_State *lhap_char_base_handleWrite(
         const HAPService *service,
         const HAPBaseCharacteristic *characteristic,
         const void *pfunc) {
+    PAL_TRACE3(hap__write__start, accessory->aid, characteristic->iid, session);
+
     lua_State *co = lua_newthread(L);
     lua_pushcfunction(co, lhap_char_call_handle_write);
     lhap_call_context *call_ctx = lua_newuserdata(co, sizeof(*call_ctx));
@@ -1825,6 +2029,7 @@ static lua_State *lhap_char_base_handleWrite(
     call_ctx->accessory = accessory;
     call_ctx->service = service;
     call_ctx->characteristic = characteristic;
+    lhap_bind_write_ctx(L, co);
 
     lc_push_traceback(co);
     HAPAssert(lua_rawgetp(co, LUA_REGISTRYINDEX, pfunc) == LUA_TFUNCTION);
@@ -1860,6 +2065,12 @@ HAPError lhap_char_last_handleWrite(lua_State *L,
         HAPLogError(&lhap_log, "%s: %s", __func__, lua_tostring(L, -1));
         break;
     }
+    if (status != LUA_YIELD) {
+        lhap_unbind_write_ctx(L, co);
+        PAL_TRACE4(hap__write__done, accessory->aid,
+            ((const HAPBaseCharacteristic *)call_ctx->characteristic)->iid,
+            err, call_ctx->session);
+    }
 
     lua_settop(L, 0);
     lc_collectgarbage(L);
@@ -2081,6 +2292,380 @@ lhap_characteristic_cbs_cb(lua_State *L, const lc_table_kv *kv, void *arg) {
     return lc_traverse_table(L, -1, lhap_characteristic_cbs_kvs, arg);
 }
 
+static bool
+lhap_characteristic_derived_from_cb(lua_State *L, const lc_table_kv *kv, void *arg) {
+    lua_Unsigned len = lua_rawlen(L, -1);
+    for (lua_Unsigned i = 1; i <= len; i++) {
+        bool valid = lua_rawgeti(L, -1, i) == LUA_TNUMBER && lua_isinteger(L, -1);
+        lua_pop(L, 1);
+        if (!valid) {
+            HAPLogError(&lhap_log, "%s: Invalid instance ID.", __func__);
+            return false;
+        }
+    }
+
+    // The graph is built from it when the server starts.
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, arg);
+    return true;
+}
+
+static bool
+lhap_characteristic_slot_cb(lua_State *L, const lc_table_kv *kv, void *arg) {
+    if (!lua_toboolean(L, -1)) {
+        return true;
+    }
+
+    // The read callback serves the slot value and falls back to "cbs.read".
+#define LHAP_CASE_CHAR_SET_SLOT_READ_CB(format) \
+    LHAP_CASE_CHAR_FORMAT_CODE(format, arg, \
+        p->callbacks.handleRead = lhap_char_ ## format ## _handleRead)
+
+    switch (((HAPBaseCharacteristic *)arg)->format) {
+        LHAP_CASE_CHAR_SET_SLOT_READ_CB(Data)
+        LHAP_CASE_CHAR_SET_SLOT_READ_CB(Bool)
+        LHAP_CASE_CHAR_SET_SLOT_READ_CB(UInt8)
+        LHAP_CASE_CHAR_SET_SLOT_READ_CB(UInt16)
+        LHAP_CASE_CHAR_SET_SLOT_READ_CB(UInt32)
+        LHAP_CASE_CHAR_SET_SLOT_READ_CB(UInt64)
+        LHAP_CASE_CHAR_SET_SLOT_READ_CB(Int)
+        LHAP_CASE_CHAR_SET_SLOT_READ_CB(Float)
+        LHAP_CASE_CHAR_SET_SLOT_READ_CB(String)
+    default:
+        HAPLogError(&lhap_log, "%s: %s characteristic can not be backed by a slot.",
+            __func__, lhap_characteristic_format_strs[((HAPBaseCharacteristic *)arg)->format]);
+        return false;
+    }
+
+#undef LHAP_CASE_CHAR_SET_SLOT_READ_CB
+
+    lhap_char_get_flags(arg)->slot = true;
+    return true;
+}
+
+/**
+ * Entry of the value map of a binding.
+ */
+typedef struct {
+    int type;               /* Type of the property value. */
+    const char *s;          /* String property value, kept alive by the keys table. */
+    size_t len;
+    lua_Number n;           /* Number or boolean property value. */
+    lua_Number cval;        /* Characteristic value. */
+    int key;                /* Index of the property value in the keys table. */
+} lhap_binding_entry;
+
+/**
+ * Property binding of a characteristic.
+ *
+ * Compiled from "binding" of the characteristic, the read and write handlers
+ * map the property of the accessory context with sorted lookup tables.
+ *
+ * The user value 1 is the property name and 2 is the keys table.
+ */
+typedef struct {
+    HAPCharacteristicFormat format;
+    lua_Number scale;
+    lua_Number offset;
+    bool has_default;
+    lua_Number dflt;
+    bool event;
+    size_t cnt;
+    lhap_binding_entry *by_prop;    /* Sorted by property value. */
+    lhap_binding_entry *by_cval;    /* Sorted by characteristic value. */
+    lhap_binding_entry entries[];
+} lhap_binding;
+
+static int lhap_binding_cmp_prop(const void *a, const void *b) {
+    const lhap_binding_entry *x = a;
+    const lhap_binding_entry *y = b;
+    if (x->type != y->type) {
+        return x->type < y->type ? -1 : 1;
+    }
+    if (x->type == LUA_TSTRING) {
+        if (x->len != y->len) {
+            return x->len < y->len ? -1 : 1;
+        }
+        return memcmp(x->s, y->s, x->len);
+    }
+    return x->n < y->n ? -1 : (x->n > y->n ? 1 : 0);
+}
+
+static int lhap_binding_cmp_cval(const void *a, const void *b) {
+    const lhap_binding_entry *x = a;
+    const lhap_binding_entry *y = b;
+    return x->cval < y->cval ? -1 : (x->cval > y->cval ? 1 : 0);
+}
+
+// Convert the value at idx to the key of a map entry.
+static bool lhap_binding_to_entry(lua_State *L, int idx, lhap_binding_entry *e) {
+    e->type = lua_type(L, idx);
+    switch (e->type) {
+    case LUA_TSTRING:
+        e->s = lua_tolstring(L, idx, &e->len);
+        return true;
+    case LUA_TNUMBER:
+        e->n = lua_tonumber(L, idx);
+        return true;
+    case LUA_TBOOLEAN:
+        e->n = lua_toboolean(L, idx);
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void lhap_binding_push_cval(lua_State *L, const lhap_binding *b, lua_Number cval) {
+    switch (b->format) {
+    case kHAPCharacteristicFormat_Bool:
+        lua_pushboolean(L, cval != 0);
+        break;
+    case kHAPCharacteristicFormat_Float:
+        lua_pushnumber(L, cval);
+        break;
+    default:
+        lua_pushinteger(L, (lua_Integer)(cval < 0 ? cval - 0.5 : cval + 0.5));
+        break;
+    }
+}
+
+static int lhap_binding_finish_read(lua_State *L, int status, lua_KContext ctx) {
+    const lhap_binding *b = lua_touserdata(L, lua_upvalueindex(1));
+    HAPError err = kHAPError_None;
+
+    if (b->cnt) {
+        lhap_binding_entry key;
+        const lhap_binding_entry *e = NULL;
+        if (lhap_binding_to_entry(L, -1, &key)) {
+            e = bsearch(&key, b->by_prop, b->cnt, sizeof(key), lhap_binding_cmp_prop);
+        }
+        if (e) {
+            lhap_binding_push_cval(L, b, e->cval);
+        } else if (b->has_default) {
+            lhap_binding_push_cval(L, b, b->dflt);
+        } else {
+            HAPLogError(&lhap_log, "%s: Unmapped property value.", __func__);
+            lua_pushnil(L);
+            err = kHAPError_InvalidData;
+        }
+    } else if (b->format == kHAPCharacteristicFormat_Bool) {
+        lua_pushboolean(L, lua_toboolean(L, -1));
+    } else {
+        int isnum;
+        lua_Number n = lua_tonumberx(L, -1, &isnum);
+        if (isnum) {
+            lhap_binding_push_cval(L, b, n * b->scale + b->offset);
+        } else {
+            HAPLogError(&lhap_log, "%s: Property value is not a number.", __func__);
+            lua_pushnil(L);
+            err = kHAPError_InvalidData;
+        }
+    }
+    lua_pushinteger(L, err);
+    return 2;
+}
+
+/* read(request, context) -> value, err */
+static int lhap_binding_read(lua_State *L) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_getfield(L, 2, "getProp");
+    lua_pushvalue(L, 2);
+    lua_getiuservalue(L, lua_upvalueindex(1), 1);
+    lua_callk(L, 2, 1, 0, lhap_binding_finish_read);
+    return lhap_binding_finish_read(L, LUA_OK, 0);
+}
+
+static bool lhap_raise_event_by_iid(lhap_desc *desc, lua_State *_Nullable L,
+    uint64_t aid, uint64_t sid, uint64_t cid);
+
+static int lhap_binding_finish_write(lua_State *L, int status, lua_KContext ctx) {
+    const lhap_binding *b = lua_touserdata(L, lua_upvalueindex(1));
+    lhap_desc *desc = &gv_lhap_desc;
+    if (b->event && desc->is_started) {
+        // 1: request
+        lua_getfield(L, 1, "aid");
+        lua_getfield(L, 1, "sid");
+        lua_getfield(L, 1, "cid");
+        lhap_raise_event_by_iid(desc, L, lua_tointeger(L, -3), lua_tointeger(L, -2), lua_tointeger(L, -1));
+    }
+    lua_pushinteger(L, kHAPError_None);
+    return 1;
+}
+
+/* write(request, value, context) -> err */
+static int lhap_binding_write(lua_State *L) {
+    const lhap_binding *b = lua_touserdata(L, lua_upvalueindex(1));
+    luaL_checktype(L, 3, LUA_TTABLE);
+    lua_getfield(L, 3, "setProp");
+    lua_pushvalue(L, 3);
+    lua_getiuservalue(L, lua_upvalueindex(1), 1);
+
+    lua_Number cval = b->format == kHAPCharacteristicFormat_Bool ? lua_toboolean(L, 2) : lua_tonumber(L, 2);
+    if (b->cnt) {
+        lhap_binding_entry key = { .cval = cval };
+        const lhap_binding_entry *e = bsearch(&key, b->by_cval, b->cnt, sizeof(key), lhap_binding_cmp_cval);
+        if (!e) {
+            HAPLogError(&lhap_log, "%s: Unmapped characteristic value.", __func__);
+            lua_settop(L, 0);
+            lua_pushinteger(L, kHAPError_InvalidData);
+            return 1;
+        }
+        lua_getiuservalue(L, lua_upvalueindex(1), 2);
+        lua_rawgeti(L, -1, e->key);
+        lua_remove(L, -2);
+    } else if (b->format == kHAPCharacteristicFormat_Bool) {
+        lua_pushboolean(L, cval != 0);
+    } else {
+        lua_Number n = (cval - b->offset) / b->scale;
+        lua_Integer i;
+        if (lua_numbertointeger(n, &i) && (lua_Number)i == n) {
+            lua_pushinteger(L, i);
+        } else {
+            lua_pushnumber(L, n);
+        }
+    }
+    lua_callk(L, 2, 0, 0, lhap_binding_finish_write);
+    return lhap_binding_finish_write(L, LUA_OK, 0);
+}
+
+static lua_Number lhap_binding_opt_number(lua_State *L, int idx, const char *k, lua_Number def) {
+    lua_getfield(L, idx, k);
+    lua_Number n = luaL_optnumber(L, -1, def);
+    lua_pop(L, 1);
+    return n;
+}
+
+/* compile(binding) -> read, write */
+static int lhap_binding_compile(lua_State *L) {
+    HAPCharacteristicFormat format = lua_tointeger(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+
+    lua_getfield(L, 2, "prop");
+    luaL_argexpected(L, lua_type(L, -1) == LUA_TSTRING, 2, "string \"prop\"");
+    int prop = lua_gettop(L);
+
+    lua_Integer cnt = 0;
+    int map = 0;
+    if (lua_getfield(L, 2, "map") == LUA_TTABLE) {
+        map = lua_gettop(L);
+        for (lua_pushnil(L); lua_next(L, map); lua_pop(L, 1)) {
+            cnt++;
+        }
+    } else {
+        luaL_argexpected(L, lua_isnil(L, -1), 2, "table \"map\"");
+    }
+
+    lhap_binding *b = lua_newuserdatauv(L, sizeof(*b) + cnt * 2 * sizeof(lhap_binding_entry), 2);
+    int ud = lua_gettop(L);
+    b->format = format;
+    b->scale = lhap_binding_opt_number(L, 2, "scale", 1);
+    b->offset = lhap_binding_opt_number(L, 2, "offset", 0);
+    luaL_argcheck(L, b->scale != 0, 2, "\"scale\" must not be 0");
+    lua_getfield(L, 2, "default");
+    b->has_default = !lua_isnil(L, -1);
+    b->dflt = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : lua_tonumber(L, -1);
+    lua_pop(L, 1);
+    lua_getfield(L, 2, "event");
+    b->event = lua_isnil(L, -1) || lua_toboolean(L, -1);
+    lua_pop(L, 1);
+    b->cnt = cnt;
+    b->by_prop = b->entries;
+    b->by_cval = b->entries + cnt;
+
+    lua_pushvalue(L, prop);
+    lua_setiuservalue(L, ud, 1);
+
+    if (map) {
+        lua_createtable(L, cnt, 0);
+        int keys = lua_gettop(L);
+        int i = 0;
+        for (lua_pushnil(L); lua_next(L, map); lua_pop(L, 1)) {
+            lhap_binding_entry *e = b->by_prop + i;
+            luaL_argcheck(L, lhap_binding_to_entry(L, -2, e), 2, "invalid key type of \"map\"");
+            luaL_argcheck(L, lua_isnumber(L, -1) || lua_isboolean(L, -1), 2, "invalid value type of \"map\"");
+            e->cval = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : lua_tonumber(L, -1);
+            e->key = ++i;
+            lua_pushvalue(L, -2);
+            lua_rawseti(L, keys, i);
+        }
+        lua_pushvalue(L, keys);
+        lua_setiuservalue(L, ud, 2);
+
+        qsort(b->by_prop, cnt, sizeof(lhap_binding_entry), lhap_binding_cmp_prop);
+        HAPRawBufferCopyBytes(b->by_cval, b->by_prop, cnt * sizeof(lhap_binding_entry));
+        qsort(b->by_cval, cnt, sizeof(lhap_binding_entry), lhap_binding_cmp_cval);
+        for (lua_Integer j = 1; j < cnt; j++) {
+            luaL_argcheck(L, b->by_cval[j - 1].cval != b->by_cval[j].cval, 2,
+                "duplicate characteristic value in \"map\"");
+        }
+    }
+
+    lua_pushvalue(L, ud);
+    lua_pushcclosure(L, lhap_binding_read, 1);
+    lua_pushvalue(L, ud);
+    lua_pushcclosure(L, lhap_binding_write, 1);
+    return 2;
+}
+
+// Compile "binding" of the characteristic at the top of the stack into the read and write handlers,
+// the write handler is only installed if the characteristic is writable.
+static bool lhap_characteristic_compile_binding(lua_State *L, HAPCharacteristic *c) {
+    HAPCharacteristicFormat format = ((HAPBaseCharacteristic *)c)->format;
+    bool writable = ((HAPBaseCharacteristic *)c)->properties.writable;
+    if (lua_getfield(L, -1, "binding") == LUA_TNIL) {
+        lua_pop(L, 1);
+        return true;
+    }
+
+    lua_pushcfunction(L, lhap_binding_compile);
+    lua_pushinteger(L, format);
+    lua_pushvalue(L, -3);
+    if (lua_pcall(L, 2, 2, 0) != LUA_OK) {
+        HAPLogError(&lhap_log, "%s: %s", __func__, lua_tostring(L, -1));
+        lua_pop(L, 2);
+        return false;
+    }
+
+#define LHAP_CASE_CHAR_SET_BINDING_CBS(format) \
+    LHAP_CASE_CHAR_FORMAT_CODE(format, c, \
+        int conflict = lua_rawgetp(L, LUA_REGISTRYINDEX, &p->callbacks.handleRead) != LUA_TNIL; \
+        conflict |= lua_rawgetp(L, LUA_REGISTRYINDEX, &p->callbacks.handleWrite) != LUA_TNIL; \
+        if (conflict) { \
+            HAPLogError(&lhap_log, "%s: \"binding\" conflicts with \"cbs\".", __func__); \
+            lua_pop(L, 5); \
+            return false; \
+        } \
+        lua_pop(L, 2); \
+        if (writable) { \
+            lua_rawsetp(L, LUA_REGISTRYINDEX, &p->callbacks.handleWrite); \
+            p->callbacks.handleWrite = lhap_char_ ## format ## _handleWrite; \
+        } else { \
+            lua_pop(L, 1); \
+        } \
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &p->callbacks.handleRead); \
+        p->callbacks.handleRead = lhap_char_ ## format ## _handleRead)
+
+    switch (format) {
+    LHAP_CASE_CHAR_SET_BINDING_CBS(Bool)
+    LHAP_CASE_CHAR_SET_BINDING_CBS(UInt8)
+    LHAP_CASE_CHAR_SET_BINDING_CBS(UInt16)
+    LHAP_CASE_CHAR_SET_BINDING_CBS(UInt32)
+    LHAP_CASE_CHAR_SET_BINDING_CBS(UInt64)
+    LHAP_CASE_CHAR_SET_BINDING_CBS(Int)
+    LHAP_CASE_CHAR_SET_BINDING_CBS(Float)
+    default:
+        HAPLogError(&lhap_log, "%s: %s characteristic can not be bound to a property.",
+            __func__, lhap_characteristic_format_strs[format]);
+        lua_pop(L, 3);
+        return false;
+    }
+
+#undef LHAP_CASE_CHAR_SET_BINDING_CBS
+
+    lua_pop(L, 1);
+    return true;
+}
+
 static const lc_table_kv lhap_characteristic_kvs[] = {
     {"format", LC_TSTRING, NULL},
     {"iid", LC_TNUMBER, lhap_characteristic_iid_cb},
@@ -2090,6 +2675,9 @@ static const lc_table_kv lhap_characteristic_kvs[] = {
     {"units", LC_TSTRING, lhap_characteristic_units_cb},
     {"constraints", LC_TTABLE, lhap_characteristic_constraints_cb},
     {"cbs", LC_TTABLE, lhap_characteristic_cbs_cb},
+    {"slot", LC_TBOOLEAN, lhap_characteristic_slot_cb},
+    {"binding", LC_TTABLE, NULL},
+    {"derivedFrom", LC_TTABLE, lhap_characteristic_derived_from_cb},
     {NULL, LC_TNONE, NULL},
 };
 
@@ -2115,14 +2703,15 @@ static bool lhap_service_characteristics_arr_cb(lua_State *L, size_t i, void *ar
         return false;
     }
 
-    HAPCharacteristic *c = pal_mem_calloc(lhap_characteristic_struct_size[format]);
+    HAPCharacteristic *c = pal_mem_calloc(lhap_characteristic_struct_size[format] + sizeof(lhap_char_flags));
     if (!c) {
         HAPLogError(&lhap_log, "%s: Failed to alloc memory.", __func__);
         return false;
     }
     ((HAPBaseCharacteristic *)c)->format = format;
     characteristics[i] = c;
-    if (!lc_traverse_table(L, -1, lhap_characteristic_kvs, c)) {
+    if (!lc_traverse_table(L, -1, lhap_characteristic_kvs, c) ||
+        !lhap_characteristic_compile_binding(L, c)) {
         HAPLogError(&lhap_log, "%s: Failed to parse characteristic.", __func__);
         return false;
     }
@@ -2133,6 +2722,7 @@ static void lhap_reset_characteristic(lua_State *L, HAPCharacteristic *character
     HAPCharacteristicFormat format =
         ((HAPBaseCharacteristic *)characteristic)->format;
     lhap_safe_free(((HAPBaseCharacteristic *)characteristic)->manufacturerDescription);
+    lhap_rawsetp_reset(L, LUA_REGISTRYINDEX, characteristic);
 
 #define LHAP_RESET_CHAR_CBS(type, ptr) \
     LHAP_CASE_CHAR_FORMAT_CODE(type, ptr, \
@@ -2401,6 +2991,10 @@ static void lhap_server_handle_update_state(HAPAccessoryServerRef *server, void
     lhap_desc *desc = context;
     lua_State *L = app_get_lua_main_thread();
 
+    if (HAPAccessoryServerGetState(server) == kHAPAccessoryServerState_Running) {
+        app_mem_set_phase(HAPAccessoryServerIsPaired(server) ? APP_MEM_PHASE_STEADY : APP_MEM_PHASE_PAIRING);
+    }
+
     HAPAssert(lua_gettop(L) == 0);
     lc_push_traceback(L);
     HAPAssert(lua_rawgetp(L, LUA_REGISTRYINDEX, &desc->server_cbs.handleUpdatedState) == LUA_TFUNCTION);
@@ -2423,6 +3017,11 @@ static void lhap_server_handle_session_accept(
     lhap_desc *desc = context;
     lua_State *L = app_get_lua_main_thread();
 
+    // Pairing finishes in a session, the sessions after it are steady state.
+    if (HAPAccessoryServerIsPaired(server)) {
+        app_mem_set_phase(APP_MEM_PHASE_STEADY);
+    }
+
     HAPAssert(lua_gettop(L) == 0);
     lc_push_traceback(L);
     HAPAssert(lua_rawgetp(L, LUA_REGISTRYINDEX, &desc->server_cbs.handleSessionAccept) == LUA_TFUNCTION);
@@ -2578,6 +3177,31 @@ err:
     return 0;
 }
 
+static bool lhap_accessory_is_native(lhap_desc *desc, const HAPAccessory *accessory) {
+    for (size_t i = 0; i < desc->native_accs_cnt; i++) {
+        if (desc->native_accs[i] == accessory) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Make room for one more bridged accessory and the NULL terminator.
+static bool lhap_reserve_bridged_accessory(lhap_desc *desc) {
+    if (desc->bridged_accs_max - desc->bridged_accs_cnt > 1) {
+        return true;
+    }
+    size_t max = desc->bridged_accs_cnt ? desc->bridged_accs_cnt * 2 : 2;
+    HAPAccessory **accs = pal_mem_realloc(desc->bridged_accs, sizeof(HAPAccessory *) * max);
+    if (!accs) {
+        return false;
+    }
+    accs[desc->bridged_accs_cnt] = NULL;
+    desc->bridged_accs = accs;
+    desc->bridged_accs_max = max;
+    return true;
+}
+
 /* deinit() */
 int lhap_deinit(lua_State *L) {
     lhap_desc *desc = &gv_lhap_desc;
@@ -2592,20 +3216,39 @@ int lhap_deinit(lua_State *L) {
 
     lhap_reset_server_cb(L, &desc->server_cbs);
 
+    if (desc->slots) {
+        pal_slot_region_destroy(desc->slots);
+        desc->slots = NULL;
+    }
+
     HAPRawBufferZero(&desc->server, sizeof(desc->server));
     HAPRawBufferZero(&desc->server_cbs, sizeof(desc->server_cbs));
 
     if (desc->bridged_accs) {
         for (HAPAccessory **pa = desc->bridged_accs; *pa != NULL; pa++) {
+            if (lhap_accessory_is_native(desc, *pa)) {
+                continue;
+            }
             lhap_reset_accessory(L, *pa);
             pal_mem_free(*pa);
         }
         lhap_safe_free(desc->bridged_accs);
     }
+    lhap_safe_free(desc->native_accs);
+    desc->native_accs_cnt = 0;
     if (desc->primary_acc) {
         lhap_reset_accessory(L, desc->primary_acc);
         lhap_safe_free(desc->primary_acc);
     }
+    if (desc->ids) {
+        pal_nvs_close(desc->ids);
+        desc->ids = NULL;
+    }
+    desc->ids_opened = false;
+    lhap_safe_free(desc->ids_used);
+    desc->ids_used_cnt = 0;
+    desc->ids_used_max = 0;
+    desc->ids_used_lost = false;
     desc->attribute_cnt = LHAP_ATTR_CNT_DFT;
     desc->bridged_aid = 1;
     desc->iid = LHAP_ATTR_CNT_DFT + 1;
@@ -2629,14 +3272,8 @@ static int lhap_add_bridged_accessory(lua_State *L) {
 
     luaL_checktype(L, 1, LUA_TTABLE);
 
-    if (desc->bridged_accs_max - desc->bridged_accs_cnt <= 1) {
-        desc->bridged_accs_max = desc->bridged_accs_cnt ? desc->bridged_accs_cnt * 2 : 2;
-        HAPAccessory **accs = pal_mem_realloc(desc->bridged_accs, sizeof(HAPAccessory *) * desc->bridged_accs_max);
-        if (!accs) {
-            luaL_error(L, "Failed to alloc memory.");
-        }
-        accs[desc->bridged_accs_cnt] = NULL;
-        desc->bridged_accs = accs;
+    if (!lhap_reserve_bridged_accessory(desc)) {
+        luaL_error(L, "Failed to alloc memory.");
     }
 
     HAPAccessory *acc = pal_mem_calloc(sizeof(HAPAccessory));
@@ -2661,6 +3298,294 @@ static int lhap_add_bridged_accessory(lua_State *L) {
     return 0;
 }
 
+HAPError lhap_add_native_bridged_accessory(const HAPAccessory *accessory) {
+    HAPPrecondition(accessory);
+    lhap_desc *desc = &gv_lhap_desc;
+
+    if (!desc->inited || desc->is_started) {
+        HAPLogError(&lhap_log, "%s: HAP is not initialized or already started.", __func__);
+        return kHAPError_InvalidState;
+    }
+    if (!HAPBridgedAccessoryIsValid(accessory)) {
+        HAPLogError(&lhap_log, "%s: Invalid bridged accessory.", __func__);
+        return kHAPError_InvalidData;
+    }
+
+    const HAPAccessory **native = pal_mem_realloc(desc->native_accs,
+        sizeof(HAPAccessory *) * (desc->native_accs_cnt + 1));
+    if (!native) {
+        return kHAPError_OutOfResources;
+    }
+    desc->native_accs = native;
+    if (!lhap_reserve_bridged_accessory(desc)) {
+        return kHAPError_OutOfResources;
+    }
+    desc->native_accs[desc->native_accs_cnt++] = accessory;
+    desc->bridged_accs[desc->bridged_accs_cnt++] = (HAPAccessory *)accessory;
+    desc->bridged_accs[desc->bridged_accs_cnt] = NULL;
+
+    if (accessory->services) {
+        for (const HAPService * const *ps = accessory->services; *ps; ps++) {
+            desc->attribute_cnt++;
+            if ((*ps)->characteristics) {
+                for (const void * const *pc = (*ps)->characteristics; *pc; pc++) {
+                    desc->attribute_cnt++;
+                }
+            }
+        }
+    }
+
+    HAPLog(&lhap_log, "Native bridged accessory \"%s\" has been configured.", accessory->name);
+    return kHAPError_None;
+}
+
+static bool lhap_accessory_has_characteristic(const HAPAccessory *a, uint64_t iid) {
+    if (!a->services) {
+        return false;
+    }
+    for (HAPService **ps = (HAPService **)a->services; *ps; ps++) {
+        if (!(*ps)->characteristics) {
+            continue;
+        }
+        for (HAPCharacteristic **pc = (HAPCharacteristic **)(*ps)->characteristics; *pc; pc++) {
+            if ((*(HAPBaseCharacteristic **)pc)->iid == iid) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static int lhap_dep_edge_cmp(const void *a, const void *b) {
+    const lhap_dep_edge *x = a;
+    const lhap_dep_edge *y = b;
+    if (x->aid != y->aid) {
+        return x->aid < y->aid ? -1 : 1;
+    }
+    return x->iid < y->iid ? -1 : (x->iid > y->iid ? 1 : 0);
+}
+
+// Add the characteristics of the accessory with "derivedFrom" to the graph,
+// only count the nodes and edges if the graph is not allocated.
+static bool lhap_dep_add_accessory(lua_State *L, lhap_desc *desc, const HAPAccessory *a,
+    size_t *nodes_cnt, size_t *edges_cnt) {
+    if (!a->services) {
+        return true;
+    }
+    for (HAPService **ps = (HAPService **)a->services; *ps; ps++) {
+        if (!(*ps)->characteristics) {
+            continue;
+        }
+        for (HAPCharacteristic **pc = (HAPCharacteristic **)(*ps)->characteristics; *pc; pc++) {
+            if (lua_rawgetp(L, LUA_REGISTRYINDEX, *pc) != LUA_TTABLE) {
+                lua_pop(L, 1);
+                continue;
+            }
+            lua_Unsigned len = lua_rawlen(L, -1);
+            if (desc->dep_nodes) {
+                lhap_dep_node *node = desc->dep_nodes + *nodes_cnt;
+                node->accessory = a;
+                node->service = *ps;
+                node->characteristic = *pc;
+                node->pending = false;
+                for (lua_Unsigned i = 1; i <= len; i++) {
+                    lua_rawgeti(L, -1, i);
+                    uint64_t iid = lua_tointeger(L, -1);
+                    lua_pop(L, 1);
+                    if (!lhap_accessory_has_characteristic(a, iid)) {
+                        HAPLogError(&lhap_log,
+                            "%s: Characteristic %llu.%llu is derived from unknown characteristic %llu.",
+                            __func__, (unsigned long long)a->aid,
+                            (unsigned long long)(*(HAPBaseCharacteristic **)pc)->iid, (unsigned long long)iid);
+                        lua_pop(L, 1);
+                        return false;
+                    }
+                    desc->dep_edges[*edges_cnt + i - 1] = (lhap_dep_edge) {
+                        .aid = a->aid,
+                        .iid = iid,
+                        .node = *nodes_cnt,
+                    };
+                }
+            }
+            (*nodes_cnt)++;
+            *edges_cnt += len;
+            lua_pop(L, 1);
+        }
+    }
+    return true;
+}
+
+static void lhap_dep_free(lhap_desc *desc) {
+    lhap_safe_free(desc->dep_nodes);
+    lhap_safe_free(desc->dep_edges);
+    lhap_safe_free(desc->dep_pending);
+    desc->dep_nodes_cnt = 0;
+    desc->dep_edges_cnt = 0;
+    desc->dep_pending_cnt = 0;
+}
+
+// Build the dependency graph from "derivedFrom" of the characteristics.
+static bool lhap_dep_build(lua_State *L, lhap_desc *desc) {
+    size_t nodes_cnt = 0;
+    size_t edges_cnt = 0;
+
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            if (nodes_cnt == 0) {
+                return true;
+            }
+            desc->dep_nodes = pal_mem_calloc(nodes_cnt * sizeof(lhap_dep_node));
+            desc->dep_edges = pal_mem_calloc((edges_cnt ? edges_cnt : 1) * sizeof(lhap_dep_edge));
+            desc->dep_pending = pal_mem_calloc(nodes_cnt * sizeof(size_t));
+            if (!desc->dep_nodes || !desc->dep_edges || !desc->dep_pending) {
+                HAPLogError(&lhap_log, "%s: Failed to alloc memory.", __func__);
+                goto err;
+            }
+            nodes_cnt = 0;
+            edges_cnt = 0;
+        }
+        if (!lhap_dep_add_accessory(L, desc, desc->primary_acc, &nodes_cnt, &edges_cnt)) {
+            goto err;
+        }
+        if (desc->bridged_accs) {
+            for (HAPAccessory **pa = desc->bridged_accs; *pa != NULL; pa++) {
+                if (lhap_accessory_is_native(desc, *pa)) {
+                    continue;
+                }
+                if (!lhap_dep_add_accessory(L, desc, *pa, &nodes_cnt, &edges_cnt)) {
+                    goto err;
+                }
+            }
+        }
+    }
+
+    desc->dep_nodes_cnt = nodes_cnt;
+    desc->dep_edges_cnt = edges_cnt;
+    qsort(desc->dep_edges, edges_cnt, sizeof(lhap_dep_edge), lhap_dep_edge_cmp);
+    return true;
+
+err:
+    lhap_dep_free(desc);
+    return false;
+}
+
+typedef struct {
+    const HAPCharacteristic *characteristic;
+    const HAPService *service;
+    const HAPAccessory *accessory;
+    HAPSessionRef *skipped;
+} lhap_event_fanout;
+
+static void lhap_raise_event_on_other_session(
+        void *_Nullable context,
+        HAPAccessoryServerRef *server,
+        HAPSessionRef *session,
+        bool *shouldContinue) {
+    lhap_event_fanout *fanout = context;
+    if (session != fanout->skipped) {
+        HAPAccessoryServerRaiseEventOnSession(server, fanout->characteristic,
+            fanout->service, fanout->accessory, session);
+    }
+}
+
+#if BRIDGE_TEST_HOOKS
+static void lhap_test_record_event(const HAPAccessory *a, const HAPCharacteristic *c, size_t session) {
+    lhap_test_desc *test = &gv_lhap_test_desc;
+    if (test->events_cnt == HAPArrayCount(test->events)) {
+        HAPLogError(&lhap_log, "%s: Too many events.", __func__);
+        return;
+    }
+    test->events[test->events_cnt++] = (lhap_test_event) {
+        .aid = a->aid,
+        .iid = ((const HAPBaseCharacteristic *)c)->iid,
+        .session = session,
+    };
+}
+#endif
+
+// Raise the event on "session", or on all the sessions but "skipped" if "session" is NULL.
+static void lhap_server_raise_event(lhap_desc *desc, const HAPCharacteristic *c, const HAPService *s,
+    const HAPAccessory *a, HAPSessionRef *_Nullable session, HAPSessionRef *_Nullable skipped) {
+#if BRIDGE_TEST_HOOKS
+    lhap_test_desc *test = &gv_lhap_test_desc;
+    if (test->started) {
+        for (size_t i = 0; i < test->sessions_cnt; i++) {
+            HAPSessionRef *ts = test->sessions + i;
+            if (session ? ts == session : ts != skipped) {
+                lhap_test_record_event(a, c, i + 1);
+            }
+        }
+        return;
+    }
+#endif
+    if (session) {
+        HAPAccessoryServerRaiseEventOnSession(&desc->server, c, s, a, session);
+    } else if (skipped) {
+        // Sessions not subscribed to the characteristic are skipped by the server
+        // without encoding the event.
+        lhap_event_fanout fanout = {
+            .characteristic = c,
+            .service = s,
+            .accessory = a,
+            .skipped = skipped,
+        };
+        HAPAccessoryServerEnumerateConnectedSessions(&desc->server,
+            lhap_raise_event_on_other_session, &fanout);
+    } else {
+        HAPAccessoryServerRaiseEvent(&desc->server, c, s, a);
+    }
+}
+
+static void lhap_dep_flush(void *_Nullable context, size_t contextSize) {
+    lhap_desc *desc = &gv_lhap_desc;
+
+    desc->dep_flush_scheduled = false;
+    for (size_t i = 0; i < desc->dep_pending_cnt; i++) {
+        lhap_dep_node *node = desc->dep_nodes + desc->dep_pending[i];
+        node->pending = false;
+        if (desc->is_started) {
+            lhap_server_raise_event(desc, node->characteristic, node->service, node->accessory, NULL, NULL);
+        }
+    }
+    desc->dep_pending_cnt = 0;
+}
+
+// Mark the characteristics derived from the characteristic "aid.iid", and the
+// ones derived from them. Each of their events is raised once at the end of the tick.
+static void lhap_dep_mark(lhap_desc *desc, uint64_t aid, uint64_t iid) {
+    const lhap_dep_edge key = { .aid = aid, .iid = iid };
+    size_t lo = 0;
+    size_t hi = desc->dep_edges_cnt;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (lhap_dep_edge_cmp(desc->dep_edges + mid, &key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (; lo < desc->dep_edges_cnt && lhap_dep_edge_cmp(desc->dep_edges + lo, &key) == 0; lo++) {
+        size_t idx = desc->dep_edges[lo].node;
+        lhap_dep_node *node = desc->dep_nodes + idx;
+        if (node->pending) {
+            continue;
+        }
+        node->pending = true;
+        desc->dep_pending[desc->dep_pending_cnt++] = idx;
+        lhap_dep_mark(desc, aid, ((const HAPBaseCharacteristic *)node->characteristic)->iid);
+    }
+
+    if (desc->dep_pending_cnt && !desc->dep_flush_scheduled) {
+        if (HAPPlatformRunLoopScheduleCallback(lhap_dep_flush, NULL, 0) == kHAPError_None) {
+            desc->dep_flush_scheduled = true;
+        } else {
+            HAPLogError(&lhap_log, "%s: Failed to schedule the derived events, raise them now.", __func__);
+            lhap_dep_flush(NULL, 0);
+        }
+    }
+}
+
 /* start(confChanged: boolean) */
 static int lhap_start(lua_State *L) {
     lhap_desc *desc = &gv_lhap_desc;
@@ -2687,6 +3612,10 @@ static int lhap_start(lua_State *L) {
         desc->bridged_accs_max = max;
     }
 
+    if (!lhap_dep_build(L, desc)) {
+        luaL_error(L, "Failed to build the characteristic dependency graph.");
+    }
+
 #if IP
     size_t readable_cnt = 0;
     size_t writable_cnt = 0;
@@ -2754,12 +3683,20 @@ static int lhap_stop(lua_State *L) {
         luaL_error(L, "HAP is not started.");
     }
 
+#if BRIDGE_TEST_HOOKS
+    if (gv_lhap_test_desc.started) {
+        luaL_error(L, "HAP is started by the test hooks.");
+    }
+#endif
+
     // Stop accessory server.
     HAPAccessoryServerStop(&desc->server);
 
     // Release accessory server.
     HAPAccessoryServerRelease(&desc->server);
 
+    lhap_dep_free(desc);
+
 #if IP
     pal_hap_deinit_ip(&desc->server_options);
 #endif
@@ -2774,7 +3711,10 @@ static int lhap_stop(lua_State *L) {
 }
 
 /**
- * raiseEvent(accessoryIID:integer, serviceIID:integer, characteristicIID:integer)
+ * raiseEvent(accessoryIID:integer, serviceIID:integer, characteristicIID:integer, session?:lightuserdata)
+ *
+ * An event of the characteristic being written, raised from its write handler,
+ * is not sent back to the controller that wrote it.
  */
 static int lhap_raise_event(lua_State *L) {
     lua_Integer iid;
@@ -2844,56 +3784,607 @@ service:
     }
 
     if (session) {
-        HAPAccessoryServerRaiseEventOnSession(&desc->server, c, s, a, session);
-    } else {
-        HAPAccessoryServerRaiseEvent(&desc->server, c, s, a);
+        lhap_server_raise_event(desc, c, s, a, session, NULL);
+        return 0;
+    }
+
+    lhap_server_raise_event(desc, c, s, a, NULL, lhap_get_writer_session(L, c));
+    lhap_dep_mark(desc, a->aid, iid);
+
+    return 0;
+}
+
+// Find the characteristic by the instance IDs, "sid" 0 matches any service.
+static const HAPCharacteristic *lhap_find_characteristic(lhap_desc *desc, uint64_t aid, uint64_t sid,
+    uint64_t cid, const HAPAccessory **accessory, const HAPService **service) {
+    HAPAccessory *a = NULL;
+    if (desc->primary_acc->aid == aid) {
+        a = desc->primary_acc;
+    } else if (desc->bridged_accs) {
+        for (HAPAccessory **pa = desc->bridged_accs; *pa != NULL; pa++) {
+            if ((*pa)->aid == aid) {
+                a = *pa;
+                break;
+            }
+        }
+    }
+    if (!a || !a->services) {
+        return NULL;
+    }
+
+    for (HAPService **ps = (HAPService **)a->services; *ps; ps++) {
+        if ((sid && (*ps)->iid != sid) || !(*ps)->characteristics) {
+            continue;
+        }
+        for (HAPCharacteristic **pc = (HAPCharacteristic **)(*ps)->characteristics; *pc; pc++) {
+            if ((*(HAPBaseCharacteristic **)pc)->iid == cid) {
+                *accessory = a;
+                *service = *ps;
+                return *pc;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Raise an event for the characteristic, "sid" 0 matches any service.
+// If raised from the write handler of the characteristic running in "L",
+// the session that wrote it is skipped.
+static bool lhap_raise_event_by_iid(lhap_desc *desc, lua_State *_Nullable L,
+    uint64_t aid, uint64_t sid, uint64_t cid) {
+    const HAPAccessory *a;
+    const HAPService *s;
+    const HAPCharacteristic *c = lhap_find_characteristic(desc, aid, sid, cid, &a, &s);
+    if (!c) {
+        return false;
+    }
+    lhap_server_raise_event(desc, c, s, a, NULL, L ? lhap_get_writer_session(L, c) : NULL);
+    lhap_dep_mark(desc, aid, cid);
+    return true;
+}
+
+bool lhap_raise_native_event(uint64_t aid, uint64_t sid, uint64_t cid) {
+    lhap_desc *desc = &gv_lhap_desc;
+
+    if (!desc->is_started) {
+        return false;
+    }
+    return lhap_raise_event_by_iid(desc, NULL, aid, sid, cid);
+}
+
+static void lhap_slot_changed_cb(pal_slot_region *region, uint64_t aid, uint64_t iid, void *arg) {
+    lhap_desc *desc = arg;
+
+    if (!desc->is_started) {
+        return;
+    }
+    const HAPAccessory *a;
+    const HAPService *s;
+    const HAPCharacteristic *c = lhap_find_characteristic(desc, aid, 0, iid, &a, &s);
+    if (!c || lhap_accessory_is_native(desc, a) || !lhap_char_get_flags(c)->slot) {
+        HAPLogError(&lhap_log, "%s: Characteristic %llu.%llu of the slot not found.",
+            __func__, (unsigned long long)aid, (unsigned long long)iid);
+        return;
+    }
+    lhap_server_raise_event(desc, c, s, a, NULL, NULL);
+    lhap_dep_mark(desc, aid, iid);
+}
+
+// Find a characteristic backed by a slot whose ID does not fit in the 32-bit half of the slot key.
+static const HAPCharacteristic *lhap_accessory_find_bad_slot(const HAPAccessory *a) {
+    if (!a || !a->services) {
+        return NULL;
+    }
+    for (HAPService **ps = (HAPService **)a->services; *ps; ps++) {
+        if (!(*ps)->characteristics) {
+            continue;
+        }
+        for (HAPCharacteristic **pc = (HAPCharacteristic **)(*ps)->characteristics; *pc; pc++) {
+            if (lhap_char_get_flags(*pc)->slot &&
+                (a->aid > UINT32_MAX || ((HAPBaseCharacteristic *)*pc)->iid > UINT32_MAX)) {
+                return *pc;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * openSlots(name: string, nslots: integer)
+ */
+static int lhap_open_slots(lua_State *L) {
+    lhap_desc *desc = &gv_lhap_desc;
+
+    if (!desc->inited) {
+        luaL_error(L, "HAP is not initialized.");
+    }
+
+    if (desc->slots) {
+        luaL_error(L, "Slots are already opened.");
     }
 
+    const char *name = luaL_checkstring(L, 1);
+    lua_Integer nslots = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, nslots > 0 && nslots <= UINT32_MAX, 2, "out of range");
+
+    // The slots are keyed by (aid << 32) | iid.
+    const HAPAccessory *a = desc->primary_acc;
+    const HAPCharacteristic *c = lhap_accessory_find_bad_slot(a);
+    for (HAPAccessory **pa = desc->bridged_accs; !c && pa && *pa; pa++) {
+        if (!lhap_accessory_is_native(desc, *pa)) {
+            a = *pa;
+            c = lhap_accessory_find_bad_slot(a);
+        }
+    }
+    if (c) {
+        luaL_error(L, "Characteristic %I.%I backed by a slot has an ID out of 32 bits.",
+            (lua_Integer)a->aid, (lua_Integer)((HAPBaseCharacteristic *)c)->iid);
+    }
+
+    desc->slots = pal_slot_region_create(name, nslots, lhap_slot_changed_cb, desc);
+    if (!desc->slots) {
+        luaL_error(L, "Failed to open slots.");
+    }
     return 0;
 }
 
+#define LHAP_IDS_NAMESPACE "hap_ids"
+#define LHAP_IDS_NEXT_AID "next_aid"
+#define LHAP_IDS_NEXT_IID "next_iid"
+#define LHAP_IDS_KEY_MAXLEN 128
+#define LHAP_IDS_HASH_MASK (UINT64_MAX >> 8)
+
+static void lhap_ids_load_next(lhap_desc *desc, const char *key, size_t *counter) {
+    uint64_t next;
+    if (pal_nvs_get_len(desc->ids, key) == sizeof(next) &&
+        pal_nvs_get(desc->ids, key, &next, sizeof(next)) && next > *counter) {
+        *counter = next;
+    }
+}
+
+// Open the persisted ID mapping, the counters start after all persisted IDs,
+// so that the unkeyed IDs never collide with them.
+static void lhap_ids_open(lhap_desc *desc) {
+    if (desc->ids_opened) {
+        return;
+    }
+    desc->ids_opened = true;
+    desc->ids = pal_nvs_open(LHAP_IDS_NAMESPACE, PAL_NVS_MODE_READWRITE);
+    if (!desc->ids) {
+        HAPLogError(&lhap_log, "%s: Failed to open the ID mapping, IDs are not persisted.", __func__);
+        return;
+    }
+    lhap_ids_load_next(desc, LHAP_IDS_NEXT_AID, &desc->bridged_aid);
+    lhap_ids_load_next(desc, LHAP_IDS_NEXT_IID, &desc->iid);
+}
+
+// Record a NVS key requested since init, the others are removed by pruneIDs().
+static void lhap_ids_mark_used(lhap_desc *desc, char type, uint64_t hash) {
+    if (desc->ids_used_cnt == desc->ids_used_max) {
+        size_t max = desc->ids_used_max ? desc->ids_used_max * 2 : 16;
+        uint64_t *used = pal_mem_realloc(desc->ids_used, max * sizeof(*used));
+        if (!used) {
+            HAPLogError(&lhap_log, "%s: Failed to alloc memory, IDs are not pruned.", __func__);
+            desc->ids_used_lost = true;
+            return;
+        }
+        desc->ids_used = used;
+        desc->ids_used_max = max;
+    }
+    desc->ids_used[desc->ids_used_cnt++] = ((uint64_t)(uint8_t)type << 56) | hash;
+}
+
+/**
+ * Get the ID of a key from the persisted mapping, or allocate and persist a new one.
+ *
+ * The NVS key is the type followed by 56 bits of the FNV-1a hash of the key,
+ * which fits in the 15 characters allowed by the ESP-IDF NVS. The value is the
+ * ID followed by the key, a hash collision is resolved by probing the next hash.
+ * A pruned entry in the middle of a probe sequence is left as a tombstone,
+ * a value of only 8 bytes, so that the lookups probe through it.
+ */
+static uint64_t lhap_ids_get(lhap_desc *desc, char type, const char *key,
+    size_t *counter, const char *next_key) {
+    lhap_ids_open(desc);
+    if (!key || !desc->ids) {
+        return (*counter)++;
+    }
+
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    for (const char *c = key; *c; c++) {
+        hash ^= (uint8_t)*c;
+        hash *= UINT64_C(0x100000001b3);
+    }
+    size_t keylen = strlen(key);
+    HAPAssert(keylen > 0 && keylen <= LHAP_IDS_KEY_MAXLEN);
+    uint64_t id;
+    char value[sizeof(id) + LHAP_IDS_KEY_MAXLEN];
+    size_t value_len = sizeof(id) + keylen;
+    char nvs_key[16];
+    for (hash >>= 8;; hash = (hash + 1) & LHAP_IDS_HASH_MASK) {
+        snprintf(nvs_key, sizeof(nvs_key), "%c%014" PRIx64, type, hash);
+        size_t len = pal_nvs_get_len(desc->ids, nvs_key);
+        if (len == 0) {
+            break;
+        }
+        if (len == value_len && pal_nvs_get(desc->ids, nvs_key, value, value_len) &&
+            HAPRawBufferAreEqual(value + sizeof(id), key, keylen)) {
+            HAPRawBufferCopyBytes(&id, value, sizeof(id));
+            lhap_ids_mark_used(desc, type, hash);
+            return id;
+        }
+    }
+
+    id = (*counter)++;
+    uint64_t next = *counter;
+    HAPRawBufferCopyBytes(value, &id, sizeof(id));
+    HAPRawBufferCopyBytes(value + sizeof(id), key, keylen);
+    lhap_ids_mark_used(desc, type, hash);
+    if (!pal_nvs_set(desc->ids, nvs_key, value, value_len) ||
+        !pal_nvs_set(desc->ids, next_key, &next, sizeof(next)) ||
+        !pal_nvs_commit(desc->ids)) {
+        HAPLogError(&lhap_log, "%s: Failed to persist the ID of \"%s\".", __func__, key);
+    }
+    return id;
+}
+
+static const char *lhap_ids_check_key(lua_State *L, int idx) {
+    size_t len;
+    const char *key = luaL_optlstring(L, idx, NULL, &len);
+    luaL_argcheck(L, !key || (len > 0 && len <= LHAP_IDS_KEY_MAXLEN && strlen(key) == len), idx,
+        "key is empty, too long or has zeros");
+    return key;
+}
+
+/* getNewBridgedAccessoryID(key?: string) -> aid */
 static int lhap_get_new_bridged_aid(lua_State *L) {
-    lua_pushinteger(L, gv_lhap_desc.bridged_aid++);
+    const char *key = lhap_ids_check_key(L, 1);
+    lhap_desc *desc = &gv_lhap_desc;
+    lua_pushinteger(L, lhap_ids_get(desc, 'a', key, &desc->bridged_aid, LHAP_IDS_NEXT_AID));
     return 1;
 }
 
+/* getNewInstanceID(key?: string) -> iid */
 static int lhap_get_new_iid(lua_State *L) {
-    lua_pushinteger(L, gv_lhap_desc.iid++);
+    const char *key = lhap_ids_check_key(L, 1);
+    lhap_desc *desc = &gv_lhap_desc;
+    lua_pushinteger(L, lhap_ids_get(desc, 'i', key, &desc->iid, LHAP_IDS_NEXT_IID));
     return 1;
 }
 
-static const luaL_Reg haplib[] = {
-    {"init", lhap_init},
-    {"deinit", lhap_deinit},
-    {"addBridgedAccessory", lhap_add_bridged_accessory},
-    {"start", lhap_start},
-    {"stop", lhap_stop},
-    {"raiseEvent", lhap_raise_event},
-    {"getNewBridgedAccessoryID", lhap_get_new_bridged_aid},
-    {"getNewInstanceID", lhap_get_new_iid},
-    /* placeholders */
-    {"Error", NULL},
-    {"AccessoryInformationService", NULL},
-    {"HapProtocolInformationService", NULL},
-    {"PairingService", NULL},
-    {NULL, NULL},
-};
+static bool lhap_ids_is_used(lhap_desc *desc, uint64_t v) {
+    for (size_t i = 0; i < desc->ids_used_cnt; i++) {
+        if (desc->ids_used[i] == v) {
+            return true;
+        }
+    }
+    return false;
+}
 
-LUAMOD_API int luaopen_hap(lua_State *L) {
-    luaL_newlib(L, haplib);
+typedef struct {
+    lhap_desc *desc;
+    lua_Integer pruned;
+} lhap_ids_prune_ctx;
+
+static bool lhap_ids_prune_cb(pal_nvs_handle *handle, const char *key, void *arg) {
+    lhap_ids_prune_ctx *ctx = arg;
+    uint64_t hash;
+    char type = key[0];
+    if ((type != 'a' && type != 'i') || strlen(key) != 15 || sscanf(key + 1, "%14" SCNx64, &hash) != 1 ||
+        lhap_ids_is_used(ctx->desc, ((uint64_t)(uint8_t)type << 56) | hash)) {
+        return true;
+    }
 
-    /* set Error */
-    lc_create_enum_table(L, lhap_error_strs,
-        HAPArrayCount(lhap_error_strs));
-    lua_setfield(L, -2, "Error");
+    // A tombstone is only needed while the next entry may be probed through it.
+    char next_key[16];
+    snprintf(next_key, sizeof(next_key), "%c%014" PRIx64, type, (hash + 1) & LHAP_IDS_HASH_MASK);
+    bool keep = pal_nvs_get_len(handle, next_key) != 0;
+    uint64_t tombstone = 0;
+    bool is_tombstone = pal_nvs_get_len(handle, key) == sizeof(tombstone);
+    if (!keep) {
+        pal_nvs_remove(handle, key);
+    } else if (!is_tombstone) {
+        pal_nvs_set(handle, key, &tombstone, sizeof(tombstone));
+    }
+    if (!is_tombstone) {
+        ctx->pruned++;
+    }
+    return true;
+}
 
-    /* set services */
-    for (const lhap_lightuserdata *ud = lhap_accessory_services_userdatas;
-        ud->ptr; ud++) {
-        lua_pushlightuserdata(L, ud->ptr);
-        lua_setfield(L, -2, ud->name);
+/* pruneIDs() -> integer */
+static int lhap_prune_ids(lua_State *L) {
+    lhap_desc *desc = &gv_lhap_desc;
+    lhap_ids_open(desc);
+    if (desc->ids_used_lost) {
+        luaL_error(L, "Failed to record the requested keys.");
+    }
+    lhap_ids_prune_ctx ctx = {
+        .desc = desc,
+    };
+    if (desc->ids) {
+        pal_nvs_foreach(desc->ids, lhap_ids_prune_cb, &ctx);
+        if (!pal_nvs_commit(desc->ids)) {
+            luaL_error(L, "Failed to commit the ID mapping.");
+        }
+    }
+    lua_pushinteger(L, ctx.pruned);
+    return 1;
+}
+
+uint64_t lhap_new_bridged_aid(void) {
+    lhap_desc *desc = &gv_lhap_desc;
+    return lhap_ids_get(desc, 'a', NULL, &desc->bridged_aid, LHAP_IDS_NEXT_AID);
+}
+
+uint64_t lhap_new_iid(void) {
+    lhap_desc *desc = &gv_lhap_desc;
+    return lhap_ids_get(desc, 'i', NULL, &desc->iid, LHAP_IDS_NEXT_IID);
+}
+
+#if BRIDGE_TEST_HOOKS
+/* test.start(nsessions: integer) */
+static int lhap_test_start(lua_State *L) {
+    lhap_desc *desc = &gv_lhap_desc;
+    lhap_test_desc *test = &gv_lhap_test_desc;
+
+    if (!desc->inited) {
+        luaL_error(L, "HAP is not initialized.");
+    }
+
+    if (desc->is_started) {
+        luaL_error(L, "HAP is already started");
     }
 
+    lua_Integer n = luaL_checkinteger(L, 1);
+    luaL_argcheck(L, n >= 0 && n <= LHAP_TEST_SESSIONS_MAX, 1, "out of range");
+
+    if (!lhap_dep_build(L, desc)) {
+        luaL_error(L, "Failed to build the characteristic dependency graph.");
+    }
+
+    test->sessions_cnt = n;
+    test->events_cnt = 0;
+    test->started = true;
+    desc->is_started = true;
+    return 0;
+}
+
+/* test.stop() */
+static int lhap_test_stop(lua_State *L) {
+    lhap_desc *desc = &gv_lhap_desc;
+    lhap_test_desc *test = &gv_lhap_test_desc;
+
+    if (!test->started) {
+        luaL_error(L, "HAP is not started by the test hooks.");
+    }
+
+    lhap_dep_free(desc);
+    test->started = false;
+    test->events_cnt = 0;
+    desc->is_started = false;
+    return 0;
+}
+
+// Check the accessory and characteristic IIDs at "idx" and "idx + 1".
+static const HAPCharacteristic *lhap_test_check_characteristic(lua_State *L, int idx,
+    const HAPAccessory **accessory, const HAPService **service) {
+    lhap_desc *desc = &gv_lhap_desc;
+
+    if (!gv_lhap_test_desc.started) {
+        luaL_error(L, "HAP is not started by the test hooks.");
+    }
+
+    const HAPCharacteristic *c = lhap_find_characteristic(desc, luaL_checkinteger(L, idx), 0,
+        luaL_checkinteger(L, idx + 1), accessory, service);
+    if (!c) {
+        luaL_argerror(L, idx + 1, "characteristic not found");
+    }
+    if (((const HAPBaseCharacteristic *)c)->format == kHAPCharacteristicFormat_TLV8) {
+        luaL_argerror(L, idx + 1, "TLV8 characteristic is not supported");
+    }
+    return c;
+}
+
+static HAPSessionRef *lhap_test_check_session(lua_State *L, int idx) {
+    lhap_test_desc *test = &gv_lhap_test_desc;
+    lua_Integer i = luaL_checkinteger(L, idx);
+    luaL_argcheck(L, i >= 1 && i <= (lua_Integer)test->sessions_cnt, idx, "session not found");
+    return test->sessions + i - 1;
+}
+
+// Get the registry key of the read or write handler of the characteristic.
+static const void *lhap_test_handler_key(const HAPCharacteristic *characteristic, bool write) {
+    const void *key = NULL;
+
+#define LHAP_CASE_CHAR_GET_HANDLER_KEY(format) \
+    LHAP_CASE_CHAR_FORMAT_CODE(format, (HAPCharacteristic *)characteristic, \
+        key = write ? (const void *)&p->callbacks.handleWrite : (const void *)&p->callbacks.handleRead)
+
+    switch (((const HAPBaseCharacteristic *)characteristic)->format) {
+        LHAP_CASE_CHAR_GET_HANDLER_KEY(Data)
+        LHAP_CASE_CHAR_GET_HANDLER_KEY(Bool)
+        LHAP_CASE_CHAR_GET_HANDLER_KEY(UInt8)
+        LHAP_CASE_CHAR_GET_HANDLER_KEY(UInt16)
+        LHAP_CASE_CHAR_GET_HANDLER_KEY(UInt32)
+        LHAP_CASE_CHAR_GET_HANDLER_KEY(UInt64)
+        LHAP_CASE_CHAR_GET_HANDLER_KEY(Int)
+        LHAP_CASE_CHAR_GET_HANDLER_KEY(Float)
+        LHAP_CASE_CHAR_GET_HANDLER_KEY(String)
+        LHAP_CASE_CHAR_GET_HANDLER_KEY(TLV8)
+    }
+
+#undef LHAP_CASE_CHAR_GET_HANDLER_KEY
+
+    return key;
+}
+
+/**
+ * test.read(aid: integer, iid: integer, session: integer) -> err, value
+ *
+ * The read handler must not yield.
+ */
+static int lhap_test_read(lua_State *L) {
+    lhap_desc *desc = &gv_lhap_desc;
+    const HAPAccessory *a;
+    const HAPService *s;
+    const HAPCharacteristic *c = lhap_test_check_characteristic(L, 1, &a, &s);
+    HAPSessionRef *session = lhap_test_check_session(L, 3);
+
+    lua_State *co = lua_newthread(L);
+    HAPError err = lhap_char_base_handleRead(co, &desc->server, kHAPTransportType_IP, session,
+        a, s, (const HAPBaseCharacteristic *)c, lhap_test_handler_key(c, false));
+    lua_pushinteger(L, err);
+    if (err != kHAPError_None) {
+        return 1;
+    }
+    lua_pushvalue(co, -2);
+    lua_xmove(co, L, 1);
+    return 2;
+}
+
+/**
+ * test.write(aid: integer, iid: integer, value: any, session: integer) -> err
+ *
+ * The write handler must not yield.
+ */
+static int lhap_test_write(lua_State *L) {
+    lhap_desc *desc = &gv_lhap_desc;
+    const HAPAccessory *a;
+    const HAPService *s;
+    const HAPCharacteristic *c = lhap_test_check_characteristic(L, 1, &a, &s);
+    luaL_checkany(L, 3);
+    HAPSessionRef *session = lhap_test_check_session(L, 4);
+    const void *key = lhap_test_handler_key(c, true);
+
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, key) != LUA_TFUNCTION) {
+        luaL_argerror(L, 2, "characteristic is not writable");
+    }
+    lua_pop(L, 1);
+
+    lua_State *L1 = lua_newthread(L);
+    lua_State *co = lhap_char_base_handleWrite(L1, &desc->server, kHAPTransportType_IP, session,
+        false, a, s, (const HAPBaseCharacteristic *)c, key);
+    switch (((const HAPBaseCharacteristic *)c)->format) {
+    case kHAPCharacteristicFormat_Bool:
+        lua_pushboolean(co, lua_toboolean(L, 3));
+        break;
+    case kHAPCharacteristicFormat_Data:
+    case kHAPCharacteristicFormat_String:
+        lua_pushstring(co, luaL_checkstring(L, 3));
+        break;
+    default:
+        lua_pushnumber(co, luaL_checknumber(L, 3));
+        break;
+    }
+    lua_pushinteger(L, lhap_char_last_handleWrite(L1, co, a));
+    return 1;
+}
+
+/* test.writeSlot(aid: integer, iid: integer, value: boolean|number|string) */
+static int lhap_test_write_slot(lua_State *L) {
+    lhap_desc *desc = &gv_lhap_desc;
+
+    if (!desc->slots) {
+        luaL_error(L, "Slots are not opened.");
+    }
+
+    lua_Integer aid = luaL_checkinteger(L, 1);
+    luaL_argcheck(L, aid > 0 && aid <= UINT32_MAX, 1, "out of range");
+    lua_Integer iid = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, iid > 0 && iid <= UINT32_MAX, 2, "out of range");
+    pal_slot_value v = { 0 };
+    switch (lua_type(L, 3)) {
+    case LUA_TBOOLEAN:
+        v.b = lua_toboolean(L, 3);
+        break;
+    case LUA_TNUMBER:
+        if (lua_isinteger(L, 3)) {
+            v.i = lua_tointeger(L, 3);
+        } else {
+            v.f = lua_tonumber(L, 3);
+        }
+        break;
+    case LUA_TSTRING: {
+        size_t len;
+        const char *str = lua_tolstring(L, 3, &len);
+        luaL_argcheck(L, len <= sizeof(v.s), 3, "too long");
+        HAPRawBufferCopyBytes(v.s, str, len);
+        v.len = len;
+        break;
+    }
+    default:
+        luaL_argerror(L, 3, "boolean, number or string expected");
+    }
+
+    if (!pal_slot_write(desc->slots, aid, iid, &v)) {
+        luaL_error(L, "Failed to write the slot.");
+    }
+    pal_slot_ring(desc->slots);
+    return 0;
+}
+
+/* test.events() -> events: { aid: integer, iid: integer, session: integer }[] */
+static int lhap_test_events(lua_State *L) {
+    lhap_test_desc *test = &gv_lhap_test_desc;
+
+    lua_createtable(L, test->events_cnt, 0);
+    for (size_t i = 0; i < test->events_cnt; i++) {
+        lua_createtable(L, 0, 3);
+        lua_pushinteger(L, test->events[i].aid);
+        lua_setfield(L, -2, "aid");
+        lua_pushinteger(L, test->events[i].iid);
+        lua_setfield(L, -2, "iid");
+        lua_pushinteger(L, test->events[i].session);
+        lua_setfield(L, -2, "session");
+        lua_rawseti(L, -2, i + 1);
+    }
+    test->events_cnt = 0;
+    return 1;
+}
+
+static const lc_rotable_kv lhap_test_funcs[] = {
+    LC_ROFUNC("events", lhap_test_events),
+    LC_ROFUNC("read", lhap_test_read),
+    LC_ROFUNC("start", lhap_test_start),
+    LC_ROFUNC("stop", lhap_test_stop),
+    LC_ROFUNC("write", lhap_test_write),
+    LC_ROFUNC("writeSlot", lhap_test_write_slot),
+    LC_ROEND,
+};
+#endif
+
+static const lc_rotable_kv haplib[] = {
+    LC_ROPTR("AccessoryInformationService", (void *)&accessoryInformationService),
+    LC_ROTABLE("Error", lhap_error_kvs),
+    LC_ROPTR("HapProtocolInformationService", (void *)&hapProtocolInformationService),
+    LC_ROPTR("PairingService", (void *)&pairingService),
+    LC_ROFUNC("addBridgedAccessory", lhap_add_bridged_accessory),
+    LC_ROFUNC("deinit", lhap_deinit),
+    LC_ROFUNC("getNewBridgedAccessoryID", lhap_get_new_bridged_aid),
+    LC_ROFUNC("getNewInstanceID", lhap_get_new_iid),
+    LC_ROFUNC("init", lhap_init),
+    LC_ROFUNC("openSlots", lhap_open_slots),
+    LC_ROFUNC("pruneIDs", lhap_prune_ids),
+    LC_ROFUNC("raiseEvent", lhap_raise_event),
+    LC_ROFUNC("start", lhap_start),
+    LC_ROFUNC("stop", lhap_stop),
+#if BRIDGE_TEST_HOOKS
+    LC_ROTABLE("test", lhap_test_funcs),
+#endif
+    LC_ROEND,
+};
+
+LUAMOD_API int luaopen_hap(lua_State *L) {
+    /* the contexts are released with their coroutines */
+    lua_newtable(L);
+    lua_createtable(L, 0, 1);
+    lua_pushliteral(L, "k");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &gv_lhap_desc.write_ctxs);
+
+    lc_push_rotable(L, haplib);
     return 1;
 }
 
@@ -7,6 +7,8 @@
 #include <lauxlib.h>
 #include <pal/crypto/md.h>
 
+#include "lc.h"
+
 #define LUA_HASH_OBJ_NAME "HashObject*"
 
 #define LHASH_GET_OBJ(L, idx) \
@@ -42,9 +44,9 @@ static int lhash_create(lua_State *L) {
     return 1;
 }
 
-static const luaL_Reg hashlib[] = {
-    {"create", lhash_create},
-    {NULL, NULL},
+static const lc_rotable_kv hashlib[] = {
+    LC_ROFUNC("create", lhash_create),
+    LC_ROEND,
 };
 
 static int lhash_obj_update(lua_State *L) {
@@ -109,7 +111,7 @@ static void lhash_createmeta(lua_State *L) {
 }
 
 LUAMOD_API int luaopen_hash(lua_State *L) {
-    luaL_newlib(L, hashlib); /* new module */
+    lc_push_rotable(L, hashlib);
     lhash_createmeta(L);
     return 1;
 }
@@ -7,6 +7,7 @@
 #include <HAPLog.h>
 #include <lauxlib.h>
 
+#include "lc.h"
 #include "app_int.h"
 
 #define LUA_LOGGER_NAME "logger*"
@@ -67,9 +68,9 @@ static int llog_logger_tostring(lua_State *L) {
     return 1;
 }
 
-static const luaL_Reg loglib[] = {
-    {"getLogger", llog_get_logger},
-    {NULL, NULL},
+static const lc_rotable_kv loglib[] = {
+    LC_ROFUNC("getLogger", llog_get_logger),
+    LC_ROEND,
 };
 
 /*
@@ -103,7 +104,7 @@ static void createmeta(lua_State *L) {
 }
 
 LUAMOD_API int luaopen_log(lua_State *L) {
-    luaL_newlib(L, loglib); /* new module */
+    lc_push_rotable(L, loglib);
     createmeta(L);
     return 1;
 }
@@ -0,0 +1,1010 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#include <string.h>
+#include <lauxlib.h>
+#include <pal/net/socket.h>
+#include <pal/serial.h>
+#include <pal/memory.h>
+#include <HAPBase.h>
+#include <HAPLog.h>
+#include <HAPPlatform.h>
+#include <HAPPlatformTimer.h>
+
+#include "lc.h"
+#include "app_int.h"
+
+#define LUA_MODBUS_CLIENT_NAME "ModbusClient*"
+
+// The max number of registers in a read request.
+#define LMODBUS_READ_MAXCNT 125
+
+// The max number of registers in a write request.
+#define LMODBUS_WRITE_MAXCNT 123
+
+// The max length of a PDU.
+#define LMODBUS_PDU_MAXLEN 253
+
+// The length of the MBAP header.
+#define LMODBUS_MBAP_LEN 7
+
+// The max number of the in-flight requests on a TCP connection.
+#define LMODBUS_PIPELINE_MAX 32
+
+#define LMODBUS_FC_READ_HOLDING_REGISTERS 0x03
+#define LMODBUS_FC_READ_INPUT_REGISTERS 0x04
+#define LMODBUS_FC_WRITE_SINGLE_REGISTER 0x06
+#define LMODBUS_FC_WRITE_MULTIPLE_REGISTERS 0x10
+#define LMODBUS_FC_EXCEPTION 0x80
+
+typedef struct lmodbus_req {
+    struct lmodbus_req *next;       // The next request in the unit queue or the in-flight list.
+    struct lmodbus_req *merged;     // The reads merged into this one.
+    lua_State *co;
+    HAPPlatformTimerRef timer;
+    uint16_t tid;
+    uint8_t unit;
+    uint8_t fc;
+    uint16_t addr;
+    uint16_t cnt;
+    uint16_t base;                  // The first register of the merged reads.
+    uint16_t span;                  // The number of registers of the merged reads.
+    uint16_t values[0];             // The values to be written.
+} lmodbus_req;
+
+typedef struct lmodbus_unit {
+    struct lmodbus_unit *next;
+    uint8_t id;
+    lmodbus_req *head;
+    lmodbus_req **ptail;
+} lmodbus_unit;
+
+typedef struct {
+    bool rtu;
+    bool closed;
+    bool pinned;
+    bool flush_scheduled;
+    bool receiving;
+    bool busy;                      // In a callback of the run loop.
+    pal_socket_obj *socket;
+    pal_serial_obj *serial;
+    uint32_t timeout;
+    size_t pipeline;
+    size_t ninflight;
+    uint16_t next_tid;
+    lmodbus_unit *units;
+    lmodbus_unit *rr;               // The unit served first in the next dispatch.
+    lmodbus_req *inflight;
+    size_t rlen;
+    uint8_t rbuf[LMODBUS_MBAP_LEN + LMODBUS_PDU_MAXLEN];
+} lmodbus_client;
+
+static const HAPLogObject lmodbus_log = {
+    .subsystem = APP_BRIDGE_LOG_SUBSYSTEM,
+    .category = "lmodbus",
+};
+
+static const char *lmodbus_exception_strs[] = {
+    [1] = "illegal function",
+    [2] = "illegal data address",
+    [3] = "illegal data value",
+    [4] = "server device failure",
+    [5] = "acknowledge",
+    [6] = "server device busy",
+    [8] = "memory parity error",
+    [10] = "gateway path unavailable",
+    [11] = "gateway target device failed to respond",
+};
+
+static void lmodbus_dispatch(lmodbus_client *c);
+static void lmodbus_tcp_recv(lmodbus_client *c);
+static void lmodbus_rtu_recv(lmodbus_client *c);
+
+static inline uint16_t lmodbus_get_u16(const uint8_t *p) {
+    return (p[0] << 8) | p[1];
+}
+
+static inline uint8_t *lmodbus_put_u16(uint8_t *p, uint16_t v) {
+    *p++ = v >> 8;
+    *p++ = v & 0xff;
+    return p;
+}
+
+static uint16_t lmodbus_crc16(const uint8_t *data, size_t len) {
+    uint16_t crc = 0xffff;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+static inline bool lmodbus_fc_is_read(uint8_t fc) {
+    return fc == LMODBUS_FC_READ_HOLDING_REGISTERS || fc == LMODBUS_FC_READ_INPUT_REGISTERS;
+}
+
+// Keep the client alive while it has the pending requests or the scheduled flush.
+static void lmodbus_client_pin(lua_State *L, int idx, lmodbus_client *c) {
+    if (!c->pinned) {
+        lua_pushvalue(L, idx);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, c);
+        c->pinned = true;
+    }
+}
+
+static void lmodbus_client_release(lua_State *L, lmodbus_client *c) {
+    if (!c->pinned || c->busy || c->flush_scheduled || c->ninflight) {
+        return;
+    }
+    for (lmodbus_unit *u = c->units; u; u = u->next) {
+        if (u->head) {
+            return;
+        }
+    }
+    c->pinned = false;
+    lua_pushnil(L);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, c);
+}
+
+// Leave the callback of the run loop.
+static void lmodbus_client_leave(lmodbus_client *c) {
+    lua_State *L = app_get_lua_main_thread();
+    c->busy = false;
+    lmodbus_client_release(L, c);
+    lc_collectgarbage(L);
+}
+
+static void lmodbus_req_free(lmodbus_req *req) {
+    while (req) {
+        lmodbus_req *next = req->merged;
+        if (req->timer) {
+            HAPPlatformTimerDeregister(req->timer);
+        }
+        pal_mem_free(req);
+        req = next;
+    }
+}
+
+// Resume the coroutines of the request and the reads merged into it, and free them.
+static void lmodbus_req_done(lmodbus_req *req, const uint8_t *regs, const char *err) {
+    lua_State *L = app_get_lua_main_thread();
+    // Not empty when the client is closed by the script run by app_init().
+    int top = lua_gettop(L);
+    int status, nres;
+
+    if (req->timer) {
+        HAPPlatformTimerDeregister(req->timer);
+        req->timer = 0;
+    }
+
+    while (req) {
+        lmodbus_req *next = req->merged;
+        lua_State *co = req->co;
+        if (err) {
+            lua_pushnil(co);
+            lua_pushstring(co, err);
+        } else if (regs) {
+            lua_createtable(co, req->cnt, 0);
+            const uint8_t *p = regs + (req->addr - req->base) * 2;
+            for (uint16_t i = 0; i < req->cnt; i++) {
+                lua_pushinteger(co, lmodbus_get_u16(p + i * 2));
+                lua_rawseti(co, -2, i + 1);
+            }
+            lua_pushnil(co);
+        } else {
+            lua_pushnil(co);
+            lua_pushnil(co);
+        }
+        pal_mem_free(req);
+
+        status = lc_resumethread(co, L, 2, &nres);
+        if (status != LUA_OK && status != LUA_YIELD) {
+            HAPLogError(&lmodbus_log, "%s: %s", __func__, lua_tostring(L, -1));
+        }
+        lua_settop(L, top);
+        req = next;
+    }
+}
+
+// Check the response PDU and finish the request.
+static void lmodbus_req_finish(lmodbus_req *req, const uint8_t *pdu, size_t len) {
+    char err[64];
+
+    if (len == 2 && pdu[0] == (req->fc | LMODBUS_FC_EXCEPTION)) {
+        uint8_t code = pdu[1];
+        snprintf(err, sizeof(err), "exception %u (%s)", code,
+            code < HAPArrayCount(lmodbus_exception_strs) && lmodbus_exception_strs[code] ?
+            lmodbus_exception_strs[code] : "unknown");
+        lmodbus_req_done(req, NULL, err);
+        return;
+    }
+    if (len == 0 || pdu[0] != req->fc) {
+        goto bad;
+    }
+
+    switch (req->fc) {
+    case LMODBUS_FC_READ_HOLDING_REGISTERS:
+    case LMODBUS_FC_READ_INPUT_REGISTERS:
+        if (len != 2 + req->span * 2 || pdu[1] != req->span * 2) {
+            goto bad;
+        }
+        lmodbus_req_done(req, pdu + 2, NULL);
+        return;
+    case LMODBUS_FC_WRITE_SINGLE_REGISTER:
+        if (len != 5 || lmodbus_get_u16(pdu + 1) != req->addr || lmodbus_get_u16(pdu + 3) != req->values[0]) {
+            goto bad;
+        }
+        break;
+    case LMODBUS_FC_WRITE_MULTIPLE_REGISTERS:
+        if (len != 5 || lmodbus_get_u16(pdu + 1) != req->addr || lmodbus_get_u16(pdu + 3) != req->cnt) {
+            goto bad;
+        }
+        break;
+    default:
+        HAPAssertionFailure();
+    }
+    lmodbus_req_done(req, NULL, NULL);
+    return;
+
+bad:
+    HAPLogBufferError(&lmodbus_log, pdu, len, "Bad response to unit %u function 0x%02x",
+        req->unit, req->fc);
+    lmodbus_req_done(req, NULL, "bad response");
+}
+
+static size_t lmodbus_req_encode(lmodbus_req *req, uint8_t *pdu) {
+    uint8_t *p = pdu;
+    *p++ = req->fc;
+    switch (req->fc) {
+    case LMODBUS_FC_READ_HOLDING_REGISTERS:
+    case LMODBUS_FC_READ_INPUT_REGISTERS:
+        p = lmodbus_put_u16(p, req->base);
+        p = lmodbus_put_u16(p, req->span);
+        break;
+    case LMODBUS_FC_WRITE_SINGLE_REGISTER:
+        p = lmodbus_put_u16(p, req->addr);
+        p = lmodbus_put_u16(p, req->values[0]);
+        break;
+    case LMODBUS_FC_WRITE_MULTIPLE_REGISTERS:
+        p = lmodbus_put_u16(p, req->addr);
+        p = lmodbus_put_u16(p, req->cnt);
+        *p++ = req->cnt * 2;
+        for (uint16_t i = 0; i < req->cnt; i++) {
+            p = lmodbus_put_u16(p, req->values[i]);
+        }
+        break;
+    default:
+        HAPAssertionFailure();
+    }
+    return p - pdu;
+}
+
+static lmodbus_unit *lmodbus_unit_get(lmodbus_client *c, uint8_t id) {
+    lmodbus_unit **pu = &c->units;
+    for (; *pu; pu = &(*pu)->next) {
+        if ((*pu)->id == id) {
+            return *pu;
+        }
+    }
+    lmodbus_unit *u = pal_mem_calloc(sizeof(*u));
+    if (!u) {
+        return NULL;
+    }
+    u->id = id;
+    u->ptail = &u->head;
+    *pu = u;
+    return u;
+}
+
+static lmodbus_req *lmodbus_unit_pop(lmodbus_unit *u) {
+    lmodbus_req *req = u->head;
+    u->head = req->next;
+    if (!u->head) {
+        u->ptail = &u->head;
+    }
+    req->next = NULL;
+    return req;
+}
+
+// Merge the queued reads of the same function that overlap or adjoin the range of @p head,
+// up to the first write, so a write is never reordered with the reads.
+static void lmodbus_unit_merge(lmodbus_unit *u, lmodbus_req *head) {
+    if (!lmodbus_fc_is_read(head->fc)) {
+        return;
+    }
+
+    uint32_t lo = head->base;
+    uint32_t hi = lo + head->span;
+    bool merged;
+    do {
+        merged = false;
+        lmodbus_req **pp = &u->head;
+        while (*pp && lmodbus_fc_is_read((*pp)->fc)) {
+            lmodbus_req *r = *pp;
+            uint32_t rlo = r->addr;
+            uint32_t rhi = rlo + r->cnt;
+            uint32_t nlo = rlo < lo ? rlo : lo;
+            uint32_t nhi = rhi > hi ? rhi : hi;
+            if (r->fc == head->fc && rlo <= hi && rhi >= lo && nhi - nlo <= LMODBUS_READ_MAXCNT) {
+                lo = nlo;
+                hi = nhi;
+                *pp = r->next;
+                if (!*pp) {
+                    u->ptail = pp;
+                }
+                r->next = NULL;
+                r->merged = head->merged;
+                head->merged = r;
+                merged = true;
+                continue;
+            }
+            pp = &r->next;
+        }
+    } while (merged);
+
+    head->base = lo;
+    head->span = hi - lo;
+    for (lmodbus_req *r = head->merged; r; r = r->merged) {
+        r->base = head->base;
+    }
+}
+
+// Pick the next unit with the queued requests in the round-robin order.
+static lmodbus_unit *lmodbus_unit_next(lmodbus_client *c) {
+    lmodbus_unit *start = c->rr ? c->rr : c->units;
+    lmodbus_unit *u = start;
+    while (u) {
+        if (u->head) {
+            return u;
+        }
+        u = u->next ? u->next : c->units;
+        if (u == start) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void lmodbus_inflight_remove(lmodbus_client *c, lmodbus_req *req) {
+    for (lmodbus_req **pp = &c->inflight; *pp; pp = &(*pp)->next) {
+        if (*pp == req) {
+            *pp = req->next;
+            req->next = NULL;
+            c->ninflight--;
+            return;
+        }
+    }
+    HAPAssertionFailure();
+}
+
+// Fail all the in-flight and queued requests, when the connection is broken.
+static void lmodbus_fail_all(lmodbus_client *c, const char *err) {
+    HAPLogError(&lmodbus_log, "%s: %s", __func__, err);
+    while (!c->closed && c->inflight) {
+        lmodbus_req *req = c->inflight;
+        lmodbus_inflight_remove(c, req);
+        lmodbus_req_done(req, NULL, err);
+    }
+    lmodbus_unit *u;
+    while (!c->closed && (u = lmodbus_unit_next(c))) {
+        lmodbus_req_done(lmodbus_unit_pop(u), NULL, err);
+    }
+}
+
+static void lmodbus_timeout_cb(HAPPlatformTimerRef timer, void *context) {
+    lmodbus_client *c = context;
+    c->busy = true;
+
+    lmodbus_req *req = c->inflight;
+    for (; req && req->timer != timer; req = req->next) { }
+    HAPAssert(req);
+    req->timer = 0;
+    HAPLogInfo(&lmodbus_log, "Request to unit %u function 0x%02x timed out.", req->unit, req->fc);
+    lmodbus_inflight_remove(c, req);
+    lmodbus_req_done(req, NULL, pal_socket_get_error_str(PAL_SOCKET_ERR_TIMEOUT));
+
+    if (!c->closed) {
+        lmodbus_dispatch(c);
+    }
+    lmodbus_client_leave(c);
+}
+
+static void lmodbus_tcp_sent_cb(pal_socket_obj *o, pal_socket_err err, size_t sent_len, void *arg) {
+    // The request is failed by the timer or the receiving.
+    if (err != PAL_SOCKET_ERR_OK) {
+        HAPLogError(&lmodbus_log, "%s: %s", __func__, pal_socket_get_error_str(err));
+    }
+}
+
+static void lmodbus_rtu_sent_cb(pal_serial_obj *o, pal_serial_err err, void *arg) {
+    // The request is failed by the read timeout, or by closing the client.
+    if (err != PAL_SERIAL_ERR_OK && err != PAL_SERIAL_ERR_CLOSED) {
+        HAPLogError(&lmodbus_log, "%s: %s", __func__, pal_serial_get_error_str(err));
+    }
+}
+
+static const char *lmodbus_send(lmodbus_client *c, lmodbus_req *req) {
+    uint8_t buf[LMODBUS_MBAP_LEN + LMODBUS_PDU_MAXLEN];
+
+    if (c->rtu) {
+        buf[0] = req->unit;
+        size_t len = 1 + lmodbus_req_encode(req, buf + 1);
+        uint16_t crc = lmodbus_crc16(buf, len);
+        buf[len++] = crc & 0xff;
+        buf[len++] = crc >> 8;
+
+        // Drop the late bytes of the last response.
+        pal_serial_discard(c->serial);
+        pal_serial_err err = pal_serial_write(c->serial, buf, len, lmodbus_rtu_sent_cb, c);
+        if (err != PAL_SERIAL_ERR_OK && err != PAL_SERIAL_ERR_IN_PROGRESS) {
+            return pal_serial_get_error_str(err);
+        }
+        c->rlen = 0;
+        return NULL;
+    }
+
+    req->tid = c->next_tid++;
+    size_t pdulen = lmodbus_req_encode(req, buf + LMODBUS_MBAP_LEN);
+    lmodbus_put_u16(buf, req->tid);
+    lmodbus_put_u16(buf + 2, 0);
+    lmodbus_put_u16(buf + 4, pdulen + 1);
+    buf[6] = req->unit;
+    size_t len = LMODBUS_MBAP_LEN + pdulen;
+    pal_socket_err err = pal_socket_send(c->socket, buf, &len, true, lmodbus_tcp_sent_cb, c);
+    if (err != PAL_SOCKET_ERR_OK && err != PAL_SOCKET_ERR_IN_PROGRESS) {
+        return pal_socket_get_error_str(err);
+    }
+    if (c->timeout && HAPPlatformTimerRegister(&req->timer, HAPPlatformClockGetCurrent() + c->timeout,
+        lmodbus_timeout_cb, c) != kHAPError_None) {
+        return "failed to create timeout timer";
+    }
+    return NULL;
+}
+
+// Send the queued requests until the pipeline is full.
+static void lmodbus_dispatch(lmodbus_client *c) {
+    lmodbus_unit *u;
+    while (!c->closed && c->ninflight < c->pipeline && (u = lmodbus_unit_next(c))) {
+        lmodbus_req *req = lmodbus_unit_pop(u);
+        lmodbus_unit_merge(u, req);
+        c->rr = u->next;
+
+        const char *err = lmodbus_send(c, req);
+        if (err) {
+            lmodbus_req_done(req, NULL, err);
+            continue;
+        }
+        req->next = c->inflight;
+        c->inflight = req;
+        c->ninflight++;
+        if (c->rtu) {
+            lmodbus_rtu_recv(c);
+        } else {
+            lmodbus_tcp_recv(c);
+        }
+    }
+}
+
+static void lmodbus_flush_cb(void *context, size_t contextSize) {
+    HAPAssert(contextSize == sizeof(lmodbus_client *));
+    lmodbus_client *c = *(lmodbus_client **)context;
+
+    c->busy = true;
+    c->flush_scheduled = false;
+    lmodbus_dispatch(c);
+    lmodbus_client_leave(c);
+}
+
+static void lmodbus_tcp_recved_cb(pal_socket_obj *o, pal_socket_err err,
+    const char *addr, uint16_t port, void *data, size_t len, void *arg) {
+    lmodbus_client *c = arg;
+
+    c->busy = true;
+    c->receiving = false;
+    if (err != PAL_SOCKET_ERR_OK) {
+        lmodbus_fail_all(c, pal_socket_get_error_str(err));
+        goto end;
+    }
+    if (len == 0) {
+        lmodbus_fail_all(c, "connection closed by the server");
+        goto end;
+    }
+    memcpy(c->rbuf + c->rlen, data, len);
+    c->rlen += len;
+
+    while (!c->closed && c->rlen >= LMODBUS_MBAP_LEN) {
+        uint16_t tid = lmodbus_get_u16(c->rbuf);
+        uint16_t pid = lmodbus_get_u16(c->rbuf + 2);
+        uint16_t alen = lmodbus_get_u16(c->rbuf + 4);
+        if (pid != 0 || alen < 2 || alen > LMODBUS_PDU_MAXLEN + 1) {
+            c->rlen = 0;
+            lmodbus_fail_all(c, "bad response");
+            goto end;
+        }
+        size_t flen = LMODBUS_MBAP_LEN - 1 + alen;
+        if (c->rlen < flen) {
+            break;
+        }
+
+        lmodbus_req *req = c->inflight;
+        for (; req && req->tid != tid; req = req->next) { }
+        if (req) {
+            lmodbus_inflight_remove(c, req);
+            lmodbus_req_finish(req, c->rbuf + LMODBUS_MBAP_LEN, flen - LMODBUS_MBAP_LEN);
+        } else {
+            HAPLogInfo(&lmodbus_log, "%s: Drop the response of transaction %u.", __func__, tid);
+        }
+        if (c->closed) {
+            break;
+        }
+        c->rlen -= flen;
+        memmove(c->rbuf, c->rbuf + flen, c->rlen);
+    }
+
+    if (!c->closed) {
+        lmodbus_dispatch(c);
+        lmodbus_tcp_recv(c);
+    }
+
+end:
+    lmodbus_client_leave(c);
+}
+
+static void lmodbus_tcp_recv(lmodbus_client *c) {
+    if (c->receiving || !c->ninflight) {
+        return;
+    }
+    pal_socket_err err = pal_socket_recv(c->socket, sizeof(c->rbuf) - c->rlen, lmodbus_tcp_recved_cb, c);
+    if (err == PAL_SOCKET_ERR_IN_PROGRESS) {
+        c->receiving = true;
+    } else {
+        lmodbus_fail_all(c, pal_socket_get_error_str(err));
+    }
+}
+
+// The length of the RTU frame, from the first 3 bytes.
+static size_t lmodbus_rtu_frame_len(const uint8_t *hdr) {
+    if (hdr[1] & LMODBUS_FC_EXCEPTION) {
+        return 5;
+    }
+    switch (hdr[1]) {
+    case LMODBUS_FC_READ_HOLDING_REGISTERS:
+    case LMODBUS_FC_READ_INPUT_REGISTERS:
+        return 3 + hdr[2] + 2;
+    default:
+        return 8;
+    }
+}
+
+// Handle the received bytes, returns true if more bytes are needed.
+static bool lmodbus_rtu_input(lmodbus_client *c, pal_serial_err err, const void *data, size_t len) {
+    lmodbus_req *req = c->inflight;
+    HAPAssert(req);
+
+    if (err != PAL_SERIAL_ERR_OK) {
+        HAPLogInfo(&lmodbus_log, "Request to unit %u function 0x%02x failed: %s.",
+            req->unit, req->fc, pal_serial_get_error_str(err));
+        lmodbus_inflight_remove(c, req);
+        lmodbus_req_done(req, NULL, pal_serial_get_error_str(err));
+        goto next;
+    }
+
+    memcpy(c->rbuf + c->rlen, data, len);
+    c->rlen += len;
+    if (c->rlen == 3) {
+        if (c->rbuf[0] != req->unit || (c->rbuf[1] & ~LMODBUS_FC_EXCEPTION) != req->fc) {
+            HAPLogBufferError(&lmodbus_log, c->rbuf, c->rlen, "Unexpected response to unit %u function 0x%02x",
+                req->unit, req->fc);
+            lmodbus_inflight_remove(c, req);
+            lmodbus_req_done(req, NULL, "bad response");
+            goto next;
+        }
+        return true;
+    }
+
+    lmodbus_inflight_remove(c, req);
+    if (lmodbus_crc16(c->rbuf, c->rlen - 2) != (c->rbuf[c->rlen - 2] | (c->rbuf[c->rlen - 1] << 8))) {
+        lmodbus_req_done(req, NULL, "CRC mismatch");
+    } else {
+        lmodbus_req_finish(req, c->rbuf + 1, c->rlen - 3);
+    }
+
+next:
+    c->rlen = 0;
+    lmodbus_dispatch(c);
+    return false;
+}
+
+static void lmodbus_rtu_recved_cb(pal_serial_obj *o, pal_serial_err err,
+    const void *data, size_t len, void *arg) {
+    lmodbus_client *c = arg;
+
+    // The serial port is destroyed by closing the client, which fails the requests.
+    if (c->closed) {
+        return;
+    }
+    c->busy = true;
+    c->receiving = false;
+    if (lmodbus_rtu_input(c, err, data, len) && !c->closed) {
+        lmodbus_rtu_recv(c);
+    }
+    lmodbus_client_leave(c);
+}
+
+static void lmodbus_rtu_recv(lmodbus_client *c) {
+    const void *data;
+    pal_serial_err err;
+    size_t len;
+
+    do {
+        len = c->rlen == 0 ? 3 : lmodbus_rtu_frame_len(c->rbuf) - c->rlen;
+        err = pal_serial_read_exactly(c->serial, len, &data, lmodbus_rtu_recved_cb, c);
+        if (err == PAL_SERIAL_ERR_IN_PROGRESS) {
+            c->receiving = true;
+            return;
+        }
+    } while (lmodbus_rtu_input(c, err, data, len) && !c->closed);
+}
+
+// Close the client, the pending requests fail with "err".
+// If "err" is NULL, the requests are freed without resuming their coroutines,
+// this only happens when the client is collected by lua_close().
+static void lmodbus_client_close(lmodbus_client *c, const char *err) {
+    if (c->closed) {
+        return;
+    }
+    c->closed = true;
+    if (c->socket) {
+        pal_socket_destroy(c->socket);
+        c->socket = NULL;
+    }
+    if (c->serial) {
+        pal_serial_destroy(c->serial);
+        c->serial = NULL;
+    }
+    while (c->inflight) {
+        lmodbus_req *req = c->inflight;
+        lmodbus_inflight_remove(c, req);
+        if (err) {
+            lmodbus_req_done(req, NULL, err);
+        } else {
+            lmodbus_req_free(req);
+        }
+    }
+    lmodbus_unit *next;
+    while (err && (next = lmodbus_unit_next(c))) {
+        lmodbus_req_done(lmodbus_unit_pop(next), NULL, err);
+    }
+    while (c->units) {
+        lmodbus_unit *u = c->units;
+        c->units = u->next;
+        while (u->head) {
+            lmodbus_req_free(lmodbus_unit_pop(u));
+        }
+        pal_mem_free(u);
+    }
+    c->rr = NULL;
+}
+
+static lmodbus_client *lmodbus_client_new(lua_State *L) {
+    lmodbus_client *c = lua_newuserdata(L, sizeof(lmodbus_client));
+    memset(c, 0, sizeof(*c));
+    luaL_setmetatable(L, LUA_MODBUS_CLIENT_NAME);
+    return c;
+}
+
+static uint32_t lmodbus_opt_timeout(lua_State *L, int idx) {
+    lua_Integer timeout = 3000;
+    if (!lua_isnoneornil(L, idx)) {
+        luaL_checktype(L, idx, LUA_TTABLE);
+        lua_getfield(L, idx, "timeout");
+        timeout = luaL_optinteger(L, -1, timeout);
+        lua_pop(L, 1);
+        luaL_argcheck(L, timeout >= 0 && timeout <= UINT32_MAX, idx, "timeout out of range");
+    }
+    return timeout;
+}
+
+static void lmodbus_connected_cb(pal_socket_obj *o, pal_socket_err err, void *arg) {
+    lua_State *L = app_get_lua_main_thread();
+    lua_State *co = arg;
+    int status, nres;
+
+    HAPAssert(lua_gettop(L) == 0);
+    lua_pushinteger(co, err);
+    status = lc_resumethread(co, L, 1, &nres);
+    if (status != LUA_OK && status != LUA_YIELD) {
+        HAPLogError(&lmodbus_log, "%s: %s", __func__, lua_tostring(L, -1));
+    }
+
+    lua_settop(L, 0);
+    lc_collectgarbage(L);
+}
+
+static int finshconnect(lua_State *L, int status, lua_KContext extra) {
+    // lua_stack: [4] = client, [-1] = err
+    pal_socket_err err = lua_tointeger(L, -1);
+    lmodbus_client *c = lua_touserdata(L, 4);
+
+    switch (err) {
+    case PAL_SOCKET_ERR_OK:
+        // The timeouts of the requests are handled by the client.
+        pal_socket_set_timeout(c->socket, 0);
+        lua_pushvalue(L, 4);
+        return 1;
+    case PAL_SOCKET_ERR_IN_PROGRESS:
+        lua_yieldk(L, 0, extra, finshconnect);
+        break;
+    default:
+        luaL_error(L, pal_socket_get_error_str(err));
+        break;
+    }
+    return 0;
+}
+
+static int lmodbus_tcp(lua_State *L) {
+    if (!lua_isyieldable(L)) {
+        luaL_error(L, "attempt to connect outside a yieldable coroutine");
+    }
+    const char *addr = luaL_checkstring(L, 1);
+    lua_Integer port = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, (port >= 0) && (port <= 65535), 2, "port out of range");
+    uint32_t timeout = lmodbus_opt_timeout(L, 3);
+    lua_Integer pipeline = 8;
+    if (!lua_isnoneornil(L, 3)) {
+        lua_getfield(L, 3, "pipeline");
+        pipeline = luaL_optinteger(L, -1, pipeline);
+        lua_pop(L, 1);
+        luaL_argcheck(L, pipeline >= 1 && pipeline <= LMODBUS_PIPELINE_MAX, 3, "pipeline out of range");
+    }
+    lua_settop(L, 3);
+
+    lmodbus_client *c = lmodbus_client_new(L);
+    c->timeout = timeout;
+    c->pipeline = pipeline;
+    c->socket = pal_socket_create(PAL_SOCKET_TYPE_TCP,
+        strchr(addr, ':') ? PAL_ADDR_FAMILY_IPV6 : PAL_ADDR_FAMILY_IPV4);
+    if (!c->socket) {
+        luaL_error(L, "failed to create socket object");
+    }
+    pal_socket_set_timeout(c->socket, timeout);
+
+    lua_pushinteger(L, pal_socket_connect(c->socket, addr, port, lmodbus_connected_cb, L));
+    return finshconnect(L, LUA_OK, 0);
+}
+
+static int lmodbus_rtu(lua_State *L) {
+    const char *path = luaL_checkstring(L, 1);
+    pal_serial_cfg cfg = {
+        .baudrate = 9600,
+        .databits = 8,
+        .parity = PAL_SERIAL_PARITY_EVEN,
+        .stopbits = 1,
+    };
+    lserial_check_cfg(L, 2, &cfg);
+    uint32_t timeout = lmodbus_opt_timeout(L, 2);
+
+    lmodbus_client *c = lmodbus_client_new(L);
+    c->rtu = true;
+    c->timeout = timeout;
+    // Only one request is on the bus at a time.
+    c->pipeline = 1;
+    c->serial = pal_serial_open(path, &cfg);
+    if (!c->serial) {
+        luaL_error(L, "failed to open serial port %s", path);
+    }
+    pal_serial_set_timeout(c->serial, timeout);
+
+    return 1;
+}
+
+static lmodbus_client *lmodbus_client_get(lua_State *L, int idx) {
+    lmodbus_client *c = luaL_checkudata(L, idx, LUA_MODBUS_CLIENT_NAME);
+    if (c->closed) {
+        luaL_error(L, "attemp to use a closed client");
+    }
+    return c;
+}
+
+static int finshreq(lua_State *L, int status, lua_KContext extra) {
+    // lua_stack: [-1] = err, [-2] = registers
+    if (!lua_isnil(L, -1)) {
+        luaL_error(L, "%s", lua_tostring(L, -1));
+    }
+    lua_pop(L, 1);
+    return 1;
+}
+
+static int lmodbus_client_request(lua_State *L, uint8_t fc) {
+    lmodbus_client *c = lmodbus_client_get(L, 1);
+    lua_Integer unit = luaL_checkinteger(L, 2);
+    if (c->rtu) {
+        luaL_argcheck(L, unit >= 1 && unit <= 247, 2, "unit out of range");
+    } else {
+        luaL_argcheck(L, unit >= 0 && unit <= 255, 2, "unit out of range");
+    }
+    lua_Integer addr = luaL_checkinteger(L, 3);
+    luaL_argcheck(L, addr >= 0 && addr <= UINT16_MAX, 3, "address out of range");
+
+    lua_Integer cnt, v = 0;
+    switch (fc) {
+    case LMODBUS_FC_READ_HOLDING_REGISTERS:
+    case LMODBUS_FC_READ_INPUT_REGISTERS:
+        cnt = luaL_checkinteger(L, 4);
+        luaL_argcheck(L, cnt >= 1 && cnt <= LMODBUS_READ_MAXCNT, 4, "count out of range");
+        break;
+    case LMODBUS_FC_WRITE_SINGLE_REGISTER:
+        cnt = 1;
+        v = luaL_checkinteger(L, 4);
+        luaL_argcheck(L, v >= 0 && v <= UINT16_MAX, 4, "value out of range");
+        break;
+    case LMODBUS_FC_WRITE_MULTIPLE_REGISTERS:
+        luaL_checktype(L, 4, LUA_TTABLE);
+        cnt = luaL_len(L, 4);
+        luaL_argcheck(L, cnt >= 1 && cnt <= LMODBUS_WRITE_MAXCNT, 4, "too many or no values");
+        break;
+    default:
+        HAPAssertionFailure();
+    }
+    luaL_argcheck(L, addr + cnt <= UINT16_MAX + 1, 3, "address out of range");
+    if (!lua_isyieldable(L)) {
+        luaL_error(L, "attempt to request outside a yieldable coroutine");
+    }
+
+    lmodbus_req *req = pal_mem_calloc(sizeof(*req) + (lmodbus_fc_is_read(fc) ? 0 : cnt * sizeof(uint16_t)));
+    if (!req) {
+        luaL_error(L, "failed to alloc request");
+    }
+    req->co = L;
+    req->unit = unit;
+    req->fc = fc;
+    req->addr = addr;
+    req->cnt = cnt;
+    req->base = addr;
+    req->span = cnt;
+    if (fc == LMODBUS_FC_WRITE_SINGLE_REGISTER) {
+        req->values[0] = v;
+    } else if (fc == LMODBUS_FC_WRITE_MULTIPLE_REGISTERS) {
+        for (lua_Integer i = 0; i < cnt; i++) {
+            int isnum;
+            v = (lua_rawgeti(L, 4, i + 1), lua_tointegerx(L, -1, &isnum));
+            lua_pop(L, 1);
+            if (!isnum || v < 0 || v > UINT16_MAX) {
+                pal_mem_free(req);
+                luaL_argerror(L, 4, "value out of range");
+            }
+            req->values[i] = v;
+        }
+    }
+
+    lmodbus_unit *u = lmodbus_unit_get(c, unit);
+    if (!u) {
+        pal_mem_free(req);
+        luaL_error(L, "failed to alloc unit");
+    }
+
+    // Queue the request and send it at the end of the run loop iteration,
+    // so the reads issued together can be merged.
+    if (!c->flush_scheduled) {
+        if (HAPPlatformRunLoopScheduleCallback(lmodbus_flush_cb, &c, sizeof(c)) != kHAPError_None) {
+            pal_mem_free(req);
+            luaL_error(L, "failed to schedule the request");
+        }
+        c->flush_scheduled = true;
+    }
+    *(u->ptail) = req;
+    u->ptail = &req->next;
+    lmodbus_client_pin(L, 1, c);
+
+    return lua_yieldk(L, 0, 0, finshreq);
+}
+
+static int lmodbus_client_readholding(lua_State *L) {
+    return lmodbus_client_request(L, LMODBUS_FC_READ_HOLDING_REGISTERS);
+}
+
+static int lmodbus_client_readinput(lua_State *L) {
+    return lmodbus_client_request(L, LMODBUS_FC_READ_INPUT_REGISTERS);
+}
+
+static int lmodbus_client_writeregister(lua_State *L) {
+    return lmodbus_client_request(L, LMODBUS_FC_WRITE_SINGLE_REGISTER);
+}
+
+static int lmodbus_client_writeregisters(lua_State *L) {
+    return lmodbus_client_request(L, LMODBUS_FC_WRITE_MULTIPLE_REGISTERS);
+}
+
+static int lmodbus_client_settimeout(lua_State *L) {
+    lmodbus_client *c = lmodbus_client_get(L, 1);
+    lua_Integer ms = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, ms >= 0 && ms <= UINT32_MAX, 2, "ms out of range");
+
+    c->timeout = ms;
+    if (c->rtu) {
+        pal_serial_set_timeout(c->serial, ms);
+    }
+    return 0;
+}
+
+static int lmodbus_client_closemeth(lua_State *L) {
+    lmodbus_client *c = lmodbus_client_get(L, 1);
+    lmodbus_client_close(c, "client closed");
+    lmodbus_client_release(L, c);
+    return 0;
+}
+
+static int lmodbus_client_tbc(lua_State *L) {
+    lmodbus_client *c = luaL_checkudata(L, 1, LUA_MODBUS_CLIENT_NAME);
+    lmodbus_client_close(c, "client closed");
+    lmodbus_client_release(L, c);
+    return 0;
+}
+
+static int lmodbus_client_gc(lua_State *L) {
+    lmodbus_client *c = luaL_checkudata(L, 1, LUA_MODBUS_CLIENT_NAME);
+    // A client with the pending requests is pinned, so it is only collected
+    // with the requests by lua_close(), when their coroutines can not run.
+    lmodbus_client_close(c, NULL);
+    return 0;
+}
+
+static int lmodbus_client_tostring(lua_State *L) {
+    lmodbus_client *c = luaL_checkudata(L, 1, LUA_MODBUS_CLIENT_NAME);
+    if (c->closed) {
+        lua_pushliteral(L, "modbus client (closed)");
+    } else {
+        lua_pushfstring(L, "modbus %s client (%p)", c->rtu ? "RTU" : "TCP", c);
+    }
+    return 1;
+}
+
+static const lc_rotable_kv lmodbus_funcs[] = {
+    LC_ROFUNC("rtu", lmodbus_rtu),
+    LC_ROFUNC("tcp", lmodbus_tcp),
+    LC_ROEND,
+};
+
+/*
+ * methods for modbus client
+ */
+static const luaL_Reg lmodbus_client_meth[] = {
+    {"readholding", lmodbus_client_readholding},
+    {"readinput", lmodbus_client_readinput},
+    {"writeregister", lmodbus_client_writeregister},
+    {"writeregisters", lmodbus_client_writeregisters},
+    {"settimeout", lmodbus_client_settimeout},
+    {"close", lmodbus_client_closemeth},
+    {NULL, NULL}
+};
+
+/*
+ * metamethods for modbus client
+ */
+static const luaL_Reg lmodbus_client_metameth[] = {
+    {"__index", NULL},  /* place holder */
+    {"__gc", lmodbus_client_gc},
+    {"__close", lmodbus_client_tbc},
+    {"__tostring", lmodbus_client_tostring},
+    {NULL, NULL}
+};
+
+static void lmodbus_createmeta(lua_State *L) {
+    luaL_newmetatable(L, LUA_MODBUS_CLIENT_NAME);  /* metatable for ModbusClient* */
+    luaL_setfuncs(L, lmodbus_client_metameth, 0);  /* add metamethods to new metatable */
+    luaL_newlibtable(L, lmodbus_client_meth);  /* create method table */
+    luaL_setfuncs(L, lmodbus_client_meth, 0);  /* add ModbusClient* methods to method table */
+    lua_setfield(L, -2, "__index");  /* metatable.__index = method table */
+    lua_pop(L, 1);  /* pop metatable */
+}
+
+LUAMOD_API int luaopen_modbus(lua_State *L) {
+    lc_push_rotable(L, lmodbus_funcs);
+    lmodbus_createmeta(L);
+    return 1;
+}
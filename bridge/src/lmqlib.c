@@ -131,9 +131,9 @@ static int lmq_obj_tostring(lua_State *L) {
     return 0;
 }
 
-static const luaL_Reg lmq_funcs[] = {
-    {"create", lmq_create},
-    {NULL, NULL},
+static const lc_rotable_kv lmq_funcs[] = {
+    LC_ROFUNC("create", lmq_create),
+    LC_ROEND,
 };
 
 /*
@@ -165,7 +165,7 @@ static void lmq_createmeta(lua_State *L) {
 }
 
 LUAMOD_API int luaopen_mq(lua_State *L) {
-    luaL_newlib(L, lmq_funcs);
+    lc_push_rotable(L, lmq_funcs);
     lmq_createmeta(L);
     return 1;
 }
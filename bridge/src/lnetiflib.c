@@ -0,0 +1,167 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#include <lauxlib.h>
+#include <pal/net/netif.h>
+#include <HAPLog.h>
+
+#include "app_int.h"
+#include "lc.h"
+
+static const char *lnetif_event_type_strs[] = {
+    [PAL_NETIF_EVENT_UP] = "up",
+    [PAL_NETIF_EVENT_DOWN] = "down",
+    [PAL_NETIF_EVENT_NEWADDR] = "newaddr",
+    [PAL_NETIF_EVENT_DELADDR] = "deladdr",
+};
+
+static const char *lnetif_family_strs[] = {
+    "",
+    "IPV4",
+    "IPV6",
+};
+
+static const HAPLogObject lnetif_log = {
+    .subsystem = APP_BRIDGE_LOG_SUBSYSTEM,
+    .category = "lnetif",
+};
+
+/**
+ * Network interface watcher descriptor.
+ */
+typedef struct {
+    pal_netif_watcher *watcher;     /* Created when the first handler is added. */
+} lnetif_desc;
+
+static lnetif_desc gv_lnetif_desc;
+
+static void lnetif_push_event(lua_State *L, const pal_netif_event *event) {
+    bool isaddr = event->type == PAL_NETIF_EVENT_NEWADDR || event->type == PAL_NETIF_EVENT_DELADDR;
+
+    lua_createtable(L, 0, isaddr ? 5 : 3);
+    lua_pushstring(L, lnetif_event_type_strs[event->type]);
+    lua_setfield(L, -2, "type");
+    lua_pushstring(L, event->name);
+    lua_setfield(L, -2, "name");
+    lua_pushinteger(L, event->index);
+    lua_setfield(L, -2, "index");
+    if (isaddr) {
+        lua_pushstring(L, lnetif_family_strs[event->af]);
+        lua_setfield(L, -2, "family");
+        lua_pushstring(L, event->addr);
+        lua_setfield(L, -2, "addr");
+    }
+}
+
+static void lnetif_event_cb(pal_netif_watcher *w, const pal_netif_event *event, void *arg) {
+    lua_State *L = app_get_lua_main_thread();
+    if (!L) {
+        return;
+    }
+
+    HAPAssert(lua_gettop(L) == 0);
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &gv_lnetif_desc) != LUA_TTABLE) {
+        lua_settop(L, 0);
+        return;
+    }
+
+    // Copy the handlers to an array, the handlers may add or remove handlers.
+    lua_newtable(L);
+    lua_Integer n = 0;
+    lua_pushnil(L);
+    while (lua_next(L, 1)) {
+        lua_pop(L, 1);
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, 2, ++n);
+    }
+
+    for (lua_Integer i = 1; i <= n; i++) {
+        lua_rawgeti(L, 2, i);
+        lua_pushvalue(L, -1);
+        if (lua_rawget(L, 1) == LUA_TNIL) {
+            // Removed by a previous handler.
+            lua_settop(L, 2);
+            continue;
+        }
+        lua_pop(L, 1);
+        int nres, status;
+        lua_State *co = lua_newthread(L);
+        lua_insert(L, -2);
+        lua_xmove(L, co, 1);
+        lnetif_push_event(co, event);
+        status = lc_startthread(co, L, 1, &nres);
+        if (status != LUA_OK && status != LUA_YIELD) {
+            HAPLogError(&lnetif_log, "%s: %s", __func__, lua_tostring(L, -1));
+        }
+        lua_settop(L, 2);
+    }
+    lua_settop(L, 0);
+    lc_collectgarbage(L);
+}
+
+static void lnetif_get_handlers(lua_State *L) {
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &gv_lnetif_desc) != LUA_TTABLE) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &gv_lnetif_desc);
+    }
+}
+
+static int lnetif_on_change(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    lnetif_desc *desc = &gv_lnetif_desc;
+
+    if (!desc->watcher) {
+        desc->watcher = pal_netif_watcher_create(lnetif_event_cb, desc);
+        if (!desc->watcher) {
+            luaL_error(L, "failed to create the network interface watcher");
+        }
+    }
+
+    lnetif_get_handlers(L);
+    lua_pushvalue(L, 1);
+    lua_pushboolean(L, true);
+    lua_rawset(L, -3);
+    return 0;
+}
+
+static int lnetif_off_change(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    lnetif_desc *desc = &gv_lnetif_desc;
+
+    lnetif_get_handlers(L);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    lua_rawset(L, -3);
+
+    // Stop watching when the last handler is removed.
+    lua_pushnil(L);
+    if (lua_next(L, -2)) {
+        return 0;
+    }
+    pal_netif_watcher_destroy(desc->watcher);
+    desc->watcher = NULL;
+    return 0;
+}
+
+void lnetif_deinit(void) {
+    lnetif_desc *desc = &gv_lnetif_desc;
+
+    pal_netif_watcher_destroy(desc->watcher);
+    desc->watcher = NULL;
+}
+
+static const lc_rotable_kv lnetif_funcs[] = {
+    LC_ROFUNC("offChange", lnetif_off_change),
+    LC_ROFUNC("onChange", lnetif_on_change),
+    LC_ROEND,
+};
+
+LUAMOD_API int luaopen_netif(lua_State *L) {
+    lc_push_rotable(L, lnetif_funcs);
+    return 1;
+}
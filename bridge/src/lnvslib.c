@@ -13,6 +13,16 @@
 
 #define LUA_NVS_HANDLE_NAME "NVS*"
 
+/*
+ * Values longer than this are stored compressed if it saves space.
+ */
+#define LNVS_COMPRESS_THRESHOLD 256
+
+/*
+ * The first byte of a zlib stream, a JSON text never starts with it.
+ */
+#define LNVS_ZLIB_MAGIC 0x78
+
 typedef struct {
     pal_nvs_handle *handle;
 } lnvs_handle;
@@ -58,6 +68,13 @@ static int lnvs_handle_get(lua_State *L) {
     }
     luaL_pushresult(&B);
 
+    if (*lua_tostring(L, -1) == LNVS_ZLIB_MAGIC) {
+        // s = compress.inflate(s)
+        lua_getfield(L, lua_upvalueindex(2), "inflate");
+        lua_insert(L, -2);
+        lua_call(L, 1, 1);
+    }
+
     // return json.decode(s)
     lua_call(L, 1, 1);
     return 1;
@@ -79,6 +96,15 @@ static int lnvs_handle_set(lua_State *L) {
     size_t len;
     const char *value = luaL_checklstring(L, 3, &len);
 
+    if (len > LNVS_COMPRESS_THRESHOLD) {
+        // compress.deflate(value), the platform may not support it.
+        lua_getfield(L, lua_upvalueindex(2), "deflate");
+        lua_pushvalue(L, 3);
+        if (lua_pcall(L, 1, 1, 0) == LUA_OK && lua_rawlen(L, -1) < len) {
+            value = lua_tolstring(L, -1, &len);
+        }
+    }
+
     if (!pal_nvs_set(handle->handle, key, value, len)) {
         luaL_error(L, "failed to set key");
     }
@@ -126,9 +152,9 @@ static int lnvs_handle_tostring(lua_State *L) {
     return 1;
 }
 
-static const luaL_Reg lnvs_funcs[] = {
-    {"open", lnvs_open},
-    {NULL, NULL},
+static const lc_rotable_kv lnvs_funcs[] = {
+    LC_ROFUNC("open", lnvs_open),
+    LC_ROEND,
 };
 
 /*
@@ -161,13 +187,16 @@ static void lnvs_createmeta(lua_State *L) {
     lua_getglobal(L, "require");
     lua_pushstring(L, "cjson");
     lua_call(L, 1, 1);  /* require "cjson" */
-    luaL_setfuncs(L, lnvs_handle_meth, 1);  /* add NVS handle methods to method table */
+    lua_getglobal(L, "require");
+    lua_pushstring(L, LUA_COMPRESS_NAME);
+    lua_call(L, 1, 1);  /* require "compress" */
+    luaL_setfuncs(L, lnvs_handle_meth, 2);  /* add NVS handle methods to method table */
     lua_setfield(L, -2, "__index");  /* metatable.__index = method table */
     lua_pop(L, 1);  /* pop metatable */
 }
 
 LUAMOD_API int luaopen_nvs(lua_State *L) {
-    luaL_newlib(L, lnvs_funcs);
+    lc_push_rotable(L, lnvs_funcs);
     lnvs_createmeta(L);
     return 1;
 }
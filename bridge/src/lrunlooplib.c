@@ -0,0 +1,288 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#include <lauxlib.h>
+#include <HAPLog.h>
+#include <HAPPlatformTimer.h>
+#include <HAPPlatformRunLoop.h>
+
+#include "app_int.h"
+#include "lc.h"
+
+// Interval between two probes, in milliseconds.
+#define LRUNLOOP_PROBE_INTERVAL_MS 200
+
+// Default lag thresholds of the pressure levels, in milliseconds.
+#define LRUNLOOP_MODERATE_THRESHOLD_DEFAULT 50
+#define LRUNLOOP_CRITICAL_THRESHOLD_DEFAULT 200
+
+static const HAPLogObject lrunloop_log = {
+    .subsystem = APP_BRIDGE_LOG_SUBSYSTEM,
+    .category = "lrunloop",
+};
+
+static const char *lrunloop_pressure_strs[] = {
+    "normal",
+    "moderate",
+    "critical",
+    NULL,
+};
+
+/**
+ * Run loop monitor descriptor.
+ */
+typedef struct {
+    bool inited:1;
+    bool scheduled:1;           /* A callback is scheduled and not yet run. */
+    lrunloop_pressure pressure;
+    HAPPlatformTimerRef timer;
+    HAPTime deadline;           /* Deadline of the probe timer. */
+    HAPTime lag;                /* Smoothed timer lag. */
+    HAPTime max_lag;            /* Max timer lag since the last call to runloop.stats(). */
+    HAPTime iter;               /* Smoothed iteration time. */
+    HAPTime max_iter;           /* Max iteration time since the last call to runloop.stats(). */
+    HAPTime thresholds[2];      /* Lag thresholds of the moderate and critical levels. */
+} lrunloop_desc;
+
+static lrunloop_desc gv_lrunloop_desc = {
+    .thresholds = {
+        LRUNLOOP_MODERATE_THRESHOLD_DEFAULT,
+        LRUNLOOP_CRITICAL_THRESHOLD_DEFAULT,
+    },
+};
+
+// Exponentially weighted moving average with a weight of 1/4.
+static HAPTime lrunloop_ewma(HAPTime avg, HAPTime sample) {
+    return avg - avg / 4 + sample / 4;
+}
+
+static lrunloop_pressure lrunloop_calc_pressure(lrunloop_desc *desc) {
+    HAPTime lag = HAPMax(desc->lag, desc->iter);
+    lrunloop_pressure pressure = LRUNLOOP_PRESSURE_NORMAL;
+
+    // Leave a level only when the lag drops below half of its threshold.
+    for (int i = LRUNLOOP_PRESSURE_CRITICAL; i > LRUNLOOP_PRESSURE_NORMAL; i--) {
+        HAPTime threshold = desc->thresholds[i - 1];
+        if (lag >= threshold || (desc->pressure >= i && lag >= threshold / 2)) {
+            pressure = i;
+            break;
+        }
+    }
+    return pressure;
+}
+
+static void lrunloop_notify(lrunloop_pressure pressure) {
+    lua_State *L = app_get_lua_main_thread();
+    if (!L) {
+        return;
+    }
+
+    HAPAssert(lua_gettop(L) == 0);
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &gv_lrunloop_desc) != LUA_TTABLE) {
+        lua_settop(L, 0);
+        return;
+    }
+
+    // Copy the handlers to an array, the handlers may add or remove handlers.
+    lua_newtable(L);
+    lua_Integer n = 0;
+    lua_pushnil(L);
+    while (lua_next(L, 1)) {
+        lua_pop(L, 1);
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, 2, ++n);
+    }
+
+    for (lua_Integer i = 1; i <= n; i++) {
+        lua_rawgeti(L, 2, i);
+        lua_pushvalue(L, -1);
+        if (lua_rawget(L, 1) == LUA_TNIL) {
+            // Removed by a previous handler.
+            lua_settop(L, 2);
+            continue;
+        }
+        lua_pop(L, 1);
+        int nres, status;
+        lua_State *co = lua_newthread(L);
+        lua_insert(L, -2);
+        lua_xmove(L, co, 1);
+        lua_pushstring(co, lrunloop_pressure_strs[pressure]);
+        status = lc_startthread(co, L, 1, &nres);
+        if (status != LUA_OK && status != LUA_YIELD) {
+            HAPLogError(&lrunloop_log, "%s: %s", __func__, lua_tostring(L, -1));
+        }
+        lua_settop(L, 2);
+    }
+    lua_settop(L, 0);
+    lc_collectgarbage(L);
+}
+
+static void lrunloop_update(lrunloop_desc *desc) {
+    lrunloop_pressure pressure = lrunloop_calc_pressure(desc);
+    if (pressure == desc->pressure) {
+        return;
+    }
+    HAPLogInfo(&lrunloop_log, "Pressure changed: %s -> %s (lag: %llums, iteration: %llums)",
+        lrunloop_pressure_strs[desc->pressure], lrunloop_pressure_strs[pressure],
+        (unsigned long long)desc->lag, (unsigned long long)desc->iter);
+    desc->pressure = pressure;
+    lrunloop_notify(pressure);
+}
+
+static void lrunloop_iter_cb(void *_Nullable context, size_t contextSize) {
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize == sizeof(HAPTime));
+    lrunloop_desc *desc = &gv_lrunloop_desc;
+
+    desc->scheduled = false;
+    if (!desc->inited) {
+        return;
+    }
+    HAPTime now = HAPPlatformClockGetCurrent();
+    HAPTime iter = now - *(HAPTime *)context;
+    desc->iter = lrunloop_ewma(desc->iter, iter);
+    desc->max_iter = HAPMax(desc->max_iter, iter);
+    lrunloop_update(desc);
+}
+
+static void lrunloop_probe_cb(HAPPlatformTimerRef timer, void *context) {
+    lrunloop_desc *desc = context;
+    HAPTime now = HAPPlatformClockGetCurrent();
+    HAPTime lag = now > desc->deadline ? now - desc->deadline : 0;
+
+    desc->timer = 0;
+    desc->lag = lrunloop_ewma(desc->lag, lag);
+    desc->max_lag = HAPMax(desc->max_lag, lag);
+
+    // The scheduled callback runs on the next iteration of the run loop,
+    // the delay until it runs is the time spent on the current iteration.
+    if (!desc->scheduled) {
+        if (HAPPlatformRunLoopScheduleCallback(lrunloop_iter_cb, &now, sizeof(now)) == kHAPError_None) {
+            desc->scheduled = true;
+        }
+    }
+
+    lrunloop_update(desc);
+
+    desc->deadline = HAPPlatformClockGetCurrent() + LRUNLOOP_PROBE_INTERVAL_MS;
+    if (HAPPlatformTimerRegister(&desc->timer, desc->deadline, lrunloop_probe_cb, desc) != kHAPError_None) {
+        HAPLogError(&lrunloop_log, "%s: Failed to register the probe timer.", __func__);
+    }
+}
+
+void lrunloop_init(void) {
+    lrunloop_desc *desc = &gv_lrunloop_desc;
+    if (desc->inited) {
+        return;
+    }
+
+    desc->deadline = HAPPlatformClockGetCurrent() + LRUNLOOP_PROBE_INTERVAL_MS;
+    if (HAPPlatformTimerRegister(&desc->timer, desc->deadline, lrunloop_probe_cb, desc) != kHAPError_None) {
+        HAPLogError(&lrunloop_log, "%s: Failed to register the probe timer.", __func__);
+        return;
+    }
+    desc->inited = true;
+}
+
+void lrunloop_deinit(void) {
+    lrunloop_desc *desc = &gv_lrunloop_desc;
+    if (!desc->inited) {
+        return;
+    }
+
+    if (desc->timer) {
+        HAPPlatformTimerDeregister(desc->timer);
+        desc->timer = 0;
+    }
+    desc->inited = false;
+    desc->pressure = LRUNLOOP_PRESSURE_NORMAL;
+    desc->lag = 0;
+    desc->max_lag = 0;
+    desc->iter = 0;
+    desc->max_iter = 0;
+}
+
+lrunloop_pressure lrunloop_get_pressure(void) {
+    return gv_lrunloop_desc.pressure;
+}
+
+static int lrunloop_pressure_(lua_State *L) {
+    lua_pushstring(L, lrunloop_pressure_strs[gv_lrunloop_desc.pressure]);
+    return 1;
+}
+
+static int lrunloop_stats(lua_State *L) {
+    lrunloop_desc *desc = &gv_lrunloop_desc;
+
+    lua_createtable(L, 0, 5);
+    lua_pushstring(L, lrunloop_pressure_strs[desc->pressure]);
+    lua_setfield(L, -2, "pressure");
+    lua_pushinteger(L, desc->lag);
+    lua_setfield(L, -2, "lag");
+    lua_pushinteger(L, desc->max_lag);
+    lua_setfield(L, -2, "maxLag");
+    lua_pushinteger(L, desc->iter);
+    lua_setfield(L, -2, "iteration");
+    lua_pushinteger(L, desc->max_iter);
+    lua_setfield(L, -2, "maxIteration");
+    desc->max_lag = 0;
+    desc->max_iter = 0;
+    return 1;
+}
+
+static int lrunloop_set_thresholds(lua_State *L) {
+    lua_Integer moderate = luaL_checkinteger(L, 1);
+    lua_Integer critical = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, moderate > 0, 1, "moderate out of range");
+    luaL_argcheck(L, critical > moderate, 2, "critical must be greater than moderate");
+
+    gv_lrunloop_desc.thresholds[0] = moderate;
+    gv_lrunloop_desc.thresholds[1] = critical;
+    return 0;
+}
+
+static void lrunloop_get_handlers(lua_State *L) {
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &gv_lrunloop_desc) != LUA_TTABLE) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &gv_lrunloop_desc);
+    }
+}
+
+static int lrunloop_on_pressure_change(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+
+    lrunloop_get_handlers(L);
+    lua_pushvalue(L, 1);
+    lua_pushboolean(L, true);
+    lua_rawset(L, -3);
+    return 0;
+}
+
+static int lrunloop_off_pressure_change(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+
+    lrunloop_get_handlers(L);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    lua_rawset(L, -3);
+    return 0;
+}
+
+static const lc_rotable_kv lrunloop_funcs[] = {
+    LC_ROFUNC("offPressureChange", lrunloop_off_pressure_change),
+    LC_ROFUNC("onPressureChange", lrunloop_on_pressure_change),
+    LC_ROFUNC("pressure", lrunloop_pressure_),
+    LC_ROFUNC("setThresholds", lrunloop_set_thresholds),
+    LC_ROFUNC("stats", lrunloop_stats),
+    LC_ROEND,
+};
+
+LUAMOD_API int luaopen_runloop(lua_State *L) {
+    lc_push_rotable(L, lrunloop_funcs);
+    return 1;
+}
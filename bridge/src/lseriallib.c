@@ -0,0 +1,334 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#include <lauxlib.h>
+#include <pal/serial.h>
+#include <HAPBase.h>
+#include <HAPLog.h>
+
+#include "lc.h"
+#include "app_int.h"
+
+#define LUA_SERIAL_PORT_NAME "SerialPort*"
+
+typedef struct {
+    pal_serial_obj *port;
+} lserial_port;
+
+static const HAPLogObject lserial_log = {
+    .subsystem = APP_BRIDGE_LOG_SUBSYSTEM,
+    .category = "lserial",
+};
+
+// Set while a port is collected, its pending operations are failed without
+// resuming their coroutines, which may be collected in the same cycle.
+static bool gv_lserial_collecting;
+
+static const char *lserial_parity_strs[] = {
+    "none",
+    "odd",
+    "even",
+    NULL,
+};
+
+static lua_Integer lserial_opt_integer(lua_State *L, int idx, const char *k, lua_Integer def) {
+    lua_getfield(L, idx, k);
+    lua_Integer v = luaL_optinteger(L, -1, def);
+    lua_pop(L, 1);
+    return v;
+}
+
+void lserial_check_cfg(lua_State *L, int idx, pal_serial_cfg *cfg) {
+    if (lua_isnoneornil(L, idx)) {
+        return;
+    }
+    luaL_checktype(L, idx, LUA_TTABLE);
+    lua_Integer baudrate = lserial_opt_integer(L, idx, "baudrate", cfg->baudrate);
+    luaL_argcheck(L, baudrate > 0 && baudrate <= UINT32_MAX, idx, "baudrate out of range");
+    cfg->baudrate = baudrate;
+    lua_Integer databits = lserial_opt_integer(L, idx, "databits", cfg->databits);
+    luaL_argcheck(L, databits >= 5 && databits <= 8, idx, "databits out of range");
+    cfg->databits = databits;
+    lua_Integer stopbits = lserial_opt_integer(L, idx, "stopbits", cfg->stopbits);
+    luaL_argcheck(L, stopbits == 1 || stopbits == 2, idx, "stopbits must be 1 or 2");
+    cfg->stopbits = stopbits;
+    lua_getfield(L, idx, "parity");
+    cfg->parity = luaL_checkoption(L, -1, lserial_parity_strs[cfg->parity], lserial_parity_strs);
+    lua_pop(L, 1);
+}
+
+static int lserial_open(lua_State *L) {
+    const char *path = luaL_checkstring(L, 1);
+    pal_serial_cfg cfg = {
+        .baudrate = 115200,
+        .databits = 8,
+        .parity = PAL_SERIAL_PARITY_NONE,
+        .stopbits = 1,
+    };
+    lserial_check_cfg(L, 2, &cfg);
+
+    lserial_port *obj = lua_newuserdata(L, sizeof(lserial_port));
+    luaL_setmetatable(L, LUA_SERIAL_PORT_NAME);
+
+    obj->port = pal_serial_open(path, &cfg);
+    if (!obj->port) {
+        luaL_error(L, "failed to open serial port %s", path);
+    }
+
+    return 1;
+}
+
+static int lserial_openpty(lua_State *L) {
+    char slave[64];
+
+    lserial_port *obj = lua_newuserdata(L, sizeof(lserial_port));
+    luaL_setmetatable(L, LUA_SERIAL_PORT_NAME);
+
+    obj->port = pal_serial_open_pty(slave, sizeof(slave));
+    if (!obj->port) {
+        luaL_error(L, "failed to open pseudo-terminal");
+    }
+    lua_pushstring(L, slave);
+
+    return 2;
+}
+
+static lserial_port *lserial_port_get(lua_State *L, int idx) {
+    lserial_port *obj = luaL_checkudata(L, idx, LUA_SERIAL_PORT_NAME);
+    if (!obj->port) {
+        luaL_error(L, "attemp to use a destroyed serial port");
+    }
+    return obj;
+}
+
+static int lserial_port_settimeout(lua_State *L) {
+    lserial_port *obj = lserial_port_get(L, 1);
+    lua_Integer ms = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, ms >= 0 && ms <= UINT32_MAX, 2, "ms out of range");
+
+    pal_serial_set_timeout(obj->port, ms);
+
+    return 0;
+}
+
+static void lserial_sent_cb(pal_serial_obj *o, pal_serial_err err, void *arg) {
+    if (gv_lserial_collecting) {
+        return;
+    }
+    lua_State *L = app_get_lua_main_thread();
+    lua_State *co = arg;
+    // Not empty when the port is destroyed by the script run by app_init().
+    int top = lua_gettop(L);
+    int status, nres;
+
+    lua_pushinteger(co, err);
+    status = lc_resumethread(co, L, 1, &nres);
+    if (status != LUA_OK && status != LUA_YIELD) {
+        HAPLogError(&lserial_log, "%s: %s", __func__, lua_tostring(L, -1));
+    }
+
+    lua_settop(L, top);
+    lc_collectgarbage(L);
+}
+
+static int finshwrite(lua_State *L, int status, lua_KContext extra) {
+    // lua_stack: [-1] = err
+    pal_serial_err err = lua_tointeger(L, -1);
+
+    switch (err) {
+    case PAL_SERIAL_ERR_OK:
+        break;
+    case PAL_SERIAL_ERR_IN_PROGRESS:
+        lua_yieldk(L, 0, extra, finshwrite);
+        break;
+    default:
+        luaL_error(L, pal_serial_get_error_str(err));
+        break;
+    }
+    return 0;
+}
+
+static int lserial_port_write(lua_State *L) {
+    lserial_port *obj = lserial_port_get(L, 1);
+    size_t len;
+    const char *data = luaL_checklstring(L, 2, &len);
+
+    lua_pushinteger(L, pal_serial_write(obj->port, data, len, lserial_sent_cb, L));
+    return finshwrite(L, LUA_OK, 0);
+}
+
+static void lserial_recved_cb(pal_serial_obj *o, pal_serial_err err,
+    const void *data, size_t len, void *arg) {
+    if (gv_lserial_collecting) {
+        return;
+    }
+    lua_State *L = app_get_lua_main_thread();
+    lua_State *co = arg;
+    // Not empty when the port is destroyed by the script run by app_init().
+    int top = lua_gettop(L);
+    int status, nres;
+
+    lua_pushlstring(co, data, len);
+    lua_pushinteger(co, err);
+    status = lc_resumethread(co, L, 2, &nres);
+    if (status != LUA_OK && status != LUA_YIELD) {
+        HAPLogError(&lserial_log, "%s: %s", __func__, lua_tostring(L, -1));
+    }
+
+    lua_settop(L, top);
+    lc_collectgarbage(L);
+}
+
+static int finshread(lua_State *L, int status, lua_KContext extra) {
+    // lua_stack: [-1] = err, [-2] = data
+    pal_serial_err err = lua_tointeger(L, -1);
+
+    switch (err) {
+    case PAL_SERIAL_ERR_OK:
+        lua_pop(L, 1);
+        return 1;
+    case PAL_SERIAL_ERR_IN_PROGRESS:
+        lua_yieldk(L, 0, extra, finshread);
+        break;
+    default:
+        luaL_error(L, pal_serial_get_error_str(err));
+        break;
+    }
+    return 0;
+}
+
+static int lserial_port_read_result(lua_State *L, pal_serial_err err, const void *data, size_t len) {
+    if (err == PAL_SERIAL_ERR_OK) {
+        lua_pushlstring(L, data, len);
+    } else {
+        lua_pushnil(L);
+    }
+    lua_pushinteger(L, err);
+    return finshread(L, LUA_OK, 0);
+}
+
+static int lserial_port_read(lua_State *L) {
+    lserial_port *obj = lserial_port_get(L, 1);
+    lua_Integer maxlen = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, maxlen > 0, 2, "maxlen out of range");
+
+    const void *data = NULL;
+    size_t len = 0;
+    pal_serial_err err = pal_serial_read(obj->port, maxlen, &data, &len, lserial_recved_cb, L);
+    return lserial_port_read_result(L, err, data, len);
+}
+
+static int lserial_port_readexactly(lua_State *L) {
+    lserial_port *obj = lserial_port_get(L, 1);
+    lua_Integer len = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, len > 0, 2, "len out of range");
+
+    const void *data = NULL;
+    pal_serial_err err = pal_serial_read_exactly(obj->port, len, &data, lserial_recved_cb, L);
+    return lserial_port_read_result(L, err, data, len);
+}
+
+static int lserial_port_readuntil(lua_State *L) {
+    lserial_port *obj = lserial_port_get(L, 1);
+    size_t delimlen;
+    const char *delim = luaL_checklstring(L, 2, &delimlen);
+    luaL_argcheck(L, delimlen > 0 && delimlen <= PAL_SERIAL_DELIM_MAXLEN, 2, "delimiter length out of range");
+    lua_Integer maxlen = luaL_checkinteger(L, 3);
+    luaL_argcheck(L, maxlen >= (lua_Integer)delimlen, 3, "maxlen out of range");
+
+    const void *data = NULL;
+    size_t len = 0;
+    pal_serial_err err = pal_serial_read_until(obj->port, delim, delimlen, maxlen,
+        &data, &len, lserial_recved_cb, L);
+    return lserial_port_read_result(L, err, data, len);
+}
+
+// The pending operations fail with an error, the port is detached first
+// so their coroutines can not use it.
+static void lserial_port_close(lserial_port *obj) {
+    pal_serial_obj *port = obj->port;
+    obj->port = NULL;
+    pal_serial_destroy(port);
+}
+
+static int lserial_port_destroy(lua_State *L) {
+    lserial_port *obj = lserial_port_get(L, 1);
+    lserial_port_close(obj);
+    return 0;
+}
+
+static int lserial_port_tbc(lua_State *L) {
+    lserial_port *obj = luaL_checkudata(L, 1, LUA_SERIAL_PORT_NAME);
+    if (obj->port) {
+        lserial_port_close(obj);
+    }
+    return 0;
+}
+
+static int lserial_port_gc(lua_State *L) {
+    lserial_port *obj = luaL_checkudata(L, 1, LUA_SERIAL_PORT_NAME);
+    if (obj->port) {
+        gv_lserial_collecting = true;
+        lserial_port_close(obj);
+        gv_lserial_collecting = false;
+    }
+    return 0;
+}
+
+static int lserial_port_tostring(lua_State *L) {
+    lserial_port *obj = luaL_checkudata(L, 1, LUA_SERIAL_PORT_NAME);
+    if (obj->port) {
+        lua_pushfstring(L, "serial port (%p)", obj->port);
+    } else {
+        lua_pushliteral(L, "serial port (destroyed)");
+    }
+    return 1;
+}
+
+static const lc_rotable_kv lserial_funcs[] = {
+    LC_ROFUNC("open", lserial_open),
+    LC_ROFUNC("openpty", lserial_openpty),
+    LC_ROEND,
+};
+
+/*
+ * methods for serial port object
+ */
+static const luaL_Reg lserial_port_meth[] = {
+    {"settimeout", lserial_port_settimeout},
+    {"write", lserial_port_write},
+    {"read", lserial_port_read},
+    {"readexactly", lserial_port_readexactly},
+    {"readuntil", lserial_port_readuntil},
+    {"destroy", lserial_port_destroy},
+    {NULL, NULL}
+};
+
+/*
+ * metamethods for serial port object
+ */
+static const luaL_Reg lserial_port_metameth[] = {
+    {"__index", NULL},  /* place holder */
+    {"__gc", lserial_port_gc},
+    {"__close", lserial_port_tbc},
+    {"__tostring", lserial_port_tostring},
+    {NULL, NULL}
+};
+
+static void lserial_createmeta(lua_State *L) {
+    luaL_newmetatable(L, LUA_SERIAL_PORT_NAME);  /* metatable for SerialPort* */
+    luaL_setfuncs(L, lserial_port_metameth, 0);  /* add metamethods to new metatable */
+    luaL_newlibtable(L, lserial_port_meth);  /* create method table */
+    luaL_setfuncs(L, lserial_port_meth, 0);  /* add SerialPort* methods to method table */
+    lua_setfield(L, -2, "__index");  /* metatable.__index = method table */
+    lua_pop(L, 1);  /* pop metatable */
+}
+
+LUAMOD_API int luaopen_serial(lua_State *L) {
+    lc_push_rotable(L, lserial_funcs);
+    lserial_createmeta(L);
+    return 1;
+}
@@ -78,6 +78,18 @@ static int lsocket_obj_enablebroadcast(lua_State *L) {
     return 0;
 }
 
+static int lsocket_obj_joingroup(lua_State *L) {
+    lsocket_obj *obj = lsocket_obj_get(L, 1);
+    const char *maddr = luaL_checkstring(L, 2);
+    const char *ifaddr = luaL_optstring(L, 3, NULL);
+
+    pal_socket_err err = pal_socket_join_multicast_group(obj->socket, maddr, ifaddr);
+    if (err != PAL_SOCKET_ERR_OK) {
+        luaL_error(L, pal_socket_get_error_str(err));
+    }
+    return 0;
+}
+
 static int lsocket_obj_bind(lua_State *L) {
     lsocket_obj *obj = lsocket_obj_get(L, 1);
     const char *addr = luaL_checkstring(L, 2);
@@ -371,9 +383,9 @@ static int lsocket_obj_tostring(lua_State *L) {
     return 1;
 }
 
-static const luaL_Reg lsocket_funcs[] = {
-    {"create", lsocket_create},
-    {NULL, NULL},
+static const lc_rotable_kv lsocket_funcs[] = {
+    LC_ROFUNC("create", lsocket_create),
+    LC_ROEND,
 };
 
 /*
@@ -382,6 +394,7 @@ static const luaL_Reg lsocket_funcs[] = {
 static const luaL_Reg lsocket_obj_meth[] = {
     {"settimeout", lsocket_obj_settimeout},
     {"enablebroadcast", lsocket_obj_enablebroadcast},
+    {"joingroup", lsocket_obj_joingroup},
     {"bind", lsocket_obj_bind},
     {"listen", lsocket_obj_listen},
     {"accept", lsocket_obj_accept},
@@ -417,7 +430,7 @@ static void lsocket_createmeta(lua_State *L) {
 }
 
 LUAMOD_API int luaopen_socket(lua_State *L) {
-    luaL_newlib(L, lsocket_funcs);
+    lc_push_rotable(L, lsocket_funcs);
     lsocket_createmeta(L);
     return 1;
 }
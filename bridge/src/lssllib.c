@@ -34,12 +34,40 @@ static int lssl_create(lua_State *L) {
         hostname = luaL_checkstring(L, 2);
     }
 
+    const char *protos[PAL_SSL_ALPN_MAX];
+    size_t nprotos = 0;
+    if (!lua_isnoneornil(L, 3)) {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        luaL_argcheck(L, ep == PAL_SSL_ENDPOINT_CLIENT, 3, "ALPN is only supported by client");
+        nprotos = luaL_len(L, 3);
+        luaL_argcheck(L, nprotos > 0 && nprotos <= PAL_SSL_ALPN_MAX, 3, "invalid number of protocols");
+        for (size_t i = 0; i < nprotos; i++) {
+            lua_geti(L, 3, i + 1);
+            protos[i] = lua_tostring(L, -1);
+            luaL_argcheck(L, protos[i], 3, "protocol must be a string");
+        }
+    }
+
     lssl_ctx *ctx = lua_newuserdata(L, sizeof(*ctx));
     luaL_setmetatable(L, LUA_SSL_CTX_NAME);
     ctx->ctx = pal_ssl_create(ep, hostname);
-    if (!ctx) {
+    if (!ctx->ctx) {
         luaL_error(L, "failed to create SSL context");
     }
+    if (nprotos && !pal_ssl_set_alpn(ctx->ctx, protos, nprotos)) {
+        luaL_error(L, "failed to set ALPN protocols");
+    }
+    return 1;
+}
+
+static int lssl_ctx_alpn(lua_State *L) {
+    lssl_ctx *ctx = luaL_checkudata(L, 1, LUA_SSL_CTX_NAME);
+    const char *proto = pal_ssl_get_alpn(ctx->ctx);
+    if (proto) {
+        lua_pushstring(L, proto);
+    } else {
+        lua_pushnil(L);
+    }
     return 1;
 }
 
@@ -123,9 +151,9 @@ static int lssl_ctx_tostring(lua_State *L) {
     return 1;
 }
 
-static const luaL_Reg lssl_funcs[] = {
-    {"create", lssl_create},
-    {NULL, NULL},
+static const lc_rotable_kv lssl_funcs[] = {
+    LC_ROFUNC("create", lssl_create),
+    LC_ROEND,
 };
 
 /*
@@ -146,6 +174,7 @@ static const luaL_Reg lssl_ctx_meth[] = {
     {"handshake", lssl_ctx_handshake},
     {"encrypt", lssl_ctx_encrypt},
     {"decrypt", lssl_ctx_decrypt},
+    {"alpn", lssl_ctx_alpn},
     {NULL, NULL},
 };
 
@@ -159,7 +188,7 @@ static void lssl_createmeta(lua_State *L) {
 }
 
 LUAMOD_API int luaopen_ssl(lua_State *L) {
-    luaL_newlib(L, lssl_funcs);
+    lc_push_rotable(L, lssl_funcs);
     lssl_createmeta(L);
     return 1;
 }
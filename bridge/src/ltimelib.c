@@ -13,6 +13,15 @@
 
 #define LUA_TIMER_NAME "Timer*"
 
+// Delay of a deferred background timer, in milliseconds.
+#define LTIME_TIMER_DEFER_MS 1000
+
+// Max times a background timer is deferred under moderate pressure.
+#define LTIME_TIMER_DEFER_MAX 3
+
+// Max times a background timer is deferred under critical pressure.
+#define LTIME_TIMER_DEFER_MAX_CRITICAL 10
+
 static const HAPLogObject ltime_log = {
     .subsystem = APP_BRIDGE_LOG_SUBSYSTEM,
     .category = "ltime",
@@ -23,6 +32,8 @@ static const HAPLogObject ltime_log = {
  */
 typedef struct {
     int nargs;
+    bool background;            /* Deferred when the run loop is under pressure. */
+    int deferred;               /* Times the timer has been deferred. */
     HAPPlatformTimerRef timer;  /* Timer ID. Start from 1. */
 } ltime_timer_ctx;
 
@@ -66,6 +77,8 @@ static int ltime_createTimer(lua_State *L) {
         lua_setiuservalue(L, 1, i);
     }
     ctx->nargs = n - 1;
+    ctx->background = false;
+    ctx->deferred = 0;
     ctx->timer = 0;
     return 1;
 }
@@ -76,6 +89,30 @@ static void ltime_timer_cb(HAPPlatformTimerRef timer, void *context) {
 
     ctx->timer = 0;
 
+    if (ctx->background) {
+        int max;
+        switch (lrunloop_get_pressure()) {
+        case LRUNLOOP_PRESSURE_MODERATE:
+            max = LTIME_TIMER_DEFER_MAX;
+            break;
+        case LRUNLOOP_PRESSURE_CRITICAL:
+            max = LTIME_TIMER_DEFER_MAX_CRITICAL;
+            break;
+        default:
+            max = 0;
+            break;
+        }
+        if (ctx->deferred < max) {
+            if (HAPPlatformTimerRegister(&ctx->timer, HAPPlatformClockGetCurrent() + LTIME_TIMER_DEFER_MS,
+                ltime_timer_cb, ctx) == kHAPError_None) {
+                ctx->deferred++;
+                return;
+            }
+            HAPLogError(&ltime_log, "%s: Failed to defer the timer.", __func__);
+        }
+        ctx->deferred = 0;
+    }
+
     HAPAssert(lua_gettop(L) == 0);
 
     int nres, status;
@@ -105,6 +142,7 @@ static int ltime_timer_start(lua_State *L) {
     if (ctx->timer) {
         HAPPlatformTimerDeregister(ctx->timer);
     }
+    ctx->deferred = 0;
 
     if (HAPPlatformTimerRegister(&ctx->timer,
         ms ? (HAPTime)ms + HAPPlatformClockGetCurrent() : 0,
@@ -128,6 +166,14 @@ static int ltime_timer_stop(lua_State *L) {
     return 0;
 }
 
+static int ltime_timer_set_background(lua_State *L) {
+    ltime_timer_ctx *ctx = luaL_checkudata(L, 1, LUA_TIMER_NAME);
+    luaL_checktype(L, 2, LUA_TBOOLEAN);
+
+    ctx->background = lua_toboolean(L, 2);
+    return 0;
+}
+
 static int ltime_timer_tostring(lua_State *L) {
     ltime_timer_ctx *ctx = luaL_checkudata(L, 1, LUA_TIMER_NAME);
 
@@ -139,10 +185,16 @@ static int ltime_timer_tostring(lua_State *L) {
     return 1;
 }
 
-static const luaL_Reg ltime_funcs[] = {
-    {"sleep", ltime_sleep},
-    {"createTimer", ltime_createTimer},
-    {NULL, NULL},
+static int ltime_monotonic(lua_State *L) {
+    lua_pushinteger(L, HAPPlatformClockGetCurrent());
+    return 1;
+}
+
+static const lc_rotable_kv ltime_funcs[] = {
+    LC_ROFUNC("createTimer", ltime_createTimer),
+    LC_ROFUNC("monotonic", ltime_monotonic),
+    LC_ROFUNC("sleep", ltime_sleep),
+    LC_ROEND,
 };
 
 /*
@@ -161,6 +213,7 @@ static const luaL_Reg ltime_timer_metameth[] = {
 static const luaL_Reg ltime_timer_meth[] = {
     {"start", ltime_timer_start},
     {"stop", ltime_timer_stop},
+    {"setBackground", ltime_timer_set_background},
     {NULL, NULL},
 };
 
@@ -174,7 +227,7 @@ static void ltime_createmeta(lua_State *L) {
 }
 
 LUAMOD_API int luaopen_time(lua_State *L) {
-    luaL_newlib(L, ltime_funcs);
+    lc_push_rotable(L, ltime_funcs);
     ltime_createmeta(L);
     return 1;
 }
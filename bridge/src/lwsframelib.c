@@ -0,0 +1,386 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#include <string.h>
+#include <lauxlib.h>
+#include <pal/memory.h>
+#include <pal/crypto/md.h>
+#include <HAPPlatform.h>
+#include "lc.h"
+#include "app_int.h"
+
+#define LUA_WSFRAME_PARSER_NAME "WSFrameParser*"
+
+// GUID concatenated to the key to compute Sec-WebSocket-Accept (RFC 6455 1.3).
+#define LWSFRAME_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+#define LWSFRAME_KEY_LEN 16
+#define LWSFRAME_HEADER_LEN_MAX 14
+#define LWSFRAME_CONTROL_PAYLOAD_MAX 125
+#define LWSFRAME_MAXSIZE_DEFAULT (64 * 1024)
+
+#define LWSFRAME_FIN 0x80
+#define LWSFRAME_RSV 0x70
+#define LWSFRAME_MASK 0x80
+
+// Opcodes.
+#define LWSFRAME_OP_CONTINUATION 0x0
+
+/**
+ * Incremental frame parser.
+ */
+typedef struct {
+    uint8_t *buf;       /* received bytes */
+    size_t pos;         /* position of the first unparsed byte */
+    size_t len;         /* length of the received bytes */
+    size_t cap;         /* capacity of buf */
+    uint8_t *msg;       /* payload of the fragmented message */
+    size_t msglen;      /* length of the fragmented message */
+    size_t msgcap;      /* capacity of msg */
+    uint8_t msgop;      /* opcode of the fragmented message, 0 if there is none */
+    size_t maxsize;     /* max size of a message */
+} lwsframe_parser;
+
+static const char *lwsframe_opcode_strs[] = {
+    "continuation",
+    "text",
+    "binary",
+    "close",
+    "ping",
+    "pong",
+    NULL,
+};
+
+static const uint8_t lwsframe_opcodes[] = {
+    0x0, 0x1, 0x2, 0x8, 0x9, 0xa,
+};
+
+static const char lwsframe_base64_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const char *lwsframe_opcode_str(uint8_t op) {
+    for (size_t i = 0; i < HAPArrayCount(lwsframe_opcodes); i++) {
+        if (lwsframe_opcodes[i] == op) {
+            return lwsframe_opcode_strs[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * XOR the data with the masking key, a machine word at a time.
+ *
+ * The data must start at a multiple of 4 bytes from the start of the payload.
+ */
+static void lwsframe_mask(uint8_t *data, size_t len, const uint8_t key[4]) {
+    uint8_t key8[8];
+    memcpy(key8, key, 4);
+    memcpy(key8 + 4, key, 4);
+    uint64_t k;
+    memcpy(&k, key8, sizeof(k));
+
+    size_t i = 0;
+    for (; i + sizeof(k) <= len; i += sizeof(k)) {
+        uint64_t v;
+        memcpy(&v, data + i, sizeof(v));
+        v ^= k;
+        memcpy(data + i, &v, sizeof(v));
+    }
+    for (; i < len; i++) {
+        data[i] ^= key[i & 3];
+    }
+}
+
+static void lwsframe_push_base64(lua_State *L, const uint8_t *data, size_t len) {
+    luaL_Buffer B;
+    char *out = luaL_buffinitsize(L, &B, (len + 2) / 3 * 4);
+    char *p = out;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = data[i] << 16;
+        if (i + 1 < len) {
+            v |= data[i + 1] << 8;
+        }
+        if (i + 2 < len) {
+            v |= data[i + 2];
+        }
+        *p++ = lwsframe_base64_chars[(v >> 18) & 0x3f];
+        *p++ = lwsframe_base64_chars[(v >> 12) & 0x3f];
+        *p++ = i + 1 < len ? lwsframe_base64_chars[(v >> 6) & 0x3f] : '=';
+        *p++ = i + 2 < len ? lwsframe_base64_chars[v & 0x3f] : '=';
+    }
+    luaL_pushresultsize(&B, p - out);
+}
+
+static int lwsframe_key(lua_State *L) {
+    uint8_t key[LWSFRAME_KEY_LEN];
+    HAPPlatformRandomNumberFill(key, sizeof(key));
+    lwsframe_push_base64(L, key, sizeof(key));
+    return 1;
+}
+
+static int lwsframe_accept(lua_State *L) {
+    size_t len;
+    const char *key = luaL_checklstring(L, 1, &len);
+
+    pal_md_ctx *ctx = pal_md_new(PAL_MD_SHA1);
+    if (!ctx) {
+        luaL_error(L, "failed to create a SHA1 context");
+    }
+    uint8_t digest[20];
+    HAPAssert(pal_md_get_size(ctx) == sizeof(digest));
+    bool ok = pal_md_update(ctx, key, len) &&
+        pal_md_update(ctx, LWSFRAME_GUID, sizeof(LWSFRAME_GUID) - 1) &&
+        pal_md_digest(ctx, digest);
+    pal_md_free(ctx);
+    if (!ok) {
+        luaL_error(L, "failed to compute the accept key");
+    }
+    lwsframe_push_base64(L, digest, sizeof(digest));
+    return 1;
+}
+
+static int lwsframe_encode(lua_State *L) {
+    uint8_t op = lwsframe_opcodes[luaL_checkoption(L, 1, NULL, lwsframe_opcode_strs)];
+    size_t len;
+    const char *payload = luaL_optlstring(L, 2, "", &len);
+    bool fin = lua_isnoneornil(L, 3) ? true : lua_toboolean(L, 3);
+    bool mask = lua_isnoneornil(L, 4) ? true : lua_toboolean(L, 4);
+    if (op & 0x8) {
+        luaL_argcheck(L, len <= LWSFRAME_CONTROL_PAYLOAD_MAX, 2, "control frame payload too large");
+        luaL_argcheck(L, fin, 3, "control frame must not be fragmented");
+    }
+
+    luaL_Buffer B;
+    uint8_t *out = (uint8_t *)luaL_buffinitsize(L, &B, LWSFRAME_HEADER_LEN_MAX + len);
+    uint8_t *p = out;
+    *p++ = (fin ? LWSFRAME_FIN : 0) | op;
+    uint8_t maskbit = mask ? LWSFRAME_MASK : 0;
+    if (len < 126) {
+        *p++ = maskbit | len;
+    } else if (len <= UINT16_MAX) {
+        *p++ = maskbit | 126;
+        *p++ = len >> 8;
+        *p++ = len;
+    } else {
+        *p++ = maskbit | 127;
+        for (int i = 7; i >= 0; i--) {
+            *p++ = (uint64_t)len >> (i * 8);
+        }
+    }
+    if (mask) {
+        uint8_t *key = p;
+        HAPPlatformRandomNumberFill(key, 4);
+        p += 4;
+        memcpy(p, payload, len);
+        lwsframe_mask(p, len, key);
+    } else {
+        memcpy(p, payload, len);
+    }
+    p += len;
+    luaL_pushresultsize(&B, p - out);
+    return 1;
+}
+
+static int lwsframe_parser_create(lua_State *L) {
+    lua_Integer maxsize = luaL_optinteger(L, 1, LWSFRAME_MAXSIZE_DEFAULT);
+    luaL_argcheck(L, maxsize > 0, 1, "maxsize must be positive");
+
+    lwsframe_parser *parser = lua_newuserdata(L, sizeof(*parser));
+    memset(parser, 0, sizeof(*parser));
+    parser->maxsize = maxsize;
+    luaL_setmetatable(L, LUA_WSFRAME_PARSER_NAME);
+    return 1;
+}
+
+static bool lwsframe_reserve(uint8_t **buf, size_t *cap, size_t size) {
+    if (size <= *cap) {
+        return true;
+    }
+    size_t newcap = *cap ? *cap : 256;
+    while (newcap < size) {
+        newcap *= 2;
+    }
+    uint8_t *newbuf = pal_mem_realloc(*buf, newcap);
+    if (!newbuf) {
+        return false;
+    }
+    *buf = newbuf;
+    *cap = newcap;
+    return true;
+}
+
+static lwsframe_parser *lwsframe_parser_get(lua_State *L, int idx) {
+    return luaL_checkudata(L, idx, LUA_WSFRAME_PARSER_NAME);
+}
+
+static int lwsframe_parser_feed(lua_State *L) {
+    lwsframe_parser *parser = lwsframe_parser_get(L, 1);
+    size_t len;
+    const char *data = luaL_checklstring(L, 2, &len);
+
+    // Drop the parsed bytes before growing the buffer.
+    if (parser->pos) {
+        memmove(parser->buf, parser->buf + parser->pos, parser->len - parser->pos);
+        parser->len -= parser->pos;
+        parser->pos = 0;
+    }
+    if (!lwsframe_reserve(&parser->buf, &parser->cap, parser->len + len)) {
+        luaL_error(L, "failed to alloc memory");
+    }
+    memcpy(parser->buf + parser->len, data, len);
+    parser->len += len;
+    return 0;
+}
+
+static int lwsframe_parser_next(lua_State *L) {
+    lwsframe_parser *parser = lwsframe_parser_get(L, 1);
+
+    while (true) {
+        uint8_t *p = parser->buf + parser->pos;
+        size_t avail = parser->len - parser->pos;
+        if (avail < 2) {
+            return 0;
+        }
+        bool fin = p[0] & LWSFRAME_FIN;
+        uint8_t op = p[0] & 0x0f;
+        bool masked = p[1] & LWSFRAME_MASK;
+        uint64_t plen = p[1] & 0x7f;
+        size_t hlen = 2;
+        if (p[0] & LWSFRAME_RSV) {
+            luaL_error(L, "reserved bits are set");
+        }
+        if (plen == 126) {
+            if (avail < 4) {
+                return 0;
+            }
+            plen = (p[2] << 8) | p[3];
+            hlen = 4;
+        } else if (plen == 127) {
+            if (avail < 10) {
+                return 0;
+            }
+            plen = 0;
+            for (int i = 2; i < 10; i++) {
+                plen = (plen << 8) | p[i];
+            }
+            hlen = 10;
+        }
+        if (masked) {
+            hlen += 4;
+        }
+
+        const char *opstr = lwsframe_opcode_str(op);
+        if (!opstr) {
+            luaL_error(L, "unknown opcode 0x%x", op);
+        }
+        if ((op & 0x8) && (!fin || plen > LWSFRAME_CONTROL_PAYLOAD_MAX)) {
+            luaL_error(L, "invalid control frame");
+        }
+        if (plen > parser->maxsize ||
+            (op == LWSFRAME_OP_CONTINUATION && plen > parser->maxsize - parser->msglen)) {
+            luaL_error(L, "message too large");
+        }
+        if (avail < hlen || avail - hlen < plen) {
+            return 0;
+        }
+
+        uint8_t *payload = p + hlen;
+        if (masked) {
+            lwsframe_mask(payload, plen, payload - 4);
+        }
+        parser->pos += hlen + plen;
+
+        if (op & 0x8) {
+            // Control frames may be injected in the middle of a fragmented message.
+            lua_pushstring(L, opstr);
+            lua_pushlstring(L, (const char *)payload, plen);
+            return 2;
+        }
+        if (op == LWSFRAME_OP_CONTINUATION) {
+            if (!parser->msgop) {
+                luaL_error(L, "unexpected continuation frame");
+            }
+        } else {
+            if (parser->msgop) {
+                luaL_error(L, "expected continuation frame");
+            }
+            if (fin) {
+                lua_pushstring(L, opstr);
+                lua_pushlstring(L, (const char *)payload, plen);
+                return 2;
+            }
+            parser->msgop = op;
+        }
+        if (!lwsframe_reserve(&parser->msg, &parser->msgcap, parser->msglen + plen)) {
+            luaL_error(L, "failed to alloc memory");
+        }
+        memcpy(parser->msg + parser->msglen, payload, plen);
+        parser->msglen += plen;
+        if (fin) {
+            lua_pushstring(L, lwsframe_opcode_str(parser->msgop));
+            lua_pushlstring(L, (const char *)parser->msg, parser->msglen);
+            parser->msgop = 0;
+            parser->msglen = 0;
+            return 2;
+        }
+    }
+}
+
+static int lwsframe_parser_gc(lua_State *L) {
+    lwsframe_parser *parser = lwsframe_parser_get(L, 1);
+    pal_mem_free(parser->buf);
+    pal_mem_free(parser->msg);
+    memset(parser, 0, sizeof(*parser));
+    return 0;
+}
+
+static int lwsframe_parser_tostring(lua_State *L) {
+    lwsframe_parser *parser = lwsframe_parser_get(L, 1);
+    lua_pushfstring(L, "websocket frame parser (%p)", parser);
+    return 1;
+}
+
+static const lc_rotable_kv lwsframe_funcs[] = {
+    LC_ROFUNC("accept", lwsframe_accept),
+    LC_ROFUNC("encode", lwsframe_encode),
+    LC_ROFUNC("key", lwsframe_key),
+    LC_ROFUNC("parser", lwsframe_parser_create),
+    LC_ROEND,
+};
+
+/*
+ * methods for frame parser
+ */
+static const luaL_Reg lwsframe_parser_meth[] = {
+    {"feed", lwsframe_parser_feed},
+    {"next", lwsframe_parser_next},
+    {NULL, NULL},
+};
+
+/*
+ * metamethods for frame parser
+ */
+static const luaL_Reg lwsframe_parser_metameth[] = {
+    {"__index", NULL},  /* place holder */
+    {"__gc", lwsframe_parser_gc},
+    {"__tostring", lwsframe_parser_tostring},
+    {NULL, NULL}
+};
+
+static void lwsframe_createmeta(lua_State *L) {
+    luaL_newmetatable(L, LUA_WSFRAME_PARSER_NAME);  /* metatable for frame parser */
+    luaL_setfuncs(L, lwsframe_parser_metameth, 0);  /* add metamethods to new metatable */
+    luaL_newlibtable(L, lwsframe_parser_meth);  /* create method table */
+    luaL_setfuncs(L, lwsframe_parser_meth, 0);  /* add frame parser methods to method table */
+    lua_setfield(L, -2, "__index");  /* metatable.__index = method table */
+    lua_pop(L, 1);  /* pop metatable */
+}
+
+LUAMOD_API int luaopen_wsframe(lua_State *L) {
+    lc_push_rotable(L, lwsframe_funcs);
+    lwsframe_createmeta(L);
+    return 1;
+}
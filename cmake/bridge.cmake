@@ -18,6 +18,7 @@ set(BRIDGE_SRCS
     ${BRIDGE_SRC_DIR}/lchiplib.c
     ${BRIDGE_SRC_DIR}/ltimelib.c
     ${BRIDGE_SRC_DIR}/lc.c
+    ${BRIDGE_SRC_DIR}/lcheap.c
     ${BRIDGE_SRC_DIR}/lhashlib.c
     ${BRIDGE_SRC_DIR}/lcipherlib.c
     ${BRIDGE_SRC_DIR}/lsocketlib.c
@@ -25,6 +26,14 @@ set(BRIDGE_SRCS
     ${BRIDGE_SRC_DIR}/lssllib.c
     ${BRIDGE_SRC_DIR}/ldnslib.c
     ${BRIDGE_SRC_DIR}/lnvslib.c
+    ${BRIDGE_SRC_DIR}/lrunlooplib.c
+    ${BRIDGE_SRC_DIR}/lcpluginlib.c
+    ${BRIDGE_SRC_DIR}/lwsframelib.c
+    ${BRIDGE_SRC_DIR}/lcompresslib.c
+    ${BRIDGE_SRC_DIR}/laiolib.c
+    ${BRIDGE_SRC_DIR}/lseriallib.c
+    ${BRIDGE_SRC_DIR}/lmodbuslib.c
+    ${BRIDGE_SRC_DIR}/lnetiflib.c
     ${BRIDGE_SRC_DIR}/embedfs.c
 )
 
@@ -32,6 +41,7 @@ set(BRIDGE_SRCS
 set(BRIDGE_HEADERS
     ${BRIDGE_INC_DIR}/app.h
     ${BRIDGE_INC_DIR}/embedfs.h
+    ${BRIDGE_INC_DIR}/plugin.h
     ${BRIDGE_SRC_DIR}/app_int.h
     ${BRIDGE_SRC_DIR}/lc.h
 )
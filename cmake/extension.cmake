@@ -9,11 +9,23 @@
 # out: absolute path of the output file
 # in: input file path relative to ${dir}
 # dir: the path in the debug information generated by luac will be relative to this directory
+# LINEMAP: generate stripped bytecode with luastrip and write the line map to <map>
 #
-# gen_lua_binary(<out> <in> <dir> <luac> [DEBUG])
+# gen_lua_binary(<out> <in> <dir> <luac> [DEBUG] [LINEMAP <map> LUASTRIP <luastrip>])
 function(gen_lua_binary out in dir luac)
     set(options DEBUG)
-    cmake_parse_arguments(arg "${options}" "" "" "${ARGN}")
+    set(one LINEMAP LUASTRIP)
+    cmake_parse_arguments(arg "${options}" "${one}" "" "${ARGN}")
+    if(arg_LINEMAP)
+        add_custom_command(OUTPUT ${out} ${arg_LINEMAP}
+            COMMAND cd ${dir}
+            COMMAND ${arg_LUASTRIP} ${in} ${out} ${arg_LINEMAP}
+            COMMAND echo "Generated ${out}"
+            DEPENDS ${arg_LUASTRIP} ${dir}/${in}
+            COMMENT "Generating ${out}"
+        )
+        return()
+    endif()
     if(NOT arg_DEBUG)
         set(LUAC_FLAGS ${LUAC_FLAGS} -s)
     endif()
@@ -28,12 +40,16 @@ endfunction(gen_lua_binary)
 
 # Genrate lua binraies in a directory.
 #
+# LINEMAP: generate stripped bytecode "*.luac" and line maps "*.luam" with luastrip
+#
 # gen_lua_binary_from_dir(<target> <dest_dir> <luac> [DEBUG]
+#                         [LINEMAP LUASTRIP <luastrip>]
 #                         [SRC_DIRS dir1 [dir2...]])
 function(gen_lua_binary_from_dir target dest_dir luac)
-    set(options DEBUG)
+    set(options DEBUG LINEMAP)
+    set(one LUASTRIP)
     set(multi SRC_DIRS)
-    cmake_parse_arguments(arg "${options}" "" "${multi}" "${ARGN}")
+    cmake_parse_arguments(arg "${options}" "${one}" "${multi}" "${ARGN}")
     if(arg_DEBUG)
         set(GEN_LUA_LIBRARY_OPTIONS DEBUG)
     endif()
@@ -45,8 +61,14 @@ function(gen_lua_binary_from_dir target dest_dir luac)
             set(bins ${bins} ${bin})
             get_filename_component(dir ${bin} DIRECTORY)
             make_directory(${dir})
+            if(arg_LINEMAP)
+                set(map ${dest_dir}/${script}m)
+                set(bins ${bins} ${map})
+                set(GEN_LUA_BINARY_LINEMAP LINEMAP ${map} LUASTRIP ${arg_LUASTRIP})
+            endif()
             gen_lua_binary(${bin} ${script} ${src_dir} ${luac}
                 ${GEN_LUA_LIBRARY_OPTIONS}
+                ${GEN_LUA_BINARY_LINEMAP}
             )
         endforeach()
     endforeach()
@@ -58,12 +80,15 @@ endfunction(gen_lua_binary_from_dir)
 
 # Compile luac.
 #
-# compile_luac(<bin> <src_dir> <build_dir>
+# LUASTRIP: the path of luastrip built together with luac
+#
+# compile_luac(<bin> <src_dir> <build_dir> [LUASTRIP <luastrip>]
 #              [DEPENDS depend depend depend ... ])
 function(compile_luac bin src_dir build_dir)
+    set(one LUASTRIP)
     set(multi DEPENDS)
-    cmake_parse_arguments(arg "" "" "${multi}" "${ARGN}")
-    add_custom_command(OUTPUT ${bin}
+    cmake_parse_arguments(arg "" "${one}" "${multi}" "${ARGN}")
+    add_custom_command(OUTPUT ${bin} ${arg_LUASTRIP}
         COMMAND ${CMAKE_COMMAND} ${src_dir} -B${build_dir} -G Ninja
         COMMAND cmake --build ${build_dir}
         DEPENDS ${src_dir}/CMakeLists.txt ${arg_DEPENDS}
@@ -165,15 +190,26 @@ endfunction(target_add_embedfs)
 #
 # Add lua binary embedfs to a target.
 #
+# LINEMAP: embed stripped bytecode with line maps, the line maps are used to
+#          symbolize tracebacks
+#
 # target_add_lua_binary_embedfs(<target> <root_name> <luac> [DEBUG]
+#                               [LINEMAP LUASTRIP <luastrip>]
 #                               [SRC_DIRS dir1 [dir2...]])
 function(target_add_lua_binary_embedfs target root_name luac)
-    set(options DEBUG)
+    set(options DEBUG LINEMAP)
+    set(one LUASTRIP)
     set(multi SRC_DIRS)
-    cmake_parse_arguments(arg "${options}" "" "${multi}" "${ARGN}")
+    cmake_parse_arguments(arg "${options}" "${one}" "${multi}" "${ARGN}")
     if(arg_DEBUG)
         set(GEN_LUA_LIBRARY_OPTIONS DEBUG)
     endif()
+    if(arg_LINEMAP)
+        set(GEN_LUA_LIBRARY_OPTIONS ${GEN_LUA_LIBRARY_OPTIONS} LINEMAP LUASTRIP ${arg_LUASTRIP})
+        set(suffixes c m)
+    else()
+        set(suffixes c)
+    endif()
 
     set(dest_dir ${CMAKE_BINARY_DIR}/${target}_${root_name})
     set(output ${dest_dir}/${target}_${root_name}.c)
@@ -187,9 +223,14 @@ function(target_add_lua_binary_embedfs target root_name luac)
     )
 
     foreach(src_dir ${arg_SRC_DIRS})
-        file(GLOB_RECURSE bins RELATIVE ${src_dir} ${src_dir}/*.lua)
+        file(GLOB_RECURSE scripts RELATIVE ${src_dir} ${src_dir}/*.lua)
+        set(bins)
+        foreach(script ${scripts})
+            foreach(suffix ${suffixes})
+                set(bins ${bins} ${script}${suffix})
+            endforeach()
+        endforeach()
         foreach(bin ${bins})
-            set(bin ${bin}c)
             set(header ${dest_dir}/${bin}.h)
             set(headers ${headers} ${header})
             string(REGEX REPLACE "[/.]" "_" filename ${bin})
@@ -17,6 +17,8 @@ set(PLATFORM_MBEDTLS_INC_DIR ${PLATFORM_DIR}/mbedtls/include)
 set(PLATFORM_MBEDTLS_SRC_DIR ${PLATFORM_MBEDTLS_DIR}/src)
 set(PLATFORM_OPENSSL_DIR ${PLATFORM_DIR}/openssl)
 set(PLATFORM_OPENSSL_SRC_DIR ${PLATFORM_OPENSSL_DIR}/src)
+set(PLATFORM_ZLIB_DIR ${PLATFORM_DIR}/zlib)
+set(PLATFORM_ZLIB_SRC_DIR ${PLATFORM_ZLIB_DIR}/src)
 set(PLATFORM_LINUX_DIR ${PLATFORM_DIR}/linux)
 set(PLATFORM_LINUX_SRC_DIR ${PLATFORM_LINUX_DIR}/src)
 set(PLATFORM_ESP_DIR ${PLATFORM_DIR}/esp/components/platform)
@@ -33,7 +35,14 @@ set(PLATFORM_HEADERS
     ${PLATFORM_INC_DIR}/pal/net/socket.h
     ${PLATFORM_INC_DIR}/pal/net/addr.h
     ${PLATFORM_INC_DIR}/pal/net/dns.h
+    ${PLATFORM_INC_DIR}/pal/net/netif.h
     ${PLATFORM_INC_DIR}/pal/nvs.h
+    ${PLATFORM_INC_DIR}/pal/slot.h
+    ${PLATFORM_INC_DIR}/pal/compress.h
+    ${PLATFORM_INC_DIR}/pal/trace.h
+    ${PLATFORM_INC_DIR}/pal/aio.h
+    ${PLATFORM_INC_DIR}/pal/dispatch.h
+    ${PLATFORM_INC_DIR}/pal/serial.h
 )
 
 # collect platform Linux include directories
@@ -49,11 +58,18 @@ set(PLATFORM_LINUX_SRCS
     ${PLATFORM_OPENSSL_SRC_DIR}/cipher.c
     ${PLATFORM_OPENSSL_SRC_DIR}/md.c
     ${PLATFORM_OPENSSL_SRC_DIR}/ssl.c
+    ${PLATFORM_ZLIB_SRC_DIR}/compress.c
     ${PLATFORM_LINUX_SRC_DIR}/chip.c
     ${PLATFORM_LINUX_SRC_DIR}/memory.c
     ${PLATFORM_LINUX_SRC_DIR}/main.c
     ${PLATFORM_LINUX_SRC_DIR}/dns.c
+    ${PLATFORM_LINUX_SRC_DIR}/netif.c
+    ${PLATFORM_LINUX_SRC_DIR}/slot.c
+    ${PLATFORM_LINUX_SRC_DIR}/slot_writer.c
     ${PLATFORM_COMMON_POSIX_SRC_DIR}/nvs.c
+    ${PLATFORM_COMMON_POSIX_SRC_DIR}/aio.c
+    ${PLATFORM_COMMON_POSIX_SRC_DIR}/dispatch.c
+    ${PLATFORM_COMMON_POSIX_SRC_DIR}/serial.c
 )
 
 # collect platform ESP include directories
@@ -66,6 +82,9 @@ set(PLATFORM_ESP_INC_DIRS
 set(PLATFORM_ESP_SRCS
     ${PLATFORM_COMMON_SRC_DIR}/hap.c
     ${PLATFORM_COMMON_POSIX_SRC_DIR}/socket.c
+    ${PLATFORM_COMMON_POSIX_SRC_DIR}/aio.c
+    ${PLATFORM_COMMON_POSIX_SRC_DIR}/dispatch.c
+    ${PLATFORM_COMMON_POSIX_SRC_DIR}/serial.c
     ${PLATFORM_MBEDTLS_SRC_DIR}/cipher.c
     ${PLATFORM_MBEDTLS_SRC_DIR}/md.c
     ${PLATFORM_MBEDTLS_SRC_DIR}/ssl.c
@@ -73,5 +92,8 @@ set(PLATFORM_ESP_SRCS
     ${PLATFORM_ESP_SRC_DIR}/chip.c
     ${PLATFORM_ESP_SRC_DIR}/memory.c
     ${PLATFORM_ESP_SRC_DIR}/dns.c
+    ${PLATFORM_ESP_SRC_DIR}/netif.c
+    ${PLATFORM_ESP_SRC_DIR}/slot.c
+    ${PLATFORM_ESP_SRC_DIR}/compress.c
     ${PLATFORM_ESP_SRC_DIR}/nvs.cpp
 )
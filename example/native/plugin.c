@@ -0,0 +1,126 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+// A light bulb served by a native plugin, the counterpart of example/lightbulb/plugin.lua.
+//
+// The plugin only uses the bridge through the API table, so it is built and
+// loaded without linking against the bridge or the ADK.
+
+#include <plugin.h>
+
+#define NATIVE_PLUGIN_NAME "native"
+
+static const bridge_plugin_api *gv_native_api;
+static bool gv_native_light_bulb_on;
+
+static HAPError native_identify(
+        HAPAccessoryServerRef *server,
+        const HAPAccessoryIdentifyRequest *request,
+        void *_Nullable context) {
+    gv_native_api->log(kHAPLogType_Info, NATIVE_PLUGIN_NAME, "Identify callback is called.");
+    return kHAPError_None;
+}
+
+static HAPError native_on_handle_read(
+        HAPAccessoryServerRef *server,
+        const HAPBoolCharacteristicReadRequest *request,
+        bool *value,
+        void *_Nullable context) {
+    *value = gv_native_light_bulb_on;
+    gv_native_api->log(kHAPLogType_Info, NATIVE_PLUGIN_NAME, "Read lightBulbOn: %s", *value ? "true" : "false");
+    return kHAPError_None;
+}
+
+static HAPError native_on_handle_write(
+        HAPAccessoryServerRef *server,
+        const HAPBoolCharacteristicWriteRequest *request,
+        bool value,
+        void *_Nullable context) {
+    gv_native_api->log(kHAPLogType_Info, NATIVE_PLUGIN_NAME, "Write lightBulbOn: %s", value ? "true" : "false");
+    if (value != gv_native_light_bulb_on) {
+        gv_native_light_bulb_on = value;
+        gv_native_api->raise_event(request->accessory->aid, request->service->iid, request->characteristic->iid);
+    }
+    return kHAPError_None;
+}
+
+// The types and IDs are filled in init().
+static HAPBoolCharacteristic native_on_characteristic = {
+    .format = kHAPCharacteristicFormat_Bool,
+    .manufacturerDescription = NULL,
+    .properties = { .readable = true,
+                    .writable = true,
+                    .supportsEventNotification = true,
+                    .hidden = false,
+                    .requiresTimedWrite = false,
+                    .supportsAuthorizationData = false,
+                    .ip = { .controlPoint = false, .supportsWriteResponse = false },
+                    .ble = { .supportsBroadcastNotification = true,
+                             .supportsDisconnectedNotification = true,
+                             .readableWithoutSecurity = false,
+                             .writableWithoutSecurity = false } },
+    .callbacks = { .handleRead = native_on_handle_read, .handleWrite = native_on_handle_write }
+};
+
+static HAPService native_light_bulb_service = {
+    .name = NULL,
+    .properties = { .primaryService = true, .hidden = false, .ble = { .supportsConfiguration = false } },
+    .linkedServices = NULL,
+    .characteristics = (const HAPCharacteristic *const[]) { &native_on_characteristic, NULL }
+};
+
+static const HAPService *native_services[] = {
+    NULL,   // Accessory Information service.
+    &native_light_bulb_service,
+    NULL,
+};
+
+static HAPAccessory native_accessory = {
+    .category = kHAPAccessoryCategory_BridgedAccessory,
+    .name = "Acme Native Light Bulb",
+    .manufacturer = "Acme",
+    .model = "LightBulb1,1",
+    .serialNumber = "099DB48E9E2A",
+    .firmwareVersion = "1",
+    .hardwareVersion = "1",
+    .services = native_services,
+    .callbacks = { .identify = native_identify }
+};
+
+static bool native_init(const bridge_plugin_api *api, const char *conf) {
+    gv_native_api = api;
+
+    native_services[0] = api->accessory_information_service;
+    native_light_bulb_service.serviceType = api->get_service_type("LightBulb",
+        &native_light_bulb_service.debugDescription);
+    native_on_characteristic.characteristicType = api->get_characteristic_type("On",
+        &native_on_characteristic.debugDescription);
+    if (!native_light_bulb_service.serviceType || !native_on_characteristic.characteristicType) {
+        api->log(kHAPLogType_Error, NATIVE_PLUGIN_NAME, "Unknown service or characteristic type.");
+        return false;
+    }
+
+    native_accessory.aid = api->get_new_bridged_aid();
+    native_light_bulb_service.iid = api->get_new_iid();
+    native_on_characteristic.iid = api->get_new_iid();
+    if (api->add_bridged_accessory(&native_accessory) != kHAPError_None) {
+        api->log(kHAPLogType_Error, NATIVE_PLUGIN_NAME, "Failed to add the accessory.");
+        return false;
+    }
+
+    api->log(kHAPLogType_Info, NATIVE_PLUGIN_NAME, "Initialized.");
+    return true;
+}
+
+static void native_handle_state(HAPAccessoryServerState state) {
+    gv_native_api->log(kHAPLogType_Info, NATIVE_PLUGIN_NAME, "HAP server state: %d.", state);
+}
+
+BRIDGE_PLUGIN_DEFINE(
+    .name = NATIVE_PLUGIN_NAME,
+    .init = native_init,
+    .handle_state = native_handle_state,
+);
@@ -4,8 +4,11 @@
 // you may not use this file except in compliance with the License.
 // See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
 
+#include <math.h>
 #include <pal/chip.h>
 #include <esp_system.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
 
 #define SERIAL_NUMBER_BUF_LEN (6 * 2 + 1)
 #define HARDWARE_VERSION_BUF_LEN 16
@@ -76,3 +79,20 @@ const char *pal_chip_get_hardware_version(void)
     snprintf(hardware_version, sizeof(hardware_version), "%d", info.revision);
     return hardware_version;
 }
+
+bool pal_chip_get_resource_usage(pal_chip_resource_usage *usage)
+{
+    if (!usage) {
+        return false;
+    }
+    usage->cpu_user_ms = -1;
+    usage->cpu_sys_ms = -1;
+    usage->cpu_usage = -1;
+    usage->rss = -1;
+    usage->heap_used = heap_caps_get_total_size(MALLOC_CAP_DEFAULT) - heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    usage->fds = -1;
+    usage->ncpus = portNUM_PROCESSORS;
+    usage->loadavg[0] = usage->loadavg[1] = usage->loadavg[2] = -1;
+    usage->temp = NAN;
+    return true;
+}
@@ -0,0 +1,266 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#include <string.h>
+#include <rom/miniz.h>
+#include <pal/memory.h>
+#include <pal/compress.h>
+#include <HAPBase.h>
+
+/*
+ * Only decompression is supported, it is backed by the tinfl decompressor
+ * in ROM. The deflate compressor in ROM needs more than 300KB of RAM.
+ */
+
+#define GZIP_FHCRC      0x02
+#define GZIP_FEXTRA     0x04
+#define GZIP_FNAME      0x08
+#define GZIP_FCOMMENT   0x10
+#define GZIP_TRAILER_LEN 8
+
+typedef enum {
+    PAL_COMPRESS_GZIP_HEADER,       /* 10 bytes fixed header */
+    PAL_COMPRESS_GZIP_EXTRA_LEN,
+    PAL_COMPRESS_GZIP_EXTRA,
+    PAL_COMPRESS_GZIP_NAME,
+    PAL_COMPRESS_GZIP_COMMENT,
+    PAL_COMPRESS_GZIP_HCRC,
+    PAL_COMPRESS_GZIP_DONE,
+} pal_compress_gzip_state;
+
+struct pal_compress_ctx {
+    pal_compress_format format;
+    bool finished;
+    pal_compress_gzip_state gzip_state;
+    uint8_t gzip_flags;
+    uint8_t gzip_xlen;      /* low byte of XLEN */
+    size_t gzip_remain;     /* remaining bytes of the current header field or trailer */
+    const uint8_t *in;
+    size_t ilen;
+    size_t dict_ofs;        /* next output position in the dictionary */
+    size_t pending_ofs;     /* output in the dictionary not returned yet */
+    size_t pending_len;
+    tinfl_decompressor decomp;
+    uint8_t dict[TINFL_LZ_DICT_SIZE];
+};
+
+pal_compress_ctx *pal_compress_create(pal_compress_mode mode, pal_compress_format format, int level) {
+    HAPPrecondition(mode == PAL_COMPRESS_DEFLATE || mode == PAL_COMPRESS_INFLATE);
+    HAPPrecondition(format == PAL_COMPRESS_FORMAT_RAW || format == PAL_COMPRESS_FORMAT_ZLIB ||
+        format == PAL_COMPRESS_FORMAT_GZIP);
+
+    if (mode == PAL_COMPRESS_DEFLATE) {
+        return NULL;
+    }
+
+    pal_compress_ctx *ctx = pal_mem_alloc(sizeof(*ctx));
+    if (!ctx) {
+        return NULL;
+    }
+    ctx->format = format;
+    ctx->finished = false;
+    ctx->gzip_state = PAL_COMPRESS_GZIP_HEADER;
+    ctx->gzip_flags = 0;
+    ctx->gzip_xlen = 0;
+    ctx->gzip_remain = 10;
+    ctx->in = NULL;
+    ctx->ilen = 0;
+    ctx->dict_ofs = 0;
+    ctx->pending_ofs = 0;
+    ctx->pending_len = 0;
+    tinfl_init(&ctx->decomp);
+    return ctx;
+}
+
+void pal_compress_free(pal_compress_ctx *ctx) {
+    if (ctx) {
+        pal_mem_free(ctx);
+    }
+}
+
+/*
+ * Move to the next optional field of the gzip header.
+ */
+static void pal_compress_gzip_next(pal_compress_ctx *ctx) {
+    switch (ctx->gzip_state) {
+    case PAL_COMPRESS_GZIP_HEADER:
+        if (ctx->gzip_flags & GZIP_FEXTRA) {
+            ctx->gzip_state = PAL_COMPRESS_GZIP_EXTRA_LEN;
+            ctx->gzip_remain = 2;
+            return;
+        }
+        // fall through
+    case PAL_COMPRESS_GZIP_EXTRA_LEN:
+    case PAL_COMPRESS_GZIP_EXTRA:
+        if (ctx->gzip_flags & GZIP_FNAME) {
+            ctx->gzip_state = PAL_COMPRESS_GZIP_NAME;
+            return;
+        }
+        // fall through
+    case PAL_COMPRESS_GZIP_NAME:
+        if (ctx->gzip_flags & GZIP_FCOMMENT) {
+            ctx->gzip_state = PAL_COMPRESS_GZIP_COMMENT;
+            return;
+        }
+        // fall through
+    case PAL_COMPRESS_GZIP_COMMENT:
+        if (ctx->gzip_flags & GZIP_FHCRC) {
+            ctx->gzip_state = PAL_COMPRESS_GZIP_HCRC;
+            ctx->gzip_remain = 2;
+            return;
+        }
+        // fall through
+    default:
+        ctx->gzip_state = PAL_COMPRESS_GZIP_DONE;
+    }
+}
+
+/*
+ * Skip the gzip header, return false if the header is invalid.
+ */
+static bool pal_compress_gzip_skip_header(pal_compress_ctx *ctx) {
+    static const uint8_t magic[] = { 0x1f, 0x8b, 8 };
+
+    while (ctx->ilen && ctx->gzip_state != PAL_COMPRESS_GZIP_DONE) {
+        uint8_t c = *ctx->in;
+        ctx->in++;
+        ctx->ilen--;
+        switch (ctx->gzip_state) {
+        case PAL_COMPRESS_GZIP_HEADER: {
+            size_t pos = 10 - ctx->gzip_remain;
+            if (pos < sizeof(magic) && c != magic[pos]) {
+                return false;
+            }
+            if (pos == 3) {
+                ctx->gzip_flags = c;
+            }
+            ctx->gzip_remain--;
+            if (!ctx->gzip_remain) {
+                pal_compress_gzip_next(ctx);
+            }
+            break;
+        }
+        case PAL_COMPRESS_GZIP_EXTRA_LEN:
+            // XLEN in little endian.
+            if (ctx->gzip_remain == 2) {
+                ctx->gzip_xlen = c;
+                ctx->gzip_remain--;
+                break;
+            }
+            ctx->gzip_remain = ctx->gzip_xlen | (c << 8);
+            ctx->gzip_state = PAL_COMPRESS_GZIP_EXTRA;
+            if (!ctx->gzip_remain) {
+                pal_compress_gzip_next(ctx);
+            }
+            break;
+        case PAL_COMPRESS_GZIP_EXTRA:
+        case PAL_COMPRESS_GZIP_HCRC:
+            ctx->gzip_remain--;
+            if (!ctx->gzip_remain) {
+                pal_compress_gzip_next(ctx);
+            }
+            break;
+        case PAL_COMPRESS_GZIP_NAME:
+        case PAL_COMPRESS_GZIP_COMMENT:
+            if (c == 0) {
+                pal_compress_gzip_next(ctx);
+            }
+            break;
+        default:
+            HAPFatalError();
+        }
+    }
+    return true;
+}
+
+pal_compress_err pal_compress_update(pal_compress_ctx *ctx, const void *in, size_t ilen,
+    void *out, size_t *olen, bool finish) {
+    HAPPrecondition(ctx);
+    HAPPrecondition(out);
+    HAPPrecondition(olen);
+    HAPPrecondition(*olen > 0);
+
+    if (in) {
+        ctx->in = in;
+        ctx->ilen = ilen;
+    }
+
+    uint8_t *pout = out;
+    size_t osize = *olen;
+    *olen = 0;
+
+    while (1) {
+        if (ctx->pending_len) {
+            size_t len = HAPMin(ctx->pending_len, osize - *olen);
+            memcpy(pout + *olen, ctx->dict + ctx->pending_ofs, len);
+            *olen += len;
+            ctx->pending_ofs += len;
+            ctx->pending_len -= len;
+            if (ctx->pending_len) {
+                return PAL_COMPRESS_ERR_AGAIN;
+            }
+        }
+
+        if (ctx->finished) {
+            if (ctx->format == PAL_COMPRESS_FORMAT_GZIP) {
+                // The CRC32 and ISIZE are not checked.
+                size_t len = HAPMin(ctx->gzip_remain, ctx->ilen);
+                ctx->gzip_remain -= len;
+                ctx->in += len;
+                ctx->ilen -= len;
+            }
+            if (ctx->ilen) {
+                return PAL_COMPRESS_ERR_DATA;
+            }
+            return PAL_COMPRESS_ERR_OK;
+        }
+
+        if (ctx->format == PAL_COMPRESS_FORMAT_GZIP) {
+            if (!pal_compress_gzip_skip_header(ctx)) {
+                return PAL_COMPRESS_ERR_DATA;
+            }
+            if (ctx->gzip_state != PAL_COMPRESS_GZIP_DONE) {
+                return PAL_COMPRESS_ERR_OK;
+            }
+        }
+
+        mz_uint32 flags = finish ? 0 : TINFL_FLAG_HAS_MORE_INPUT;
+        if (ctx->format == PAL_COMPRESS_FORMAT_ZLIB) {
+            flags |= TINFL_FLAG_PARSE_ZLIB_HEADER;
+        }
+        size_t isize = ctx->ilen;
+        size_t dsize = TINFL_LZ_DICT_SIZE - ctx->dict_ofs;
+        tinfl_status status = tinfl_decompress(&ctx->decomp, ctx->in, &isize,
+            ctx->dict, ctx->dict + ctx->dict_ofs, &dsize, flags);
+        ctx->in += isize;
+        ctx->ilen -= isize;
+        ctx->pending_ofs = ctx->dict_ofs;
+        ctx->pending_len = dsize;
+        ctx->dict_ofs = (ctx->dict_ofs + dsize) & (TINFL_LZ_DICT_SIZE - 1);
+
+        switch (status) {
+        case TINFL_STATUS_DONE:
+            ctx->finished = true;
+            ctx->gzip_remain = GZIP_TRAILER_LEN;
+            break;
+        case TINFL_STATUS_HAS_MORE_OUTPUT:
+            break;
+        case TINFL_STATUS_NEEDS_MORE_INPUT:
+            if (ctx->pending_len == 0) {
+                return PAL_COMPRESS_ERR_OK;
+            }
+            break;
+        default:
+            return PAL_COMPRESS_ERR_DATA;
+        }
+    }
+}
+
+bool pal_compress_finished(pal_compress_ctx *ctx) {
+    HAPPrecondition(ctx);
+
+    return ctx->finished;
+}
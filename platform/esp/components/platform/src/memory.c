@@ -6,6 +6,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <esp_heap_caps.h>
 #include <pal/memory.h>
 
 void *pal_mem_alloc(size_t size)
@@ -27,3 +28,21 @@ void pal_mem_free(void *p)
 {
     return free(p);
 }
+
+bool pal_mem_get_stats(pal_mem_stats *stats)
+{
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, MALLOC_CAP_DEFAULT);
+    stats->cap = info.total_free_bytes + info.total_allocated_bytes;
+    stats->used = info.total_allocated_bytes;
+    // The heap only records the low watermark since boot.
+    stats->peak = stats->cap - info.minimum_free_bytes;
+    stats->largest_free = info.largest_free_block;
+    stats->failed = 0;
+    return true;
+}
+
+// The low watermark of the heap can not be reset, the peak is since boot.
+void pal_mem_reset_peak(void)
+{
+}
@@ -0,0 +1,178 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#include <stdio.h>
+#include <string.h>
+#include <esp_event.h>
+#include <esp_netif.h>
+#include <esp_wifi.h>
+#include <pal/net/netif.h>
+#include <pal/memory.h>
+#include <HAPPlatform.h>
+
+struct pal_netif_watcher {
+    bool destroyed;
+    pal_netif_event_cb event_cb;
+    void *arg;
+    struct pal_netif_watcher *next;
+};
+
+typedef struct {
+    bool registered;                    // The esp_event handlers are registered.
+    bool dispatching;
+    pal_netif_watcher *watchers;
+    char ipv4[PAL_NETIF_ADDR_MAXLEN];   // The last IPv4 address, it is not in IP_EVENT_STA_LOST_IP.
+} pal_netif_desc;
+
+static const HAPLogObject netif_log_obj = {
+    .subsystem = kHAPPlatform_LogSubsystem,
+    .category = "netif",
+};
+
+static pal_netif_desc gv_netif_desc;
+
+static void pal_netif_free_destroyed(pal_netif_desc *desc) {
+    for (pal_netif_watcher **pw = &desc->watchers; *pw;) {
+        pal_netif_watcher *w = *pw;
+        if (w->destroyed) {
+            *pw = w->next;
+            pal_mem_free(w);
+        } else {
+            pw = &w->next;
+        }
+    }
+}
+
+static void pal_netif_dispatch(void* _Nullable context, size_t contextSize) {
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize == sizeof(pal_netif_event));
+    pal_netif_event *event = context;
+    pal_netif_desc *desc = &gv_netif_desc;
+
+    if (event->type == PAL_NETIF_EVENT_NEWADDR && event->af == PAL_ADDR_FAMILY_IPV4) {
+        memcpy(desc->ipv4, event->addr, sizeof(desc->ipv4));
+    } else if (event->type == PAL_NETIF_EVENT_DELADDR && event->af == PAL_ADDR_FAMILY_IPV4) {
+        if (desc->ipv4[0] == '\0') {
+            return;
+        }
+        memcpy(event->addr, desc->ipv4, sizeof(event->addr));
+        desc->ipv4[0] = '\0';
+    }
+
+    desc->dispatching = true;
+    for (pal_netif_watcher *w = desc->watchers; w; w = w->next) {
+        if (!w->destroyed) {
+            w->event_cb(w, event, w->arg);
+        }
+    }
+    desc->dispatching = false;
+    pal_netif_free_destroyed(desc);
+}
+
+static void pal_netif_event_handler(void* event_handler_arg, esp_event_base_t event_base,
+    int32_t event_id, void* event_data) {
+    pal_netif_event event = { 0 };
+    esp_netif_t *netif = NULL;
+
+    if (event_base == WIFI_EVENT) {
+        switch (event_id) {
+        case WIFI_EVENT_STA_CONNECTED:
+            event.type = PAL_NETIF_EVENT_UP;
+            break;
+        case WIFI_EVENT_STA_DISCONNECTED:
+            event.type = PAL_NETIF_EVENT_DOWN;
+            break;
+        default:
+            return;
+        }
+        netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    } else if (event_base == IP_EVENT) {
+        switch (event_id) {
+        case IP_EVENT_STA_GOT_IP: {
+            ip_event_got_ip_t *evt = event_data;
+            event.type = PAL_NETIF_EVENT_NEWADDR;
+            event.af = PAL_ADDR_FAMILY_IPV4;
+            esp_ip4addr_ntoa(&evt->ip_info.ip, event.addr, sizeof(event.addr));
+            netif = evt->esp_netif;
+            break;
+        }
+        case IP_EVENT_STA_LOST_IP:
+            event.type = PAL_NETIF_EVENT_DELADDR;
+            event.af = PAL_ADDR_FAMILY_IPV4;
+            netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+            break;
+        case IP_EVENT_GOT_IP6: {
+            ip_event_got_ip6_t *evt = event_data;
+            event.type = PAL_NETIF_EVENT_NEWADDR;
+            event.af = PAL_ADDR_FAMILY_IPV6;
+            snprintf(event.addr, sizeof(event.addr), IPV6STR, IPV62STR(evt->ip6_info.ip));
+            netif = evt->esp_netif;
+            break;
+        }
+        default:
+            return;
+        }
+    } else {
+        return;
+    }
+
+    if (netif) {
+        event.index = esp_netif_get_netif_impl_index(netif);
+        esp_netif_get_netif_impl_name(netif, event.name);
+    }
+
+    // The esp_event handlers run in the event task, dispatch the event on the run loop.
+    if (HAPPlatformRunLoopScheduleCallback(pal_netif_dispatch, &event, sizeof(event)) != kHAPError_None) {
+        HAPLogError(&netif_log_obj, "%s: Failed to schedule the event %d.", __func__, event.type);
+    }
+}
+
+pal_netif_watcher *pal_netif_watcher_create(pal_netif_event_cb event_cb, void *arg) {
+    HAPPrecondition(event_cb);
+    pal_netif_desc *desc = &gv_netif_desc;
+
+    pal_netif_watcher *w = pal_mem_calloc(sizeof(*w));
+    if (!w) {
+        HAPLogError(&netif_log_obj, "%s: Failed to alloc memory.", __func__);
+        return NULL;
+    }
+    w->event_cb = event_cb;
+    w->arg = arg;
+
+    if (!desc->registered) {
+        ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, pal_netif_event_handler, NULL));
+        ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, ESP_EVENT_ANY_ID, pal_netif_event_handler, NULL));
+        desc->registered = true;
+    }
+    w->next = desc->watchers;
+    desc->watchers = w;
+    return w;
+}
+
+void pal_netif_watcher_destroy(pal_netif_watcher *w) {
+    if (!w) {
+        return;
+    }
+    pal_netif_desc *desc = &gv_netif_desc;
+
+    w->destroyed = true;
+    if (!desc->dispatching) {
+        pal_netif_free_destroyed(desc);
+    }
+
+    bool alive = false;
+    for (pal_netif_watcher *t = desc->watchers; t; t = t->next) {
+        if (!t->destroyed) {
+            alive = true;
+            break;
+        }
+    }
+    if (!alive && desc->registered) {
+        ESP_ERROR_CHECK(esp_event_handler_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, pal_netif_event_handler));
+        ESP_ERROR_CHECK(esp_event_handler_unregister(IP_EVENT, ESP_EVENT_ANY_ID, pal_netif_event_handler));
+        desc->registered = false;
+    }
+}
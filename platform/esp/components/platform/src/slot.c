@@ -0,0 +1,35 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#include <pal/slot.h>
+
+// There are no external writers on ESP, the slot region is not supported.
+
+pal_slot_region *pal_slot_region_create(const char *name, size_t nslots,
+    pal_slot_changed_cb changed_cb, void *arg) {
+    return NULL;
+}
+
+void pal_slot_region_destroy(pal_slot_region *region) {
+}
+
+bool pal_slot_read(pal_slot_region *region, uint64_t aid, uint64_t iid, pal_slot_value *value) {
+    return false;
+}
+
+pal_slot_region *pal_slot_writer_attach(const char *name) {
+    return NULL;
+}
+
+void pal_slot_writer_detach(pal_slot_region *region) {
+}
+
+bool pal_slot_write(pal_slot_region *region, uint64_t aid, uint64_t iid, const pal_slot_value *value) {
+    return false;
+}
+
+void pal_slot_ring(pal_slot_region *region) {
+}
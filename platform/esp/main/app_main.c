@@ -34,6 +34,8 @@
 #include <pal/hap.h>
 #include <pal/crypto/ssl.h>
 #include <pal/net/dns.h>
+#include <pal/aio.h>
+#include <pal/dispatch.h>
 
 #include <HAPPlatform+Init.h>
 #include <HAPPlatformAccessorySetup+Init.h>
@@ -174,6 +176,10 @@ void app_main_task(void *arg) {
     // Initialize global platform objects.
     init_platform();
 
+    // Initialize pal modules running on the run loop.
+    pal_dispatch_init();
+    pal_aio_init();
+
     app_init(&platform.hapPlatform, APP_SPIFFS_DIR_PATH, CONFIG_LUA_APP_ENTRY);
 
     // Run main loop until explicitly stopped.
@@ -182,6 +188,10 @@ void app_main_task(void *arg) {
 
     app_deinit();
 
+    // De-initialize pal modules running on the run loop.
+    pal_aio_deinit();
+    pal_dispatch_deinit();
+
     deinit_platform();
 
     // De-initialize pal modules.
@@ -0,0 +1,121 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#ifndef PLATFORM_INCLUDE_PAL_AIO_H_
+#define PLATFORM_INCLUDE_PAL_AIO_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * File type.
+ */
+typedef enum {
+    PAL_AIO_TYPE_FILE,          /**< Regular file. */
+    PAL_AIO_TYPE_DIR,           /**< Directory. */
+    PAL_AIO_TYPE_OTHER,         /**< Others. */
+} pal_aio_type;
+
+/**
+ * File status.
+ */
+typedef struct {
+    pal_aio_type type;          /**< File type. */
+    uint64_t size;              /**< Size in bytes. */
+    int64_t mtime;              /**< Last modification time in seconds since the Epoch. */
+} pal_aio_file_stat;
+
+/**
+ * A callback called when the file is read.
+ *
+ * @param err 0 on success, or the error number.
+ * @param buf The data read, it is only valid in the callback.
+ * @param len The length of the data read.
+ * @param arg The last parameter of pal_aio_read().
+ */
+typedef void (*pal_aio_read_cb)(int err, const void *buf, size_t len, void *arg);
+
+/**
+ * A callback called when the data is written.
+ *
+ * @param err 0 on success, or the error number.
+ * @param arg The last parameter of pal_aio_write().
+ */
+typedef void (*pal_aio_write_cb)(int err, void *arg);
+
+/**
+ * A callback called when the file status is got.
+ *
+ * @param err 0 on success, or the error number.
+ * @param st The file status, it is only valid in the callback.
+ * @param arg The last parameter of pal_aio_stat().
+ */
+typedef void (*pal_aio_stat_cb)(int err, const pal_aio_file_stat *st, void *arg);
+
+/**
+ * Initialize asynchronous file I/O module.
+ *
+ * The file operations are performed on a worker thread, and the callbacks
+ * are called on the run loop.
+ */
+void pal_aio_init();
+
+/**
+ * De-initialize asynchronous file I/O module.
+ *
+ * The pending operations are dropped without calling the callbacks.
+ */
+void pal_aio_deinit();
+
+/**
+ * Read a file.
+ *
+ * @param path File path.
+ * @param offset The offset to start reading from.
+ * @param len The max length to read, 0 means until the end of the file.
+ * @param cb A callback called when the file is read.
+ * @param arg The value to be passed as the last argument to @p cb.
+ * @return true on success.
+ * @return false on failure.
+ */
+bool pal_aio_read(const char *path, uint64_t offset, size_t len, pal_aio_read_cb cb, void *arg);
+
+/**
+ * Write data to a file, the file is created if it does not exist.
+ *
+ * @param path File path.
+ * @param data The data to be written, it is copied.
+ * @param len The length of the data.
+ * @param append Append to the end of the file instead of truncating it.
+ * @param cb A callback called when the data is written.
+ * @param arg The value to be passed as the last argument to @p cb.
+ * @return true on success.
+ * @return false on failure.
+ */
+bool pal_aio_write(const char *path, const void *data, size_t len, bool append,
+    pal_aio_write_cb cb, void *arg);
+
+/**
+ * Get the status of a file.
+ *
+ * @param path File path.
+ * @param cb A callback called when the file status is got.
+ * @param arg The value to be passed as the last argument to @p cb.
+ * @return true on success.
+ * @return false on failure.
+ */
+bool pal_aio_stat(const char *path, pal_aio_stat_cb cb, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PLATFORM_INCLUDE_PAL_AIO_H_
@@ -11,6 +11,28 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Resource usage of the current process and the host.
+ *
+ * Fields that are not available on the platform are set to -1, except @p temp,
+ * which can be negative and is set to NAN.
+ */
+typedef struct {
+    int64_t cpu_user_ms;    /**< User CPU time of the process, in milliseconds. */
+    int64_t cpu_sys_ms;     /**< System CPU time of the process, in milliseconds. */
+    int cpu_usage;          /**< CPU usage of the process since the previous sample, in percent. */
+    int64_t rss;            /**< Resident set size of the process, in bytes. */
+    int64_t heap_used;      /**< Used heap of the system, in bytes, on the platforms without processes. */
+    int fds;                /**< Number of open file descriptors. */
+    int ncpus;              /**< Number of online CPUs. */
+    double loadavg[3];      /**< System load average over 1, 5 and 15 minutes. */
+    double temp;            /**< Chip temperature, in degrees Celsius, NAN if not available. */
+} pal_chip_resource_usage;
+
 /**
  * Get manufacturer.
  */
@@ -31,6 +53,16 @@ const char *pal_chip_get_serial_number(void);
  */
 const char *pal_chip_get_hardware_version(void);
 
+/**
+ * Get resource usage.
+ *
+ * The usage is sampled at most once per second, calls in between return the cached sample.
+ *
+ * @param usage The pointer to the resource usage to be filled.
+ * @returns true on success, false on failure.
+ */
+bool pal_chip_get_resource_usage(pal_chip_resource_usage *usage);
+
 #ifdef __cplusplus
 }
 #endif
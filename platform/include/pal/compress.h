@@ -0,0 +1,107 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#ifndef PLATFORM_INCLUDE_PAL_COMPRESS_H_
+#define PLATFORM_INCLUDE_PAL_COMPRESS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Compression mode.
+ */
+typedef enum {
+    PAL_COMPRESS_DEFLATE,           /**< Compress. */
+    PAL_COMPRESS_INFLATE,           /**< Decompress. */
+} pal_compress_mode;
+
+/**
+ * Compressed data format.
+ */
+typedef enum {
+    PAL_COMPRESS_FORMAT_RAW,        /**< Raw deflate stream (RFC 1951). */
+    PAL_COMPRESS_FORMAT_ZLIB,       /**< zlib stream (RFC 1950). */
+    PAL_COMPRESS_FORMAT_GZIP,       /**< gzip stream (RFC 1952). */
+} pal_compress_format;
+
+/**
+ * Compression error numbers.
+ */
+typedef enum {
+    PAL_COMPRESS_ERR_OK,            /**< The input is consumed and all output is returned. */
+    PAL_COMPRESS_ERR_AGAIN,         /**< The output buffer is full, call again with no input. */
+    PAL_COMPRESS_ERR_DATA,          /**< The compressed data is corrupted. */
+    PAL_COMPRESS_ERR_UNKNOWN,       /**< Unknown. */
+} pal_compress_err;
+
+/**
+ * Compression context.
+ */
+typedef struct pal_compress_ctx pal_compress_ctx;
+
+/**
+ * Default compression level.
+ */
+#define PAL_COMPRESS_LEVEL_DEFAULT (-1)
+
+/**
+ * Create a compression context.
+ *
+ * @param mode Compression mode.
+ * @param format Compressed data format.
+ * @param level Compression level from 0 to 9, or PAL_COMPRESS_LEVEL_DEFAULT.
+ *              Only used by PAL_COMPRESS_DEFLATE.
+ * @return the compression context on success.
+ * @return NULL on failure, or the mode is not supported by the platform.
+ */
+pal_compress_ctx *pal_compress_create(pal_compress_mode mode, pal_compress_format format, int level);
+
+/**
+ * Free a compression context.
+ *
+ * @param ctx The compression context to be freed.
+ *            If this is NULL, the function has no effect.
+ */
+void pal_compress_free(pal_compress_ctx *ctx);
+
+/**
+ * Compress or decompress a chunk of data.
+ *
+ * When PAL_COMPRESS_ERR_AGAIN is returned, the input is not fully consumed
+ * and must stay valid, call again with @p in = NULL and @p ilen = 0
+ * until PAL_COMPRESS_ERR_OK is returned.
+ *
+ * @param ctx The compression context.
+ * @param in The input data.
+ * @param ilen The length of the input data.
+ * @param out The output buffer.
+ * @param olen The length of the output buffer, the length of the output data on return.
+ * @param finish Whether it is the last chunk.
+ *               When compressing, the stream is terminated.
+ * @return PAL_COMPRESS_ERR_OK on success.
+ * @return PAL_COMPRESS_ERR_AGAIN if the output buffer is full.
+ * @return others on failure.
+ */
+pal_compress_err pal_compress_update(pal_compress_ctx *ctx, const void *in, size_t ilen,
+    void *out, size_t *olen, bool finish);
+
+/**
+ * Whether the end of the stream is reached.
+ *
+ * @param ctx The compression context.
+ */
+bool pal_compress_finished(pal_compress_ctx *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PLATFORM_INCLUDE_PAL_COMPRESS_H_
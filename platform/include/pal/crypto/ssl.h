@@ -15,6 +15,16 @@ extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
 
+/**
+ * Maximum number of the protocols advertised by ALPN.
+ */
+#define PAL_SSL_ALPN_MAX 4
+
+/**
+ * Maximum total length of the protocols advertised by ALPN.
+ */
+#define PAL_SSL_ALPN_LEN_MAX 64
+
 /**
  * SSL method.
  */
@@ -66,6 +76,28 @@ pal_ssl_ctx *pal_ssl_create(pal_ssl_endpoint ep, const char *hostname);
  */
 void pal_ssl_free(pal_ssl_ctx *ctx);
 
+/**
+ * Set the protocols advertised by ALPN, must be called before the handshake.
+ *
+ * Only valid when the SSL endpoint is PAL_SSL_ENDPOINT_CLIENT.
+ *
+ * @param ctx SSL context.
+ * @param protos Protocol names in order of preference, such as "h2" and "http/1.1".
+ * @param num Number of @p protos, no more than PAL_SSL_ALPN_MAX.
+ * @return true on success
+ * @return false on failure.
+ */
+bool pal_ssl_set_alpn(pal_ssl_ctx *ctx, const char *const *protos, size_t num);
+
+/**
+ * Get the protocol selected by the server with ALPN.
+ *
+ * @param ctx SSL context.
+ * @return the protocol name, valid until the context is freed.
+ * @return NULL if no protocol is selected.
+ */
+const char *pal_ssl_get_alpn(pal_ssl_ctx *ctx);
+
 /**
  * Whether the handshake is finshed.
  *
@@ -0,0 +1,66 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#ifndef PLATFORM_INCLUDE_PAL_DISPATCH_H_
+#define PLATFORM_INCLUDE_PAL_DISPATCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+
+typedef struct pal_dispatch_node pal_dispatch_node;
+
+/**
+ * A callback called on the run loop.
+ *
+ * @param node The node passed to pal_dispatch_async().
+ */
+typedef void (*pal_dispatch_cb)(pal_dispatch_node *node);
+
+/**
+ * Dispatch node.
+ *
+ * Embed it as the first member of the object to be passed to the run loop,
+ * and cast the node back to the object in the callback.
+ */
+struct pal_dispatch_node {
+    pal_dispatch_node *next;    /**< Used by the queue. */
+    pal_dispatch_cb cb;         /**< Used by the queue. */
+};
+
+/**
+ * Initialize the dispatch queue.
+ *
+ * It must be called after the run loop is created.
+ */
+void pal_dispatch_init();
+
+/**
+ * De-initialize the dispatch queue.
+ *
+ * The pending nodes are dropped without calling the callbacks.
+ */
+void pal_dispatch_deinit();
+
+/**
+ * Call a callback on the run loop.
+ *
+ * It is lock-free and can be called from any thread. The callbacks are called
+ * in the order they are dispatched, and the run loop is woken up once for all
+ * the nodes dispatched before it runs.
+ *
+ * @param node The node, it must stay valid until @p cb is called.
+ * @param cb A callback called on the run loop.
+ */
+void pal_dispatch_async(pal_dispatch_node *node, pal_dispatch_cb cb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PLATFORM_INCLUDE_PAL_DISPATCH_H_
@@ -12,6 +12,7 @@ extern "C" {
 #endif
 
 #include <stddef.h>
+#include <stdbool.h>
 
 /**
  * Allocate and free dynamic memory.
@@ -46,6 +47,33 @@ void *pal_mem_realloc(void *ptr, size_t size);
  */
 void pal_mem_free(void *p);
 
+/**
+ * Heap statistics.
+ */
+typedef struct {
+    size_t cap;             /**< Size of the heap. */
+    size_t used;            /**< Bytes in use, including the block overhead. */
+    size_t peak;            /**< Peak of used since the last pal_mem_reset_peak(). */
+    size_t largest_free;    /**< Largest free block. */
+    size_t failed;          /**< Number of failed allocations. */
+} pal_mem_stats;
+
+/**
+ * Get the heap statistics.
+ *
+ * @param stats The pointer to the statistics to be filled.
+ * @returns true on success, false if the platform does not track the heap.
+ */
+bool pal_mem_get_stats(pal_mem_stats *stats);
+
+/**
+ * Reset the peak to the bytes in use.
+ *
+ * It is a no-op on ESP, the heap only records its low watermark since boot,
+ * so the peak reported there is the peak since boot.
+ */
+void pal_mem_reset_peak(void);
+
 #ifdef __cplusplus
 }
 #endif
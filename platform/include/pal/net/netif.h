@@ -0,0 +1,89 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#ifndef PLATFORM_INCLUDE_PAL_NET_NETIF_H_
+#define PLATFORM_INCLUDE_PAL_NET_NETIF_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pal/net/addr.h>
+
+/**
+ * The max length of the interface name, including the terminating null byte.
+ */
+#define PAL_NETIF_NAME_MAXLEN 16
+
+/**
+ * The max length of the address string, including the terminating null byte.
+ */
+#define PAL_NETIF_ADDR_MAXLEN 46
+
+/**
+ * Network interface event types.
+ */
+typedef enum {
+    PAL_NETIF_EVENT_UP,             /**< The link is up and running. */
+    PAL_NETIF_EVENT_DOWN,           /**< The link is down or removed. */
+    PAL_NETIF_EVENT_NEWADDR,        /**< An address is added. */
+    PAL_NETIF_EVENT_DELADDR,        /**< An address is removed. */
+} pal_netif_event_type;
+
+/**
+ * Network interface event.
+ */
+typedef struct {
+    pal_netif_event_type type;      /**< Event type. */
+    unsigned int index;             /**< Interface index. */
+    char name[PAL_NETIF_NAME_MAXLEN];   /**< Interface name, may be empty if the interface is removed. */
+    pal_addr_family af;             /**< Address family, only for the address events. */
+    char addr[PAL_NETIF_ADDR_MAXLEN];   /**< Address, only for the address events. */
+} pal_netif_event;
+
+/**
+ * Opaque structure for the network interface watcher.
+ */
+typedef struct pal_netif_watcher pal_netif_watcher;
+
+/**
+ * A callback called when an event occurs.
+ *
+ * The watcher can be destroyed in the callback.
+ *
+ * @param w The pointer to the watcher.
+ * @param event The event, it is only valid in the callback.
+ * @param arg The last paramter of pal_netif_watcher_create().
+ */
+typedef void (*pal_netif_event_cb)(pal_netif_watcher *w, const pal_netif_event *event, void *arg);
+
+/**
+ * Create a network interface watcher.
+ *
+ * The link and address changes are reported as soon as the system notifies them,
+ * the callback is called on the run loop. The states at the time of creation
+ * are not reported. An address is reported once until it is removed.
+ * If the notifications are dropped, the links and addresses are dumped again and
+ * the differences are reported.
+ *
+ * @param event_cb A callback called when an event occurs.
+ * @param arg The value to be passed as the last argument to @p event_cb.
+ * @returns a watcher or NULL on error.
+ */
+pal_netif_watcher *pal_netif_watcher_create(pal_netif_event_cb event_cb, void *arg);
+
+/**
+ * Destroy the watcher.
+ *
+ * @param w The pointer to the watcher.
+ */
+void pal_netif_watcher_destroy(pal_netif_watcher *w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PLATFORM_INCLUDE_PAL_NET_NETIF_H_
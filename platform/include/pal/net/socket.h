@@ -74,6 +74,17 @@ void pal_socket_set_timeout(pal_socket_obj *o, uint32_t ms);
  */
 pal_socket_err pal_socket_enable_broadcast(pal_socket_obj *o);
 
+/**
+ * Join a multicast group.
+ *
+ * @param o The pointer to the socket object.
+ * @param maddr Multicast group address.
+ * @param ifaddr Address of the local interface, or NULL to let the system choose one.
+ *               Only used by IPv4 sockets.
+ * @returns zero on success, error number on error.
+ */
+pal_socket_err pal_socket_join_multicast_group(pal_socket_obj *o, const char *maddr, const char *ifaddr);
+
 /**
  * Bind a local IP address and port.
  *
@@ -37,6 +37,15 @@ bool pal_nvs_erase(pal_nvs_handle *handle);
 
 bool pal_nvs_commit(pal_nvs_handle *handle);
 
+/**
+ * A callback called with each key, returns false to stop.
+ *
+ * The callback can set or remove the key it is called with, but not the other keys.
+ */
+typedef bool (*pal_nvs_foreach_cb)(pal_nvs_handle *handle, const char *key, void *arg);
+
+void pal_nvs_foreach(pal_nvs_handle *handle, pal_nvs_foreach_cb cb, void *arg);
+
 void pal_nvs_close(pal_nvs_handle *handle);
 
 #ifdef __cplusplus
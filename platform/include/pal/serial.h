@@ -0,0 +1,208 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#ifndef PLATFORM_INCLUDE_PAL_SERIAL_H_
+#define PLATFORM_INCLUDE_PAL_SERIAL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * The max length of the delimiter passed to pal_serial_read_until().
+ */
+#define PAL_SERIAL_DELIM_MAXLEN 16
+
+/**
+ * Parity.
+ */
+typedef enum {
+    PAL_SERIAL_PARITY_NONE,         /**< No parity. */
+    PAL_SERIAL_PARITY_ODD,          /**< Odd parity. */
+    PAL_SERIAL_PARITY_EVEN,         /**< Even parity. */
+} pal_serial_parity;
+
+/**
+ * Serial port configuration.
+ */
+typedef struct {
+    uint32_t baudrate;              /**< Baud rate. */
+    uint8_t databits;               /**< Data bits, 5 ~ 8. */
+    pal_serial_parity parity;       /**< Parity. */
+    uint8_t stopbits;               /**< Stop bits, 1 or 2. */
+} pal_serial_cfg;
+
+/**
+ * Serial port error numbers.
+ */
+typedef enum {
+    PAL_SERIAL_ERR_OK,              /**< No error. */
+    PAL_SERIAL_ERR_TIMEOUT,         /**< Timeout. */
+    PAL_SERIAL_ERR_IN_PROGRESS,     /**< In progress. */
+    PAL_SERIAL_ERR_UNKNOWN,         /**< Unknown. */
+    PAL_SERIAL_ERR_ALLOC,           /**< Failed to alloc. */
+    PAL_SERIAL_ERR_BUSY,            /**< Busy, try again later. */
+    PAL_SERIAL_ERR_OVERFLOW,        /**< Delimiter not found within the max length. */
+    PAL_SERIAL_ERR_CLOSED,          /**< The serial port is closed. */
+
+    PAL_SERIAL_ERR_COUNT,           /**< Error count, not error number. */
+} pal_serial_err;
+
+/**
+ * Opaque structure for the serial port object.
+ */
+typedef struct pal_serial_obj pal_serial_obj;
+
+/**
+ * Open a serial port.
+ *
+ * The port is set to raw mode, the reads and writes are performed on the run loop
+ * and never block it.
+ *
+ * @param path The path of the tty device, such as "/dev/ttyUSB0".
+ * @param cfg The configuration.
+ * @returns a serial port object or NULL on error.
+ */
+pal_serial_obj *pal_serial_open(const char *path, const pal_serial_cfg *cfg);
+
+/**
+ * Open the master side of a pseudo-terminal pair.
+ *
+ * The slave side can be opened with pal_serial_open(). Only supported on Linux.
+ *
+ * @param slave The buffer to store the path of the slave side.
+ * @param len The length of the buffer.
+ * @returns a serial port object or NULL on error.
+ */
+pal_serial_obj *pal_serial_open_pty(char *slave, size_t len);
+
+/**
+ * Close the serial port and destroy the object.
+ *
+ * The callbacks of the pending operations are called with PAL_SERIAL_ERR_CLOSED
+ * before it returns, they must not use the object.
+ *
+ * @param o The pointer to the serial port object.
+ */
+void pal_serial_destroy(pal_serial_obj *o);
+
+/**
+ * Set the timeout of the reads.
+ *
+ * @param o The pointer to the serial port object.
+ * @param ms Timeout in milliseconds, 0 means no timeout.
+ */
+void pal_serial_set_timeout(pal_serial_obj *o, uint32_t ms);
+
+/**
+ * A callback called when all the data is written.
+ *
+ * @param o The pointer to the serial port object.
+ * @param err The error of the write procress.
+ * @param arg The last paramter of pal_serial_write().
+ */
+typedef void (*pal_serial_sent_cb)(pal_serial_obj *o, pal_serial_err err, void *arg);
+
+/**
+ * Write all the data.
+ *
+ * The data that cannot be written at once is queued and written when the port
+ * is ready, the later writes are queued behind it.
+ *
+ * @param o The pointer to the serial port object.
+ * @param data The data to be written.
+ * @param len The length of the data.
+ * @param sent_cb A callback called when all the data is written,
+ *                only if PAL_SERIAL_ERR_IN_PROGRESS is returned.
+ * @param arg The value to be passed as the last argument to @p sent_cb.
+ * @returns PAL_SERIAL_ERR_OK if all the data is written.
+ * @returns PAL_SERIAL_ERR_IN_PROGRESS if the data is queued.
+ * @returns other error number on error.
+ */
+pal_serial_err pal_serial_write(pal_serial_obj *o, const void *data, size_t len,
+    pal_serial_sent_cb sent_cb, void *arg);
+
+/**
+ * A callback called when a frame is received.
+ *
+ * @param o The pointer to the serial port object.
+ * @param err The error of the read procress.
+ * @param data The frame, it is only valid in the callback.
+ * @param len The length of the frame.
+ * @param arg The last paramter of the read function.
+ */
+typedef void (*pal_serial_recved_cb)(pal_serial_obj *o, pal_serial_err err,
+    const void *data, size_t len, void *arg);
+
+/**
+ * Read the available data, at least 1 byte.
+ *
+ * If the data is already buffered, PAL_SERIAL_ERR_OK is returned and
+ * @p data points to the frame, which is valid until the next call on the object.
+ *
+ * @param o The pointer to the serial port object.
+ * @param maxlen The max length of the data.
+ * @param data The pointer to the frame.
+ * @param len The length of the frame.
+ * @param recved_cb A callback called when the frame is received,
+ *                  only if PAL_SERIAL_ERR_IN_PROGRESS is returned.
+ * @param arg The value to be passed as the last argument to @p recved_cb.
+ * @returns zero on success, error number on error.
+ */
+pal_serial_err pal_serial_read(pal_serial_obj *o, size_t maxlen, const void **data, size_t *len,
+    pal_serial_recved_cb recved_cb, void *arg);
+
+/**
+ * Read exactly @p len bytes.
+ *
+ * On timeout the received bytes are kept in the buffer.
+ *
+ * @see pal_serial_read()
+ */
+pal_serial_err pal_serial_read_exactly(pal_serial_obj *o, size_t len, const void **data,
+    pal_serial_recved_cb recved_cb, void *arg);
+
+/**
+ * Read until the delimiter, the delimiter is included in the frame.
+ *
+ * If the delimiter is not found in the first @p maxlen bytes, PAL_SERIAL_ERR_OVERFLOW
+ * is returned and the bytes are kept in the buffer, read them with pal_serial_read()
+ * to skip them.
+ *
+ * @param delim The delimiter.
+ * @param delimlen The length of the delimiter, 1 ~ PAL_SERIAL_DELIM_MAXLEN.
+ * @param maxlen The max length of the frame.
+ * @see pal_serial_read()
+ */
+pal_serial_err pal_serial_read_until(pal_serial_obj *o, const void *delim, size_t delimlen, size_t maxlen,
+    const void **data, size_t *len, pal_serial_recved_cb recved_cb, void *arg);
+
+/**
+ * Discard the received data that is not read yet.
+ *
+ * It does nothing if a read is pending.
+ *
+ * @param o The pointer to the serial port object.
+ */
+void pal_serial_discard(pal_serial_obj *o);
+
+/**
+ * Get error string.
+ *
+ * @param err Error number.
+ * @returns error string.
+ */
+const char *pal_serial_get_error_str(pal_serial_err err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PLATFORM_INCLUDE_PAL_SERIAL_H_
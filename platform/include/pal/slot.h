@@ -0,0 +1,139 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#ifndef PLATFORM_INCLUDE_PAL_SLOT_H_
+#define PLATFORM_INCLUDE_PAL_SLOT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Shared-memory characteristic value slots.
+ *
+ * The bridge creates a region of value slots that external processes
+ * (e.g. radio daemons) write without any system call per update.
+ * Each slot is keyed by (aid, iid), both fit in 32 bits, and protected
+ * by a sequence lock, which allows a single writer per slot. Writers ring
+ * the doorbell of the region after a batch of updates and the bridge
+ * raises events for all slots changed since the last ring.
+ */
+
+/**
+ * Magic number of the region.
+ */
+#define PAL_SLOT_MAGIC 0x534c4f54
+
+/**
+ * Version of the region layout.
+ */
+#define PAL_SLOT_VERSION 1
+
+/**
+ * Max length of a string or data value.
+ */
+#define PAL_SLOT_VALUE_MAX_LEN 64
+
+/**
+ * Value of a slot.
+ */
+typedef struct {
+    uint32_t len;               /**< Length of the string or data value. */
+    union {
+        bool b;                 /**< Bool. */
+        int64_t i;              /**< UInt8, UInt16, UInt32, UInt64 and Int. */
+        double f;               /**< Float. */
+        char s[PAL_SLOT_VALUE_MAX_LEN];  /**< String and Data. */
+    };
+} pal_slot_value;
+
+/**
+ * Opaque structure for the slot region.
+ */
+typedef struct pal_slot_region pal_slot_region;
+
+/**
+ * A callback called for each slot changed since the previous doorbell ring.
+ *
+ * @param region The pointer to the slot region.
+ * @param aid Accessory instance ID.
+ * @param iid Characteristic instance ID.
+ * @param arg The last paramter of pal_slot_region_create().
+ */
+typedef void (*pal_slot_changed_cb)(pal_slot_region *region, uint64_t aid, uint64_t iid, void *arg);
+
+/**
+ * Create a slot region and register its doorbell in the run loop.
+ *
+ * @param name The name of the region, writers attach to it with the same name.
+ * @param nslots The number of slots.
+ * @param changed_cb A callback called for each changed slot.
+ * @param arg The value to be passed as the last argument to @p changed_cb.
+ * @returns a region pointer or NULL on error.
+ */
+pal_slot_region *pal_slot_region_create(const char *name, size_t nslots,
+    pal_slot_changed_cb changed_cb, void *arg);
+
+/**
+ * Destroy the slot region.
+ *
+ * @param region The pointer to the slot region.
+ */
+void pal_slot_region_destroy(pal_slot_region *region);
+
+/**
+ * Read the value of a slot.
+ *
+ * @param region The pointer to the slot region.
+ * @param aid Accessory instance ID.
+ * @param iid Characteristic instance ID.
+ * @param value The pointer to the value to be filled.
+ * @returns true if the slot has a value, false otherwise.
+ */
+bool pal_slot_read(pal_slot_region *region, uint64_t aid, uint64_t iid, pal_slot_value *value);
+
+/**
+ * Attach to a slot region created by the bridge, used by writers.
+ *
+ * @param name The name of the region.
+ * @returns a region pointer or NULL on error.
+ */
+pal_slot_region *pal_slot_writer_attach(const char *name);
+
+/**
+ * Detach from the slot region.
+ *
+ * @param region The pointer to the slot region.
+ */
+void pal_slot_writer_detach(pal_slot_region *region);
+
+/**
+ * Write the value of a slot, the slot is claimed on the first write.
+ *
+ * @param region The pointer to the slot region.
+ * @param aid Accessory instance ID.
+ * @param iid Characteristic instance ID.
+ * @param value The value.
+ * @returns true on success, false if the region is full or @p aid or @p iid does not fit in 32 bits.
+ */
+bool pal_slot_write(pal_slot_region *region, uint64_t aid, uint64_t iid, const pal_slot_value *value);
+
+/**
+ * Ring the doorbell to notify the bridge of the written slots.
+ *
+ * @param region The pointer to the slot region.
+ */
+void pal_slot_ring(pal_slot_region *region);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PLATFORM_INCLUDE_PAL_SLOT_H_
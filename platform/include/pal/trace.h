@@ -0,0 +1,51 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#ifndef PLATFORM_INCLUDE_PAL_TRACE_H_
+#define PLATFORM_INCLUDE_PAL_TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Static tracepoints.
+ *
+ * With PAL_TRACE_USDT, the tracepoints are compiled into USDT probes of the
+ * provider "homekit_bridge", which are a single nop until a tracer such as
+ * bpftrace or perf attaches to them. Otherwise they are compiled out.
+ * For example, PAL_TRACE3(hap__read__start, aid, iid, session) is attached to with
+ * "usdt:<binary>:homekit_bridge:hap__read__start" in bpftrace.
+ *
+ * The arguments must be integers or pointers, and have no side effects.
+ * Nothing is measured at the probe sites, the tracers compute the durations
+ * from the timestamps of the start and done probes of an operation.
+ */
+#if PAL_TRACE_USDT
+
+#include <sys/sdt.h>
+
+#define PAL_TRACE0(name) DTRACE_PROBE(homekit_bridge, name)
+#define PAL_TRACE1(name, a1) DTRACE_PROBE1(homekit_bridge, name, a1)
+#define PAL_TRACE2(name, a1, a2) DTRACE_PROBE2(homekit_bridge, name, a1, a2)
+#define PAL_TRACE3(name, a1, a2, a3) DTRACE_PROBE3(homekit_bridge, name, a1, a2, a3)
+#define PAL_TRACE4(name, a1, a2, a3, a4) DTRACE_PROBE4(homekit_bridge, name, a1, a2, a3, a4)
+
+#else
+
+#define PAL_TRACE0(name) do {} while (0)
+#define PAL_TRACE1(name, a1) do { (void)(a1); } while (0)
+#define PAL_TRACE2(name, a1, a2) do { (void)(a1); (void)(a2); } while (0)
+#define PAL_TRACE3(name, a1, a2, a3) do { (void)(a1); (void)(a2); (void)(a3); } while (0)
+#define PAL_TRACE4(name, a1, a2, a3, a4) do { (void)(a1); (void)(a2); (void)(a3); (void)(a4); } while (0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PLATFORM_INCLUDE_PAL_TRACE_H_
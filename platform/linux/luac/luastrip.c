@@ -0,0 +1,109 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+// Compile a lua script to stripped bytecode and a line map.
+//
+// The bytecode keeps the source name of the chunk and the line range of each
+// function, but drops the line info, local names and upvalue names. The line
+// map records (function, pc) -> line, one line per function in pre-order:
+//
+//     <linedefined>,<lastlinedefined> <pc>:<line> <pc>:<line> ...
+//
+// A pair is only emitted when the line changes.
+//
+// Usage: luastrip <input> <bytecode output> <line map output>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "ldebug.h"
+#include "lobject.h"
+#include "lstate.h"
+
+#define toproto(L, i) (clLvalue(s2v(L->top + (i)))->p)
+
+static void write_linemap(FILE *fp, const Proto *f) {
+    fprintf(fp, "%d,%d", f->linedefined, f->lastlinedefined);
+    int last = -1;
+    for (int pc = 0; pc < f->sizecode; pc++) {
+        int line = luaG_getfuncline(f, pc);
+        if (line != last) {
+            fprintf(fp, " %d:%d", pc, line);
+            last = line;
+        }
+    }
+    fputc('\n', fp);
+    for (int i = 0; i < f->sizep; i++) {
+        write_linemap(fp, f->p[i]);
+    }
+}
+
+// The arrays are leaked, the state is never closed.
+static void strip(Proto *f) {
+    f->lineinfo = NULL;
+    f->sizelineinfo = 0;
+    f->abslineinfo = NULL;
+    f->sizeabslineinfo = 0;
+    f->locvars = NULL;
+    f->sizelocvars = 0;
+    for (int i = 0; i < f->sizeupvalues; i++) {
+        f->upvalues[i].name = NULL;
+    }
+    for (int i = 0; i < f->sizep; i++) {
+        strip(f->p[i]);
+    }
+}
+
+static int writer(lua_State *L, const void *p, size_t size, void *ud) {
+    (void)L;
+    return fwrite(p, size, 1, ud) != 1 && size != 0;
+}
+
+static void fatal(const char *msg) {
+    fprintf(stderr, "luastrip: %s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 4) {
+        fatal("usage: luastrip <input> <bytecode output> <line map output>");
+    }
+
+    lua_State *L = luaL_newstate();
+    if (!L) {
+        fatal("cannot create state: not enough memory");
+    }
+    if (luaL_loadfile(L, argv[1]) != LUA_OK) {
+        fatal(lua_tostring(L, -1));
+    }
+    Proto *f = toproto(L, -1);
+
+    FILE *fp = fopen(argv[3], "w");
+    if (!fp) {
+        fatal("cannot open the line map output");
+    }
+    write_linemap(fp, f);
+    if (fclose(fp)) {
+        fatal("cannot write the line map output");
+    }
+
+    strip(f);
+
+    fp = fopen(argv[2], "wb");
+    if (!fp) {
+        fatal("cannot open the bytecode output");
+    }
+    // Not stripped by the dumper, the source name is needed to find the line map.
+    if (lua_dump(L, writer, fp, 0)) {
+        fatal("cannot dump the bytecode");
+    }
+    if (fclose(fp)) {
+        fatal("cannot write the bytecode output");
+    }
+    return EXIT_SUCCESS;
+}
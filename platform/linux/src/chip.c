@@ -4,8 +4,17 @@
 // you may not use this file except in compliance with the License.
 // See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
 
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/resource.h>
 #include <pal/chip.h>
 
+#define CHIP_SAMPLE_INTERVAL_MS 1000
+#define CHIP_THERMAL_ZONE_PATH "/sys/class/thermal/thermal_zone0/temp"
+
 const char *pal_chip_get_manufacturer(void) {
     return "Unknown";
 }
@@ -21,3 +30,87 @@ const char *pal_chip_get_serial_number(void) {
 const char *pal_chip_get_hardware_version(void) {
     return "Unknown";
 }
+
+bool pal_chip_get_resource_usage(pal_chip_resource_usage *usage) {
+    static pal_chip_resource_usage cache;
+    static struct timespec last;
+
+    if (!usage) {
+        return false;
+    }
+
+    struct timespec now;
+    if (clock_gettime(CLOCK_MONOTONIC, &now)) {
+        return false;
+    }
+    int64_t elapsed_ms = (now.tv_sec - last.tv_sec) * 1000 + (now.tv_nsec - last.tv_nsec) / 1000000;
+    if (last.tv_sec != 0 && elapsed_ms < CHIP_SAMPLE_INTERVAL_MS) {
+        *usage = cache;
+        return true;
+    }
+
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru)) {
+        return false;
+    }
+    pal_chip_resource_usage cur = {
+        .cpu_user_ms = ru.ru_utime.tv_sec * 1000 + ru.ru_utime.tv_usec / 1000,
+        .cpu_sys_ms = ru.ru_stime.tv_sec * 1000 + ru.ru_stime.tv_usec / 1000,
+        .cpu_usage = -1,
+        .rss = -1,
+        .heap_used = -1,
+        .fds = -1,
+        .ncpus = (int)sysconf(_SC_NPROCESSORS_ONLN),
+        .loadavg = { -1, -1, -1 },
+        .temp = NAN,
+    };
+    if (last.tv_sec != 0 && elapsed_ms > 0) {
+        int64_t cpu_ms = cur.cpu_user_ms + cur.cpu_sys_ms - cache.cpu_user_ms - cache.cpu_sys_ms;
+        cur.cpu_usage = (int)(cpu_ms * 100 / elapsed_ms);
+    }
+
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        long pages;
+        if (fscanf(fp, "%*s %ld", &pages) == 1) {
+            cur.rss = (int64_t)pages * sysconf(_SC_PAGESIZE);
+        }
+        fclose(fp);
+    }
+
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir) {
+        int cnt = 0;
+        struct dirent *ent;
+        while ((ent = readdir(dir)) != NULL) {
+            if (ent->d_name[0] != '.') {
+                cnt++;
+            }
+        }
+        closedir(dir);
+        // Not counting the fd of the directory stream itself.
+        cur.fds = cnt - 1;
+    }
+
+    fp = fopen("/proc/loadavg", "r");
+    if (fp) {
+        if (fscanf(fp, "%lf %lf %lf", &cur.loadavg[0], &cur.loadavg[1], &cur.loadavg[2]) != 3) {
+            cur.loadavg[0] = cur.loadavg[1] = cur.loadavg[2] = -1;
+        }
+        fclose(fp);
+    }
+
+    fp = fopen(CHIP_THERMAL_ZONE_PATH, "r");
+    if (fp) {
+        long millideg;
+        if (fscanf(fp, "%ld", &millideg) == 1) {
+            cur.temp = millideg / 1000.0;
+        }
+        fclose(fp);
+    }
+
+    cache = cur;
+    last = now;
+    *usage = cur;
+    return true;
+}
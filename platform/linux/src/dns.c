@@ -10,10 +10,13 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <pal/net/dns.h>
+#include <pal/dispatch.h>
 #include <pal/memory.h>
+#include <pal/trace.h>
 #include <HAPPlatform.h>
 
 struct pal_dns_req_ctx {
+    pal_dispatch_node node;
     bool iscancel;
     pal_dns_response_cb cb;
     void *arg;
@@ -40,9 +43,8 @@ static void pal_dns_destroy_req_ctx(pal_dns_req_ctx *ctx) {
     pal_mem_free(ctx);
 }
 
-static void pal_dns_req_ctx_schedule(void* _Nullable context, size_t contextSize) {
-    HAPPrecondition(context);
-    struct pal_dns_req_ctx *ctx = *(struct pal_dns_req_ctx **)context;
+static void pal_dns_req_ctx_schedule(pal_dispatch_node *node) {
+    struct pal_dns_req_ctx *ctx = (struct pal_dns_req_ctx *)node;
 
     const char *addr = NULL;
     int ret = gai_error(&ctx->gaicb);
@@ -68,6 +70,7 @@ static void pal_dns_req_ctx_schedule(void* _Nullable context, size_t contextSize
     }
 
 done:
+    PAL_TRACE3(dns__response, ctx->hostname, addr, ret);
     if (!ctx->iscancel) {
         ctx->iscancel = true;
         ctx->cb(addr, ctx->arg);
@@ -77,8 +80,7 @@ done:
 
 static void pal_dns_req_ctx_notify(__sigval_t sigev_value) {
     struct pal_dns_req_ctx *ctx = sigev_value.sival_ptr;
-    HAPAssert(HAPPlatformRunLoopScheduleCallback(pal_dns_req_ctx_schedule,
-        &ctx, sizeof(ctx)) == kHAPError_None);
+    pal_dispatch_async(&ctx->node, pal_dns_req_ctx_schedule);
 }
 
 void pal_dns_init() {
@@ -112,6 +114,7 @@ pal_dns_req_ctx *pal_dns_start_request(const char *hostname, pal_addr_family af,
         .sigev_notify_function = pal_dns_req_ctx_notify,
         .sigev_value.sival_ptr = ctx,
     };
+    PAL_TRACE2(dns__request, ctx->hostname, af);
     int ret = getaddrinfo_a(GAI_NOWAIT, cbs, HAPArrayCount(cbs), &sigevent);
     if (ret) {
         HAPLogError(&dns_log_obj, "%s: getaddrinfo_a() failed: %s.", __func__, gai_strerror(ret));
@@ -16,6 +16,8 @@
 #include <pal/hap.h>
 #include <pal/crypto/ssl.h>
 #include <pal/net/dns.h>
+#include <pal/aio.h>
+#include <pal/dispatch.h>
 #include <pal/nvs_int.h>
 
 #include <HAPPlatform+Init.h>
@@ -203,6 +205,10 @@ int main(int argc, char *argv[]) {
     // Initialize global platform objects.
     init_platform();
 
+    // Initialize pal modules running on the run loop.
+    pal_dispatch_init();
+    pal_aio_init();
+
     app_init(&platform.hapPlatform, workdir, entry);
 
     // Run main loop until explicitly stopped.
@@ -211,6 +217,10 @@ int main(int argc, char *argv[]) {
 
     app_deinit();
 
+    // De-initialize pal modules running on the run loop.
+    pal_aio_deinit();
+    pal_dispatch_deinit();
+
     deinit_platform();
 
     // De-initialize pal modules.
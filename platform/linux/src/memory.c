@@ -7,6 +7,302 @@
 #include <stdlib.h>
 #include <pal/memory.h>
 
+#if PAL_MEM_EMULATION
+
+// Low-memory emulation.
+//
+// All memory is allocated from a fixed arena of PAL_MEM_CAP bytes (can be
+// overridden by the environment variable "PAL_MEM_CAP"), like the heap of
+// an ESP32. The allocator is a first-fit allocator with boundary tags, the
+// same family as the multi_heap of ESP-IDF, so it fragments as the device does.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#ifndef PAL_MEM_CAP
+#define PAL_MEM_CAP (256 * 1024)
+#endif
+
+#define MEM_ALIGN 8
+#define MEM_HDR_SIZE sizeof(size_t)
+#define MEM_USED ((size_t)1)        // The block is used.
+#define MEM_PREV_USED ((size_t)2)   // The previous block is used.
+#define MEM_FLAGS (MEM_USED | MEM_PREV_USED)
+
+/**
+ * Free block, used blocks only have the header.
+ *
+ * A free block ends with a footer containing its size, so it can be merged
+ * with the next block when the next block is freed.
+ */
+typedef struct mem_block {
+    size_t hdr;                 // Block size | flags.
+    struct mem_block *prev;
+    struct mem_block *next;
+} mem_block;
+
+#define MEM_MIN_BLOCK_SIZE (sizeof(mem_block) + sizeof(size_t))
+
+static struct {
+    bool inited;
+    pthread_mutex_t lock;
+    char *start;
+    char *end;                  // The epilogue, a used block of size 0.
+    mem_block *free_list;
+    pal_mem_stats stats;
+} gv_mem = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static inline size_t mem_block_size(const mem_block *b) {
+    return b->hdr & ~MEM_FLAGS;
+}
+
+static inline mem_block *mem_block_next(const mem_block *b) {
+    return (mem_block *)((char *)b + mem_block_size(b));
+}
+
+static inline void mem_block_set_footer(mem_block *b) {
+    *(size_t *)((char *)mem_block_next(b) - sizeof(size_t)) = mem_block_size(b);
+}
+
+static void mem_list_insert(mem_block *b) {
+    b->prev = NULL;
+    b->next = gv_mem.free_list;
+    if (gv_mem.free_list) {
+        gv_mem.free_list->prev = b;
+    }
+    gv_mem.free_list = b;
+}
+
+static void mem_list_remove(mem_block *b) {
+    if (b->prev) {
+        b->prev->next = b->next;
+    } else {
+        gv_mem.free_list = b->next;
+    }
+    if (b->next) {
+        b->next->prev = b->prev;
+    }
+}
+
+// Make a free block and merge it with the free neighbours.
+static void mem_make_free(mem_block *b, size_t size) {
+    b->hdr = size | (b->hdr & MEM_PREV_USED);
+
+    mem_block *next = mem_block_next(b);
+    if (!(next->hdr & MEM_USED)) {
+        mem_list_remove(next);
+        b->hdr += mem_block_size(next);
+        next = mem_block_next(b);
+    }
+    if (!(b->hdr & MEM_PREV_USED)) {
+        size_t prev_size = *(size_t *)((char *)b - sizeof(size_t));
+        mem_block *prev = (mem_block *)((char *)b - prev_size);
+        mem_list_remove(prev);
+        prev->hdr += mem_block_size(b);
+        b = prev;
+    }
+    next->hdr &= ~MEM_PREV_USED;
+    mem_block_set_footer(b);
+    mem_list_insert(b);
+}
+
+// Split the tail of a used block into a free block if it is large enough.
+static void mem_split(mem_block *b, size_t size) {
+    size_t remain = mem_block_size(b) - size;
+    if (remain < MEM_MIN_BLOCK_SIZE) {
+        return;
+    }
+    b->hdr = size | (b->hdr & MEM_FLAGS);
+    mem_block *tail = mem_block_next(b);
+    tail->hdr = MEM_PREV_USED;
+    mem_make_free(tail, remain);
+}
+
+static bool mem_init(void) {
+    if (gv_mem.inited) {
+        return true;
+    }
+
+    size_t cap = PAL_MEM_CAP;
+    const char *env = getenv("PAL_MEM_CAP");
+    if (env) {
+        cap = strtoul(env, NULL, 0);
+    }
+    cap &= ~(size_t)(MEM_ALIGN - 1);
+    if (cap < MEM_MIN_BLOCK_SIZE * 2) {
+        fprintf(stderr, "pal_mem: Invalid heap cap %zu.\n", cap);
+        abort();
+    }
+
+    // One more header for the epilogue.
+    void *p = mmap(NULL, cap + MEM_HDR_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    gv_mem.start = p;
+    gv_mem.end = gv_mem.start + cap;
+    *(size_t *)gv_mem.end = MEM_USED;
+
+    mem_block *b = (mem_block *)gv_mem.start;
+    b->hdr = cap | MEM_PREV_USED;
+    mem_block_set_footer(b);
+    mem_list_insert(b);
+
+    gv_mem.stats.cap = cap;
+    gv_mem.inited = true;
+    return true;
+}
+
+static size_t mem_request_size(size_t size) {
+    if (size > SIZE_MAX - MEM_HDR_SIZE - MEM_ALIGN) {
+        return 0;
+    }
+    size = (size + MEM_HDR_SIZE + MEM_ALIGN - 1) & ~(size_t)(MEM_ALIGN - 1);
+    return size < MEM_MIN_BLOCK_SIZE ? MEM_MIN_BLOCK_SIZE : size;
+}
+
+static void mem_account(ssize_t delta) {
+    gv_mem.stats.used += delta;
+    if (gv_mem.stats.used > gv_mem.stats.peak) {
+        gv_mem.stats.peak = gv_mem.stats.used;
+    }
+}
+
+static void *mem_alloc_locked(size_t size) {
+    size_t n = mem_request_size(size);
+    if (n == 0 || !mem_init()) {
+        gv_mem.stats.failed++;
+        return NULL;
+    }
+
+    for (mem_block *b = gv_mem.free_list; b; b = b->next) {
+        if (mem_block_size(b) < n) {
+            continue;
+        }
+        mem_list_remove(b);
+        b->hdr |= MEM_USED;
+        mem_block_next(b)->hdr |= MEM_PREV_USED;
+        mem_split(b, n);
+        mem_account(mem_block_size(b));
+        return (char *)b + MEM_HDR_SIZE;
+    }
+    gv_mem.stats.failed++;
+    return NULL;
+}
+
+static void mem_free_locked(void *p) {
+    mem_block *b = (mem_block *)((char *)p - MEM_HDR_SIZE);
+    if ((char *)b < gv_mem.start || (char *)b >= gv_mem.end || !(b->hdr & MEM_USED)) {
+        fprintf(stderr, "pal_mem: Invalid free of %p.\n", p);
+        abort();
+    }
+    mem_account(-(ssize_t)mem_block_size(b));
+    mem_make_free(b, mem_block_size(b));
+}
+
+static void *mem_realloc_locked(void *p, size_t size) {
+    mem_block *b = (mem_block *)((char *)p - MEM_HDR_SIZE);
+    size_t old = mem_block_size(b);
+    size_t n = mem_request_size(size);
+    if (n == 0) {
+        gv_mem.stats.failed++;
+        return NULL;
+    }
+
+    // Shrink in place.
+    if (n <= old) {
+        mem_split(b, n);
+        mem_account((ssize_t)mem_block_size(b) - (ssize_t)old);
+        return p;
+    }
+
+    // Grow in place into the next free block.
+    mem_block *next = mem_block_next(b);
+    if (!(next->hdr & MEM_USED) && old + mem_block_size(next) >= n) {
+        mem_list_remove(next);
+        b->hdr += mem_block_size(next);
+        mem_block_next(b)->hdr |= MEM_PREV_USED;
+        mem_split(b, n);
+        mem_account((ssize_t)mem_block_size(b) - (ssize_t)old);
+        return p;
+    }
+
+    void *np = mem_alloc_locked(size);
+    if (!np) {
+        return NULL;
+    }
+    memcpy(np, p, old - MEM_HDR_SIZE);
+    mem_free_locked(p);
+    return np;
+}
+
+void *pal_mem_alloc(size_t size) {
+    pthread_mutex_lock(&gv_mem.lock);
+    void *p = mem_alloc_locked(size);
+    pthread_mutex_unlock(&gv_mem.lock);
+    return p;
+}
+
+void *pal_mem_calloc(size_t size) {
+    void *p = pal_mem_alloc(size);
+    if (p) {
+        memset(p, 0, size);
+    }
+    return p;
+}
+
+void *pal_mem_realloc(void *ptr, size_t size) {
+    if (!ptr) {
+        return pal_mem_alloc(size);
+    }
+    if (size == 0) {
+        pal_mem_free(ptr);
+        return NULL;
+    }
+    pthread_mutex_lock(&gv_mem.lock);
+    void *p = mem_realloc_locked(ptr, size);
+    pthread_mutex_unlock(&gv_mem.lock);
+    return p;
+}
+
+void pal_mem_free(void *p) {
+    if (!p) {
+        return;
+    }
+    pthread_mutex_lock(&gv_mem.lock);
+    mem_free_locked(p);
+    pthread_mutex_unlock(&gv_mem.lock);
+}
+
+bool pal_mem_get_stats(pal_mem_stats *stats) {
+    pthread_mutex_lock(&gv_mem.lock);
+    mem_init();
+    *stats = gv_mem.stats;
+    stats->largest_free = 0;
+    for (mem_block *b = gv_mem.free_list; b; b = b->next) {
+        size_t size = mem_block_size(b) - MEM_HDR_SIZE;
+        if (size > stats->largest_free) {
+            stats->largest_free = size;
+        }
+    }
+    pthread_mutex_unlock(&gv_mem.lock);
+    return true;
+}
+
+void pal_mem_reset_peak(void) {
+    pthread_mutex_lock(&gv_mem.lock);
+    gv_mem.stats.peak = gv_mem.stats.used;
+    pthread_mutex_unlock(&gv_mem.lock);
+}
+
+#else
+
 void *pal_mem_alloc(size_t size) {
     return malloc(size);
 }
@@ -22,3 +318,12 @@ void *pal_mem_realloc(void *ptr, size_t size) {
 void pal_mem_free(void *p) {
     return free(p);
 }
+
+bool pal_mem_get_stats(pal_mem_stats *stats) {
+    return false;
+}
+
+void pal_mem_reset_peak(void) {
+}
+
+#endif  // PAL_MEM_EMULATION
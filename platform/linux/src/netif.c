@@ -0,0 +1,534 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <pal/net/netif.h>
+#include <pal/memory.h>
+
+#include <HAPLog.h>
+#include <HAPPlatform.h>
+#include <HAPPlatformFileHandle.h>
+
+// The size of the receive buffer.
+#define PAL_NETIF_RBUF_LEN 8192
+
+// Timeout of the initial dump of the links and addresses, in milliseconds.
+#define PAL_NETIF_DUMP_TIMEOUT_MS 1000
+
+typedef struct pal_netif_link {
+    struct pal_netif_link *next;
+    unsigned int index;
+    bool up;
+    bool seen;                      // Listed since the last dump request.
+} pal_netif_link;
+
+typedef struct pal_netif_addr {
+    struct pal_netif_addr *next;
+    unsigned int index;
+    pal_addr_family af;
+    bool seen;                      // Listed since the last dump request.
+    char name[PAL_NETIF_NAME_MAXLEN];
+    char addr[PAL_NETIF_ADDR_MAXLEN];
+} pal_netif_addr;
+
+struct pal_netif_watcher {
+    bool dispatching;               // In the event callback.
+    bool destroyed;                 // Destroyed in the event callback.
+    bool seeding;                   // Learning the states from the first dumps.
+    uint16_t dumping;               // The type of the dump waiting for the replies, 0 if none.
+    int fd;
+    uint32_t portid;
+    uint32_t seq;
+    HAPPlatformFileHandleRef handle;
+    pal_netif_event_cb event_cb;
+    void *arg;
+    pal_netif_link *links;
+    pal_netif_addr *addrs;
+};
+
+static const HAPLogObject netif_log_obj = {
+    .subsystem = kHAPPlatform_LogSubsystem,
+    .category = "netif",
+};
+
+static pal_netif_link *pal_netif_link_get(pal_netif_watcher *w, unsigned int index, bool create) {
+    for (pal_netif_link *l = w->links; l; l = l->next) {
+        if (l->index == index) {
+            return l;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    pal_netif_link *l = pal_mem_calloc(sizeof(*l));
+    if (!l) {
+        HAPLogError(&netif_log_obj, "%s: Failed to alloc memory.", __func__);
+        return NULL;
+    }
+    l->index = index;
+    l->next = w->links;
+    w->links = l;
+    return l;
+}
+
+static void pal_netif_link_remove(pal_netif_watcher *w, unsigned int index) {
+    for (pal_netif_link **pl = &w->links; *pl; pl = &(*pl)->next) {
+        pal_netif_link *l = *pl;
+        if (l->index == index) {
+            *pl = l->next;
+            pal_mem_free(l);
+            return;
+        }
+    }
+}
+
+static pal_netif_addr *pal_netif_addr_find(pal_netif_watcher *w, const pal_netif_event *event) {
+    for (pal_netif_addr *a = w->addrs; a; a = a->next) {
+        if (a->index == event->index && a->af == event->af && !strcmp(a->addr, event->addr)) {
+            return a;
+        }
+    }
+    return NULL;
+}
+
+static bool pal_netif_addr_add(pal_netif_watcher *w, const pal_netif_event *event) {
+    pal_netif_addr *a = pal_mem_calloc(sizeof(*a));
+    if (!a) {
+        HAPLogError(&netif_log_obj, "%s: Failed to alloc memory.", __func__);
+        return false;
+    }
+    a->index = event->index;
+    a->af = event->af;
+    a->seen = true;
+    memcpy(a->name, event->name, sizeof(a->name));
+    memcpy(a->addr, event->addr, sizeof(a->addr));
+    a->next = w->addrs;
+    w->addrs = a;
+    return true;
+}
+
+static bool pal_netif_addr_remove(pal_netif_watcher *w, const pal_netif_event *event) {
+    for (pal_netif_addr **pa = &w->addrs; *pa; pa = &(*pa)->next) {
+        pal_netif_addr *a = *pa;
+        if (a->index == event->index && a->af == event->af && !strcmp(a->addr, event->addr)) {
+            *pa = a->next;
+            pal_mem_free(a);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Request a dump of the links(RTM_GETLINK) or the addresses(RTM_GETADDR),
+// the replies update the tracked states.
+static bool pal_netif_watcher_dump(pal_netif_watcher *w, uint16_t type) {
+    struct {
+        struct nlmsghdr nlh;
+        union {
+            struct ifinfomsg ifi;
+            struct ifaddrmsg ifa;
+        };
+    } req = {
+        .nlh = {
+            .nlmsg_len = type == RTM_GETLINK ?
+                NLMSG_LENGTH(sizeof(struct ifinfomsg)) : NLMSG_LENGTH(sizeof(struct ifaddrmsg)),
+            .nlmsg_type = type,
+            .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+            .nlmsg_seq = ++w->seq,
+        },
+    };
+    struct sockaddr_nl sa = {
+        .nl_family = AF_NETLINK,
+    };
+
+    if (sendto(w->fd, &req, req.nlh.nlmsg_len, 0, (struct sockaddr *)&sa, sizeof(sa)) == -1) {
+        HAPLogError(&netif_log_obj, "%s: sendto() failed: %s.", __func__, strerror(errno));
+        return false;
+    }
+    if (type == RTM_GETLINK) {
+        for (pal_netif_link *l = w->links; l; l = l->next) {
+            l->seen = false;
+        }
+    } else {
+        for (pal_netif_addr *a = w->addrs; a; a = a->next) {
+            a->seen = false;
+        }
+    }
+    w->dumping = type;
+    return true;
+}
+
+static void pal_netif_watcher_emit(pal_netif_watcher *w, const pal_netif_event *event) {
+    HAPLogDebug(&netif_log_obj, "Interface %s(%u): type = %d, addr = %s",
+        event->name, event->index, event->type, event->addr);
+    w->event_cb(w, event, w->arg);
+}
+
+static void pal_netif_watcher_handle_link(pal_netif_watcher *w, const struct nlmsghdr *nlh) {
+    const struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+    if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifi))) {
+        return;
+    }
+
+    pal_netif_event event = {
+        .index = ifi->ifi_index,
+    };
+    int len = IFLA_PAYLOAD(nlh);
+    for (const struct rtattr *rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if (rta->rta_type == IFLA_IFNAME) {
+            strncpy(event.name, RTA_DATA(rta), sizeof(event.name) - 1);
+        }
+    }
+
+    bool up = false;
+    if (nlh->nlmsg_type == RTM_NEWLINK) {
+        up = (ifi->ifi_flags & (IFF_UP | IFF_RUNNING)) == (IFF_UP | IFF_RUNNING);
+        pal_netif_link *l = pal_netif_link_get(w, event.index, true);
+        if (!l) {
+            return;
+        }
+        l->seen = true;
+        if (l->up == up) {
+            return;
+        }
+        l->up = up;
+    } else {
+        pal_netif_link *l = pal_netif_link_get(w, event.index, false);
+        bool was_up = l && l->up;
+        pal_netif_link_remove(w, event.index);
+        if (!was_up) {
+            return;
+        }
+    }
+
+    if (!w->seeding) {
+        event.type = up ? PAL_NETIF_EVENT_UP : PAL_NETIF_EVENT_DOWN;
+        pal_netif_watcher_emit(w, &event);
+    }
+}
+
+static void pal_netif_watcher_handle_addr(pal_netif_watcher *w, const struct nlmsghdr *nlh) {
+    const struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+    if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa))) {
+        return;
+    }
+    if (ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6) {
+        return;
+    }
+
+    uint32_t flags = ifa->ifa_flags;
+    const void *local = NULL;
+    const void *address = NULL;
+    pal_netif_event event = {
+        .type = nlh->nlmsg_type == RTM_NEWADDR ? PAL_NETIF_EVENT_NEWADDR : PAL_NETIF_EVENT_DELADDR,
+        .index = ifa->ifa_index,
+        .af = ifa->ifa_family == AF_INET ? PAL_ADDR_FAMILY_IPV4 : PAL_ADDR_FAMILY_IPV6,
+    };
+    int len = IFA_PAYLOAD(nlh);
+    for (const struct rtattr *rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        switch (rta->rta_type) {
+        case IFA_LOCAL:
+            local = RTA_DATA(rta);
+            break;
+        case IFA_ADDRESS:
+            address = RTA_DATA(rta);
+            break;
+        case IFA_LABEL:
+            strncpy(event.name, RTA_DATA(rta), sizeof(event.name) - 1);
+            break;
+        case IFA_FLAGS:
+            flags = *(const uint32_t *)RTA_DATA(rta);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // IFA_ADDRESS is the peer address on the point-to-point interfaces.
+    const void *addr = local ? local : address;
+    if (!addr || !inet_ntop(ifa->ifa_family, addr, event.addr, sizeof(event.addr))) {
+        return;
+    }
+
+    // The addresses are tracked, so that the repeated RTM_NEWADDR (e.g. the lifetime updates)
+    // are not reported and the changes dropped on overflow can be found by a dump.
+    if (event.type == PAL_NETIF_EVENT_NEWADDR) {
+        pal_netif_addr *a = pal_netif_addr_find(w, &event);
+        if (a) {
+            a->seen = true;
+            return;
+        }
+        // The address is not usable until the duplicate address detection is done,
+        // another RTM_NEWADDR is sent then.
+        if (flags & IFA_F_TENTATIVE) {
+            return;
+        }
+    } else if (!pal_netif_addr_remove(w, &event)) {
+        return;
+    }
+
+    if (event.name[0] == '\0') {
+        char name[IF_NAMESIZE];
+        if (if_indextoname(event.index, name)) {
+            strncpy(event.name, name, sizeof(event.name) - 1);
+        }
+    }
+    if (event.type == PAL_NETIF_EVENT_NEWADDR && !pal_netif_addr_add(w, &event)) {
+        return;
+    }
+    if (!w->seeding) {
+        pal_netif_watcher_emit(w, &event);
+    }
+}
+
+// Remove the links not listed in the dump, they are removed while the notifications are dropped.
+static void pal_netif_watcher_sweep_links(pal_netif_watcher *w) {
+    pal_netif_link **pl = &w->links;
+    while (*pl && !w->destroyed) {
+        pal_netif_link *l = *pl;
+        if (l->seen) {
+            pl = &l->next;
+            continue;
+        }
+        *pl = l->next;
+        pal_netif_event event = {
+            .type = PAL_NETIF_EVENT_DOWN,
+            .index = l->index,
+        };
+        bool was_up = l->up;
+        pal_mem_free(l);
+        if (was_up && !w->seeding) {
+            pal_netif_watcher_emit(w, &event);
+            // The list may be changed in the callback.
+            pl = &w->links;
+        }
+    }
+}
+
+// Remove the addresses not listed in the dump, they are removed while the notifications are dropped.
+static void pal_netif_watcher_sweep_addrs(pal_netif_watcher *w) {
+    pal_netif_addr **pa = &w->addrs;
+    while (*pa && !w->destroyed) {
+        pal_netif_addr *a = *pa;
+        if (a->seen) {
+            pa = &a->next;
+            continue;
+        }
+        *pa = a->next;
+        pal_netif_event event = {
+            .type = PAL_NETIF_EVENT_DELADDR,
+            .index = a->index,
+            .af = a->af,
+        };
+        memcpy(event.name, a->name, sizeof(event.name));
+        memcpy(event.addr, a->addr, sizeof(event.addr));
+        pal_mem_free(a);
+        if (!w->seeding) {
+            pal_netif_watcher_emit(w, &event);
+            // The list may be changed in the callback.
+            pa = &w->addrs;
+        }
+    }
+}
+
+static void pal_netif_watcher_handle_msgs(pal_netif_watcher *w, const void *buf, size_t len) {
+    for (const struct nlmsghdr *nlh = buf; NLMSG_OK(nlh, len) && !w->destroyed; nlh = NLMSG_NEXT(nlh, len)) {
+        bool dump = nlh->nlmsg_pid == w->portid && nlh->nlmsg_seq == w->seq;
+        switch (nlh->nlmsg_type) {
+        case NLMSG_DONE:
+            if (!dump) {
+                break;
+            }
+            if (w->dumping == RTM_GETLINK) {
+                // Only one dump can run at a time, the addresses are dumped after the links.
+                w->dumping = 0;
+                pal_netif_watcher_sweep_links(w);
+                if (!w->destroyed && !pal_netif_watcher_dump(w, RTM_GETADDR)) {
+                    w->seeding = false;
+                }
+            } else if (w->dumping == RTM_GETADDR) {
+                w->dumping = 0;
+                pal_netif_watcher_sweep_addrs(w);
+                w->seeding = false;
+            }
+            break;
+        case NLMSG_ERROR:
+            HAPLogError(&netif_log_obj, "%s: Error %d from the kernel.", __func__,
+                ((const struct nlmsgerr *)NLMSG_DATA(nlh))->error);
+            if (dump) {
+                w->dumping = 0;
+                w->seeding = false;
+            }
+            break;
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+            pal_netif_watcher_handle_link(w, nlh);
+            break;
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+            pal_netif_watcher_handle_addr(w, nlh);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static void pal_netif_watcher_free(pal_netif_watcher *w) {
+    while (w->links) {
+        pal_netif_link *l = w->links;
+        w->links = l->next;
+        pal_mem_free(l);
+    }
+    while (w->addrs) {
+        pal_netif_addr *a = w->addrs;
+        w->addrs = a->next;
+        pal_mem_free(a);
+    }
+    pal_mem_free(w);
+}
+
+// Receive and handle a batch of messages, returns false if there is no more message.
+static bool pal_netif_watcher_recv(pal_netif_watcher *w) {
+    char buf[PAL_NETIF_RBUF_LEN] __attribute__((aligned(NLMSG_ALIGNTO)));
+    ssize_t rc = recv(w->fd, buf, sizeof(buf), 0);
+    if (rc > 0) {
+        pal_netif_watcher_handle_msgs(w, buf, rc);
+        return true;
+    }
+    if (rc == -1 && errno == EINTR) {
+        return true;
+    }
+    if (rc == -1 && errno == ENOBUFS) {
+        // The notifications are dropped, resync the links and then the addresses.
+        HAPLogError(&netif_log_obj, "%s: Receive buffer overflow, resync the links and addresses.", __func__);
+        return pal_netif_watcher_dump(w, RTM_GETLINK);
+    }
+    if (rc == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        HAPLogError(&netif_log_obj, "%s: recv() failed: %s.", __func__, strerror(errno));
+    }
+    return false;
+}
+
+// Learn the links and addresses from the initial dumps, so that only the later changes are reported.
+static bool pal_netif_watcher_seed(pal_netif_watcher *w) {
+    if (!pal_netif_watcher_dump(w, RTM_GETLINK)) {
+        return false;
+    }
+    struct pollfd pfd = {
+        .fd = w->fd,
+        .events = POLLIN,
+    };
+    while (w->seeding) {
+        if (pal_netif_watcher_recv(w)) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return false;
+        }
+        if (poll(&pfd, 1, PAL_NETIF_DUMP_TIMEOUT_MS) <= 0) {
+            HAPLogError(&netif_log_obj, "%s: Timed out waiting for the links and addresses.", __func__);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void pal_netif_watcher_handle_event_cb(
+        HAPPlatformFileHandleRef fileHandle,
+        HAPPlatformFileHandleEvent fileHandleEvents,
+        void *context) {
+    HAPPrecondition(context);
+    pal_netif_watcher *w = context;
+    HAPPrecondition(w->handle == fileHandle);
+
+    if (!fileHandleEvents.isReadyForReading) {
+        return;
+    }
+
+    w->dispatching = true;
+    while (!w->destroyed && pal_netif_watcher_recv(w)) {
+        continue;
+    }
+    w->dispatching = false;
+
+    if (w->destroyed) {
+        pal_netif_watcher_free(w);
+    }
+}
+
+pal_netif_watcher *pal_netif_watcher_create(pal_netif_event_cb event_cb, void *arg) {
+    HAPPrecondition(event_cb);
+
+    pal_netif_watcher *w = pal_mem_calloc(sizeof(*w));
+    if (!w) {
+        HAPLogError(&netif_log_obj, "%s: Failed to alloc memory.", __func__);
+        return NULL;
+    }
+    w->event_cb = event_cb;
+    w->arg = arg;
+    w->seeding = true;
+
+    w->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (w->fd == -1) {
+        HAPLogError(&netif_log_obj, "%s: socket() failed: %s.", __func__, strerror(errno));
+        pal_mem_free(w);
+        return NULL;
+    }
+
+    struct sockaddr_nl sa = {
+        .nl_family = AF_NETLINK,
+        .nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR,
+    };
+    socklen_t salen = sizeof(sa);
+    if (bind(w->fd, (struct sockaddr *)&sa, sizeof(sa)) == -1 ||
+        getsockname(w->fd, (struct sockaddr *)&sa, &salen) == -1) {
+        HAPLogError(&netif_log_obj, "%s: Failed to bind the netlink socket: %s.", __func__, strerror(errno));
+        goto err;
+    }
+    w->portid = sa.nl_pid;
+
+    if (!pal_netif_watcher_seed(w)) {
+        goto err;
+    }
+
+    if (HAPPlatformFileHandleRegister(&w->handle, w->fd,
+        (HAPPlatformFileHandleEvent) { .isReadyForReading = true },
+        pal_netif_watcher_handle_event_cb, w) != kHAPError_None) {
+        HAPLogError(&netif_log_obj, "%s: Failed to register handle callback", __func__);
+        goto err;
+    }
+
+    HAPLogDebug(&netif_log_obj, "%s() = %p", __func__, w);
+    return w;
+
+err:
+    close(w->fd);
+    pal_netif_watcher_free(w);
+    return NULL;
+}
+
+void pal_netif_watcher_destroy(pal_netif_watcher *w) {
+    if (!w) {
+        return;
+    }
+    HAPLogDebug(&netif_log_obj, "%s(%p)", __func__, w);
+    HAPPlatformFileHandleDeregister(w->handle);
+    close(w->fd);
+    if (w->dispatching) {
+        w->destroyed = true;
+        return;
+    }
+    pal_netif_watcher_free(w);
+}
@@ -0,0 +1,270 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pal/memory.h>
+#include <HAPLog.h>
+#include <HAPPlatform.h>
+#include <HAPPlatformFileHandle.h>
+
+#include "slot_int.h"
+
+static const HAPLogObject slot_log_obj = {
+    .subsystem = kHAPPlatform_LogSubsystem,
+    .category = "slot",
+};
+
+static void pal_slot_send_doorbell(pal_slot_region *region, int fd) {
+    char byte = 0;
+    struct iovec iov = {
+        .iov_base = &byte,
+        .iov_len = sizeof(byte),
+    };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } u;
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = u.buf,
+        .msg_controllen = sizeof(u.buf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &region->efd, sizeof(int));
+
+    ssize_t rc;
+    do {
+        rc = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (rc == -1 && errno == EINTR);
+    if (rc == -1) {
+        HAPLogError(&slot_log_obj, "%s: sendmsg() failed: %s.", __func__, strerror(errno));
+    }
+}
+
+static void pal_slot_handle_accept_cb(
+        HAPPlatformFileHandleRef fileHandle,
+        HAPPlatformFileHandleEvent fileHandleEvents,
+        void *context) {
+    if (!fileHandleEvents.isReadyForReading) {
+        return;
+    }
+    pal_slot_region *region = context;
+
+    int fd;
+    do {
+        fd = accept4(region->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    } while (fd == -1 && errno == EINTR);
+    if (fd == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            HAPLogError(&slot_log_obj, "%s: accept4() failed: %s.", __func__, strerror(errno));
+        }
+        return;
+    }
+    pal_slot_send_doorbell(region, fd);
+    close(fd);
+}
+
+static void pal_slot_handle_doorbell_cb(
+        HAPPlatformFileHandleRef fileHandle,
+        HAPPlatformFileHandleEvent fileHandleEvents,
+        void *context) {
+    if (!fileHandleEvents.isReadyForReading) {
+        return;
+    }
+    pal_slot_region *region = context;
+
+    // Reading the eventfd resets the counter, all rings since the last read are
+    // handled by one scan.
+    eventfd_t cnt;
+    if (eventfd_read(region->efd, &cnt) == -1) {
+        if (errno != EAGAIN) {
+            HAPLogError(&slot_log_obj, "%s: eventfd_read() failed: %s.", __func__, strerror(errno));
+        }
+        return;
+    }
+
+    slot_hdr *hdr = region->hdr;
+    for (uint32_t i = 0; i < hdr->nslots; i++) {
+        slot_entry *e = &hdr->slots[i];
+        uint64_t key = atomic_load_explicit(&e->key, memory_order_acquire);
+        if (key == 0) {
+            continue;
+        }
+        uint32_t seq = atomic_load_explicit(&e->seq, memory_order_acquire);
+        if (seq == region->seen[i] || (seq & 1)) {
+            continue;
+        }
+        region->seen[i] = seq;
+        if (region->changed_cb) {
+            region->changed_cb(region, key >> 32, key & UINT32_MAX, region->arg);
+        }
+    }
+}
+
+static bool pal_slot_listen(pal_slot_region *region) {
+    region->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (region->listen_fd == -1) {
+        HAPLogError(&slot_log_obj, "%s: socket() failed: %s.", __func__, strerror(errno));
+        return false;
+    }
+
+    // Abstract socket, it disappears with the process.
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int len = snprintf(addr.sun_path + 1, sizeof(addr.sun_path) - 1, SLOT_DOORBELL_SOCK_PREFIX "%s", region->name);
+    if (bind(region->listen_fd, (struct sockaddr *)&addr, offsetof(struct sockaddr_un, sun_path) + 1 + len) == -1) {
+        HAPLogError(&slot_log_obj, "%s: bind() failed: %s.", __func__, strerror(errno));
+        return false;
+    }
+    if (listen(region->listen_fd, 8) == -1) {
+        HAPLogError(&slot_log_obj, "%s: listen() failed: %s.", __func__, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+pal_slot_region *pal_slot_region_create(const char *name, size_t nslots,
+    pal_slot_changed_cb changed_cb, void *arg) {
+    HAPPrecondition(name);
+    HAPPrecondition(nslots > 0 && nslots <= UINT32_MAX);
+
+    size_t name_len = strlen(name);
+    if (name_len == 0 || name_len > NAME_MAX - 1 || strchr(name, '/')) {
+        HAPLogError(&slot_log_obj, "%s: Invalid name \"%s\".", __func__, name);
+        return NULL;
+    }
+
+    pal_slot_region *region = pal_mem_calloc(sizeof(*region) + name_len + 1);
+    if (!region) {
+        HAPLogError(&slot_log_obj, "%s: Failed to alloc memory.", __func__);
+        return NULL;
+    }
+    memcpy(region->name, name, name_len + 1);
+    region->efd = -1;
+    region->listen_fd = -1;
+    region->changed_cb = changed_cb;
+    region->arg = arg;
+    region->size = sizeof(slot_hdr) + nslots * sizeof(slot_entry);
+
+    region->seen = pal_mem_calloc(nslots * sizeof(uint32_t));
+    if (!region->seen) {
+        HAPLogError(&slot_log_obj, "%s: Failed to alloc memory.", __func__);
+        goto err;
+    }
+
+    char path[NAME_MAX + 1];
+    snprintf(path, sizeof(path), "/%s", name);
+    int fd = shm_open(path, O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        HAPLogError(&slot_log_obj, "%s: shm_open() failed: %s.", __func__, strerror(errno));
+        goto err;
+    }
+    if (ftruncate(fd, region->size) == -1) {
+        HAPLogError(&slot_log_obj, "%s: ftruncate() failed: %s.", __func__, strerror(errno));
+        close(fd);
+        shm_unlink(path);
+        goto err;
+    }
+    void *p = mmap(NULL, region->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        HAPLogError(&slot_log_obj, "%s: mmap() failed: %s.", __func__, strerror(errno));
+        shm_unlink(path);
+        goto err;
+    }
+    region->hdr = p;
+    region->hdr->nslots = nslots;
+    region->hdr->version = PAL_SLOT_VERSION;
+    atomic_thread_fence(memory_order_release);
+    region->hdr->magic = PAL_SLOT_MAGIC;
+
+    region->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (region->efd == -1) {
+        HAPLogError(&slot_log_obj, "%s: eventfd() failed: %s.", __func__, strerror(errno));
+        goto err;
+    }
+    if (!pal_slot_listen(region)) {
+        goto err;
+    }
+
+    HAPPlatformFileHandleRef efd_handle;
+    if (HAPPlatformFileHandleRegister(&efd_handle, region->efd,
+        (HAPPlatformFileHandleEvent) { .isReadyForReading = true },
+        pal_slot_handle_doorbell_cb, region) != kHAPError_None) {
+        HAPLogError(&slot_log_obj, "%s: Failed to register handle callback", __func__);
+        goto err;
+    }
+    region->efd_handle = (void *)efd_handle;
+
+    HAPPlatformFileHandleRef listen_handle;
+    if (HAPPlatformFileHandleRegister(&listen_handle, region->listen_fd,
+        (HAPPlatformFileHandleEvent) { .isReadyForReading = true },
+        pal_slot_handle_accept_cb, region) != kHAPError_None) {
+        HAPLogError(&slot_log_obj, "%s: Failed to register handle callback", __func__);
+        goto err;
+    }
+    region->listen_handle = (void *)listen_handle;
+
+    HAPLogInfo(&slot_log_obj, "Slot region \"%s\" created with %zu slots.", name, nslots);
+    return region;
+
+err:
+    pal_slot_region_destroy(region);
+    return NULL;
+}
+
+void pal_slot_region_destroy(pal_slot_region *region) {
+    if (!region) {
+        return;
+    }
+    if (region->listen_handle) {
+        HAPPlatformFileHandleDeregister((HAPPlatformFileHandleRef)region->listen_handle);
+    }
+    if (region->efd_handle) {
+        HAPPlatformFileHandleDeregister((HAPPlatformFileHandleRef)region->efd_handle);
+    }
+    if (region->listen_fd != -1) {
+        close(region->listen_fd);
+    }
+    if (region->efd != -1) {
+        close(region->efd);
+    }
+    if (region->hdr) {
+        char path[NAME_MAX + 1];
+        snprintf(path, sizeof(path), "/%s", region->name);
+        munmap(region->hdr, region->size);
+        shm_unlink(path);
+    }
+    if (region->seen) {
+        pal_mem_free(region->seen);
+    }
+    pal_mem_free(region);
+}
+
+bool pal_slot_read(pal_slot_region *region, uint64_t aid, uint64_t iid, pal_slot_value *value) {
+    HAPPrecondition(region);
+    HAPPrecondition(value);
+
+    if (aid > UINT32_MAX || iid > UINT32_MAX) {
+        return false;
+    }
+    slot_entry *e = slot_find(region->hdr, slot_make_key(aid, iid), false);
+    if (!e) {
+        return false;
+    }
+    return slot_read(e, value) != 0;
+}
@@ -0,0 +1,133 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#ifndef PLATFORM_LINUX_SRC_SLOT_INT_H_
+#define PLATFORM_LINUX_SRC_SLOT_INT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdatomic.h>
+#include <string.h>
+#include <pal/slot.h>
+
+// Prefix of the abstract unix socket used to hand out the doorbell.
+#define SLOT_DOORBELL_SOCK_PREFIX "homekit-bridge.slot."
+
+/**
+ * Slot in the shared memory.
+ *
+ * The sequence number is odd while the slot is being written,
+ * zero means the slot has never been written.
+ *
+ * The sequence lock assumes a single writer per slot: two writers of
+ * the same slot may both see an even sequence number and interleave their
+ * copies, and the readers can not detect it. Each slot must be written by
+ * one process, and by one thread of it.
+ */
+typedef struct {
+    _Atomic uint64_t key;   /* (aid << 32) | iid, 0 if the slot is free. */
+    _Atomic uint32_t seq;
+    uint32_t reserved;
+    pal_slot_value value;
+} slot_entry;
+
+/**
+ * Header of the shared memory.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nslots;
+    uint32_t reserved;
+    slot_entry slots[];
+} slot_hdr;
+
+struct pal_slot_region {
+    slot_hdr *hdr;
+    size_t size;
+    int efd;                /* Doorbell. */
+    int listen_fd;          /* Socket to hand out the doorbell, bridge side only. */
+    void *listen_handle;
+    void *efd_handle;
+    uint32_t *seen;         /* Last seen sequence number of each slot, bridge side only. */
+    pal_slot_changed_cb changed_cb;
+    void *arg;
+    char name[];
+};
+
+// Both IDs must fit in 32 bits, they are checked by the callers.
+static inline uint64_t slot_make_key(uint64_t aid, uint64_t iid) {
+    return (aid << 32) | (iid & UINT32_MAX);
+}
+
+static inline uint32_t slot_hash(uint64_t key, uint32_t nslots) {
+    return (uint32_t)((key * 0x9e3779b97f4a7c15ULL) >> 32) % nslots;
+}
+
+/**
+ * Find the slot with the key.
+ *
+ * @param claim Claim a free slot if the key is not found.
+ */
+static inline slot_entry *slot_find(slot_hdr *hdr, uint64_t key, bool claim) {
+    uint32_t n = hdr->nslots;
+    for (uint32_t i = 0, idx = slot_hash(key, n); i < n; i++, idx = (idx + 1) % n) {
+        slot_entry *e = &hdr->slots[idx];
+        uint64_t k = atomic_load_explicit(&e->key, memory_order_acquire);
+        if (k == key) {
+            return e;
+        }
+        if (k == 0) {
+            if (!claim) {
+                return NULL;
+            }
+            if (atomic_compare_exchange_strong(&e->key, &k, key) || k == key) {
+                return e;
+            }
+        }
+    }
+    return NULL;
+}
+
+static inline void slot_write(slot_entry *e, const pal_slot_value *value) {
+    uint32_t seq = atomic_load_explicit(&e->seq, memory_order_relaxed);
+    atomic_store_explicit(&e->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&e->value, value, sizeof(*value));
+    atomic_store_explicit(&e->seq, seq + 2, memory_order_release);
+}
+
+/**
+ * Read a consistent copy of the slot.
+ *
+ * @returns the sequence number of the copy, 0 if the slot has no value.
+ */
+static inline uint32_t slot_read(slot_entry *e, pal_slot_value *value) {
+    // Give up if the writer died in the middle of a write.
+    for (int retry = 0; retry < 1000; retry++) {
+        uint32_t seq = atomic_load_explicit(&e->seq, memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+        if (seq == 0) {
+            return 0;
+        }
+        memcpy(value, &e->value, sizeof(*value));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&e->seq, memory_order_relaxed) == seq) {
+            return seq;
+        }
+    }
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PLATFORM_LINUX_SRC_SLOT_INT_H_
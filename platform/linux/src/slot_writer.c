@@ -0,0 +1,148 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+// Writer side of the slot region.
+//
+// This file has no dependency on the HomeKit ADK, external writers can build
+// it together with "pal/slot.h" and "slot_int.h".
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "slot_int.h"
+
+static int pal_slot_recv_doorbell(const char *name) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int len = snprintf(addr.sun_path + 1, sizeof(addr.sun_path) - 1, SLOT_DOORBELL_SOCK_PREFIX "%s", name);
+    if (connect(fd, (struct sockaddr *)&addr, offsetof(struct sockaddr_un, sun_path) + 1 + len) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    char byte;
+    struct iovec iov = {
+        .iov_base = &byte,
+        .iov_len = sizeof(byte),
+    };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } u;
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = u.buf,
+        .msg_controllen = sizeof(u.buf),
+    };
+    ssize_t rc;
+    do {
+        rc = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (rc == -1 && errno == EINTR);
+    close(fd);
+    if (rc <= 0) {
+        return -1;
+    }
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+    int efd;
+    memcpy(&efd, CMSG_DATA(cmsg), sizeof(int));
+    return efd;
+}
+
+pal_slot_region *pal_slot_writer_attach(const char *name) {
+    size_t name_len = strlen(name);
+    if (name_len == 0 || name_len > NAME_MAX - 1 || strchr(name, '/')) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    pal_slot_region *region = calloc(1, sizeof(*region) + name_len + 1);
+    if (!region) {
+        return NULL;
+    }
+    memcpy(region->name, name, name_len + 1);
+    region->listen_fd = -1;
+
+    char path[NAME_MAX + 1];
+    snprintf(path, sizeof(path), "/%s", name);
+    int fd = shm_open(path, O_RDWR | O_CLOEXEC, 0);
+    if (fd == -1) {
+        goto err;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(slot_hdr)) {
+        close(fd);
+        goto err;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        goto err;
+    }
+    region->hdr = p;
+    region->size = st.st_size;
+    if (region->hdr->magic != PAL_SLOT_MAGIC || region->hdr->version != PAL_SLOT_VERSION ||
+        region->size < sizeof(slot_hdr) + region->hdr->nslots * sizeof(slot_entry)) {
+        errno = EPROTO;
+        goto err1;
+    }
+
+    region->efd = pal_slot_recv_doorbell(name);
+    if (region->efd == -1) {
+        goto err1;
+    }
+    return region;
+
+err1:
+    munmap(region->hdr, region->size);
+err:
+    free(region);
+    return NULL;
+}
+
+void pal_slot_writer_detach(pal_slot_region *region) {
+    if (!region) {
+        return;
+    }
+    close(region->efd);
+    munmap(region->hdr, region->size);
+    free(region);
+}
+
+bool pal_slot_write(pal_slot_region *region, uint64_t aid, uint64_t iid, const pal_slot_value *value) {
+    if (!region || !value || value->len > PAL_SLOT_VALUE_MAX_LEN || aid > UINT32_MAX || iid > UINT32_MAX) {
+        return false;
+    }
+    slot_entry *e = slot_find(region->hdr, slot_make_key(aid, iid), true);
+    if (!e) {
+        return false;
+    }
+    slot_write(e, value);
+    return true;
+}
+
+void pal_slot_ring(pal_slot_region *region) {
+    if (region && region->efd != -1) {
+        eventfd_write(region->efd, 1);
+    }
+}
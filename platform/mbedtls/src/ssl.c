@@ -32,6 +32,8 @@ struct pal_ssl_ctx {
     pal_ssl_bio out_bio;
     mbedtls_ssl_context ssl;
     mbedtls_ssl_config conf;
+    const char *alpn[PAL_SSL_ALPN_MAX + 1];  // NULL terminated, point to alpn_buf.
+    char alpn_buf[PAL_SSL_ALPN_LEN_MAX];
 };
 
 static const HAPLogObject ssl_log_obj = {
@@ -165,6 +167,38 @@ void pal_ssl_free(pal_ssl_ctx *ctx) {
     pal_mem_free(ctx);
 }
 
+bool pal_ssl_set_alpn(pal_ssl_ctx *ctx, const char *const *protos, size_t num) {
+    HAPPrecondition(ctx);
+    HAPPrecondition(protos);
+    HAPPrecondition(num > 0 && num <= PAL_SSL_ALPN_MAX);
+
+    // mbedtls keeps the pointers, copy the names into the context.
+    size_t off = 0;
+    for (size_t i = 0; i < num; i++) {
+        size_t n = strlen(protos[i]) + 1;
+        if (n == 1 || off + n > sizeof(ctx->alpn_buf)) {
+            HAPLogError(&ssl_log_obj, "%s: Invalid protocol \"%s\".", __func__, protos[i]);
+            return false;
+        }
+        memcpy(ctx->alpn_buf + off, protos[i], n);
+        ctx->alpn[i] = ctx->alpn_buf + off;
+        off += n;
+    }
+    ctx->alpn[num] = NULL;
+
+    int ret = mbedtls_ssl_conf_alpn_protocols(&ctx->conf, ctx->alpn);
+    if (ret) {
+        MBEDTLS_PRINT_ERROR(mbedtls_ssl_conf_alpn_protocols, ret);
+        return false;
+    }
+    return true;
+}
+
+const char *pal_ssl_get_alpn(pal_ssl_ctx *ctx) {
+    HAPPrecondition(ctx);
+    return mbedtls_ssl_get_alpn_protocol(&ctx->ssl);
+}
+
 bool pal_ssl_finshed(pal_ssl_ctx *ctx) {
     HAPPrecondition(ctx);
     return ctx->finshed;
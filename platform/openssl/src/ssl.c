@@ -4,6 +4,7 @@
 // you may not use this file except in compliance with the License.
 // See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
 
+#include <string.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <pal/memory.h>
@@ -23,6 +24,7 @@ struct pal_ssl_ctx {
     SSL *ssl;
     BIO *in_bio;
     BIO *out_bio;
+    char alpn[PAL_SSL_ALPN_LEN_MAX];
 };
 
 static const HAPLogObject ssl_log_obj = {
@@ -55,6 +57,7 @@ pal_ssl_ctx *pal_ssl_create(pal_ssl_endpoint ep, const char *hostname) {
         break;
     }
 
+    ctx->alpn[0] = '\0';
     ctx->ctx = SSL_CTX_new(method);
     if (!ctx->ctx) {
         LOG_OPENSSL_ERROR("Failed to new SSL context");
@@ -118,6 +121,45 @@ void pal_ssl_free(pal_ssl_ctx *ctx) {
     pal_mem_free(ctx);
 }
 
+bool pal_ssl_set_alpn(pal_ssl_ctx *ctx, const char *const *protos, size_t num) {
+    HAPPrecondition(ctx);
+    HAPPrecondition(protos);
+    HAPPrecondition(num > 0 && num <= PAL_SSL_ALPN_MAX);
+
+    // Wire format: the protocol names prefixed by their lengths.
+    unsigned char buf[PAL_SSL_ALPN_LEN_MAX + PAL_SSL_ALPN_MAX];
+    size_t len = 0;
+    for (size_t i = 0; i < num; i++) {
+        size_t n = strlen(protos[i]);
+        if (n == 0 || n > UINT8_MAX || len + 1 + n > sizeof(buf)) {
+            HAPLogError(&ssl_log_obj, "%s: Invalid protocol \"%s\".", __func__, protos[i]);
+            return false;
+        }
+        buf[len++] = n;
+        memcpy(buf + len, protos[i], n);
+        len += n;
+    }
+    if (SSL_set_alpn_protos(ctx->ssl, buf, len)) {
+        LOG_OPENSSL_ERROR("Failed to set ALPN protocols");
+        return false;
+    }
+    return true;
+}
+
+const char *pal_ssl_get_alpn(pal_ssl_ctx *ctx) {
+    HAPPrecondition(ctx);
+
+    const unsigned char *data;
+    unsigned int len;
+    SSL_get0_alpn_selected(ctx->ssl, &data, &len);
+    if (!data || len == 0 || len >= sizeof(ctx->alpn)) {
+        return NULL;
+    }
+    memcpy(ctx->alpn, data, len);
+    ctx->alpn[len] = '\0';
+    return ctx->alpn;
+}
+
 bool pal_ssl_finshed(pal_ssl_ctx *ctx) {
     HAPPrecondition(ctx);
     return SSL_is_init_finished(ctx->ssl);
@@ -0,0 +1,355 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/queue.h>
+#include <sys/stat.h>
+#include <pal/aio.h>
+#include <pal/dispatch.h>
+#include <pal/memory.h>
+#include <HAPPlatform.h>
+
+// Stack size of the worker thread, the FATFS/VFS calls on ESP need more than 4 KiB.
+#ifndef PAL_AIO_WORKER_STACK_SIZE
+#ifdef ESP_PLATFORM
+#define PAL_AIO_WORKER_STACK_SIZE 8192
+#else
+#define PAL_AIO_WORKER_STACK_SIZE 65536
+#endif
+#endif
+
+// Size of the chunks to read a file of unknown size.
+#define PAL_AIO_READ_CHUNK_SIZE 4096
+
+typedef enum {
+    PAL_AIO_OP_READ,
+    PAL_AIO_OP_WRITE,
+    PAL_AIO_OP_STAT,
+} pal_aio_op;
+
+typedef struct pal_aio_req {
+    pal_dispatch_node node;
+    pal_aio_op op;
+    int err;
+    union {
+        pal_aio_read_cb read;
+        pal_aio_write_cb write;
+        pal_aio_stat_cb stat;
+    } cb;
+    void *arg;
+    union {
+        struct {
+            uint64_t offset;
+            size_t len;
+            char *buf;
+        } read;
+        struct {
+            const char *data;  // A copy after the path.
+            size_t len;
+            bool append;
+        } write;
+        pal_aio_file_stat stat;
+    } u;
+    STAILQ_ENTRY(pal_aio_req) list_entry;
+    char path[0];
+} pal_aio_req;
+
+static const HAPLogObject aio_log_obj = {
+    .subsystem = kHAPPlatform_LogSubsystem,
+    .category = "aio",
+};
+
+static struct {
+    bool inited;
+    bool stop;
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    STAILQ_HEAD(, pal_aio_req) reqs;
+} gv_aio;
+
+static void pal_aio_req_free(pal_aio_req *req) {
+    if (req->op == PAL_AIO_OP_READ && req->u.read.buf) {
+        pal_mem_free(req->u.read.buf);
+    }
+    pal_mem_free(req);
+}
+
+static int pal_aio_do_read(pal_aio_req *req) {
+    int fd;
+    do {
+        fd = open(req->path, O_RDONLY);
+    } while (fd == -1 && errno == EINTR);
+    if (fd == -1) {
+        return errno;
+    }
+
+    int err = 0;
+    size_t cap = req->u.read.len;
+    if (cap == 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > req->u.read.offset) {
+            cap = st.st_size - req->u.read.offset;
+        } else {
+            cap = PAL_AIO_READ_CHUNK_SIZE;
+        }
+    }
+    if (req->u.read.offset && lseek(fd, req->u.read.offset, SEEK_SET) == -1) {
+        err = errno;
+        goto end;
+    }
+    req->u.read.buf = pal_mem_alloc(cap);
+    if (!req->u.read.buf) {
+        err = ENOMEM;
+        goto end;
+    }
+
+    size_t len = 0;
+    while (1) {
+        if (len == cap) {
+            if (req->u.read.len) {
+                break;
+            }
+            // The file grows, read until the end of the file.
+            char *buf = pal_mem_realloc(req->u.read.buf, cap + PAL_AIO_READ_CHUNK_SIZE);
+            if (!buf) {
+                err = ENOMEM;
+                goto end;
+            }
+            req->u.read.buf = buf;
+            cap += PAL_AIO_READ_CHUNK_SIZE;
+        }
+        ssize_t rc = read(fd, req->u.read.buf + len, cap - len);
+        if (rc == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            err = errno;
+            goto end;
+        }
+        if (rc == 0) {
+            break;
+        }
+        len += rc;
+    }
+    req->u.read.len = len;
+
+end:
+    close(fd);
+    return err;
+}
+
+static int pal_aio_do_write(pal_aio_req *req) {
+    int flags = O_WRONLY | O_CREAT | (req->u.write.append ? O_APPEND : O_TRUNC);
+    int fd;
+    do {
+        fd = open(req->path, flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    } while (fd == -1 && errno == EINTR);
+    if (fd == -1) {
+        return errno;
+    }
+
+    int err = 0;
+    const char *data = req->u.write.data;
+    size_t remain = req->u.write.len;
+    while (remain) {
+        ssize_t rc = write(fd, data, remain);
+        if (rc == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            err = errno;
+            break;
+        }
+        data += rc;
+        remain -= rc;
+    }
+    if (close(fd) == -1 && !err) {
+        err = errno;
+    }
+    return err;
+}
+
+static int pal_aio_do_stat(pal_aio_req *req) {
+    struct stat st;
+    if (stat(req->path, &st) == -1) {
+        return errno;
+    }
+    req->u.stat.type = S_ISREG(st.st_mode) ? PAL_AIO_TYPE_FILE :
+        S_ISDIR(st.st_mode) ? PAL_AIO_TYPE_DIR : PAL_AIO_TYPE_OTHER;
+    req->u.stat.size = st.st_size;
+    req->u.stat.mtime = st.st_mtime;
+    return 0;
+}
+
+static void pal_aio_req_done(pal_dispatch_node *node) {
+    pal_aio_req *req = (pal_aio_req *)node;
+
+    switch (req->op) {
+    case PAL_AIO_OP_READ:
+        req->cb.read(req->err, req->err ? NULL : req->u.read.buf,
+            req->err ? 0 : req->u.read.len, req->arg);
+        break;
+    case PAL_AIO_OP_WRITE:
+        req->cb.write(req->err, req->arg);
+        break;
+    case PAL_AIO_OP_STAT:
+        req->cb.stat(req->err, req->err ? NULL : &req->u.stat, req->arg);
+        break;
+    }
+    pal_aio_req_free(req);
+}
+
+static void *pal_aio_worker(void *arg) {
+    while (1) {
+        pthread_mutex_lock(&gv_aio.lock);
+        while (STAILQ_EMPTY(&gv_aio.reqs) && !gv_aio.stop) {
+            pthread_cond_wait(&gv_aio.cond, &gv_aio.lock);
+        }
+        if (gv_aio.stop) {
+            pthread_mutex_unlock(&gv_aio.lock);
+            break;
+        }
+        pal_aio_req *req = STAILQ_FIRST(&gv_aio.reqs);
+        STAILQ_REMOVE_HEAD(&gv_aio.reqs, list_entry);
+        pthread_mutex_unlock(&gv_aio.lock);
+
+        switch (req->op) {
+        case PAL_AIO_OP_READ:
+            req->err = pal_aio_do_read(req);
+            break;
+        case PAL_AIO_OP_WRITE:
+            req->err = pal_aio_do_write(req);
+            break;
+        case PAL_AIO_OP_STAT:
+            req->err = pal_aio_do_stat(req);
+            break;
+        }
+        pal_dispatch_async(&req->node, pal_aio_req_done);
+    }
+    return NULL;
+}
+
+void pal_aio_init() {
+    HAPPrecondition(!gv_aio.inited);
+
+    gv_aio.stop = false;
+    STAILQ_INIT(&gv_aio.reqs);
+    HAPAssert(pthread_mutex_init(&gv_aio.lock, NULL) == 0);
+    HAPAssert(pthread_cond_init(&gv_aio.cond, NULL) == 0);
+
+    pthread_attr_t attr;
+    HAPAssert(pthread_attr_init(&attr) == 0);
+    size_t stacksize = PAL_AIO_WORKER_STACK_SIZE;
+#ifdef PTHREAD_STACK_MIN
+    if (stacksize < PTHREAD_STACK_MIN) {
+        stacksize = PTHREAD_STACK_MIN;
+    }
+#endif
+    HAPAssert(pthread_attr_setstacksize(&attr, stacksize) == 0);
+    HAPAssert(pthread_create(&gv_aio.worker, &attr, pal_aio_worker, NULL) == 0);
+    pthread_attr_destroy(&attr);
+    gv_aio.inited = true;
+}
+
+void pal_aio_deinit() {
+    HAPPrecondition(gv_aio.inited);
+
+    pthread_mutex_lock(&gv_aio.lock);
+    gv_aio.stop = true;
+    pthread_cond_signal(&gv_aio.cond);
+    pthread_mutex_unlock(&gv_aio.lock);
+    pthread_join(gv_aio.worker, NULL);
+
+    while (!STAILQ_EMPTY(&gv_aio.reqs)) {
+        pal_aio_req *req = STAILQ_FIRST(&gv_aio.reqs);
+        STAILQ_REMOVE_HEAD(&gv_aio.reqs, list_entry);
+        pal_aio_req_free(req);
+    }
+    pthread_cond_destroy(&gv_aio.cond);
+    pthread_mutex_destroy(&gv_aio.lock);
+    gv_aio.inited = false;
+}
+
+// Create a request, "extra" bytes are allocated after the path.
+static pal_aio_req *pal_aio_req_create(pal_aio_op op, const char *path, size_t extra, void *arg) {
+    size_t pathlen = strlen(path);
+    pal_aio_req *req = pal_mem_calloc(sizeof(*req) + pathlen + 1 + extra);
+    if (!req) {
+        HAPLogError(&aio_log_obj, "%s: Failed to alloc memory.", __func__);
+        return NULL;
+    }
+    req->op = op;
+    req->arg = arg;
+    memcpy(req->path, path, pathlen + 1);
+    return req;
+}
+
+static void pal_aio_req_submit(pal_aio_req *req) {
+    pthread_mutex_lock(&gv_aio.lock);
+    STAILQ_INSERT_TAIL(&gv_aio.reqs, req, list_entry);
+    pthread_cond_signal(&gv_aio.cond);
+    pthread_mutex_unlock(&gv_aio.lock);
+}
+
+bool pal_aio_read(const char *path, uint64_t offset, size_t len, pal_aio_read_cb cb, void *arg) {
+    HAPPrecondition(gv_aio.inited);
+    HAPPrecondition(path);
+    HAPPrecondition(cb);
+
+    pal_aio_req *req = pal_aio_req_create(PAL_AIO_OP_READ, path, 0, arg);
+    if (!req) {
+        return false;
+    }
+    req->cb.read = cb;
+    req->u.read.offset = offset;
+    req->u.read.len = len;
+    pal_aio_req_submit(req);
+    return true;
+}
+
+bool pal_aio_write(const char *path, const void *data, size_t len, bool append,
+    pal_aio_write_cb cb, void *arg) {
+    HAPPrecondition(gv_aio.inited);
+    HAPPrecondition(path);
+    HAPPrecondition(data || len == 0);
+    HAPPrecondition(cb);
+
+    // Copy the data, the caller may be gone before the worker writes it.
+    pal_aio_req *req = pal_aio_req_create(PAL_AIO_OP_WRITE, path, len, arg);
+    if (!req) {
+        return false;
+    }
+    req->cb.write = cb;
+    char *copy = req->path + strlen(req->path) + 1;
+    if (len) {
+        memcpy(copy, data, len);
+    }
+    req->u.write.data = copy;
+    req->u.write.len = len;
+    req->u.write.append = append;
+    pal_aio_req_submit(req);
+    return true;
+}
+
+bool pal_aio_stat(const char *path, pal_aio_stat_cb cb, void *arg) {
+    HAPPrecondition(gv_aio.inited);
+    HAPPrecondition(path);
+    HAPPrecondition(cb);
+
+    pal_aio_req *req = pal_aio_req_create(PAL_AIO_OP_STAT, path, 0, arg);
+    if (!req) {
+        return false;
+    }
+    req->cb.stat = cb;
+    pal_aio_req_submit(req);
+    return true;
+}
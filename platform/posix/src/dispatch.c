@@ -0,0 +1,158 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <pal/dispatch.h>
+#include <HAPPlatform.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <HAPPlatformFileHandle.h>
+#endif
+
+static const HAPLogObject dispatch_log_obj = {
+    .subsystem = kHAPPlatform_LogSubsystem,
+    .category = "dispatch",
+};
+
+// The producers push the nodes to the head of a lock-free stack, the run loop
+// takes the whole stack at once and reverses it to the dispatch order.
+// Only the producer that finds the stack empty wakes up the run loop.
+static struct {
+    bool inited;
+    _Atomic(pal_dispatch_node *) head;
+#ifdef __linux__
+    int efd;
+    HAPPlatformFileHandleRef handle;
+#endif
+} gv_dispatch = {
+#ifdef __linux__
+    .efd = -1,
+#endif
+};
+
+static void pal_dispatch_drain(void) {
+    pal_dispatch_node *node = atomic_exchange_explicit(&gv_dispatch.head, NULL, memory_order_acquire);
+
+    pal_dispatch_node *fifo = NULL;
+    while (node) {
+        pal_dispatch_node *next = node->next;
+        node->next = fifo;
+        fifo = node;
+        node = next;
+    }
+
+    while (fifo) {
+        node = fifo;
+        fifo = node->next;
+        node->cb(node);
+    }
+}
+
+#ifdef __linux__
+
+static void pal_dispatch_handle_efd_cb(
+        HAPPlatformFileHandleRef fileHandle,
+        HAPPlatformFileHandleEvent fileHandleEvents,
+        void* _Nullable context) {
+    // Clear the counter before taking the stack, a node pushed after it
+    // wakes up the run loop again.
+    uint64_t cnt;
+    ssize_t n;
+    do {
+        n = read(gv_dispatch.efd, &cnt, sizeof(cnt));
+    } while (n == -1 && errno == EINTR);
+    if (n == -1 && errno != EAGAIN) {
+        HAPLogError(&dispatch_log_obj, "%s: read() failed: %s.", __func__, strerror(errno));
+    }
+    pal_dispatch_drain();
+}
+
+static void pal_dispatch_wakeup(void) {
+    uint64_t cnt = 1;
+    ssize_t n;
+    do {
+        n = write(gv_dispatch.efd, &cnt, sizeof(cnt));
+    } while (n == -1 && errno == EINTR);
+    if (n == -1) {
+        HAPLogError(&dispatch_log_obj, "%s: write() failed: %s.", __func__, strerror(errno));
+    }
+}
+
+void pal_dispatch_init() {
+    HAPPrecondition(!gv_dispatch.inited);
+
+    atomic_init(&gv_dispatch.head, NULL);
+    gv_dispatch.efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (gv_dispatch.efd == -1) {
+        HAPLogError(&dispatch_log_obj, "%s: eventfd() failed: %s.", __func__, strerror(errno));
+        HAPFatalError();
+    }
+    if (HAPPlatformFileHandleRegister(&gv_dispatch.handle, gv_dispatch.efd,
+        (HAPPlatformFileHandleEvent) { .isReadyForReading = true },
+        pal_dispatch_handle_efd_cb, NULL) != kHAPError_None) {
+        HAPLogError(&dispatch_log_obj, "%s: Failed to register handle callback", __func__);
+        HAPFatalError();
+    }
+    gv_dispatch.inited = true;
+}
+
+void pal_dispatch_deinit() {
+    HAPPrecondition(gv_dispatch.inited);
+
+    HAPPlatformFileHandleDeregister(gv_dispatch.handle);
+    close(gv_dispatch.efd);
+    gv_dispatch.efd = -1;
+    atomic_store(&gv_dispatch.head, NULL);
+    gv_dispatch.inited = false;
+}
+
+#else
+
+static void pal_dispatch_drain_cb(void* _Nullable context, size_t contextSize) {
+    pal_dispatch_drain();
+}
+
+// No eventfd, wake up the run loop through its loopback, still once per batch.
+static void pal_dispatch_wakeup(void) {
+    HAPAssert(HAPPlatformRunLoopScheduleCallback(pal_dispatch_drain_cb, NULL, 0) == kHAPError_None);
+}
+
+void pal_dispatch_init() {
+    HAPPrecondition(!gv_dispatch.inited);
+
+    atomic_init(&gv_dispatch.head, NULL);
+    gv_dispatch.inited = true;
+}
+
+void pal_dispatch_deinit() {
+    HAPPrecondition(gv_dispatch.inited);
+
+    atomic_store(&gv_dispatch.head, NULL);
+    gv_dispatch.inited = false;
+}
+
+#endif
+
+void pal_dispatch_async(pal_dispatch_node *node, pal_dispatch_cb cb) {
+    HAPPrecondition(node);
+    HAPPrecondition(cb);
+
+    node->cb = cb;
+    pal_dispatch_node *head = atomic_load_explicit(&gv_dispatch.head, memory_order_relaxed);
+    do {
+        node->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&gv_dispatch.head, &head, node,
+        memory_order_release, memory_order_relaxed));
+
+    if (!head) {
+        pal_dispatch_wakeup();
+    }
+}
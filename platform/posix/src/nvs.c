@@ -15,6 +15,7 @@
 #include <dirent.h>
 #include <pal/memory.h>
 #include <pal/nvs.h>
+#include <pal/trace.h>
 
 #include <HAPPlatform.h>
 #include <HAPPlatformFileManager.h>
@@ -366,6 +367,20 @@ bool pal_nvs_remove(pal_nvs_handle *handle, const char *key) {
     return false;
 }
 
+void pal_nvs_foreach(pal_nvs_handle *handle, pal_nvs_foreach_cb cb, void *arg) {
+    HAPPrecondition(handle);
+    HAPPrecondition(cb);
+
+    struct pal_nvs_item *next;
+    for (struct pal_nvs_item *t = SLIST_FIRST(&handle->item_list_head); t; t = next) {
+        // The item may be reallocated or freed in the callback.
+        next = SLIST_NEXT(t, list_entry);
+        if (!cb(handle, t->key, arg)) {
+            return;
+        }
+    }
+}
+
 bool pal_nvs_erase(pal_nvs_handle *handle) {
     HAPPrecondition(handle);
 
@@ -414,9 +429,7 @@ static bool write_all_to_tmp_file(int fd, const char *path, const char *dir, con
     return true;
 }
 
-bool pal_nvs_commit(pal_nvs_handle *handle) {
-    HAPPrecondition(handle);
-
+static bool pal_nvs_commit_sync(pal_nvs_handle *handle) {
     if (handle->mode == PAL_NVS_MODE_READONLY) {
         NVS_LOG_ERR("No permission to commit.");
         return false;
@@ -566,6 +579,15 @@ err:
     return false;
 }
 
+bool pal_nvs_commit(pal_nvs_handle *handle) {
+    HAPPrecondition(handle);
+
+    PAL_TRACE1(nvs__commit__start, handle->name);
+    bool ret = pal_nvs_commit_sync(handle);
+    PAL_TRACE2(nvs__commit__done, handle->name, ret);
+    return ret;
+}
+
 void pal_nvs_close(pal_nvs_handle *handle) {
     HAPPrecondition(handle);
 
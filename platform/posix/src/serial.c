@@ -0,0 +1,730 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <pal/serial.h>
+#include <pal/memory.h>
+#include <pal/trace.h>
+
+#include <HAPLog.h>
+#include <HAPPlatform.h>
+#include <HAPPlatformFileHandle.h>
+#include <HAPPlatformTimer.h>
+
+/**
+ * Log with level.
+ *
+ * @param level [Debug|Info|Default|Error|Fault]
+ * @param obj The pointer to serial port object.
+ */
+#define SERIAL_LOG(level, obj, fmt, arg...) \
+    HAPLogWithType(&serial_log_obj, kHAPLogType_ ## level, \
+    "(%s) " fmt, (obj)->path, ##arg)
+
+#define SERIAL_LOG_ERRNO(obj, func) \
+    SERIAL_LOG(Error, obj, "%s: %s() failed: %s.", __func__, func, strerror(errno))
+
+// The minimum capacity of the receive buffer.
+#define PAL_SERIAL_RBUF_MIN 256
+
+typedef enum {
+    PAL_SERIAL_FRAME_ANY,
+    PAL_SERIAL_FRAME_EXACTLY,
+    PAL_SERIAL_FRAME_UNTIL,
+} pal_serial_frame;
+
+typedef struct pal_serial_mbuf {
+    pal_serial_sent_cb sent_cb;
+    void *arg;
+    struct pal_serial_mbuf *next;
+    size_t len;
+    size_t pos;
+    char buf[0];
+} pal_serial_mbuf;
+
+struct pal_serial_obj {
+    bool receiving;
+    uint16_t id;
+    int fd;
+    uint32_t timeout;
+    HAPPlatformTimerRef timer;
+
+    // The framing of the pending read.
+    pal_serial_frame frame;
+    size_t frame_len;
+    size_t scanned;
+    size_t delimlen;
+    char delim[PAL_SERIAL_DELIM_MAXLEN];
+
+    // The received data is rbuf[rpos, rlen).
+    char *rbuf;
+    size_t rcap;
+    size_t rpos;
+    size_t rlen;
+
+    pal_serial_recved_cb recved_cb;
+    void *cb_arg;
+
+    HAPPlatformFileHandleRef handle;
+    HAPPlatformFileHandleEvent interests;
+
+    pal_serial_mbuf *mbuf_list_head;
+    pal_serial_mbuf **mbuf_list_ptail;
+
+    char path[0];
+};
+
+static const HAPLogObject serial_log_obj = {
+    .subsystem = kHAPPlatform_LogSubsystem,
+    .category = "serial",
+};
+
+static uint16_t gserial_count;
+
+static void pal_serial_handle_event_cb(
+        HAPPlatformFileHandleRef fileHandle,
+        HAPPlatformFileHandleEvent fileHandleEvents,
+        void *context);
+
+static const struct {
+    uint32_t baudrate;
+    speed_t speed;
+} pal_serial_speeds[] = {
+    { 1200, B1200 },
+    { 2400, B2400 },
+    { 4800, B4800 },
+    { 9600, B9600 },
+    { 19200, B19200 },
+    { 38400, B38400 },
+    { 57600, B57600 },
+    { 115200, B115200 },
+    { 230400, B230400 },
+#ifdef B460800
+    { 460800, B460800 },
+#endif
+#ifdef B921600
+    { 921600, B921600 },
+#endif
+};
+
+static pal_serial_mbuf *pal_serial_mbuf_create(const void *data, size_t len,
+    pal_serial_sent_cb sent_cb, void *arg) {
+    pal_serial_mbuf *mbuf = pal_mem_alloc(sizeof(*mbuf) + len);
+    if (!mbuf) {
+        return NULL;
+    }
+
+    memcpy(mbuf->buf, data, len);
+    mbuf->pos = 0;
+    mbuf->len = len;
+    mbuf->sent_cb = sent_cb;
+    mbuf->arg = arg;
+
+    return mbuf;
+}
+
+static void pal_serial_mbuf_in(pal_serial_obj *o, pal_serial_mbuf *mbuf) {
+    mbuf->next = NULL;
+    *(o->mbuf_list_ptail) = mbuf;
+    o->mbuf_list_ptail = &mbuf->next;
+}
+
+static pal_serial_mbuf *pal_serial_mbuf_top(pal_serial_obj *o) {
+    return o->mbuf_list_head;
+}
+
+static pal_serial_mbuf *pal_serial_mbuf_out(pal_serial_obj *o) {
+    pal_serial_mbuf *mbuf = o->mbuf_list_head;
+    if (mbuf) {
+        o->mbuf_list_head = mbuf->next;
+        if (o->mbuf_list_head == NULL) {
+            o->mbuf_list_ptail = &o->mbuf_list_head;
+        }
+    }
+    return mbuf;
+}
+
+static void pal_serial_enable_read(pal_serial_obj *o, bool flag) {
+    o->interests.isReadyForReading = flag;
+    HAPPlatformFileHandleUpdateInterests(o->handle, o->interests, pal_serial_handle_event_cb, o);
+}
+
+static void pal_serial_enable_write(pal_serial_obj *o, bool flag) {
+    o->interests.isReadyForWriting = flag;
+    HAPPlatformFileHandleUpdateInterests(o->handle, o->interests, pal_serial_handle_event_cb, o);
+}
+
+static bool pal_serial_set_attr(pal_serial_obj *o, const pal_serial_cfg *cfg) {
+    speed_t speed = 0;
+    for (size_t i = 0; i < HAPArrayCount(pal_serial_speeds); i++) {
+        if (pal_serial_speeds[i].baudrate == cfg->baudrate) {
+            speed = pal_serial_speeds[i].speed;
+            break;
+        }
+    }
+    if (!speed) {
+        SERIAL_LOG(Error, o, "%s: Unsupported baud rate %u.", __func__, cfg->baudrate);
+        return false;
+    }
+
+    tcflag_t csize;
+    switch (cfg->databits) {
+    case 5:
+        csize = CS5;
+        break;
+    case 6:
+        csize = CS6;
+        break;
+    case 7:
+        csize = CS7;
+        break;
+    case 8:
+        csize = CS8;
+        break;
+    default:
+        SERIAL_LOG(Error, o, "%s: Unsupported data bits %u.", __func__, cfg->databits);
+        return false;
+    }
+
+    struct termios tio;
+    if (tcgetattr(o->fd, &tio) == -1) {
+        SERIAL_LOG_ERRNO(o, "tcgetattr");
+        return false;
+    }
+
+    // Raw mode, the bytes are passed through as they are.
+    tio.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF | IXANY);
+    tio.c_oflag &= ~OPOST;
+    tio.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    tio.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB);
+#ifdef CRTSCTS
+    tio.c_cflag &= ~CRTSCTS;
+#endif
+    tio.c_cflag |= CREAD | CLOCAL | csize;
+    switch (cfg->parity) {
+    case PAL_SERIAL_PARITY_NONE:
+        break;
+    case PAL_SERIAL_PARITY_ODD:
+        tio.c_cflag |= PARENB | PARODD;
+        break;
+    case PAL_SERIAL_PARITY_EVEN:
+        tio.c_cflag |= PARENB;
+        break;
+    default:
+        HAPAssertionFailure();
+    }
+    switch (cfg->stopbits) {
+    case 1:
+        break;
+    case 2:
+        tio.c_cflag |= CSTOPB;
+        break;
+    default:
+        SERIAL_LOG(Error, o, "%s: Unsupported stop bits %u.", __func__, cfg->stopbits);
+        return false;
+    }
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    if (cfsetispeed(&tio, speed) == -1 || cfsetospeed(&tio, speed) == -1) {
+        SERIAL_LOG_ERRNO(o, "cfsetspeed");
+        return false;
+    }
+
+    if (tcsetattr(o->fd, TCSANOW, &tio) == -1) {
+        SERIAL_LOG_ERRNO(o, "tcsetattr");
+        return false;
+    }
+    return true;
+}
+
+static pal_serial_err pal_serial_write_async(pal_serial_obj *o, const void *data, size_t *len) {
+    ssize_t rc;
+
+    do {
+        rc = write(o->fd, data, *len);
+    } while (rc == -1 && errno == EINTR);
+    PAL_TRACE3(serial__write, o->id, *len, rc);
+    if (rc == -1) {
+        *len = 0;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return PAL_SERIAL_ERR_IN_PROGRESS;
+        } else {
+            SERIAL_LOG_ERRNO(o, "write");
+            return PAL_SERIAL_ERR_UNKNOWN;
+        }
+    }
+    *len = rc;
+    return PAL_SERIAL_ERR_OK;
+}
+
+// Read the available data into the receive buffer.
+// The buffer is grown to hold the whole frame of the pending read, except for
+// PAL_SERIAL_FRAME_ANY which takes what fits in the current capacity.
+static pal_serial_err pal_serial_fill(pal_serial_obj *o) {
+    if (o->rpos > 0) {
+        memmove(o->rbuf, o->rbuf + o->rpos, o->rlen - o->rpos);
+        o->rlen -= o->rpos;
+        o->rpos = 0;
+    }
+
+    size_t need = o->frame == PAL_SERIAL_FRAME_ANY ? 0 : o->frame_len;
+    size_t cap = need > PAL_SERIAL_RBUF_MIN ? need : PAL_SERIAL_RBUF_MIN;
+    if (cap > o->rcap) {
+        char *rbuf = pal_mem_realloc(o->rbuf, cap);
+        if (!rbuf) {
+            SERIAL_LOG(Error, o, "%s: Failed to realloc memory.", __func__);
+            return PAL_SERIAL_ERR_ALLOC;
+        }
+        o->rbuf = rbuf;
+        o->rcap = cap;
+    }
+    if (o->rlen == o->rcap) {
+        return PAL_SERIAL_ERR_OK;
+    }
+
+    ssize_t rc;
+    do {
+        rc = read(o->fd, o->rbuf + o->rlen, o->rcap - o->rlen);
+    } while (rc == -1 && errno == EINTR);
+    PAL_TRACE3(serial__read, o->id, o->rcap - o->rlen, rc);
+    if (rc == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return PAL_SERIAL_ERR_OK;
+        }
+        SERIAL_LOG_ERRNO(o, "read");
+        return PAL_SERIAL_ERR_UNKNOWN;
+    }
+    if (rc == 0) {
+        SERIAL_LOG(Error, o, "%s: The device is hung up.", __func__);
+        return PAL_SERIAL_ERR_UNKNOWN;
+    }
+    o->rlen += rc;
+    return PAL_SERIAL_ERR_OK;
+}
+
+// Find the frame of the pending read in the receive buffer.
+static pal_serial_err pal_serial_frame_check(pal_serial_obj *o, size_t *len) {
+    size_t avail = o->rlen - o->rpos;
+
+    switch (o->frame) {
+    case PAL_SERIAL_FRAME_ANY:
+        if (avail == 0) {
+            return PAL_SERIAL_ERR_IN_PROGRESS;
+        }
+        *len = avail < o->frame_len ? avail : o->frame_len;
+        return PAL_SERIAL_ERR_OK;
+    case PAL_SERIAL_FRAME_EXACTLY:
+        if (avail < o->frame_len) {
+            return PAL_SERIAL_ERR_IN_PROGRESS;
+        }
+        *len = o->frame_len;
+        return PAL_SERIAL_ERR_OK;
+    case PAL_SERIAL_FRAME_UNTIL: {
+        // Continue from where the last scan stopped.
+        const char *p = o->rbuf + o->rpos;
+        size_t end = avail < o->frame_len ? avail : o->frame_len;
+        size_t i;
+        for (i = o->scanned; i + o->delimlen <= end; i++) {
+            if (memcmp(p + i, o->delim, o->delimlen) == 0) {
+                *len = i + o->delimlen;
+                return PAL_SERIAL_ERR_OK;
+            }
+        }
+        o->scanned = i;
+        return avail >= o->frame_len ? PAL_SERIAL_ERR_OVERFLOW : PAL_SERIAL_ERR_IN_PROGRESS;
+    }
+    default:
+        HAPAssertionFailure();
+    }
+    return PAL_SERIAL_ERR_UNKNOWN;
+}
+
+static const void *pal_serial_consume(pal_serial_obj *o, size_t len) {
+    const void *data = o->rbuf + o->rpos;
+    o->rpos += len;
+    return data;
+}
+
+static void pal_serial_handle_read_cb(pal_serial_obj *o) {
+    if (!o->receiving) {
+        return;
+    }
+
+    size_t len = 0;
+    pal_serial_err err = pal_serial_fill(o);
+    if (err == PAL_SERIAL_ERR_OK) {
+        err = pal_serial_frame_check(o, &len);
+        if (err == PAL_SERIAL_ERR_IN_PROGRESS) {
+            return;
+        }
+    }
+
+    if (o->timer) {
+        HAPPlatformTimerDeregister(o->timer);
+        o->timer = 0;
+    }
+    o->receiving = false;
+    pal_serial_enable_read(o, false);
+
+    const void *data = NULL;
+    if (err == PAL_SERIAL_ERR_OK) {
+        data = pal_serial_consume(o, len);
+        SERIAL_LOG(Debug, o, "Received frame(len=%zu)", len);
+    }
+    if (o->recved_cb) {
+        o->recved_cb(o, err, data, len, o->cb_arg);
+    }
+}
+
+static void pal_serial_handle_write_cb(pal_serial_obj *o) {
+    pal_serial_mbuf *mbuf = pal_serial_mbuf_top(o);
+    if (!mbuf) {
+        return;
+    }
+
+    size_t sent_len = mbuf->len - mbuf->pos;
+    pal_serial_err err = pal_serial_write_async(o, mbuf->buf + mbuf->pos, &sent_len);
+    switch (err) {
+    case PAL_SERIAL_ERR_OK:
+        mbuf->pos += sent_len;
+        if (mbuf->pos < mbuf->len) {
+            return;
+        }
+        SERIAL_LOG(Debug, o, "Wrote data(len=%zu)", mbuf->len);
+        break;
+    case PAL_SERIAL_ERR_IN_PROGRESS:
+        return;
+    default:
+        break;
+    }
+
+    pal_serial_mbuf_out(o);
+    if (!pal_serial_mbuf_top(o)) {
+        pal_serial_enable_write(o, false);
+    }
+
+    if (mbuf->sent_cb) {
+        mbuf->sent_cb(o, err, mbuf->arg);
+    }
+    pal_mem_free(mbuf);
+}
+
+static void pal_serial_handle_event_cb(
+        HAPPlatformFileHandleRef fileHandle,
+        HAPPlatformFileHandleEvent fileHandleEvents,
+        void *context) {
+    pal_serial_obj *o = context;
+
+    HAPPrecondition(o->handle == fileHandle);
+
+    // The callbacks may destroy the object, handle one event at a time.
+    if (fileHandleEvents.isReadyForReading) {
+        pal_serial_handle_read_cb(o);
+    } else if (fileHandleEvents.isReadyForWriting) {
+        pal_serial_handle_write_cb(o);
+    }
+}
+
+static pal_serial_obj *pal_serial_create(int fd, const char *path, const pal_serial_cfg *cfg) {
+    size_t pathlen = strlen(path);
+    pal_serial_obj *o = pal_mem_calloc(sizeof(*o) + pathlen + 1);
+    if (!o) {
+        HAPLogWithType(&serial_log_obj, kHAPLogType_Error, "%s: Failed to calloc memory.", __func__);
+        close(fd);
+        return NULL;
+    }
+
+    o->fd = fd;
+    memcpy(o->path, path, pathlen + 1);
+
+    if (!pal_serial_set_attr(o, cfg)) {
+        goto err;
+    }
+
+    if (HAPPlatformFileHandleRegister(&o->handle, o->fd, o->interests,
+        pal_serial_handle_event_cb, o) != kHAPError_None) {
+        SERIAL_LOG(Error, o, "%s: Failed to register handle callback", __func__);
+        goto err;
+    }
+
+    o->id = ++gserial_count;
+    o->mbuf_list_ptail = &o->mbuf_list_head;
+
+    SERIAL_LOG(Debug, o, "%s(baudrate = %u, databits = %u, parity = %d, stopbits = %u) = %p", __func__,
+        cfg->baudrate, cfg->databits, cfg->parity, cfg->stopbits, o);
+    return o;
+
+err:
+    close(o->fd);
+    pal_mem_free(o);
+    return NULL;
+}
+
+pal_serial_obj *pal_serial_open(const char *path, const pal_serial_cfg *cfg) {
+    HAPPrecondition(path);
+    HAPPrecondition(cfg);
+
+    int fd;
+    do {
+        fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    } while (fd == -1 && errno == EINTR);
+    if (fd == -1) {
+        HAPLogWithType(&serial_log_obj, kHAPLogType_Error, "%s: Failed to open %s: %s.",
+            __func__, path, strerror(errno));
+        return NULL;
+    }
+
+    return pal_serial_create(fd, path, cfg);
+}
+
+pal_serial_obj *pal_serial_open_pty(char *slave, size_t len) {
+    HAPPrecondition(slave);
+    HAPPrecondition(len > 0);
+
+#ifdef __linux__
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd == -1) {
+        HAPLogWithType(&serial_log_obj, kHAPLogType_Error, "%s: posix_openpt() failed: %s.",
+            __func__, strerror(errno));
+        return NULL;
+    }
+    if (grantpt(fd) == -1 || unlockpt(fd) == -1 || ptsname_r(fd, slave, len) != 0 ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) == -1) {
+        HAPLogWithType(&serial_log_obj, kHAPLogType_Error, "%s: Failed to unlock the pty: %s.",
+            __func__, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    const pal_serial_cfg cfg = {
+        .baudrate = 115200,
+        .databits = 8,
+        .parity = PAL_SERIAL_PARITY_NONE,
+        .stopbits = 1,
+    };
+    return pal_serial_create(fd, "/dev/ptmx", &cfg);
+#else
+    HAPLogWithType(&serial_log_obj, kHAPLogType_Error, "%s: Not supported.", __func__);
+    return NULL;
+#endif
+}
+
+void pal_serial_destroy(pal_serial_obj *o) {
+    if (!o) {
+        return;
+    }
+    SERIAL_LOG(Debug, o, "%s(%p)", __func__, o);
+    if (o->handle) {
+        HAPPlatformFileHandleDeregister(o->handle);
+        o->handle = 0;
+    }
+    close(o->fd);
+    if (o->timer) {
+        HAPPlatformTimerDeregister(o->timer);
+        o->timer = 0;
+    }
+
+    // Fail the pending operations.
+    if (o->receiving) {
+        o->receiving = false;
+        if (o->recved_cb) {
+            o->recved_cb(o, PAL_SERIAL_ERR_CLOSED, NULL, 0, o->cb_arg);
+        }
+    }
+    pal_serial_mbuf *cur;
+    while ((cur = pal_serial_mbuf_out(o))) {
+        if (cur->sent_cb) {
+            cur->sent_cb(o, PAL_SERIAL_ERR_CLOSED, cur->arg);
+        }
+        pal_mem_free(cur);
+    }
+    pal_mem_free(o->rbuf);
+    pal_mem_free(o);
+}
+
+void pal_serial_set_timeout(pal_serial_obj *o, uint32_t ms) {
+    HAPPrecondition(o);
+
+    o->timeout = ms;
+}
+
+pal_serial_err pal_serial_write(pal_serial_obj *o, const void *data, size_t len,
+    pal_serial_sent_cb sent_cb, void *arg) {
+    HAPPrecondition(o);
+    HAPPrecondition(sent_cb);
+    if (len > 0) {
+        HAPPrecondition(data);
+    }
+
+    SERIAL_LOG(Debug, o, "%s(len = %zu)", __func__, len);
+
+    // Keep the order of the writes.
+    size_t sent_len = 0;
+    pal_serial_err err = PAL_SERIAL_ERR_IN_PROGRESS;
+    if (!pal_serial_mbuf_top(o)) {
+        sent_len = len;
+        err = pal_serial_write_async(o, data, &sent_len);
+    }
+    if (err == PAL_SERIAL_ERR_OK && sent_len == len) {
+        SERIAL_LOG(Debug, o, "Wrote data(len=%zu)", len);
+        return err;
+    }
+    if (err != PAL_SERIAL_ERR_OK && err != PAL_SERIAL_ERR_IN_PROGRESS) {
+        return err;
+    }
+
+    pal_serial_mbuf *mbuf = pal_serial_mbuf_create((const char *)data + sent_len,
+        len - sent_len, sent_cb, arg);
+    if (!mbuf) {
+        return PAL_SERIAL_ERR_ALLOC;
+    }
+    pal_serial_mbuf_in(o, mbuf);
+    pal_serial_enable_write(o, true);
+    SERIAL_LOG(Debug, o, "Writing data(len=%zu) ...", len);
+
+    return PAL_SERIAL_ERR_IN_PROGRESS;
+}
+
+static void pal_serial_read_timeout_cb(HAPPlatformTimerRef timer, void *context) {
+    pal_serial_obj *o = context;
+    PAL_TRACE2(serial__timeout, o->id, "read");
+
+    o->timer = 0;
+    o->receiving = false;
+    pal_serial_enable_read(o, false);
+
+    if (o->recved_cb) {
+        o->recved_cb(o, PAL_SERIAL_ERR_TIMEOUT, NULL, 0, o->cb_arg);
+    }
+}
+
+static pal_serial_err pal_serial_read_int(pal_serial_obj *o, pal_serial_frame frame, size_t frame_len,
+    const void **data, size_t *len, pal_serial_recved_cb recved_cb, void *arg) {
+    if (o->receiving) {
+        return PAL_SERIAL_ERR_BUSY;
+    }
+
+    o->frame = frame;
+    o->frame_len = frame_len;
+    o->scanned = 0;
+
+    // Take the frame from the buffer or the data already arrived without the run loop.
+    pal_serial_err err = pal_serial_frame_check(o, len);
+    if (err == PAL_SERIAL_ERR_IN_PROGRESS) {
+        err = pal_serial_fill(o);
+        if (err == PAL_SERIAL_ERR_OK) {
+            err = pal_serial_frame_check(o, len);
+        }
+    }
+    switch (err) {
+    case PAL_SERIAL_ERR_OK:
+        *data = pal_serial_consume(o, *len);
+        SERIAL_LOG(Debug, o, "Received frame(len=%zu)", *len);
+        return err;
+    case PAL_SERIAL_ERR_IN_PROGRESS:
+        break;
+    default:
+        return err;
+    }
+
+    if (o->timeout != 0 && HAPPlatformTimerRegister(&o->timer,
+        HAPPlatformClockGetCurrent() + o->timeout,
+        pal_serial_read_timeout_cb, o) != kHAPError_None) {
+        SERIAL_LOG(Error, o, "Failed to create timeout timer.");
+        return PAL_SERIAL_ERR_UNKNOWN;
+    }
+
+    o->recved_cb = recved_cb;
+    o->cb_arg = arg;
+    o->receiving = true;
+    pal_serial_enable_read(o, true);
+
+    SERIAL_LOG(Debug, o, "Receiving ...");
+
+    return PAL_SERIAL_ERR_IN_PROGRESS;
+}
+
+pal_serial_err pal_serial_read(pal_serial_obj *o, size_t maxlen, const void **data, size_t *len,
+    pal_serial_recved_cb recved_cb, void *arg) {
+    HAPPrecondition(o);
+    HAPPrecondition(maxlen > 0);
+    HAPPrecondition(data);
+    HAPPrecondition(len);
+    HAPPrecondition(recved_cb);
+
+    SERIAL_LOG(Debug, o, "%s(maxlen = %zu)", __func__, maxlen);
+
+    return pal_serial_read_int(o, PAL_SERIAL_FRAME_ANY, maxlen, data, len, recved_cb, arg);
+}
+
+pal_serial_err pal_serial_read_exactly(pal_serial_obj *o, size_t len, const void **data,
+    pal_serial_recved_cb recved_cb, void *arg) {
+    HAPPrecondition(o);
+    HAPPrecondition(len > 0);
+    HAPPrecondition(data);
+    HAPPrecondition(recved_cb);
+
+    SERIAL_LOG(Debug, o, "%s(len = %zu)", __func__, len);
+
+    size_t _len;
+    return pal_serial_read_int(o, PAL_SERIAL_FRAME_EXACTLY, len, data, &_len, recved_cb, arg);
+}
+
+pal_serial_err pal_serial_read_until(pal_serial_obj *o, const void *delim, size_t delimlen, size_t maxlen,
+    const void **data, size_t *len, pal_serial_recved_cb recved_cb, void *arg) {
+    HAPPrecondition(o);
+    HAPPrecondition(delim);
+    HAPPrecondition(delimlen > 0 && delimlen <= PAL_SERIAL_DELIM_MAXLEN);
+    HAPPrecondition(maxlen >= delimlen);
+    HAPPrecondition(data);
+    HAPPrecondition(len);
+    HAPPrecondition(recved_cb);
+
+    SERIAL_LOG(Debug, o, "%s(delimlen = %zu, maxlen = %zu)", __func__, delimlen, maxlen);
+
+    if (o->receiving) {
+        return PAL_SERIAL_ERR_BUSY;
+    }
+    memcpy(o->delim, delim, delimlen);
+    o->delimlen = delimlen;
+
+    return pal_serial_read_int(o, PAL_SERIAL_FRAME_UNTIL, maxlen, data, len, recved_cb, arg);
+}
+
+void pal_serial_discard(pal_serial_obj *o) {
+    HAPPrecondition(o);
+
+    if (o->receiving) {
+        return;
+    }
+    o->rpos = 0;
+    o->rlen = 0;
+    if (tcflush(o->fd, TCIFLUSH) == -1) {
+        SERIAL_LOG_ERRNO(o, "tcflush");
+    }
+}
+
+const char *pal_serial_get_error_str(pal_serial_err err) {
+    HAPPrecondition(err >= PAL_SERIAL_ERR_OK && err < PAL_SERIAL_ERR_COUNT);
+    const char *err_strs[] = {
+        [PAL_SERIAL_ERR_OK] = "no error",
+        [PAL_SERIAL_ERR_TIMEOUT] = "timeout",
+        [PAL_SERIAL_ERR_IN_PROGRESS] = "the opreation is in progress",
+        [PAL_SERIAL_ERR_UNKNOWN] = "unknown error",
+        [PAL_SERIAL_ERR_ALLOC] = "failed to alloc",
+        [PAL_SERIAL_ERR_BUSY] = "busy now, try again later",
+        [PAL_SERIAL_ERR_OVERFLOW] = "delimiter not found within the max length",
+        [PAL_SERIAL_ERR_CLOSED] = "the serial port is closed",
+    };
+    return err_strs[err];
+}
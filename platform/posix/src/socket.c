@@ -14,6 +14,7 @@
 #include <sys/select.h>
 #include <pal/net/socket.h>
 #include <pal/memory.h>
+#include <pal/trace.h>
 
 #include <HAPLog.h>
 #include <HAPPlatform.h>
@@ -305,6 +306,7 @@ pal_socket_send_async(pal_socket_obj *o, const void *data, size_t *len, pal_sock
     do {
         rc = sendto(o->fd, data, *len, 0, (struct sockaddr *)addr, addrlen);
     } while (rc == -1 && errno == EINTR);
+    PAL_TRACE3(socket__send, o->id, *len, rc);
     if (rc == -1) {
         *len = 0;
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -332,6 +334,7 @@ pal_socket_recv_async(pal_socket_obj *o, void *buf, size_t *len, pal_socket_addr
             rc = recv(o->fd, buf, *len, 0);
         } while (rc == -1 && errno == EINTR);
     }
+    PAL_TRACE3(socket__recv, o->id, *len, rc);
     if (rc == -1) {
         *len = 0;
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -682,6 +685,51 @@ pal_socket_err pal_socket_enable_broadcast(pal_socket_obj *o) {
     return PAL_SOCKET_ERR_OK;
 }
 
+pal_socket_err pal_socket_join_multicast_group(pal_socket_obj *o, const char *maddr, const char *ifaddr) {
+    HAPPrecondition(o);
+    HAPPrecondition(maddr);
+
+    int ret = -1;
+
+    SOCKET_LOG(Debug, o, "%s(maddr = \"%s\", ifaddr = \"%s\")", __func__, maddr, ifaddr ? ifaddr : "any");
+
+    if (o->type != PAL_SOCKET_TYPE_UDP) {
+        return PAL_SOCKET_ERR_INVALID_STATE;
+    }
+
+    switch (o->af) {
+    case PAL_ADDR_FAMILY_IPV4: {
+        struct ip_mreq mreq = {
+            .imr_interface.s_addr = htonl(INADDR_ANY),
+        };
+        if (inet_pton(AF_INET, maddr, &mreq.imr_multiaddr) <= 0 ||
+            (ifaddr && inet_pton(AF_INET, ifaddr, &mreq.imr_interface) <= 0)) {
+            return PAL_SOCKET_ERR_INVALID_ARG;
+        }
+        ret = setsockopt(o->fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+        break;
+    }
+    case PAL_ADDR_FAMILY_IPV6: {
+        struct ipv6_mreq mreq = {
+            .ipv6mr_interface = 0,
+        };
+        if (inet_pton(AF_INET6, maddr, &mreq.ipv6mr_multiaddr) <= 0) {
+            return PAL_SOCKET_ERR_INVALID_ARG;
+        }
+        ret = setsockopt(o->fd, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq, sizeof(mreq));
+        break;
+    }
+    default:
+        HAPAssertionFailure();
+        break;
+    }
+    if (ret != 0) {
+        SOCKET_LOG_ERRNO(o, "setsockopt");
+        return PAL_SOCKET_ERR_UNKNOWN;
+    }
+    return PAL_SOCKET_ERR_OK;
+}
+
 pal_socket_err pal_socket_bind(pal_socket_obj *o, const char *addr, uint16_t port) {
     HAPPrecondition(o);
     HAPPrecondition(addr);
@@ -724,6 +772,7 @@ pal_socket_err pal_socket_listen(pal_socket_obj *o, int backlog) {
 
 static void pal_socket_accept_timeout_cb(HAPPlatformTimerRef timer, void *context) {
     pal_socket_obj *o = context;
+    PAL_TRACE2(socket__timeout, o->id, "accept");
 
     o->timer = 0;
     o->state = PAL_SOCKET_ST_LISTENED;
@@ -778,6 +827,7 @@ pal_socket_accept(pal_socket_obj *o, pal_socket_obj **new_o, char *addr, size_t
 
 static void pal_socket_connect_timeout_cb(HAPPlatformTimerRef timer, void *context) {
     pal_socket_obj *o = context;
+    PAL_TRACE2(socket__timeout, o->id, "connect");
 
     o->timer = 0;
     o->state = PAL_SOCKET_ST_NONE;
@@ -911,6 +961,7 @@ pal_socket_err pal_socket_sendto(pal_socket_obj *o, const void *data, size_t *le
 
 static void pal_socket_recv_timeout_cb(HAPPlatformTimerRef timer, void *context) {
     pal_socket_obj *o = context;
+    PAL_TRACE2(socket__timeout, o->id, "recv");
 
     o->timer = 0;
     o->receiving = false;
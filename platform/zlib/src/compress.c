@@ -0,0 +1,135 @@
+// Copyright (c) 2021-2022 Zebin Wu and homekit-bridge contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of homekit-bridge project authors.
+
+#include <zlib.h>
+#include <pal/memory.h>
+#include <pal/compress.h>
+#include <HAPBase.h>
+
+struct pal_compress_ctx {
+    pal_compress_mode mode;
+    bool finished;
+    z_stream stream;
+};
+
+static voidpf pal_compress_zalloc(voidpf opaque, uInt items, uInt size) {
+    return pal_mem_calloc((size_t)items * size);
+}
+
+static void pal_compress_zfree(voidpf opaque, voidpf address) {
+    pal_mem_free(address);
+}
+
+static int pal_compress_window_bits(pal_compress_format format) {
+    switch (format) {
+    case PAL_COMPRESS_FORMAT_RAW:
+        return -MAX_WBITS;
+    case PAL_COMPRESS_FORMAT_ZLIB:
+        return MAX_WBITS;
+    case PAL_COMPRESS_FORMAT_GZIP:
+        return MAX_WBITS + 16;
+    default:
+        HAPFatalError();
+    }
+}
+
+pal_compress_ctx *pal_compress_create(pal_compress_mode mode, pal_compress_format format, int level) {
+    HAPPrecondition(mode == PAL_COMPRESS_DEFLATE || mode == PAL_COMPRESS_INFLATE);
+    HAPPrecondition(level == PAL_COMPRESS_LEVEL_DEFAULT || (level >= 0 && level <= 9));
+
+    pal_compress_ctx *ctx = pal_mem_calloc(sizeof(*ctx));
+    if (!ctx) {
+        return NULL;
+    }
+    ctx->mode = mode;
+    ctx->stream.zalloc = pal_compress_zalloc;
+    ctx->stream.zfree = pal_compress_zfree;
+
+    int ret;
+    int wbits = pal_compress_window_bits(format);
+    if (mode == PAL_COMPRESS_DEFLATE) {
+        ret = deflateInit2(&ctx->stream, level, Z_DEFLATED, wbits, 8, Z_DEFAULT_STRATEGY);
+    } else {
+        ret = inflateInit2(&ctx->stream, wbits);
+    }
+    if (ret != Z_OK) {
+        pal_mem_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+void pal_compress_free(pal_compress_ctx *ctx) {
+    if (!ctx) {
+        return;
+    }
+    if (ctx->mode == PAL_COMPRESS_DEFLATE) {
+        deflateEnd(&ctx->stream);
+    } else {
+        inflateEnd(&ctx->stream);
+    }
+    pal_mem_free(ctx);
+}
+
+pal_compress_err pal_compress_update(pal_compress_ctx *ctx, const void *in, size_t ilen,
+    void *out, size_t *olen, bool finish) {
+    HAPPrecondition(ctx);
+    HAPPrecondition(out);
+    HAPPrecondition(olen);
+    HAPPrecondition(*olen > 0);
+
+    z_stream *stream = &ctx->stream;
+    if (in) {
+        stream->next_in = (Bytef *)in;
+        stream->avail_in = ilen;
+    }
+    stream->next_out = out;
+    stream->avail_out = *olen;
+
+    if (ctx->finished) {
+        *olen = 0;
+        return stream->avail_in ? PAL_COMPRESS_ERR_DATA : PAL_COMPRESS_ERR_OK;
+    }
+
+    int ret;
+    if (ctx->mode == PAL_COMPRESS_DEFLATE) {
+        ret = deflate(stream, finish ? Z_FINISH : Z_NO_FLUSH);
+    } else {
+        ret = inflate(stream, Z_NO_FLUSH);
+    }
+    *olen -= stream->avail_out;
+
+    switch (ret) {
+    case Z_STREAM_END:
+        ctx->finished = true;
+        if (ctx->mode == PAL_COMPRESS_INFLATE && stream->avail_in) {
+            // Trailing garbage after the end of the stream.
+            return PAL_COMPRESS_ERR_DATA;
+        }
+        return PAL_COMPRESS_ERR_OK;
+    case Z_OK:
+    case Z_BUF_ERROR:
+        // The output buffer is full, or there are more output pending.
+        if (stream->avail_out == 0) {
+            return PAL_COMPRESS_ERR_AGAIN;
+        }
+        if (ret == Z_OK && ctx->mode == PAL_COMPRESS_DEFLATE && finish) {
+            return PAL_COMPRESS_ERR_AGAIN;
+        }
+        return PAL_COMPRESS_ERR_OK;
+    case Z_DATA_ERROR:
+    case Z_NEED_DICT:
+        return PAL_COMPRESS_ERR_DATA;
+    default:
+        return PAL_COMPRESS_ERR_UNKNOWN;
+    }
+}
+
+bool pal_compress_finished(pal_compress_ctx *ctx) {
+    HAPPrecondition(ctx);
+
+    return ctx->finished;
+}
@@ -1,6 +1,6 @@
 local hap = require "hap"
 local On = require "hap.char.On"
-local raiseEvent = hap.raiseEvent
+local bind = require "hap.bind"
 
 local plug = {}
 
@@ -8,13 +8,14 @@ local plug = {}
 ---@param device MiioDevice Device object.
 ---@param info MiioDeviceInfo Device inforamtion.
 ---@param conf MiioAccessoryConf Device configuration.
+---@param binding HapCharacteristicBinding Binding of the characteristic ``On``.
 ---@return HapAccessory accessory HomeKit Accessory.
-function plug.gen(device, info, conf)
+function plug.gen(device, info, conf, binding)
     ---@class PlugIIDs:table Plug Instance ID table.
     local iids = {
         acc = conf.aid,
-        outlet = hap.getNewInstanceID(),
-        on = hap.getNewInstanceID()
+        outlet = hap.getNewInstanceID(conf.key .. ":outlet"),
+        on = hap.getNewInstanceID(conf.key .. ":on")
     }
 
     return {
@@ -36,16 +37,7 @@ function plug.gen(device, info, conf)
                     hidden = false
                 },
                 chars = {
-                    On.new(iids.on, function (request, self)
-                        local value = self:getOn()
-                        self.logger:info(("Read On: %s"):format(value))
-                        return value, hap.Error.None
-                    end, function (request, value, self)
-                        self.logger:info(("Write On: %s"):format(value))
-                        self:setOn(value)
-                        raiseEvent(request.aid, request.sid, request.cid)
-                        return hap.Error.None
-                    end)
+                    bind(On, iids.on, binding)
                 }
             }
         },
@@ -11,15 +11,9 @@ function plug.gen(device, info, conf)
         power = {siid = 2, piid = 1}
     })
 
-    function device:getOn()
-        return self:getProp("power")
-    end
-
-    function device:setOn(value)
-        self:setProp("power", value)
-    end
-
-    return require("miio.chuangmi.plug").gen(device, info, conf)
+    return require("miio.chuangmi.plug").gen(device, info, conf, {
+        prop = "power"
+    })
 end
 
 return plug
@@ -6,21 +6,13 @@ local plug = {}
 ---@param conf MiioAccessoryConf Device configuration.
 ---@return HapAccessory accessory HomeKit Accessory.
 function plug.gen(device, info, conf)
-    function device:getOn()
-        return self:getProp("power") == "on"
-    end
-
-    function device:setOn(value)
-        local power
-        if value == true then
-            power = "on"
-        else
-            power = "off"
-        end
-        self:setProp("power", power)
-    end
-
-    return require("miio.chuangmi.plug").gen(device, info, conf)
+    return require("miio.chuangmi.plug").gen(device, info, conf, {
+        prop = "power",
+        map = {
+            on = true,
+            off = false
+        }
+    })
 end
 
 return plug
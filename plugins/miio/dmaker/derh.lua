@@ -6,6 +6,7 @@ local CurrentHumidity = require "hap.char.CurrentRelativeHumidity"
 local TargetHumidity = require "hap.char.RelativeHumidityDehumidifierThreshold"
 local searchKey = require "util".searchKey
 local raiseEvent = hap.raiseEvent
+local derive = require "hap.derive"
 local tointeger = math.tointeger
 
 local derh = {}
@@ -19,12 +20,12 @@ function derh.gen(device, info, conf)
     ---@class DmakerFanIIDs:table Dmaker Fan Instance ID table.
     local iids = {
         acc = conf.aid,
-        derh = hap.getNewInstanceID(),
-        active = hap.getNewInstanceID(),
-        curState = hap.getNewInstanceID(),
-        tgtState = hap.getNewInstanceID(),
-        curHumidity = hap.getNewInstanceID(),
-        tgtHumidity = hap.getNewInstanceID()
+        derh = hap.getNewInstanceID(conf.key .. ":derh"),
+        active = hap.getNewInstanceID(conf.key .. ":active"),
+        curState = hap.getNewInstanceID(conf.key .. ":curState"),
+        tgtState = hap.getNewInstanceID(conf.key .. ":tgtState"),
+        curHumidity = hap.getNewInstanceID(conf.key .. ":curHumidity"),
+        tgtHumidity = hap.getNewInstanceID(conf.key .. ":tgtHumidity")
     }
     device.iids = iids
 
@@ -60,10 +61,9 @@ function derh.gen(device, info, conf)
                         self.logger:info("Write Active: " .. searchKey(Active.value, value))
                         self:setProp("power", value == Active.value.Active)
                         raiseEvent(request.aid, request.sid, request.cid)
-                        raiseEvent(request.aid, request.sid, self.iids.curState)
                         return hap.Error.None
                     end),
-                    CurrentState.new(iids.curState, function (request, self)
+                    derive(CurrentState.new(iids.curState, function (request, self)
                         local value
                         if self:getProp("power") then
                             value = CurrentState.value.Dehumidifying
@@ -72,7 +72,7 @@ function derh.gen(device, info, conf)
                         end
                         self.logger:info("Read CurrentHumidifierDehumidifierState: " .. searchKey(CurrentState.value, value))
                         return value, hap.Error.None
-                    end),
+                    end), iids.active),
                     TargetState.new(iids.tgtState, function (request, self)
                         local value = TargetState.value.Dehumidifier
                         self.logger:info("Read TargetHumidifierDehumidifierState: Dehumidifier")
@@ -2,11 +2,22 @@ local hap = require "hap"
 local Active = require "hap.char.Active"
 local RotationSpeed = require "hap.char.RotationSpeed"
 local SwingMode = require "hap.char.SwingMode"
-local searchKey = require "util".searchKey
-local raiseEvent = hap.raiseEvent
+local bind = require "hap.bind"
 
 local fan = {}
 
+--- Property value -> Characteristic value.
+local valMapping = {
+    power = {
+        [true] = Active.value.Active,
+        [false] = Active.value.Inactive,
+    },
+    swingMode = {
+        [true] = SwingMode.value.Enabled,
+        [false] = SwingMode.value.Disabled
+    }
+}
+
 ---Create a fan.
 ---@param device MiioDevice Device object.
 ---@param info MiioDeviceInfo Device inforamtion.
@@ -16,10 +27,10 @@ function fan.gen(device, info, conf)
     ---@class DmakerFanIIDs:table Dmaker Fan Instance ID table.
     local iids = {
         acc = conf.aid,
-        fan = hap.getNewInstanceID(),
-        active = hap.getNewInstanceID(),
-        rotationSpeed = hap.getNewInstanceID(),
-        swingMode = hap.getNewInstanceID(),
+        fan = hap.getNewInstanceID(conf.key .. ":fan"),
+        active = hap.getNewInstanceID(conf.key .. ":active"),
+        rotationSpeed = hap.getNewInstanceID(conf.key .. ":rotationSpeed"),
+        swingMode = hap.getNewInstanceID(conf.key .. ":swingMode"),
     }
 
     return {
@@ -41,50 +52,17 @@ function fan.gen(device, info, conf)
                     hidden = false
                 },
                 chars = {
-                    Active.new(iids.active, function (request, self)
-                        local activeVal = Active.value
-                        local value
-                        if self:getProp("power") then
-                            value = activeVal.Active
-                        else
-                            value = activeVal.Inactive
-                        end
-                        self.logger:info("Read Active: " .. searchKey(activeVal, value))
-                        return value, hap.Error.None
-                    end, function (request, value, self)
-                        local activeVal = Active.value
-                        self.logger:info("Write Active: " .. searchKey(activeVal, value))
-                        self:setProp("power", value == activeVal.Active)
-                        raiseEvent(request.aid, request.sid, request.cid)
-                        return hap.Error.None
-                    end),
-                    RotationSpeed.new(iids.rotationSpeed, function (request, self)
-                        local value = self:getProp("fanSpeed")
-                        self.logger:info("Read RotationSpeed: " .. value)
-                        return tonumber(value), hap.Error.None
-                    end, function (request, value, self)
-                        self.logger:info("Write RotationSpeed: " .. value)
-                        self:setProp("fanSpeed", math.tointeger(value))
-                        raiseEvent(request.aid, request.sid, request.cid)
-                        return hap.Error.None
-                    end, 1, 100, 1),
-                    SwingMode.new(iids.swingMode, function (request, self)
-                        local swingModeVal = SwingMode.value
-                        local value
-                        if self:getProp("swingMode") then
-                            value = swingModeVal.Enabled
-                        else
-                            value = swingModeVal.Disabled
-                        end
-                        self.logger:info("Read SwingMode: " .. searchKey(swingModeVal, value))
-                        return value, hap.Error.None
-                    end, function (request, value, self)
-                        local swingModeVal = SwingMode.value
-                        self.logger:info("Write SwingMode: " .. searchKey(swingModeVal, value))
-                        self:setProp("swingMode", value == swingModeVal.Enabled)
-                        raiseEvent(request.aid, request.sid, request.cid)
-                        return hap.Error.None
-                    end)
+                    bind(Active, iids.active, {
+                        prop = "power",
+                        map = valMapping.power
+                    }),
+                    bind(RotationSpeed, iids.rotationSpeed, {
+                        prop = "fanSpeed"
+                    }, 1, 100, 1),
+                    bind(SwingMode, iids.swingMode, {
+                        prop = "swingMode",
+                        map = valMapping.swingMode
+                    })
                 }
             }
         },
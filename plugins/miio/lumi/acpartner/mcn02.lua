@@ -9,6 +9,7 @@ local HeatThrholdTemp = require "hap.char.HeatingThresholdTemperature"
 local SwingMode = require "hap.char.SwingMode"
 local searchKey = require "util".searchKey
 local raiseEvent = hap.raiseEvent
+local bind = require "hap.bind"
 
 local acpartner = {}
 
@@ -26,6 +27,10 @@ local valMapping = {
         cool = TgtHeatCoolState.value.Cool,
         heat = TgtHeatCoolState.value.Heat,
         auto = TgtHeatCoolState.value.HeatOrCool,
+    },
+    curMode = {
+        cool = CurHeatCoolState.value.Cooling,
+        heat = CurHeatCoolState.value.Heating,
     }
 }
 
@@ -38,14 +43,14 @@ function acpartner.gen(device, info, conf)
     ---@class AcpartnerIIDS:table Acpartner Instance ID table.
     local iids = {
         acc = conf.aid,
-        heaterCooler = hap.getNewInstanceID(),
-        active = hap.getNewInstanceID(),
-        curTemp = hap.getNewInstanceID(),
-        curState = hap.getNewInstanceID(),
-        tgtState = hap.getNewInstanceID(),
-        coolThrTemp = hap.getNewInstanceID(),
-        heatThrTemp = hap.getNewInstanceID(),
-        swingMode = hap.getNewInstanceID()
+        heaterCooler = hap.getNewInstanceID(conf.key .. ":heaterCooler"),
+        active = hap.getNewInstanceID(conf.key .. ":active"),
+        curTemp = hap.getNewInstanceID(conf.key .. ":curTemp"),
+        curState = hap.getNewInstanceID(conf.key .. ":curState"),
+        tgtState = hap.getNewInstanceID(conf.key .. ":tgtState"),
+        coolThrTemp = hap.getNewInstanceID(conf.key .. ":coolThrTemp"),
+        heatThrTemp = hap.getNewInstanceID(conf.key .. ":heatThrTemp"),
+        swingMode = hap.getNewInstanceID(conf.key .. ":swingMode")
     }
     device.iids = iids
 
@@ -85,24 +90,14 @@ function acpartner.gen(device, info, conf)
                         end, self.iids):start(500)
                         return hap.Error.None
                     end),
-                    CurTemp.new(iids.curTemp, function (request, self)
-                        local value = self:getProp("tar_temp")
-                        self.logger:info("Read CurrentTemperature: " .. value)
-                        return value, hap.Error.None
-                    end),
-                    CurHeatCoolState.new(iids.curState, function (request, self)
-                        local mode = self:getProp("mode")
-                        local value
-                        if mode == "cool" then
-                            value = CurHeatCoolState.value.Cooling
-                        elseif mode == "heat" then
-                            value = CurHeatCoolState.value.Heating
-                        else
-                            value = CurHeatCoolState.value.Idle
-                        end
-                        self.logger:info("Read CurrentHeaterCoolerState: " .. searchKey(CurHeatCoolState.value, value))
-                        return value, hap.Error.None
-                    end),
+                    bind(CurTemp, iids.curTemp, {
+                        prop = "tar_temp"
+                    }),
+                    bind(CurHeatCoolState, iids.curState, {
+                        prop = "mode",
+                        map = valMapping.curMode,
+                        default = CurHeatCoolState.value.Idle
+                    }),
                     TgtHeatCoolState.new(iids.tgtState, function (request, self)
                         local mode = self:getProp("mode")
                         local value
@@ -124,42 +119,17 @@ function acpartner.gen(device, info, conf)
                         end, self.iids):start(500)
                         return hap.Error.None
                     end),
-                    CoolThrholdTemp.new(iids.coolThrTemp, function (request, self)
-                        local value =  self:getProp("tar_temp")
-                        self.logger:info("Read CoolingThresholdTemperature: " .. value)
-                        return tonumber(value), hap.Error.None
-                    end, function (request, value, self)
-                        self.logger:info("Write CoolingThresholdTemperature: " .. value)
-                        self:setProp("tar_temp", math.tointeger(value))
-                        raiseEvent(request.aid, request.sid, request.cid)
-                        return hap.Error.None
-                    end, 16, 30, 1),
-                    HeatThrholdTemp.new(iids.heatThrTemp, function (request, self)
-                        local value = self:getProp("tar_temp")
-                        self.logger:info("Read HeatingThresholdTemperature: " .. value)
-                        return tonumber(value), hap.Error.None
-                    end, function (request, value, self)
-                        self.logger:info("Write HeatingThresholdTemperature: " .. value)
-                        self:setProp("tar_temp", math.tointeger(value))
-                        raiseEvent(request.aid, request.sid, request.cid)
-                        return hap.Error.None
-                    end, 16, 30, 1),
-                    SwingMode.new(iids.swingMode, function (request, self)
-                        local ver_swing = self:getProp("ver_swing")
-                        local value
-                        if ver_swing == "unsupport" then
-                            value = SwingMode.value.Disabled
-                        else
-                            value = valMapping.ver_swing[ver_swing]
-                        end
-                        self.logger:info("Read SwingMode: " .. searchKey(SwingMode.value, value))
-                        return value, hap.Error.None
-                    end, function (request, value, self)
-                        self.logger:info("Write SwingMode: " .. searchKey(SwingMode.value, value))
-                        self:setProp("ver_swing", searchKey(valMapping.ver_swing, value))
-                        raiseEvent(request.aid, request.sid, request.cid)
-                        return hap.Error.None
-                    end)
+                    bind(CoolThrholdTemp, iids.coolThrTemp, {
+                        prop = "tar_temp"
+                    }, 16, 30, 1),
+                    bind(HeatThrholdTemp, iids.heatThrTemp, {
+                        prop = "tar_temp"
+                    }, 16, 30, 1),
+                    bind(SwingMode, iids.swingMode, {
+                        prop = "ver_swing",
+                        map = valMapping.ver_swing,
+                        default = SwingMode.value.Disabled
+                    })
                 }
             }
         },
@@ -0,0 +1,249 @@
+local socket = require "socket"
+local time = require "time"
+local lock = require "lock"
+local json = require "cjson"
+local util = require "util"
+local xpcall = xpcall
+local traceback = debug.traceback
+local assert = assert
+local type = type
+
+---
+--- Lumi gateway multiplexer.
+---
+--- Lumi gateways speak a JSON protocol over UDP port 9898 in the local network
+--- ("local network protocol" must be enabled in Mi Home):
+---
+---   - The gateway multicasts ``report`` messages to 224.0.0.50:9898 when
+---     the state of a sub-device changes, and ``heartbeat`` messages every
+---     10 seconds with a token used to sign the next write.
+---   - Commands ``get_id_list``, ``read`` and ``write`` are sent to the
+---     gateway by unicast, and acknowledged by ``<cmd>_ack``.
+---
+--- One multicast listener is shared by all gateways, and demultiplexes the
+--- reports to the gateway by source address and then to the sub-device by
+--- ``sid``. Each gateway has one command channel. The sub-devices are not
+--- polled, their accessories serve reads from the last reported state and
+--- raise events as soon as a report arrives.
+---
+
+local gateway = {}
+local logger = log.getLogger("miio.lumi.gateway")
+
+local MCAST_ADDR = "224.0.0.50"
+local PORT = 9898
+
+---AES-128-CBC IV used to sign the write command.
+local WRITE_KEY_IV = util.hex2bin("17996D093D28DDB3BA695A2E6F58562E")
+
+---@type table<string, LumiGateway> Gateways by address.
+local gateways = {}
+
+---@type Socket
+local listener
+
+---@class LumiSubdevice:table Sub-device of a gateway.
+---
+---@field sid string Sub-device ID.
+---@field model string Sub-device model.
+---@field state table<string, string> Last reported state.
+---@field onReport? fun(self: LumiSubdevice, data: table<string, string>) Called when a report arrives.
+
+---@class LumiGateway:LumiGatewayPriv Lumi gateway.
+local _gateway = {}
+
+---Decode the ``data`` field of a message, encoded as a JSON string.
+---@param msg table
+---@return table
+local function decodeData(msg)
+    local data = msg.data
+    if type(data) == "string" then
+        data = json.decode(data)
+    end
+    return data or {}
+end
+
+---Handle a multicast message.
+---@param msg table
+---@param addr string
+local function handleMessage(msg, addr)
+    local gw = gateways[addr]
+    if gw == nil then
+        return
+    end
+    local cmd = msg.cmd
+    -- The model of the gateway varies, tell its heartbeats by its sid, which
+    -- is learned from the first heartbeat with a token if not known yet.
+    if cmd == "heartbeat" and gw.sid == nil and msg.token ~= nil then
+        gw.sid = msg.sid
+    end
+    if cmd == "heartbeat" and gw.sid ~= nil and msg.sid == gw.sid then
+        gw.token = msg.token
+    elseif cmd == "report" or cmd == "heartbeat" then
+        local subdev = gw.subdevs[msg.sid]
+        if subdev == nil then
+            return
+        end
+        local data = decodeData(msg)
+        for k, v in pairs(data) do
+            subdev.state[k] = v
+        end
+        if subdev.onReport then
+            subdev:onReport(data)
+        end
+    end
+end
+
+---Receive the multicast messages until the socket is closed.
+local function listen()
+    while true do
+        local success, result, addr = pcall(listener.recvfrom, listener, 1024)
+        if success == false then
+            logger:error("Multicast listener stopped: " .. result)
+            listener = nil
+            return
+        end
+        local ok, msg = pcall(json.decode, result)
+        if ok and type(msg) == "table" then
+            local success, err = xpcall(handleMessage, traceback, msg, addr)
+            if success == false then
+                logger:error(err)
+            end
+        else
+            logger:debug("Invalid message from " .. addr)
+        end
+    end
+end
+
+---Start the multicast listener if it is not started.
+local function startListener()
+    if listener then
+        return
+    end
+    listener = socket.create("UDP", "IPV4")
+    listener:bind("0.0.0.0", PORT)
+    listener:joingroup(MCAST_ADDR)
+    time.createTimer(listen):start(0)
+end
+
+---Send a command and wait for its acknowledgement.
+---@param cmd string Command.
+---@param sid? string Sub-device ID.
+---@param data? table Command data.
+---@return table msg Acknowledgement.
+function _gateway:request(cmd, sid, data)
+    local lock = self.lock
+    lock:acquire()
+    local success, result = xpcall(function ()
+        local chan = self.chan
+        chan:send(json.encode({
+            cmd = cmd,
+            sid = sid,
+            data = data and json.encode(data) or nil,
+        }))
+        local ack = cmd .. "_ack"
+        while true do
+            local msg = json.decode(chan:recv(1024))
+            if msg.cmd == ack and (sid == nil or msg.sid == sid) then
+                return msg
+            end
+        end
+    end, traceback)
+    lock:release()
+    if success == false then
+        error(result)
+    end
+    return result
+end
+
+---Get the IDs of the sub-devices.
+---@return string[] sids
+function _gateway:getIdList()
+    local msg = self:request("get_id_list")
+    self.sid = msg.sid
+    self.token = msg.token or self.token
+    return decodeData(msg)
+end
+
+---Read the model and the state of a sub-device.
+---@param sid string Sub-device ID.
+---@return string model
+---@return table<string, string> state
+function _gateway:read(sid)
+    local msg = self:request("read", sid)
+    return msg.model, decodeData(msg)
+end
+
+---Write the state of a sub-device.
+---@param sid string Sub-device ID.
+---@param data table<string, string> State.
+function _gateway:write(sid, data)
+    assert(self.token, "No token from the gateway.")
+    local cipher = self.cipher
+    cipher:begin("encrypt", self.password, WRITE_KEY_IV)
+    data.key = (util.bin2hex(cipher:update(self.token) .. cipher:finsh()))
+    local msg = self:request("write", sid, data)
+    local result = decodeData(msg)
+    if result.error then
+        error(result.error)
+    end
+end
+
+---Add a sub-device, its reports are dispatched to it from now on.
+---@param sid string Sub-device ID.
+---@param model string Sub-device model.
+---@param state table<string, string> Initial state.
+---@return LumiSubdevice subdev
+function _gateway:addSubdevice(sid, model, state)
+    local subdev = {
+        sid = sid,
+        model = model,
+        state = state,
+        gateway = self,
+        logger = log.getLogger("miio.lumi:" .. sid),
+    }
+    self.subdevs[sid] = subdev
+    return subdev
+end
+
+---Create a gateway object.
+---@param addr string Gateway address.
+---@param password string Password of the local network protocol.
+---@return LumiGateway gateway
+---@nodiscard
+function gateway.create(addr, password)
+    assert(type(addr) == "string")
+    assert(type(password) == "string")
+    assert(#password == 16)
+    assert(gateways[addr] == nil, "Duplicate gateway " .. addr)
+
+    startListener()
+
+    local chan = socket.create("UDP", "IPV4")
+    chan:settimeout(5000)
+    chan:connect(addr, PORT)
+
+    local cipher = require("cipher").create("AES-128-CBC")
+    cipher:setPadding("NONE")
+
+    ---@class LumiGatewayPriv
+    local o = {
+        addr = addr,
+        password = password,
+        chan = chan,
+        cipher = cipher,
+        lock = lock.create(),
+        sid = nil, ---@type string Gateway ID, from ``get_id_list`` or the heartbeats.
+        token = nil, ---@type string
+        subdevs = {}, ---@type table<string, LumiSubdevice>
+    }
+
+    setmetatable(o, {
+        __index = _gateway
+    })
+
+    gateways[addr] = o
+    return o
+end
+
+return gateway
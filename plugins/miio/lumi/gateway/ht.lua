@@ -0,0 +1,81 @@
+local hap = require "hap"
+local CurTemp = require "hap.char.CurrentTemperature"
+local CurRelHumidity = require "hap.char.CurrentRelativeHumidity"
+local raiseEvent = hap.raiseEvent
+
+local ht = {}
+
+---Create a temperature and humidity sensor.
+---@param subdev LumiSubdevice Sub-device object.
+---@param conf LumiSubdeviceConf Sub-device configuration.
+---@return HapAccessory accessory HomeKit Accessory.
+function ht.gen(subdev, conf)
+    local iids = {
+        acc = conf.aid,
+        tempSensor = hap.getNewInstanceID(conf.key .. ":tempSensor"),
+        curTemp = hap.getNewInstanceID(conf.key .. ":curTemp"),
+        humSensor = hap.getNewInstanceID(conf.key .. ":humSensor"),
+        curHum = hap.getNewInstanceID(conf.key .. ":curHum"),
+    }
+
+    function subdev:onReport(data)
+        if data.temperature then
+            raiseEvent(iids.acc, iids.tempSensor, iids.curTemp)
+        end
+        if data.humidity then
+            raiseEvent(iids.acc, iids.humSensor, iids.curHum)
+        end
+    end
+
+    return {
+        aid = iids.acc,
+        category = "BridgedAccessory",
+        name = conf.name or "Lumi Temperature Humidity Sensor",
+        mfg = "lumi",
+        model = subdev.model,
+        sn = subdev.sid,
+        fwVer = "1.0",
+        services = {
+            hap.AccessoryInformationService,
+            {
+                iid = iids.tempSensor,
+                type = "TemperatureSensor",
+                props = {
+                    primaryService = true,
+                    hidden = false
+                },
+                chars = {
+                    CurTemp.new(iids.curTemp, function (request, self)
+                        local value = tonumber(self.state.temperature or 0) / 100
+                        self.logger:info("Read CurrentTemperature: " .. value)
+                        return value, hap.Error.None
+                    end)
+                }
+            },
+            {
+                iid = iids.humSensor,
+                type = "HumiditySensor",
+                props = {
+                    primaryService = false,
+                    hidden = false
+                },
+                chars = {
+                    CurRelHumidity.new(iids.curHum, function (request, self)
+                        local value = tonumber(self.state.humidity or 0) / 100
+                        self.logger:info("Read CurrentRelativeHumidity: " .. value)
+                        return value, hap.Error.None
+                    end)
+                }
+            }
+        },
+        cbs = {
+            identify = function (request, self)
+                self.logger:info("Identify callback is called.")
+                return hap.Error.None
+            end
+        },
+        context = subdev
+    }
+end
+
+return ht
@@ -0,0 +1,65 @@
+local hap = require "hap"
+local ContactSensorState = require "hap.char.ContactSensorState"
+local raiseEvent = hap.raiseEvent
+
+local magnet = {}
+
+---Create a door and window sensor.
+---@param subdev LumiSubdevice Sub-device object.
+---@param conf LumiSubdeviceConf Sub-device configuration.
+---@return HapAccessory accessory HomeKit Accessory.
+function magnet.gen(subdev, conf)
+    local iids = {
+        acc = conf.aid,
+        sensor = hap.getNewInstanceID(conf.key .. ":sensor"),
+        state = hap.getNewInstanceID(conf.key .. ":state"),
+    }
+
+    function subdev:onReport(data)
+        if data.status then
+            raiseEvent(iids.acc, iids.sensor, iids.state)
+        end
+    end
+
+    return {
+        aid = iids.acc,
+        category = "BridgedAccessory",
+        name = conf.name or "Lumi Door Window Sensor",
+        mfg = "lumi",
+        model = subdev.model,
+        sn = subdev.sid,
+        fwVer = "1.0",
+        services = {
+            hap.AccessoryInformationService,
+            {
+                iid = iids.sensor,
+                type = "ContactSensor",
+                props = {
+                    primaryService = true,
+                    hidden = false
+                },
+                chars = {
+                    ContactSensorState.new(iids.state, function (request, self)
+                        local value
+                        if self.state.status == "close" then
+                            value = ContactSensorState.value.Detected
+                        else
+                            value = ContactSensorState.value.NotDetected
+                        end
+                        self.logger:info("Read ContactSensorState: " .. value)
+                        return value, hap.Error.None
+                    end)
+                }
+            }
+        },
+        cbs = {
+            identify = function (request, self)
+                self.logger:info("Identify callback is called.")
+                return hap.Error.None
+            end
+        },
+        context = subdev
+    }
+end
+
+return magnet
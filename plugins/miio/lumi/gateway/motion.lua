@@ -0,0 +1,70 @@
+local hap = require "hap"
+local MotionDetected = require "hap.char.MotionDetected"
+local raiseEvent = hap.raiseEvent
+
+local motion = {}
+
+---Create a motion sensor.
+---@param subdev LumiSubdevice Sub-device object.
+---@param conf LumiSubdeviceConf Sub-device configuration.
+---@return HapAccessory accessory HomeKit Accessory.
+function motion.gen(subdev, conf)
+    local iids = {
+        acc = conf.aid,
+        sensor = hap.getNewInstanceID(conf.key .. ":sensor"),
+        detected = hap.getNewInstanceID(conf.key .. ":detected"),
+    }
+
+    -- The sensor reports "motion" in "status", and the seconds without motion
+    -- in "no_motion" after it.
+    subdev.detected = subdev.state.status == "motion"
+
+    function subdev:onReport(data)
+        local detected = self.detected
+        if data.status == "motion" then
+            detected = true
+        elseif data.no_motion then
+            detected = false
+        end
+        if detected ~= self.detected then
+            self.detected = detected
+            raiseEvent(iids.acc, iids.sensor, iids.detected)
+        end
+    end
+
+    return {
+        aid = iids.acc,
+        category = "BridgedAccessory",
+        name = conf.name or "Lumi Motion Sensor",
+        mfg = "lumi",
+        model = subdev.model,
+        sn = subdev.sid,
+        fwVer = "1.0",
+        services = {
+            hap.AccessoryInformationService,
+            {
+                iid = iids.sensor,
+                type = "MotionSensor",
+                props = {
+                    primaryService = true,
+                    hidden = false
+                },
+                chars = {
+                    MotionDetected.new(iids.detected, function (request, self)
+                        self.logger:info(("Read MotionDetected: %s"):format(self.detected))
+                        return self.detected, hap.Error.None
+                    end)
+                }
+            }
+        },
+        cbs = {
+            identify = function (request, self)
+                self.logger:info("Identify callback is called.")
+                return hap.Error.None
+            end
+        },
+        context = subdev
+    }
+end
+
+return motion
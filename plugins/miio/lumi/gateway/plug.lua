@@ -0,0 +1,77 @@
+local hap = require "hap"
+local On = require "hap.char.On"
+local OutletInUse = require "hap.char.OutletInUse"
+local raiseEvent = hap.raiseEvent
+
+local plug = {}
+
+---Create a plug.
+---@param subdev LumiSubdevice Sub-device object.
+---@param conf LumiSubdeviceConf Sub-device configuration.
+---@return HapAccessory accessory HomeKit Accessory.
+function plug.gen(subdev, conf)
+    local iids = {
+        acc = conf.aid,
+        outlet = hap.getNewInstanceID(conf.key .. ":outlet"),
+        on = hap.getNewInstanceID(conf.key .. ":on"),
+        inUse = hap.getNewInstanceID(conf.key .. ":inUse"),
+    }
+
+    function subdev:onReport(data)
+        if data.status then
+            raiseEvent(iids.acc, iids.outlet, iids.on)
+        end
+        if data.inuse then
+            raiseEvent(iids.acc, iids.outlet, iids.inUse)
+        end
+    end
+
+    return {
+        aid = iids.acc,
+        category = "BridgedAccessory",
+        name = conf.name or "Lumi Plug",
+        mfg = "lumi",
+        model = subdev.model,
+        sn = subdev.sid,
+        fwVer = "1.0",
+        services = {
+            hap.AccessoryInformationService,
+            {
+                iid = iids.outlet,
+                type = "Outlet",
+                props = {
+                    primaryService = true,
+                    hidden = false
+                },
+                chars = {
+                    On.new(iids.on, function (request, self)
+                        local value = self.state.status == "on"
+                        self.logger:info(("Read On: %s"):format(value))
+                        return value, hap.Error.None
+                    end, function (request, value, self)
+                        self.logger:info(("Write On: %s"):format(value))
+                        local status = value and "on" or "off"
+                        self.gateway:write(self.sid, { status = status })
+                        self.state.status = status
+                        raiseEvent(request.aid, request.sid, request.cid)
+                        return hap.Error.None
+                    end),
+                    OutletInUse.new(iids.inUse, function (request, self)
+                        local value = self.state.inuse == "1"
+                        self.logger:info(("Read OutletInUse: %s"):format(value))
+                        return value, hap.Error.None
+                    end)
+                }
+            }
+        },
+        cbs = {
+            identify = function (request, self)
+                self.logger:info("Identify callback is called.")
+                return hap.Error.None
+            end
+        },
+        context = subdev
+    }
+end
+
+return plug
@@ -1,5 +1,6 @@
 local hap = require "hap"
 local device = require "miio.device"
+local gateway = require "miio.lumi.gateway"
 local util = require "util"
 local traceback = debug.traceback
 
@@ -10,14 +11,42 @@ local logger = log.getLogger("miio.plugin")
 ---@class MiioAccessoryConf
 ---
 ---@field aid integer Accessory Instance ID.
+---@field key string Unique key of the accessory, the instance IDs are persisted by it.
 ---@field addr string Device address.
 ---@field token string Device token.
 ---@field name string Accessory name.
 
+---Lumi sub-device configuration.
+---@class LumiSubdeviceConf
+---
+---@field aid integer Accessory Instance ID.
+---@field key string Unique key of the accessory, the instance IDs are persisted by it.
+---@field sid string Sub-device ID.
+---@field name string Accessory name.
+
+---Lumi gateway configuration.
+---@class LumiGatewayConf
+---
+---@field addr string Gateway address.
+---@field password string Password of the local network protocol.
+---@field subdevices? LumiSubdeviceConf[] Sub-devices to add, all supported sub-devices by default.
+
 ---Miio plugin configuration.
 ---@class MiioPluginConf:PluginConf
 ---
 ---@field accessories MiioAccessoryConf[] Accessory configurations.
+---@field gateways? LumiGatewayConf[] Lumi gateway configurations.
+
+---Sub-device model -> product module.
+local lumiProducts = {
+    sensor_ht = "ht",
+    ["weather.v1"] = "ht",
+    magnet = "magnet",
+    ["sensor_magnet.aq2"] = "magnet",
+    motion = "motion",
+    ["sensor_motion.aq2"] = "motion",
+    plug = "plug",
+}
 
 ---Generate accessory via configuration.
 ---@param conf MiioAccessoryConf Accessory configuration.
@@ -26,10 +55,42 @@ local function gen(conf)
     local obj = device.create(conf.addr, util.hex2bin(conf.token))
     local info = obj:getInfo()
     local product = require("miio." .. info.model)
-    conf.aid = hap.getNewBridgedAccessoryID()
+    conf.key = "miio:" .. info.mac
+    conf.aid = hap.getNewBridgedAccessoryID(conf.key)
     return product.gen(obj, info, conf)
 end
 
+---Generate the accessories of the sub-devices of a gateway.
+---@param conf LumiGatewayConf Gateway configuration.
+---@return HapAccessory[] accessories
+local function genGateway(conf)
+    local gw = gateway.create(conf.addr, conf.password)
+    -- Always get the list, the acknowledgement carries the gateway sid and token.
+    local sids = gw:getIdList()
+    local subdevConfs = conf.subdevices
+    if subdevConfs == nil then
+        subdevConfs = {}
+        for _, sid in ipairs(sids) do
+            table.insert(subdevConfs, { sid = sid })
+        end
+    end
+
+    local accessories = {}
+    for _, subdevConf in ipairs(subdevConfs) do
+        local model, state = gw:read(subdevConf.sid)
+        local product = lumiProducts[model]
+        if product then
+            local subdev = gw:addSubdevice(subdevConf.sid, model, state)
+            subdevConf.key = "miio:lumi." .. subdevConf.sid
+            subdevConf.aid = hap.getNewBridgedAccessoryID(subdevConf.key)
+            table.insert(accessories, require("miio.lumi.gateway." .. product).gen(subdev, subdevConf))
+        else
+            logger:default(("Unsupported sub-device %s of model %s."):format(subdevConf.sid, model))
+        end
+    end
+    return accessories
+end
+
 ---Initialize plugin.
 ---@param conf MiioPluginConf Plugin configuration.
 function plugin.init(conf)
@@ -43,6 +104,17 @@ function plugin.init(conf)
             hap.addBridgedAccessory(result)
         end
     end
+
+    for _, gatewayConf in ipairs(conf.gateways or {}) do
+        local success, result = xpcall(genGateway, traceback, gatewayConf)
+        if success == false then
+            logger:error(result)
+        else
+            for _, accessory in ipairs(result) do
+                hap.addBridgedAccessory(accessory)
+            end
+        end
+    end
 end
 
 ---Handle HAP server state.
@@ -2,8 +2,7 @@ local hap = require "hap"
 local Active = require "hap.char.Active"
 local RotationSpeed = require "hap.char.RotationSpeed"
 local SwingMode = require "hap.char.SwingMode"
-local searchKey = require "util".searchKey
-local raiseEvent = hap.raiseEvent
+local bind = require "hap.bind"
 
 local fan = {}
 
@@ -28,10 +27,10 @@ function fan.gen(device, info, conf)
     ---@class ZhimiFanIIDs:table Zhimi Fan Instance ID table.
     local iids = {
         acc = conf.aid,
-        fan = hap.getNewInstanceID(),
-        active = hap.getNewInstanceID(),
-        rotationSpeed = hap.getNewInstanceID(),
-        swingMode = hap.getNewInstanceID(),
+        fan = hap.getNewInstanceID(conf.key .. ":fan"),
+        active = hap.getNewInstanceID(conf.key .. ":active"),
+        rotationSpeed = hap.getNewInstanceID(conf.key .. ":rotationSpeed"),
+        swingMode = hap.getNewInstanceID(conf.key .. ":swingMode"),
     }
 
     return {
@@ -53,36 +52,17 @@ function fan.gen(device, info, conf)
                     hidden = false
                 },
                 chars = {
-                    Active.new(iids.active, function (request, self)
-                        local value = valMapping.power[self:getProp("power")]
-                        self.logger:info("Read Active: " .. searchKey(Active.value, value))
-                        return value, hap.Error.None
-                    end, function (request, value, self)
-                        self.logger:info("Write Active: " .. searchKey(Active.value, value))
-                        self:setProp("power", searchKey(valMapping.power, value))
-                        raiseEvent(request.aid, request.sid, request.cid)
-                        return hap.Error.None
-                    end),
-                    RotationSpeed.new(iids.rotationSpeed, function (request, self)
-                        local value = self:getProp("speed_level")
-                        self.logger:info("Read RotationSpeed: " .. value)
-                        return tonumber(value), hap.Error.None
-                    end, function (request, value, self)
-                        self.logger:info("Write RotationSpeed: " .. value)
-                        self:setProp("speed_level", math.tointeger(value))
-                        raiseEvent(request.aid, request.sid, request.cid)
-                        return hap.Error.None
-                    end, 1, 100, 1),
-                    SwingMode.new(iids.swingMode, function (request, self)
-                        local value = valMapping.angle_enable[self:getProp("angle_enable")]
-                        self.logger:info("Read SwingMode: " .. searchKey(SwingMode.value, value))
-                        return value, hap.Error.None
-                    end, function (request, value, self)
-                        self.logger:info("Write SwingMode: " .. searchKey(SwingMode.value, value))
-                        self:setProp("angle_enable", searchKey(valMapping.angle_enable, value))
-                        raiseEvent(request.aid, request.sid, request.cid)
-                        return hap.Error.None
-                    end)
+                    bind(Active, iids.active, {
+                        prop = "power",
+                        map = valMapping.power
+                    }),
+                    bind(RotationSpeed, iids.rotationSpeed, {
+                        prop = "speed_level"
+                    }, 1, 100, 1),
+                    bind(SwingMode, iids.swingMode, {
+                        prop = "angle_enable",
+                        map = valMapping.angle_enable
+                    })
                 }
             }
         },
@@ -0,0 +1,119 @@
+---Compare two Lua heap snapshots written by ``debug.heapsnapshot()``.
+---
+---Prints the (type, owner, site) aggregates whose size changed, largest growth
+---first. It runs on the bridge as a separate entry:
+---
+---    $ HEAPDIFF_OLD=/tmp/a.snap HEAPDIFF_NEW=/tmp/b.snap homekit-bridge -d tests_scripts -e heapdiff
+---
+---or with a stock Lua 5.4 interpreter:
+---
+---    $ lua tests/heapdiff.lua /tmp/a.snap /tmp/b.snap
+---
+---Without the paths, it is loaded as a module by the tests.
+---
+---Environment variables:
+---  HEAPDIFF_OLD       Path of the old snapshot.
+---  HEAPDIFF_NEW       Path of the new snapshot.
+---  HEAPDIFF_LIMIT     Maximum number of lines to print, default 50.
+
+---@class HeapAggr
+---@field type string
+---@field owner string
+---@field site string
+---@field count integer
+---@field bytes integer
+
+local heapdiff = {}
+
+---Load a snapshot.
+---@param path string
+---@return table<string, HeapAggr>
+function heapdiff.load(path)
+    local file <close> = assert(io.open(path, "r"))
+    local aggrs = {}
+    for line in file:lines() do
+        if line:sub(1, 1) ~= "#" then
+            local type, count, bytes, owner, site = line:match("^(%S+)\t(%d+)\t(%d+)\t([^\t]*)\t([^\t]*)$")
+            assert(type, "invalid snapshot line: " .. line)
+            aggrs[table.concat({ type, owner, site }, "\t")] = {
+                type = type,
+                owner = owner,
+                site = site,
+                count = math.tointeger(count),
+                bytes = math.tointeger(bytes),
+            }
+        end
+    end
+    return aggrs
+end
+
+---Compare two loaded snapshots.
+---@param old table<string, HeapAggr>
+---@param new table<string, HeapAggr>
+---@return HeapAggr[] diffs The changed aggregates, largest growth first.
+---@return HeapAggr total
+function heapdiff.diff(old, new)
+    local diffs = {}
+    local total = { count = 0, bytes = 0 }
+
+    local function add(o, n)
+        local ref = n or o
+        local d = {
+            type = ref.type,
+            owner = ref.owner,
+            site = ref.site,
+            count = (n and n.count or 0) - (o and o.count or 0),
+            bytes = (n and n.bytes or 0) - (o and o.bytes or 0),
+        }
+        total.count = total.count + d.count
+        total.bytes = total.bytes + d.bytes
+        if d.bytes ~= 0 or d.count ~= 0 then
+            table.insert(diffs, d)
+        end
+    end
+
+    for key, n in pairs(new) do
+        add(old[key], n)
+    end
+    for key, o in pairs(old) do
+        if new[key] == nil then
+            add(o, nil)
+        end
+    end
+
+    table.sort(diffs, function (a, b)
+        if a.bytes ~= b.bytes then
+            return a.bytes > b.bytes
+        end
+        return a.count > b.count
+    end)
+    return diffs, total
+end
+
+local args = arg or {}
+local oldPath = args[1] or os.getenv("HEAPDIFF_OLD")
+local newPath = args[2] or os.getenv("HEAPDIFF_NEW")
+local limit = tonumber(os.getenv("HEAPDIFF_LIMIT")) or 50
+
+-- Without the paths it is a module, the tests use it to check the snapshots.
+if oldPath == nil or newPath == nil then
+    if arg then
+        print("usage: heapdiff <old snapshot> <new snapshot>")
+        os.exit(1)
+    end
+    return heapdiff
+end
+
+local diffs, total = heapdiff.diff(heapdiff.load(oldPath), heapdiff.load(newPath))
+
+print(("%10s %8s  %-10s %-32s %s"):format("bytes", "count", "type", "owner", "site"))
+for i, d in ipairs(diffs) do
+    if i > limit then
+        print(("... %d more"):format(#diffs - limit))
+        break
+    end
+    print(("%+10d %+8d  %-10s %-32s %s"):format(d.bytes, d.count, d.type, d.owner, d.site))
+end
+print(("%+10d %+8d  total"):format(total.bytes, total.count))
+
+return heapdiff
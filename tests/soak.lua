@@ -0,0 +1,448 @@
+---Soak test.
+---
+---Serves simulated devices through a HAP accessory driven by simulated
+---controllers for a configurable duration, samples RSS, Lua heap, registry
+---size, fd count and request latency, and fails on monotonic growth or p99
+---latency drift.
+---
+---Each device is a light bulb service of the primary accessory. The controllers
+---read and write the characteristics through the HAP test hooks on their own
+---session, so the requests go through the same characteristic handlers as the
+---requests of the accessory server. The handlers answer from a cache, which is
+---synchronized with the devices over UDP on timers like the plugins do. The
+---test hooks are only built with ``BRIDGE_TEST_HOOKS``.
+---
+---It is not a part of ``test.lua``, run it as a separate entry:
+---
+---    $ SOAK_DURATION=86400 SOAK_SPEEDUP=240 homekit-bridge -d tests_scripts -e soak
+---
+---``SOAK_SPEEDUP`` only scales the sleeps of this harness, the think time of the
+---controllers, the poll interval of the devices and the sample interval, so a
+---speedup raises the request rate to pack the requests of a longer run into
+---the real duration. The timers of the bridge itself run on the real clock.
+---
+---Environment variables:
+---  SOAK_DURATION      Duration in harness seconds, default 3600.
+---  SOAK_SPEEDUP       Divisor of the harness sleeps, default 60.
+---  SOAK_INTERVAL      Sample interval in harness seconds, default 60.
+---  SOAK_DEVICES       Number of simulated devices, default 8.
+---  SOAK_CONTROLLERS   Number of simulated controllers, default 4, at most 4.
+
+local hap = require "hap"
+local socket = require "socket"
+local time = require "time"
+local chip = require "chip"
+local nvs = require "nvs"
+local json = require "cjson"
+
+local logger = log.getLogger("soak")
+
+local function getenv(name, default)
+    local v = tonumber(os.getenv(name))
+    if v == nil then
+        return default
+    end
+    assert(v > 0, name .. " must be greater than 0")
+    return v
+end
+
+local conf = {
+    duration = getenv("SOAK_DURATION", 3600) * 1000,
+    speedup = getenv("SOAK_SPEEDUP", 60),
+    interval = getenv("SOAK_INTERVAL", 60) * 1000,
+    devices = math.tointeger(getenv("SOAK_DEVICES", 8)),
+    controllers = math.tointeger(getenv("SOAK_CONTROLLERS", 4)),
+    -- Harness milliseconds between two requests of a controller.
+    thinkTime = 1000,
+    -- Harness milliseconds between two polls of a device.
+    pollInterval = 4000,
+    -- Samples taken before the bridge is considered warmed up.
+    warmup = 3,
+    -- First port of the simulated devices.
+    port = 19000,
+}
+
+---Growth tolerated before a metric is considered leaking.
+local tolerance = {
+    rss = 256 * 1024,
+    heap = 64,
+    registry = 8,
+    fds = 2,
+}
+
+---Harness clock, runs ``conf.speedup`` times faster than the real clock.
+local clock = {
+    base = time.monotonic()
+}
+
+---Get the harness time in milliseconds.
+---@return integer ms
+function clock.now()
+    return (time.monotonic() - clock.base) * conf.speedup
+end
+
+---Sleep for a specified number of harness milliseconds.
+---@param ms integer
+function clock.sleep(ms)
+    time.sleep(ms // conf.speedup)
+end
+
+local running = true
+
+---Latencies of the requests in the current sample window.
+---@type integer[]
+local latencies = {}
+
+---Number of HAP events in the current sample window.
+local events = 0
+
+---@class SoakSample:table
+---
+---@field time integer Harness time.
+---@field rss integer Resident set size in bytes.
+---@field fds integer Number of open file descriptors.
+---@field heap number Lua heap in KiB.
+---@field registry integer Number of entries in the registry.
+---@field requests integer Number of device requests in the window.
+---@field events integer Number of HAP events in the window.
+---@field p50 integer 50th latency percentile in milliseconds.
+---@field p99 integer 99th latency percentile in milliseconds.
+
+---@type SoakSample[]
+local samples = {}
+
+---Get the percentile of a sorted array.
+---@param sorted integer[]
+---@param p number
+---@return integer
+local function percentile(sorted, p)
+    if #sorted == 0 then
+        return 0
+    end
+    return sorted[math.max(1, math.ceil(#sorted * p))]
+end
+
+---Count the entries in the registry.
+---@return integer
+local function registrySize()
+    local n = 0
+    for _ in pairs(debug.getregistry()) do
+        n = n + 1
+    end
+    return n
+end
+
+---Take a sample.
+---@return SoakSample
+local function sample()
+    local usage = chip.getResourceUsage() or {}
+    local window = latencies
+    latencies = {}
+    table.sort(window)
+    local nevents = events
+    events = 0
+    collectgarbage()
+    return {
+        time = clock.now(),
+        rss = usage.rss or 0,
+        fds = usage.fds or 0,
+        heap = collectgarbage("count"),
+        registry = registrySize(),
+        requests = #window,
+        events = nevents,
+        p50 = percentile(window, 0.5),
+        p99 = percentile(window, 0.99),
+    }
+end
+
+---Simulated device, answers get/set requests over UDP.
+---@param port integer
+local function device(port)
+    local server <close> = socket.create("UDP", "IPV4")
+    server:bind("127.0.0.1", port)
+    local props = {
+        power = "off",
+        level = 0,
+    }
+    while true do
+        local msg, addr, remotePort = server:recvfrom(1024)
+        if #msg == 0 then
+            return
+        end
+        local req = json.decode(msg)
+        local result
+        if req.method == "set" then
+            for k, v in pairs(req.params) do
+                props[k] = v
+            end
+            result = "ok"
+        else
+            result = props
+        end
+        server:sendto(json.encode({id = req.id, result = result}), addr, remotePort)
+    end
+end
+
+---Send a request to the simulated device and wait for the response.
+---@param port integer
+---@param req table
+---@return any result
+local function call(port, req)
+    local start = time.monotonic()
+    local sock <close> = socket.create("UDP", "IPV4")
+    sock:settimeout(1000)
+    sock:connect("127.0.0.1", port)
+    sock:send(json.encode(req))
+    local resp = json.decode(sock:recv(1024))
+    assert(resp.id == req.id)
+    table.insert(latencies, time.monotonic() - start)
+    return resp.result
+end
+
+---Bridge side of a simulated device, a light bulb service with a cache of the device.
+---@class SoakLight:table
+---
+---@field port integer Port of the device.
+---@field sid integer Service instance ID.
+---@field cid integer Instance ID of the "On" characteristic.
+---@field power string Cached power.
+---@field reqid integer Last request ID.
+
+---@type SoakLight[]
+local lights = {}
+
+---Create the light bulb service of a device.
+---@param light SoakLight
+---@return HapService
+local function lightService(light)
+    return {
+        iid = light.sid,
+        type = "LightBulb",
+        props = {
+            primaryService = false,
+            hidden = false,
+            ble = { supportsConfiguration = false }
+        },
+        chars = {
+            {
+                format = "Bool",
+                iid = light.cid,
+                type = "On",
+                props = {
+                    readable = true,
+                    writable = true,
+                    supportsEventNotification = true,
+                    hidden = false,
+                    requiresTimedWrite = false,
+                    supportsAuthorizationData = false,
+                    ip = { controlPoint = false, supportsWriteResponse = false },
+                    ble = {
+                        supportsBroadcastNotification = true,
+                        supportsDisconnectedNotification = true,
+                        readableWithoutSecurity = false,
+                        writableWithoutSecurity = false
+                    }
+                },
+                cbs = {
+                    read = function (request, context)
+                        return light.power == "on", hap.Error.None
+                    end,
+                    write = function (request, value, context)
+                        local power = value and "on" or "off"
+                        if power ~= light.power then
+                            light.power = power
+                            -- The handlers must not block, set the device on a timer.
+                            time.createTimer(function ()
+                                light.reqid = light.reqid + 1
+                                local success, err = pcall(call, light.port, {
+                                    id = light.reqid,
+                                    method = "set",
+                                    params = { power = power },
+                                })
+                                if not success then
+                                    logger:error(err)
+                                end
+                            end):start(0)
+                            hap.raiseEvent(request.aid, request.sid, request.cid)
+                        end
+                        return hap.Error.None
+                    end
+                }
+            }
+        }
+    }
+end
+
+---Count and drop the recorded HAP events.
+local function drainEvents()
+    events = events + #hap.test.events()
+end
+
+---Poll the device and raise an event if it changed.
+---@param light SoakLight
+local function poll(light)
+    while running do
+        light.reqid = light.reqid + 1
+        local success, result = pcall(call, light.port, {
+            id = light.reqid,
+            method = "get",
+        })
+        if not success then
+            logger:error(result)
+        elseif running and result.power ~= light.power then
+            light.power = result.power
+            hap.raiseEvent(1, light.sid, light.cid)
+            drainEvents()
+        end
+        clock.sleep(conf.pollInterval)
+    end
+end
+
+---Simulated controller, reads and writes the characteristics at random.
+---@param id integer
+local function controller(id)
+    local handle <close> = nvs.open("soak" .. id)
+    local session = id
+    local n = 0
+    while running do
+        n = n + 1
+        local light = lights[math.random(#lights)]
+        if n % 4 == 0 then
+            local on = n % 8 == 0
+            local err = hap.test.write(1, light.cid, on, session)
+            assert(err == hap.Error.None, err)
+
+            -- Persist the last state like a plugin does.
+            if n % 16 == 0 then
+                handle:set("state", { power = on and "on" or "off" })
+                handle:commit()
+            end
+        else
+            local err, value = hap.test.read(1, light.cid, session)
+            assert(err == hap.Error.None, err)
+            assert(type(value) == "boolean")
+        end
+        drainEvents()
+        clock.sleep(conf.thinkTime)
+    end
+end
+
+---Check whether a series grows monotonically.
+---@param name string Metric name.
+---@return boolean
+local function isGrowing(name)
+    local first = samples[conf.warmup + 1]
+    local last = samples[#samples]
+    if #samples - conf.warmup < 4 or last[name] - first[name] <= tolerance[name] then
+        return false
+    end
+    for i = conf.warmup + 2, #samples do
+        if samples[i][name] < samples[i - 1][name] then
+            return false
+        end
+    end
+    return true
+end
+
+---Check whether the p99 latency drifts.
+---@return boolean
+local function isDrifting()
+    local base = samples[conf.warmup + 1]
+    local last = samples[#samples]
+    if base == nil or base == last then
+        return false
+    end
+    return last.p99 > base.p99 * 2 + 5
+end
+
+---Run the soak test.
+local function run()
+    logger:info(("Starting soak test: %d harness seconds, speedup %d, %d devices, %d controllers."):format(
+        conf.duration // 1000, conf.speedup, conf.devices, conf.controllers))
+
+    if not hap.test then
+        logger:error("Soak test requires the HAP test hooks, build with BRIDGE_TEST_HOOKS.")
+        os.exit(1)
+    end
+    assert(conf.controllers <= 4, "SOAK_CONTROLLERS must be at most 4")
+
+    local services = {
+        hap.AccessoryInformationService,
+        hap.HapProtocolInformationService,
+        hap.PairingService,
+    }
+    for i = 1, conf.devices do
+        local light = {
+            port = conf.port + i - 1,
+            sid = hap.getNewInstanceID(),
+            cid = hap.getNewInstanceID(),
+            power = "off",
+            reqid = 0,
+        }
+        lights[i] = light
+        table.insert(services, lightService(light))
+    end
+    hap.init({
+        aid = 1,
+        category = "Bridges",
+        name = "soak",
+        mfg = "mfg1",
+        model = "model1",
+        sn = "1234567890",
+        fwVer = "1",
+        services = services,
+        cbs = {},
+    }, {
+        updatedState = function (state) end
+    })
+    hap.test.start(conf.controllers)
+
+    for _, light in ipairs(lights) do
+        time.createTimer(device, light.port):start(0)
+    end
+    for _, light in ipairs(lights) do
+        time.createTimer(poll, light):start(10)
+    end
+    for i = 1, conf.controllers do
+        time.createTimer(controller, i):start(10)
+    end
+
+    while clock.now() < conf.duration do
+        clock.sleep(conf.interval)
+        drainEvents()
+        local s = sample()
+        table.insert(samples, s)
+        logger:info(("[%ds] rss: %dKiB, fds: %d, heap: %.1fKiB, registry: %d, requests: %d, events: %d, "
+            .. "p50: %dms, p99: %dms"):format(s.time // 1000, s.rss // 1024, s.fds, s.heap, s.registry,
+            s.requests, s.events, s.p50, s.p99))
+    end
+
+    running = false
+    hap.test.stop()
+    hap.deinit()
+    for _, light in ipairs(lights) do
+        local sock <close> = socket.create("UDP", "IPV4")
+        sock:sendto("", "127.0.0.1", light.port)
+    end
+
+    local failures = {}
+    for name, _ in pairs(tolerance) do
+        if isGrowing(name) then
+            table.insert(failures, name .. " grows monotonically")
+        end
+    end
+    if isDrifting() then
+        table.insert(failures, "p99 latency drifts")
+    end
+
+    if #failures == 0 then
+        logger:info("Soak test passed.")
+        os.exit(0)
+    end
+    for _, failure in ipairs(failures) do
+        logger:error("Soak test failed: " .. failure .. ".")
+    end
+    os.exit(1)
+end
+
+time.createTimer(run):start(0)
@@ -0,0 +1,13 @@
+---Fixture of testlinemap.lua, embedded in bridge embedfs as stripped bytecode
+---together with the test hooks.
+---
+---The test checks the lines, keep them in sync.
+
+local M = {}
+
+---The outer and the inner functions have the same line range.
+function M.call(f) local inner = function ()
+    error("inner")
+end f(inner) end
+
+return M
@@ -1,7 +1,23 @@
 local suites = {
     "testhap",
     "testsocket",
-    "testnvs"
+    "testnvs",
+    "testhttp2",
+    "testwebsocket",
+    "testcoap",
+    "testcompress",
+    "testaio",
+    "testserial",
+    "testmodbus",
+    "testnetif",
+    "testcplugin",
+    "testlinemap",
+    "testlumigateway",
+    "testlock",
+    "testrunloop",
+    "testheap",
+    "testchip",
+    "testmemory"
 }
 
 local function run()
@@ -0,0 +1,57 @@
+local aio = require "aio"
+
+local path = "testaio.txt"
+
+---Test writing, appending and reading a file.
+do
+    aio.write(path, "hello")
+    aio.append(path, " world")
+    assert(aio.read(path) == "hello world")
+    assert(aio.read(path, 6) == "world")
+    assert(aio.read(path, 6, 3) == "wor")
+    assert(aio.read(path, 100) == "")
+
+    local content = string.rep("0123456789", 1000)
+    aio.write(path, content)
+    assert(aio.read(path) == content)
+end
+
+---Test getting the file status.
+do
+    local st = aio.stat(path)
+    assert(st.type == "file")
+    assert(st.size == 10000)
+    assert(math.type(st.mtime) == "integer")
+    assert(aio.stat(".").type == "directory")
+    assert(aio.stat("testaio.nonexistent") == nil)
+end
+
+---Test errors.
+do
+    local success, err = pcall(aio.read, "testaio.nonexistent")
+    assert(success == false)
+    assert(err:find("testaio.nonexistent", 1, true))
+    assert(pcall(aio.write, ".", "x") == false)
+    assert(pcall(aio.read, path, -1) == false)
+    assert(pcall(aio.write, path) == false)
+end
+
+---Test concurrent operations are completed in order.
+do
+    aio.write(path, "")
+    local n = 10
+    local done = 0
+    for i = 1, n do
+        local co = coroutine.wrap(function ()
+            aio.append(path, tostring(i % 10))
+            done = done + 1
+        end)
+        co()
+    end
+    while done < n do
+        aio.stat(path)
+    end
+    assert(aio.read(path) == "1234567890")
+end
+
+os.remove(path)
@@ -0,0 +1,21 @@
+local chip = require "chip"
+
+---Test the fields of the resource usage have the documented types.
+do
+    local usage = chip.getResourceUsage()
+    assert(type(usage) == "table")
+    for _, k in ipairs({ "cpuUser", "cpuSys", "cpuUsage", "rss", "heapUsed", "fds", "ncpus" }) do
+        local v = usage[k]
+        assert(v == nil or (math.type(v) == "integer" and v >= 0), k)
+    end
+    assert(usage.ncpus and usage.ncpus >= 1)
+    -- Either the process or the system heap is measured.
+    assert(usage.rss or usage.heapUsed)
+    if usage.loadavg then
+        assert(#usage.loadavg == 3)
+        for _, v in ipairs(usage.loadavg) do
+            assert(math.type(v) == "float" and v >= 0)
+        end
+    end
+    assert(usage.temp == nil or math.type(usage.temp) == "float")
+end
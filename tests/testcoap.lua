@@ -0,0 +1,254 @@
+local socket = require "socket"
+local time = require "time"
+local mq = require "mq"
+local coap = require "coap"
+local pack = string.pack
+
+local PORT = 5690
+
+---Test message encoding and decoding.
+do
+    local data = coap.encode({
+        type = 0,
+        code = 1,
+        mid = 0x1234,
+        token = "\x01\x02",
+        options = {
+            { 11, "sensors" },
+            { 11, string.rep("t", 20) },
+            { 300, "x" },
+        },
+        payload = "hello",
+    })
+    local msg = coap.decode(data)
+    assert(msg.type == 0)
+    assert(msg.code == 1)
+    assert(msg.mid == 0x1234)
+    assert(msg.token == "\x01\x02")
+    assert(#msg.options == 3)
+    assert(msg.options[1][1] == 11 and msg.options[1][2] == "sensors")
+    assert(msg.options[2][1] == 11 and msg.options[2][2] == string.rep("t", 20))
+    assert(msg.options[3][1] == 300 and msg.options[3][2] == "x")
+    assert(msg.payload == "hello")
+end
+
+---A CoAP stand-in server.
+---
+---Resources:
+---  /hello   Piggybacked response "world".
+---  /slow    Empty ACK, then a separate confirmable response "late".
+---  /big     200 bytes in blocks of 64 bytes.
+---  /lossy   The first request is lost, the retransmission is answered.
+---  /temp    Observable, notifies "21" and "22", then a duplicate and a stale one.
+---  others   4.04 Not Found.
+local function startServer()
+    local server = {
+        acked = {},
+        resets = {},
+        observers = 0,
+        rst = false,
+    }
+    local sock = socket.create("UDP", "IPV4")
+    sock:bind("127.0.0.1", PORT)
+    local mid = 0x100
+    local counts = {}
+    local observer
+
+    local function send(addr, port, msg)
+        sock:sendto(coap.encode(msg), addr, port)
+    end
+
+    local function uint(v)
+        return (pack(">I4", v):gsub("^%z+", ""))
+    end
+
+    local function notify(seq, type, payload, m)
+        if m == nil then
+            mid = mid + 1
+            m = mid
+        end
+        send(observer.addr, observer.port, {
+            type = type, code = 0x45, mid = m, token = observer.token,
+            options = { { 6, uint(seq) } }, payload = payload,
+        })
+    end
+
+    local function handle(msg, addr, port)
+        if msg.type == 2 then
+            server.acked[msg.mid] = true
+            return
+        elseif msg.type == 3 then
+            server.rst = true
+            server.resets[msg.mid] = true
+            return
+        end
+        local segs, observe, block2 = {}, nil, nil
+        for _, opt in ipairs(msg.options) do
+            if opt[1] == 11 then
+                segs[#segs + 1] = opt[2]
+            elseif opt[1] == 6 then
+                observe = opt[2] == "" and 0 or opt[2]:byte()
+            elseif opt[1] == 23 then
+                block2 = 0
+                for i = 1, #opt[2] do
+                    block2 = (block2 << 8) | opt[2]:byte(i)
+                end
+            end
+        end
+        local path = "/" .. table.concat(segs, "/")
+        counts[path] = (counts[path] or 0) + 1
+        local resp = { type = 2, code = 0x45, mid = msg.mid, token = msg.token, options = {} }
+
+        if path == "/hello" then
+            resp.payload = "world"
+        elseif path == "/slow" then
+            send(addr, port, { type = 2, code = 0, mid = msg.mid })
+            time.createTimer(function ()
+                mid = mid + 1
+                server.slowMid = mid
+                send(addr, port, { type = 0, code = 0x45, mid = mid, token = msg.token, payload = "late" })
+            end):start(50)
+            return
+        elseif path == "/big" then
+            local content = string.rep("0123456789", 20)
+            local num = block2 and block2 >> 4 or 0
+            local szx = math.min(block2 and block2 & 0x7 or 2, 2)
+            local size = 1 << (szx + 4)
+            local more = (num + 1) * size < #content
+            resp.options = { { 23, uint((num << 4) | (more and 0x8 or 0) | szx) } }
+            resp.payload = content:sub(num * size + 1, (num + 1) * size)
+        elseif path == "/lossy" then
+            if counts[path] == 1 then
+                return
+            end
+            resp.payload = "ok"
+        elseif path == "/temp" and observe == 0 then
+            observer = { addr = addr, port = port, token = msg.token }
+            server.observers = server.observers + 1
+            resp.options = { { 6, uint(1) } }
+            resp.payload = "20"
+            time.createTimer(function ()
+                notify(2, 0, "21")
+                notify(3, 1, "22")
+                notify(3, 1, "22", mid)
+                notify(1, 1, "stale")
+            end):start(10)
+        elseif path == "/temp" and observe == 1 then
+            server.observers = server.observers - 1
+            resp.payload = "22"
+        else
+            resp.code = 0x84
+        end
+        send(addr, port, resp)
+    end
+
+    time.createTimer(function ()
+        while true do
+            local success, data, addr, port = pcall(sock.recvfrom, sock, 1152)
+            if success == false then
+                return
+            end
+            handle(coap.decode(data), addr, port)
+        end
+    end):start(0)
+
+    function server.notifyCancelled()
+        notify(4, 1, "23")
+    end
+
+    ---Send a message to the client, it must have observed ``/temp``.
+    function server.sendToClient(msg)
+        send(observer.addr, observer.port, msg)
+    end
+
+    function server.stop()
+        sock:destroy()
+    end
+
+    return server
+end
+
+local server = startServer()
+local client = coap.connect("127.0.0.1", PORT)
+
+---Test a piggybacked response.
+do
+    local code, payload = client:request("GET", "/hello")
+    assert(code == "2.05")
+    assert(payload == "world")
+    assert(client:request("GET", "/missing") == "4.04")
+end
+
+---Test a separate response, it must be acknowledged.
+do
+    local code, payload = client:request("GET", "/slow")
+    assert(code == "2.05")
+    assert(payload == "late")
+    -- Let the server receive the ACK.
+    time.sleep(10)
+    assert(server.acked[server.slowMid])
+end
+
+---Test block-wise transfer.
+do
+    local code, payload = client:request("GET", "/big")
+    assert(code == "2.05")
+    assert(payload == string.rep("0123456789", 20))
+end
+
+---Test retransmission.
+do
+    local code, payload = client:request("GET", "/lossy")
+    assert(code == "2.05")
+    assert(payload == "ok")
+end
+
+---Test observation.
+do
+    local values = {}
+    local done = mq.create(1)
+    local obs = client:observe("/temp", function (payload, code)
+        assert(code == "2.05")
+        values[#values + 1] = payload
+        if payload == "22" then
+            done:send(true)
+        end
+    end)
+    done:recv()
+    -- Wait for the duplicate and the stale notifications, they are dropped.
+    time.sleep(50)
+    assert(#values == 3)
+    assert(values[1] == "20" and values[2] == "21" and values[3] == "22")
+
+    obs:cancel()
+    assert(server.observers == 0)
+
+    -- Notifications of a cancelled observation are rejected.
+    server.notifyCancelled()
+    time.sleep(50)
+    assert(server.rst)
+    assert(#values == 3)
+end
+
+---Test the pings and the messages of the unknown exchanges are reset, not acknowledged.
+do
+    local unknown = { type = 0, code = 0x45, mid = 0x201, token = "\xde\xad", payload = "x" }
+    server.sendToClient({ type = 0, code = 0, mid = 0x200 })
+    server.sendToClient(unknown)
+    time.sleep(50)
+    assert(server.resets[0x200] and not server.acked[0x200])
+    assert(server.resets[0x201] and not server.acked[0x201])
+
+    -- A duplicate gets the same reply.
+    server.resets[0x201] = nil
+    server.sendToClient(unknown)
+    time.sleep(50)
+    assert(server.resets[0x201] and not server.acked[0x201])
+end
+
+---Test closing the client.
+do
+    client:close()
+    assert(pcall(client.request, client, "GET", "/hello") == false)
+    server.stop()
+end
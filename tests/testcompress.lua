@@ -0,0 +1,66 @@
+local compress = require "compress"
+
+local text = string.rep("homekit-bridge ", 1000)
+
+---Test one-shot compression in all formats.
+do
+    for _, format in ipairs({ "raw", "zlib", "gzip" }) do
+        local data = compress.deflate(text, 9, format)
+        assert(#data < #text)
+        assert(compress.inflate(data, format) == text)
+    end
+    assert(compress.deflate(text):byte() == 0x78)
+    assert(compress.inflate(compress.deflate("")) == "")
+    assert(compress.inflate(compress.deflate(text, 0)) == text)
+end
+
+---Test invalid parameters.
+do
+    assert(pcall(compress.deflate, text, 10) == false)
+    assert(pcall(compress.deflate, text, nil, "zip") == false)
+    assert(pcall(compress.inflate, nil) == false)
+end
+
+---Test invalid and truncated data.
+do
+    local data = compress.deflate(text)
+    assert(pcall(compress.inflate, "hello") == false)
+    assert(pcall(compress.inflate, data:sub(1, #data // 2)) == false)
+    assert(pcall(compress.inflate, data .. "x") == false)
+    assert(pcall(compress.inflate, data, "gzip") == false)
+end
+
+---Test the output limit of decompression.
+do
+    local data = compress.deflate(text)
+    assert(compress.inflate(data, "zlib", #text) == text)
+    assert(pcall(compress.inflate, data, "zlib", #text - 1) == false)
+end
+
+---Test streaming compression and decompression, fed in small chunks.
+do
+    local deflater = compress.deflater("gzip")
+    local chunks = {}
+    for i = 1, #text, 100 do
+        chunks[#chunks + 1] = deflater:update(text:sub(i, i + 99))
+    end
+    chunks[#chunks + 1] = deflater:finish()
+    assert(deflater:finished())
+    assert(pcall(deflater.update, deflater, "x") == false)
+    local data = table.concat(chunks)
+    assert(compress.inflate(data, "gzip") == text)
+
+    local inflater = compress.inflater("gzip")
+    local out = {}
+    for i = 1, #data, 7 do
+        out[#out + 1] = inflater:update(data:sub(i, i + 6))
+    end
+    assert(inflater:finished())
+    out[#out + 1] = inflater:finish()
+    assert(table.concat(out) == text)
+
+    inflater = compress.inflater("gzip")
+    inflater:update(data:sub(1, 10))
+    assert(inflater:finished() == false)
+    assert(pcall(inflater.finish, inflater) == false)
+end
@@ -0,0 +1,55 @@
+local hap = require "hap"
+local cplugin = require "cplugin"
+
+local logger = log.getLogger("testcplugin")
+
+---Test loading native plugins with invalid parameters.
+do
+    assert(pcall(cplugin.load) == false)
+    assert(pcall(cplugin.load, "/nonexistent/plugin.so") == false)
+end
+
+---Test the example native plugin, it serves a light bulb with the service and
+---the types looked up from the bridge.
+local path = cplugin.supported and package.searchpath("native.plugin", package.cpath)
+if not path then
+    logger:info("Skip the native plugin tests, the example native plugin is not built.")
+    return
+end
+
+hap.init({
+    aid = 1,
+    category = "Bridges",
+    name = "test",
+    mfg = "mfg1",
+    model = "model1",
+    sn = "1234567890",
+    fwVer = "1",
+    services = {
+        hap.AccessoryInformationService,
+        hap.HapProtocolInformationService,
+        hap.PairingService,
+    },
+    cbs = {}
+}, {
+    updatedState = function (state) end
+})
+
+local plugin = cplugin.load(path, "{}")
+assert(plugin.name == "native")
+plugin.handleState("Running")
+
+-- The plugin allocated the last IDs.
+local aid = hap.getNewBridgedAccessoryID() - 1
+local iid = hap.getNewInstanceID()
+local sid, cid = iid - 2, iid - 1
+
+if hap.test then
+    hap.test.start(1)
+    hap.raiseEvent(aid, sid, cid)
+    local events = hap.test.events()
+    assert(#events == 1 and events[1].aid == aid and events[1].iid == cid and events[1].session == 1)
+    hap.test.stop()
+end
+
+hap.deinit()
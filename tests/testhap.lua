@@ -1,5 +1,6 @@
 local hap = require "hap"
 local util = require "util"
+local time = require "time"
 
 local logger = log.getLogger("testhap")
 
@@ -662,3 +663,253 @@ testCharacteristic(true, "constraints.validValsRanges", { { { start = 1, stop =
 ---Configure with invalid constraints validValsRanges.
 testCharacteristic(false, "constraints.validValsRanges", { false, "test", 1, { false }, { "test" }, { start = false }, { { start = format.UInt8.min, stop = true } } }, "UInt8")
 testCharacteristic(false, "constraints.validValsRanges", { { { start = format.UInt8.min, stop = format.UInt8.max } } }, "Bool")
+
+---Configure with valid derivedFrom.
+testCharacteristic(true, "derivedFrom", { {}, { 1, 2 } })
+
+---Configure with invalid derivedFrom.
+testCharacteristic(false, "derivedFrom", { "test", true, 1, { "test" }, { 1.5 } })
+
+---Test the read-only tables of the module.
+do
+    assert(hap.Error.None == 0)
+    assert(hap.Error.Busy == 6)
+    assert(hap.Error == hap.Error)
+    assert(type(hap.AccessoryInformationService) == "userdata")
+    assert(pcall(function () hap.Error.None = 1 end) == false)
+    assert(pcall(function () hap.test = 1 end) == false)
+    local n = 0
+    for k, v in pairs(hap.Error) do
+        assert(hap.Error[k] == v)
+        n = n + 1
+    end
+    assert(n == 7)
+end
+
+---Create a characteristic served with the test hooks.
+---@param fields? table Fields to set in the characteristic.
+local function newHookChar(fields)
+    local c = {
+        format = "Bool",
+        iid = hap.getNewInstanceID(),
+        type = "On",
+        props = {
+            readable = true,
+            writable = true,
+            supportsEventNotification = true,
+            hidden = false,
+            requiresTimedWrite = false,
+            supportsAuthorizationData = false,
+            ip = { controlPoint = false, supportsWriteResponse = false },
+            ble = {
+                supportsBroadcastNotification = true,
+                supportsDisconnectedNotification = true,
+                readableWithoutSecurity = false,
+                writableWithoutSecurity = false
+            }
+        },
+        cbs = {
+            read = function (request, context)
+                return false, hap.Error.None
+            end,
+            write = function (request, value, context)
+                return hap.Error.None
+            end
+        }
+    }
+    for k, v in pairs(fields or {}) do
+        c[k] = v
+    end
+    return c
+end
+
+---Start HAP with the test hooks, the characteristics are in a service of the primary accessory.
+---@param chars HapCharacteristic[]
+---@param nsessions integer Number of the fake sessions.
+---@param context? table Accessory context.
+---@return integer sid Service instance ID.
+local function startHooks(chars, nsessions, context)
+    local sid = hap.getNewInstanceID()
+    hap.init({
+        aid = 1,
+        category = "Bridges",
+        name = "test",
+        mfg = "mfg1",
+        model = "model1",
+        sn = "1234567890",
+        fwVer = "1",
+        services = {
+            hap.AccessoryInformationService,
+            hap.HapProtocolInformationService,
+            hap.PairingService,
+            {
+                iid = sid,
+                type = "LightBulb",
+                props = {
+                    primaryService = true,
+                    hidden = false,
+                    ble = { supportsConfiguration = false }
+                },
+                chars = chars
+            }
+        },
+        cbs = {},
+        context = context
+    }, {
+        updatedState = function (state) end
+    })
+    hap.test.start(nsessions)
+    return sid
+end
+
+local function stopHooks()
+    hap.test.stop()
+    hap.deinit()
+end
+
+---Count the events of the characteristic on the session.
+local function countEvents(events, iid, session)
+    local n = 0
+    for _, e in ipairs(events) do
+        if e.aid == 1 and e.iid == iid and e.session == session then
+            n = n + 1
+        end
+    end
+    return n
+end
+
+---Test the events of the derived characteristics are raised once at the end of the tick.
+if hap.test then
+    local src = newHookChar()
+    local c1 = newHookChar({ derivedFrom = { src.iid } })
+    local c2 = newHookChar({ derivedFrom = { c1.iid } })
+    local c3 = newHookChar({ derivedFrom = { src.iid, c1.iid } })
+    local sid = startHooks({ src, c1, c2, c3 }, 1)
+
+    hap.raiseEvent(1, sid, src.iid)
+    hap.raiseEvent(1, sid, src.iid)
+    local events = hap.test.events()
+    assert(#events == 2 and countEvents(events, src.iid, 1) == 2)
+
+    time.sleep(10)
+    events = hap.test.events()
+    assert(#events == 3)
+    for _, c in ipairs({ c1, c2, c3 }) do
+        assert(countEvents(events, c.iid, 1) == 1)
+    end
+
+    stopHooks()
+
+    ---Test the events raised from the write handlers are not sent to the writer.
+    local props = { on = false }
+    local context = {
+        getProp = function (self, k)
+            return props[k]
+        end,
+        setProp = function (self, k, v)
+            props[k] = v
+        end
+    }
+    local bound = newHookChar({ binding = { prop = "on" } })
+    bound.cbs = nil
+    local raised = newHookChar({
+        cbs = {
+            write = function (request, value, context)
+                hap.raiseEvent(request.aid, request.sid, request.cid)
+                return hap.Error.None
+            end
+        }
+    })
+    startHooks({ bound, raised }, 2, context)
+
+    assert(hap.test.write(1, bound.iid, true, 1) == hap.Error.None)
+    assert(props.on == true)
+    events = hap.test.events()
+    assert(#events == 1 and countEvents(events, bound.iid, 2) == 1)
+    local err, value = hap.test.read(1, bound.iid, 2)
+    assert(err == hap.Error.None and value == true)
+
+    assert(hap.test.write(1, raised.iid, true, 2) == hap.Error.None)
+    events = hap.test.events()
+    assert(#events == 1 and countEvents(events, raised.iid, 1) == 1)
+
+    stopHooks()
+
+    ---Test the read-only characteristics bound to a property are not written.
+    local readOnly = newHookChar({ binding = { prop = "on" } })
+    readOnly.cbs = nil
+    readOnly.props.writable = false
+    startHooks({ readOnly }, 1, context)
+
+    assert(pcall(hap.test.write, 1, readOnly.iid, false, 1) == false)
+    assert(props.on == true)
+    err, value = hap.test.read(1, readOnly.iid, 1)
+    assert(err == hap.Error.None and value == true)
+    assert(#hap.test.events() == 0)
+
+    stopHooks()
+
+    ---Test the reads and events of the characteristics backed by slots.
+    local slotted = newHookChar({ slot = true })
+    local plain = newHookChar()
+    startHooks({ slotted, plain }, 1)
+    hap.openSlots("testhap", 8)
+
+    err, value = hap.test.read(1, slotted.iid, 1)
+    assert(err == hap.Error.None and value == false)
+    hap.test.writeSlot(1, slotted.iid, true)
+    hap.test.writeSlot(1, plain.iid, true)
+    time.sleep(10)
+    events = hap.test.events()
+    assert(#events == 1 and countEvents(events, slotted.iid, 1) == 1)
+    err, value = hap.test.read(1, slotted.iid, 1)
+    assert(err == hap.Error.None and value == true)
+    err, value = hap.test.read(1, plain.iid, 1)
+    assert(err == hap.Error.None and value == false)
+    -- The IDs of the slots fit in 32 bits.
+    assert(pcall(hap.test.writeSlot, 1 << 32, slotted.iid, true) == false)
+
+    stopHooks()
+else
+    logger:info("Skip the tests with the test hooks, they are not built.")
+end
+
+---Test the keyed IDs are stable and told apart by the key.
+do
+    local iid = hap.getNewInstanceID("testhap:keyed")
+    assert(hap.getNewInstanceID("testhap:keyed") == iid)
+    assert(hap.getNewInstanceID("testhap:keyed2") ~= iid)
+    assert(hap.getNewInstanceID() ~= iid)
+    local aid = hap.getNewBridgedAccessoryID("testhap:keyed")
+    assert(hap.getNewBridgedAccessoryID("testhap:keyed") == aid)
+    assert(not pcall(hap.getNewInstanceID, ""))
+    assert(not pcall(hap.getNewInstanceID, ("k"):rep(129)))
+end
+
+---Test the IDs of the keys not requested since init are pruned.
+do
+    local stale = hap.getNewInstanceID("testhap:stale")
+    hap.init({
+        aid = 1,
+        category = "Bridges",
+        name = "test",
+        mfg = "mfg1",
+        model = "model1",
+        sn = "1234567890",
+        fwVer = "1",
+        services = {
+            hap.AccessoryInformationService,
+            hap.HapProtocolInformationService,
+            hap.PairingService,
+        },
+        cbs = {}
+    }, {
+        updatedState = function (state) end
+    })
+    hap.deinit()
+    local live = hap.getNewInstanceID("testhap:live")
+    assert(hap.pruneIDs() >= 1)
+    assert(hap.pruneIDs() == 0)
+    assert(hap.getNewInstanceID("testhap:live") == live)
+    assert(hap.getNewInstanceID("testhap:stale") ~= stale)
+end
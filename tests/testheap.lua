@@ -0,0 +1,40 @@
+local heapdiff = require "heapdiff"
+
+---Test the heap snapshots keep the state of the collector.
+do
+    local path = os.tmpname()
+    local count, bytes = debug.heapsnapshot(path)
+    assert(count > 0 and bytes > 0)
+    assert(collectgarbage("isrunning"))
+
+    collectgarbage("stop")
+    debug.heapsnapshot(path)
+    assert(collectgarbage("isrunning") == false)
+    collectgarbage("restart")
+    os.remove(path)
+end
+
+---Test a known allocation is found in the diff of two snapshots.
+do
+    local oldPath, newPath = os.tmpname(), os.tmpname()
+    debug.heapsnapshot(oldPath)
+    local known = {}
+    for i = 1, 1000 do
+        known[i] = { i }
+    end
+    testheapKnown = known
+    debug.heapsnapshot(newPath)
+    testheapKnown = nil
+
+    local diffs, total = heapdiff.diff(heapdiff.load(oldPath), heapdiff.load(newPath))
+    os.remove(oldPath)
+    os.remove(newPath)
+    local found = false
+    for _, d in ipairs(diffs) do
+        if d.type == "table" and d.owner == "_G" and d.count >= 1000 then
+            found = true
+        end
+    end
+    assert(found)
+    assert(total.count >= 1000 and total.bytes > 0)
+end
@@ -0,0 +1,282 @@
+local socket = require "socket"
+local time = require "time"
+local mq = require "mq"
+local http2 = require "http2"
+local hpack = require "http2.hpack"
+local util = require "util"
+local compress = require "compress"
+local pack = string.pack
+local unpack = string.unpack
+
+local PORT = 8890
+
+---Test hpack Huffman decoding (RFC 7541 C.4.1).
+do
+    assert(hpack.huffmanDecode(util.hex2bin("f1e3c2e5f23a6ba0ab90f4ff")) == "www.example.com")
+end
+
+---Test hpack encoding and decoding.
+do
+    local decoder = hpack.decoder()
+    local block = hpack.encode({
+        { ":method", "GET" },
+        { ":path", "/index.html" },
+        { "user-agent", "homekit-bridge" },
+        { "x-empty", "" },
+    })
+    local headers = decoder:decode(block)
+    assert(headers[":method"] == "GET")
+    assert(headers[":path"] == "/index.html")
+    assert(headers["user-agent"] == "homekit-bridge")
+    assert(headers["x-empty"] == "")
+end
+
+---Test hpack dynamic table (RFC 7541 C.3).
+do
+    local decoder = hpack.decoder()
+    local headers = decoder:decode(util.hex2bin("828684410f7777772e6578616d706c652e636f6d"))
+    assert(headers[":authority"] == "www.example.com")
+    headers = decoder:decode(util.hex2bin("828684be58086e6f2d6361636865"))
+    assert(headers[":authority"] == "www.example.com")
+    assert(headers["cache-control"] == "no-cache")
+end
+
+---A HTTP/2 stand-in server, speaking HTTP/2 with prior knowledge.
+---
+---Routes:
+---  /echo      Echo the request body.
+---  /order/<n> Respond after 3 requests, in the reverse order.
+---  /reset     Reset the stream.
+---  /hang      Never respond.
+---  /gzip      Respond a gzip encoded text, if it is accepted.
+---  /corrupt   Respond a corrupted gzip encoded body.
+---@param settings table<integer, integer> Server settings.
+local function startServer(settings)
+    local listener = socket.create("TCP", "IPV4")
+    listener:bind("127.0.0.1", PORT)
+    listener:listen(1)
+
+    local sock
+    local buf = ""
+    local decoder = hpack.decoder()
+    local connWindow = 65535
+    local streams = {}
+    local ordered = {}
+
+    local function read(n)
+        while #buf < n do
+            local data = sock:recv(16384)
+            if #data == 0 then
+                return nil
+            end
+            buf = buf .. data
+        end
+        local s = buf:sub(1, n)
+        buf = buf:sub(n + 1)
+        return s
+    end
+
+    local function writeFrame(type, flags, sid, payload)
+        sock:sendall(pack(">I3BBI4", #payload, type, flags, sid) .. payload)
+    end
+
+    -- Send the pending response data within the flow control windows.
+    local function flush()
+        for sid, stream in pairs(streams) do
+            local resp = stream.resp
+            while resp and resp.pos <= #resp.body and connWindow > 0 and stream.window > 0 do
+                local n = math.min(connWindow, stream.window, 16384, #resp.body - resp.pos + 1)
+                local last = resp.pos + n > #resp.body
+                writeFrame(0x0, last and 0x1 or 0, sid, resp.body:sub(resp.pos, resp.pos + n - 1))
+                resp.pos = resp.pos + n
+                connWindow = connWindow - n
+                stream.window = stream.window - n
+                if last then
+                    streams[sid] = nil
+                end
+            end
+        end
+    end
+
+    local function respond(sid, status, body, encoding)
+        local fields = { { ":status", tostring(status) }, { "x-stream", tostring(sid) } }
+        if encoding then
+            fields[3] = { "content-encoding", encoding }
+        end
+        local block = hpack.encode(fields)
+        if body == "" then
+            writeFrame(0x1, 0x5, sid, block)
+            streams[sid] = nil
+        else
+            writeFrame(0x1, 0x4, sid, block)
+            streams[sid].resp = { body = body, pos = 1 }
+        end
+    end
+
+    local function handleRequest(sid, stream)
+        local path = stream.headers[":path"]
+        if path == "/echo" then
+            respond(sid, 200, table.concat(stream.body))
+        elseif path:find("^/order/") then
+            table.insert(ordered, sid)
+            if #ordered == 3 then
+                for i = 3, 1, -1 do
+                    respond(ordered[i], 200, streams[ordered[i]].headers[":path"])
+                end
+                ordered = {}
+            end
+        elseif path == "/gzip" then
+            local text = string.rep("homekit-bridge ", 1000)
+            if (stream.headers["accept-encoding"] or ""):find("gzip") then
+                respond(sid, 200, compress.deflate(text, nil, "gzip"), "gzip")
+            else
+                respond(sid, 200, text)
+            end
+        elseif path == "/corrupt" then
+            respond(sid, 200, compress.deflate("hello", nil, "gzip"):sub(1, 12) .. "corrupted", "gzip")
+        elseif path == "/reset" then
+            writeFrame(0x3, 0, sid, pack(">I4", 0x2))
+            streams[sid] = nil
+        end
+    end
+
+    time.createTimer(function ()
+        sock = listener:accept()
+        listener:destroy()
+        assert(read(24) == "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n")
+        local payload = ""
+        for id, value in pairs(settings) do
+            payload = payload .. pack(">I2I4", id, value)
+        end
+        writeFrame(0x4, 0, 0, payload)
+        while true do
+            local hdr = read(9)
+            if hdr == nil then
+                sock:destroy()
+                return
+            end
+            local len, type, flags, sid = unpack(">I3BBI4", hdr)
+            local payload = len > 0 and read(len) or ""
+            if type == 0x1 then
+                assert(flags & 0x4 ~= 0, "CONTINUATION is not supported by the stand-in server")
+                streams[sid] = { headers = decoder:decode(payload), body = {}, window = 65535 }
+                if flags & 0x1 ~= 0 then
+                    handleRequest(sid, streams[sid])
+                end
+            elseif type == 0x0 then
+                local stream = streams[sid]
+                table.insert(stream.body, payload)
+                -- Acknowledge at once to keep the client sending.
+                if len > 0 then
+                    writeFrame(0x8, 0, 0, pack(">I4", len))
+                    writeFrame(0x8, 0, sid, pack(">I4", len))
+                end
+                if flags & 0x1 ~= 0 then
+                    handleRequest(sid, stream)
+                end
+            elseif type == 0x4 then
+                if flags & 0x1 == 0 then
+                    writeFrame(0x4, 0x1, 0, "")
+                end
+            elseif type == 0x8 then
+                local inc = unpack(">I4", payload)
+                if sid == 0 then
+                    connWindow = connWindow + inc
+                elseif streams[sid] then
+                    streams[sid].window = streams[sid].window + inc
+                end
+            elseif type == 0x3 then
+                streams[sid] = nil
+            elseif type == 0x7 then
+                sock:destroy()
+                return
+            end
+            flush()
+        end
+    end):start(0)
+end
+
+startServer({
+    [0x3] = 10,     -- SETTINGS_MAX_CONCURRENT_STREAMS
+    [0x4] = 1000,   -- SETTINGS_INITIAL_WINDOW_SIZE
+})
+
+local conn = http2.connect("127.0.0.1", PORT, false)
+
+---Test the connection is shared.
+do
+    assert(http2.connect("127.0.0.1", PORT, false) == conn)
+end
+
+---Test concurrent requests are multiplexed over one connection.
+do
+    local done = mq.create(3)
+    for i = 1, 3 do
+        time.createTimer(function ()
+            local status, headers, body = conn:request("GET", "/order/" .. i)
+            done:send(i, status, body)
+        end):start(0)
+    end
+    local seen = {}
+    for _ = 1, 3 do
+        local i, status, body = done:recv()
+        assert(status == 200)
+        assert(body == "/order/" .. i)
+        seen[i] = true
+    end
+    assert(seen[1] and seen[2] and seen[3])
+end
+
+---Test flow control in both directions with a large body.
+do
+    local content = string.rep("0123456789", 20000)
+    local status, headers, body = conn:request("POST", "/echo", { ["content-type"] = "text/plain" }, content)
+    assert(status == 200)
+    assert(headers["x-stream"])
+    assert(body == content)
+end
+
+---Test decoding the encoded response body.
+do
+    local text = string.rep("homekit-bridge ", 1000)
+    local status, headers, body = conn:request("GET", "/gzip", { ["accept-encoding"] = "gzip, deflate" })
+    assert(status == 200)
+    assert(headers["content-encoding"] == nil)
+    assert(body == text)
+
+    status, headers, body = conn:request("GET", "/gzip")
+    assert(status == 200)
+    assert(body == text)
+
+    local success, err = pcall(conn.request, conn, "GET", "/corrupt", { ["accept-encoding"] = "gzip" })
+    assert(success == false)
+    assert(err:find("decode"))
+end
+
+---Test a stream reset by the server.
+do
+    local success, err = pcall(conn.request, conn, "GET", "/reset")
+    assert(success == false)
+    assert(err:find("reset"))
+end
+
+---Test request timeout.
+do
+    local success, err = pcall(conn.request, conn, "GET", "/hang", nil, nil, 100)
+    assert(success == false)
+    assert(err:find("timed out"))
+end
+
+---Test the connection is usable after the errors.
+do
+    local status, _, body = conn:request("POST", "/echo", nil, "hello")
+    assert(status == 200)
+    assert(body == "hello")
+end
+
+---Test closing the connection.
+do
+    conn:close()
+    local success = pcall(conn.request, conn, "GET", "/echo")
+    assert(success == false)
+end
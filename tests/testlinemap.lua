@@ -0,0 +1,16 @@
+local logger = log.getLogger("testlinemap")
+
+---Test the tracebacks of stripped bytecode are symbolized with the line map.
+local ok, fixture = pcall(require, "linemapfixture")
+if not ok then
+    logger:info("Skip the line map tests, the fixture is only embedded with the test hooks.")
+else
+    local success, traceback = xpcall(fixture.call, debug.traceback, function (f)
+        f()
+    end)
+    assert(success == false)
+    -- The functions with the same line range are told apart.
+    assert(traceback:find("linemapfixture.lua:10: in ", 1, true), traceback)
+    assert(traceback:find("linemapfixture.lua:11: in ", 1, true), traceback)
+    assert(not traceback:find("linemapfixture.lua:9: in ", 1, true), traceback)
+end
@@ -0,0 +1,44 @@
+local lock = require "lock"
+local time = require "time"
+
+---Test the lock is held by one coroutine at a time and handed over in FIFO order.
+do
+    local l = lock.create()
+    local arrived = {}
+    local acquired = {}
+    local holders = 0
+    local function worker(id)
+        arrived[#arrived + 1] = id
+        l:acquire()
+        acquired[#acquired + 1] = id
+        holders = holders + 1
+        assert(holders == 1)
+        time.sleep(10)
+        holders = holders - 1
+        l:release()
+    end
+
+    l:acquire()
+    for i = 1, 4 do
+        time.createTimer(worker, i):start(0)
+    end
+    time.sleep(20)
+    assert(#arrived == 4 and #acquired == 0)
+    l:release()
+
+    for _ = 1, 100 do
+        if #acquired == 4 and holders == 0 then
+            break
+        end
+        time.sleep(10)
+    end
+    assert(#acquired == 4 and holders == 0)
+    for i = 1, 4 do
+        assert(acquired[i] == arrived[i])
+    end
+
+    -- Released without waiters, acquired again without waiting.
+    l:acquire()
+    l:release()
+    assert(pcall(l.release, l) == false)
+end
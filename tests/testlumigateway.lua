@@ -0,0 +1,77 @@
+local gateway = require "miio.lumi.gateway"
+local socket = require "socket"
+local time = require "time"
+local json = require "cjson"
+
+local logger = log.getLogger("testlumigateway")
+
+---Port of the multicast messages of the gateways.
+local PORT = 9898
+
+---Wait until ``cond()`` returns true or timeout.
+local function waitFor(cond, ms)
+    local deadline = os.time() + ms // 1000
+    while not cond() do
+        if os.time() > deadline then
+            return false
+        end
+        time.sleep(20)
+    end
+    return true
+end
+
+---Test the messages of a stand-in gateway are dispatched, the stand-in sends
+---the multicast messages to the listener by unicast so no network is needed.
+local ok, gw = pcall(gateway.create, "127.0.0.1", "0123456789abcdef")
+if not ok then
+    logger:info("Skip the gateway tests, failed to listen on port " .. PORT .. ": " .. gw)
+else
+    local gwsid = "7811dcb00001"
+
+    local reports = {}
+    local subdev = gw:addSubdevice("158d00010001", "sensor_ht", {})
+    function subdev:onReport(data)
+        reports[#reports + 1] = data
+    end
+
+    local standin <close> = socket.create("UDP", "IPV4")
+    local function send(msg)
+        standin:sendto(json.encode(msg), "127.0.0.1", PORT)
+    end
+
+    -- The heartbeat of a gateway whose model is not "gateway" carries the token.
+    send({
+        cmd = "heartbeat",
+        model = "gateway.v3",
+        sid = gwsid,
+        token = "1234567890abcdef",
+        data = json.encode({ ip = "127.0.0.1" })
+    })
+    send({
+        cmd = "report",
+        model = "sensor_ht",
+        sid = subdev.sid,
+        data = json.encode({ temperature = "2150" })
+    })
+    send({
+        cmd = "heartbeat",
+        model = "sensor_ht",
+        sid = subdev.sid,
+        data = json.encode({ voltage = "3005" })
+    })
+    -- Unknown sub-devices are ignored.
+    send({
+        cmd = "report",
+        model = "sensor_ht",
+        sid = "158d0001ffff",
+        data = json.encode({ temperature = "0" })
+    })
+
+    assert(waitFor(function ()
+        return gw.token ~= nil and #reports == 2
+    end, 3000))
+    assert(gw.sid == gwsid and gw.token == "1234567890abcdef")
+    assert(reports[1].temperature == "2150")
+    assert(reports[2].voltage == "3005")
+    assert(subdev.state.temperature == "2150" and subdev.state.voltage == "3005")
+end
@@ -0,0 +1,20 @@
+local logger = log.getLogger("testmemory")
+
+---Footprint budget of the test run in bytes, ``TEST_MEM_BUDGET`` overrides it.
+---By default a quarter of the heap is kept free for the fragmentation and the
+---peaks the tests do not reach.
+local budget = tonumber(os.getenv("TEST_MEM_BUDGET"))
+
+---Test the footprint of the tests run before is within the budget.
+local stats = debug.memstats()
+if stats == nil then
+    logger:info("Skip the footprint test, the heap is only tracked with PAL_MEM_EMULATION.")
+else
+    assert(stats.used <= stats.peak and stats.peak <= stats.cap)
+    assert(stats.failed == 0, ("%d allocations failed"):format(stats.failed))
+    budget = budget or stats.cap * 3 // 4
+    for phase, peak in pairs(stats.phases) do
+        assert(peak <= budget, ("Memory peak of phase %s %d is over the budget %d"):format(phase, peak, budget))
+    end
+    logger:info(("Memory peak %d, budget %d"):format(stats.peak, budget))
+end
@@ -0,0 +1,368 @@
+local modbus = require "modbus"
+local serial = require "serial"
+local socket = require "socket"
+local time = require "time"
+
+local PORT = 1502
+
+---The unit that never responds.
+local SILENT_UNIT = 99
+
+local function u16(s, i)
+    return (s:byte(i) << 8) | s:byte(i + 1)
+end
+
+local function crc16(s)
+    local crc = 0xffff
+    for i = 1, #s do
+        crc = crc ~ s:byte(i)
+        for _ = 1, 8 do
+            if crc & 1 == 1 then
+                crc = (crc >> 1) ~ 0xa001
+            else
+                crc = crc >> 1
+            end
+        end
+    end
+    return crc
+end
+
+---A register map shared by all the units, the holding register ``a`` is ``a``
+---and the input register ``a`` is ``a + 1000`` by default.
+local server = {
+    holding = {},
+    nreqs = 0,
+    batch = 0,
+}
+
+function server:reset()
+    self.holding = {}
+    self.nreqs = 0
+end
+
+---Handle a request PDU, returns the response PDU.
+function server:handle(pdu)
+    self.nreqs = self.nreqs + 1
+    local fc = pdu:byte(1)
+    local addr = u16(pdu, 2)
+    if addr >= 1000 then
+        return string.pack("BB", fc | 0x80, 2)
+    end
+    if fc == 3 or fc == 4 then
+        local cnt = u16(pdu, 4)
+        local regs = {}
+        for a = addr, addr + cnt - 1 do
+            if fc == 3 then
+                regs[#regs + 1] = string.pack(">I2", self.holding[a] or a)
+            else
+                regs[#regs + 1] = string.pack(">I2", a + 1000)
+            end
+        end
+        return string.pack("BB", fc, cnt * 2) .. table.concat(regs)
+    elseif fc == 6 then
+        self.holding[addr] = u16(pdu, 4)
+        return pdu
+    elseif fc == 16 then
+        local cnt = u16(pdu, 4)
+        for i = 0, cnt - 1 do
+            self.holding[addr + i] = u16(pdu, 7 + i * 2)
+        end
+        return pdu:sub(1, 5)
+    end
+    return string.pack("BB", fc | 0x80, 1)
+end
+
+local function recvexactly(sock, len)
+    local data = ""
+    while #data < len do
+        local s = sock:recv(len - #data)
+        if #s == 0 then
+            return nil
+        end
+        data = data .. s
+    end
+    return data
+end
+
+---Serve a Modbus TCP connection, the responses are sent in the reverse order
+---while ``server.batch`` requests are collected.
+local function serve(conn)
+    local pending = {}
+    while true do
+        local hdr = recvexactly(conn, 7)
+        if not hdr then
+            break
+        end
+        local tid, _, len, unit = string.unpack(">I2I2I2B", hdr)
+        local pdu = recvexactly(conn, len - 1)
+        if not pdu then
+            break
+        end
+        if unit ~= SILENT_UNIT then
+            local resp = server:handle(pdu)
+            table.insert(pending, 1, string.pack(">I2I2I2B", tid, 0, #resp + 1, unit) .. resp)
+            if #pending >= server.batch then
+                conn:sendall(table.concat(pending))
+                pending = {}
+                server.batch = 0
+            end
+        end
+    end
+    conn:destroy()
+end
+
+local listener = socket.create("TCP", "IPV4")
+listener:bind("127.0.0.1", PORT)
+listener:listen(4)
+time.createTimer(function ()
+    while true do
+        local conn = listener:accept()
+        time.createTimer(function ()
+            serve(conn)
+        end):start(0)
+    end
+end):start(0)
+
+---Run the functions concurrently and wait for them.
+local function concurrently(...)
+    local funcs = {...}
+    local results = {}
+    local cos = {}
+    local ndone = 0
+    for i, f in ipairs(funcs) do
+        cos[i] = coroutine.wrap(function ()
+            results[i] = table.pack(pcall(f))
+            ndone = ndone + 1
+        end)
+        cos[i]()
+    end
+    while ndone < #funcs do
+        time.sleep(10)
+    end
+    return results
+end
+
+local function regsEqual(regs, expected)
+    if #regs ~= #expected then
+        return false
+    end
+    for i, v in ipairs(expected) do
+        if regs[i] ~= v then
+            return false
+        end
+    end
+    return true
+end
+
+---Test modbus.tcp() with invalid parameters.
+do
+    assert(pcall(modbus.tcp, "127.0.0.1", 65536) == false)
+    assert(pcall(modbus.tcp, "127.0.0.1", PORT, { pipeline = 0 }) == false)
+    assert(pcall(modbus.tcp, "127.0.0.1", PORT, { pipeline = 33 }) == false)
+    assert(pcall(modbus.tcp, "127.0.0.1", PORT, { timeout = -1 }) == false)
+end
+
+---Test the requests with invalid parameters.
+do
+    local client <close> = modbus.tcp("127.0.0.1", PORT)
+    assert(pcall(client.readholding, client, 256, 0, 1) == false)
+    assert(pcall(client.readholding, client, 1, 65536, 1) == false)
+    assert(pcall(client.readholding, client, 1, 0, 0) == false)
+    assert(pcall(client.readholding, client, 1, 0, 126) == false)
+    assert(pcall(client.readholding, client, 1, 65535, 2) == false)
+    assert(pcall(client.writeregister, client, 1, 0, 65536) == false)
+    assert(pcall(client.writeregisters, client, 1, 0, {}) == false)
+    assert(pcall(client.writeregisters, client, 1, 0, { 1, "x" }) == false)
+end
+
+---Test calling client:close() twice.
+do
+    local client = modbus.tcp("127.0.0.1", PORT)
+    client:close()
+    assert(pcall(client.close, client) == false)
+    assert(pcall(client.readholding, client, 1, 0, 1) == false)
+end
+
+---Test reading and writing the registers.
+do
+    server:reset()
+    local client <close> = modbus.tcp("127.0.0.1", PORT)
+    assert(regsEqual(client:readholding(1, 10, 3), { 10, 11, 12 }))
+    assert(regsEqual(client:readinput(1, 0, 2), { 1000, 1001 }))
+    client:writeregister(1, 10, 1234)
+    assert(regsEqual(client:readholding(1, 10, 1), { 1234 }))
+    client:writeregisters(1, 20, { 1, 2, 65535 })
+    assert(regsEqual(client:readholding(1, 19, 4), { 19, 1, 2, 65535 }))
+    assert(server.nreqs == 6)
+end
+
+---Test the exception response.
+do
+    local client <close> = modbus.tcp("127.0.0.1", PORT)
+    local success, err = pcall(client.readholding, client, 1, 1000, 1)
+    assert(success == false)
+    assert(err:find("exception 2"))
+    assert(regsEqual(client:readholding(1, 0, 1), { 0 }))
+end
+
+---Test merging the concurrent reads of the adjoining and overlapping ranges.
+do
+    server:reset()
+    local client <close> = modbus.tcp("127.0.0.1", PORT)
+    local results = concurrently(function ()
+        return client:readholding(1, 0, 5)
+    end, function ()
+        return client:readholding(1, 5, 5)
+    end, function ()
+        return client:readholding(1, 8, 4)
+    end, function ()
+        return client:readinput(1, 0, 1)
+    end)
+    assert(regsEqual(results[1][2], { 0, 1, 2, 3, 4 }))
+    assert(regsEqual(results[2][2], { 5, 6, 7, 8, 9 }))
+    assert(regsEqual(results[3][2], { 8, 9, 10, 11 }))
+    assert(regsEqual(results[4][2], { 1000 }))
+    assert(server.nreqs == 2)
+end
+
+---Test the reads are not merged across a write.
+do
+    server:reset()
+    local client <close> = modbus.tcp("127.0.0.1", PORT)
+    local results = concurrently(function ()
+        return client:readholding(1, 0, 2)
+    end, function ()
+        return client:writeregister(1, 2, 100)
+    end, function ()
+        return client:readholding(1, 1, 2)
+    end)
+    for _, result in ipairs(results) do
+        assert(result[1] == true)
+    end
+    assert(regsEqual(results[1][2], { 0, 1 }))
+    assert(regsEqual(results[3][2], { 1, 100 }))
+    assert(server.nreqs == 3)
+end
+
+---Test pipelining the requests to the different units, the responses are out of order.
+do
+    server:reset()
+    server.batch = 3
+    local client <close> = modbus.tcp("127.0.0.1", PORT)
+    local results = concurrently(function ()
+        return client:readholding(1, 0, 1)
+    end, function ()
+        return client:readholding(2, 10, 1)
+    end, function ()
+        return client:readinput(3, 20, 1)
+    end)
+    assert(regsEqual(results[1][2], { 0 }))
+    assert(regsEqual(results[2][2], { 10 }))
+    assert(regsEqual(results[3][2], { 1020 }))
+    assert(server.nreqs == 3)
+end
+
+---Test the request timeout.
+do
+    local client <close> = modbus.tcp("127.0.0.1", PORT, { timeout = 100 })
+    local results = concurrently(function ()
+        return client:readholding(SILENT_UNIT, 0, 1)
+    end, function ()
+        return client:readholding(1, 0, 1)
+    end)
+    assert(results[1][1] == false)
+    assert(results[1][2]:find("timeout"))
+    assert(regsEqual(results[2][2], { 0 }))
+end
+
+---Test closing the client with the pending requests.
+do
+    local client = modbus.tcp("127.0.0.1", PORT, { timeout = 100 })
+    local results = {}
+    for i = 1, 2 do
+        coroutine.wrap(function ()
+            results[i] = { pcall(client.readholding, client, SILENT_UNIT, i, 1) }
+        end)()
+    end
+    time.sleep(10)
+    client:close()
+    for i = 1, 2 do
+        assert(results[i][1] == false)
+        assert(results[i][2]:find("client closed"), results[i][2])
+    end
+end
+
+---Test the requests are refused outside a yieldable coroutine.
+do
+    server:reset()
+    local client <close> = modbus.tcp("127.0.0.1", PORT)
+    local ok, err = pcall(string.gsub, "a", "a", function ()
+        return client:readholding(1, 0, 1)
+    end)
+    assert(ok == false)
+    assert(err:find("yieldable coroutine"), err)
+    time.sleep(50)
+    assert(server.nreqs == 0)
+end
+
+---Test Modbus RTU over a pseudo-terminal pair.
+do
+    server:reset()
+    local master <close>, path = serial.openpty()
+    local client <close> = modbus.rtu(path, { baudrate = 19200, parity = "none", timeout = 200 })
+
+    ---Handle the requests, corrupt the CRC of the response to unit 3.
+    local stop = false
+    time.createTimer(function ()
+        while not stop do
+            local frame = master:readexactly(6)
+            local unit, fc = frame:byte(1, 2)
+            if fc == 16 then
+                local rest = master:readexactly(1)
+                frame = frame .. rest .. master:readexactly(rest:byte() + 2)
+            else
+                frame = frame .. master:readexactly(2)
+            end
+            assert(crc16(frame:sub(1, -3)) == string.unpack("<I2", frame, -2))
+            if unit ~= SILENT_UNIT then
+                local resp = string.char(unit) .. server:handle(frame:sub(2, -3))
+                local crc = crc16(resp)
+                if unit == 3 then
+                    crc = crc ~ 0xffff
+                end
+                master:write(resp .. string.pack("<I2", crc))
+            end
+        end
+    end):start(0)
+
+    assert(regsEqual(client:readholding(1, 0, 3), { 0, 1, 2 }))
+    client:writeregisters(1, 0, { 7, 8 })
+    client:writeregister(2, 2, 9)
+    assert(regsEqual(client:readholding(1, 0, 3), { 7, 8, 9 }))
+
+    local success, err = pcall(client.readinput, client, 1, 1000, 1)
+    assert(success == false)
+    assert(err:find("exception 2"))
+
+    success, err = pcall(client.readholding, client, 3, 0, 1)
+    assert(success == false)
+    assert(err:find("CRC"))
+
+    success, err = pcall(client.readholding, client, SILENT_UNIT, 0, 1)
+    assert(success == false)
+    assert(err:find("timeout"))
+
+    local results = concurrently(function ()
+        return client:readholding(1, 0, 2)
+    end, function ()
+        return client:readholding(1, 2, 1)
+    end, function ()
+        return client:readinput(2, 0, 1)
+    end)
+    assert(regsEqual(results[1][2], { 7, 8 }))
+    assert(regsEqual(results[2][2], { 9 }))
+    assert(regsEqual(results[3][2], { 1000 }))
+    stop = true
+end
+
+listener:destroy()
@@ -0,0 +1,105 @@
+local netif = require "netif"
+local time = require "time"
+
+local logger = log.getLogger("testnetif")
+
+---Wait until ``cond()`` returns true or timeout.
+local function waitFor(cond, ms)
+    local deadline = os.time() + ms // 1000
+    while not cond() do
+        if os.time() > deadline then
+            return false
+        end
+        time.sleep(20)
+    end
+    return true
+end
+
+---Find an event matching all the fields of ``expected``.
+local function findEvent(events, expected)
+    for _, event in ipairs(events) do
+        local match = true
+        for k, v in pairs(expected) do
+            if event[k] ~= v then
+                match = false
+                break
+            end
+        end
+        if match then
+            return event
+        end
+    end
+    return nil
+end
+
+---Test the handlers with invalid parameters.
+do
+    assert(pcall(netif.onChange) == false)
+    assert(pcall(netif.onChange, "x") == false)
+    assert(pcall(netif.offChange, {}) == false)
+end
+
+---Test adding and removing a handler.
+do
+    local function handler() end
+    netif.onChange(handler)
+    netif.offChange(handler)
+    netif.offChange(handler)
+end
+
+---Test the link and address events on a veth pair, it requires the privilege
+---to manage the links, run it in an unprivileged network namespace with
+---"unshare -rn" if needed.
+if not os.execute("ip link add hbt0 type veth peer name hbt1 2>/dev/null") then
+    logger:info("Skip the link and address tests, no privilege to add links.")
+else
+    local events = {}
+    local function handler(event)
+        events[#events + 1] = event
+    end
+    local removed = {}
+    local function removedHandler(event)
+        removed[#removed + 1] = event
+    end
+    ---Add a handler while the handlers are called.
+    local nested = {}
+    local function nestedHandler(event)
+        nested[#nested + 1] = event
+    end
+    local function addingHandler()
+        netif.onChange(nestedHandler)
+        netif.offChange(addingHandler)
+    end
+    netif.onChange(handler)
+    netif.onChange(removedHandler)
+    netif.offChange(removedHandler)
+    netif.onChange(addingHandler)
+
+    assert(os.execute("ip link set hbt1 up"))
+    assert(os.execute("ip link set hbt0 up"))
+    assert(os.execute("ip addr add 198.51.100.1/24 dev hbt0"))
+    assert(waitFor(function ()
+        return findEvent(events, { type = "up", name = "hbt0" }) and
+            findEvent(events, { type = "newaddr", name = "hbt0", family = "IPV4", addr = "198.51.100.1" })
+    end, 3000))
+    local up = findEvent(events, { type = "up", name = "hbt0" })
+    assert(math.type(up.index) == "integer" and up.index > 0)
+    assert(up.addr == nil)
+
+    events = {}
+    assert(os.execute("ip addr del 198.51.100.1/24 dev hbt0"))
+    assert(waitFor(function ()
+        return findEvent(events, { type = "deladdr", family = "IPV4", addr = "198.51.100.1" })
+    end, 3000))
+
+    events = {}
+    assert(os.execute("ip link del hbt0"))
+    assert(waitFor(function ()
+        return findEvent(events, { type = "down", index = up.index })
+    end, 3000))
+
+    netif.offChange(handler)
+    netif.offChange(nestedHandler)
+    assert(#removed == 0)
+    assert(#nested > 0)
+end
@@ -54,6 +54,23 @@ do
     end
 end
 
+-- Tests nvs.set() with a large value, it is stored compressed.
+do
+    local handle <close> = nvs.open("test")
+    local arr = {}
+    for i = 1, 200 do
+        arr[i] = {id = i, name = "accessory" .. i}
+    end
+    handle:set("test", arr)
+    for i, v in ipairs(handle:get("test")) do
+        assert(v.id == i and v.name == arr[i].name)
+    end
+
+    local str = string.rep("x", 1000)
+    handle:set("test", str)
+    assert(handle:get("test") == str)
+end
+
 -- Tests nvs.set() with invalid parameters.
 do
     local handle <close> = nvs.open("test")
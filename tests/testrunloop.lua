@@ -0,0 +1,59 @@
+local runloop = require "runloop"
+local time = require "time"
+
+---Block the run loop for ``ms`` milliseconds.
+local function block(ms)
+    local deadline = time.monotonic() + ms
+    while time.monotonic() < deadline do end
+end
+
+---Block the run loop until ``cond()`` returns true or timeout.
+local function blockFor(cond, ms)
+    local deadline = time.monotonic() + ms
+    while not cond() do
+        if time.monotonic() > deadline then
+            return false
+        end
+        block(20)
+        time.sleep(10)
+    end
+    return true
+end
+
+---Test the handlers adding and removing the handlers.
+do
+    local calls = {}
+    local first, second
+    local function added(pressure)
+        calls[#calls + 1] = "added"
+    end
+    ---Whichever of the two runs first removes the other and adds a handler.
+    local function handler(name, pressure)
+        calls[#calls + 1] = name
+        runloop.offPressureChange(first)
+        runloop.offPressureChange(second)
+        runloop.onPressureChange(added)
+    end
+    first = function (pressure) handler("first", pressure) end
+    second = function (pressure) handler("second", pressure) end
+    runloop.onPressureChange(first)
+    runloop.onPressureChange(second)
+
+    runloop.setThresholds(1, 2)
+    assert(blockFor(function () return #calls > 0 end, 3000))
+    -- The removed handler is skipped, the added one waits for the next change.
+    assert(#calls == 1 and (calls[1] == "first" or calls[1] == "second"))
+
+    runloop.setThresholds(50, 200)
+    local n = #calls
+    local deadline = time.monotonic() + 5000
+    while runloop.pressure() ~= "normal" and time.monotonic() < deadline do
+        time.sleep(50)
+    end
+    assert(runloop.pressure() == "normal")
+    assert(#calls > n)
+    for i = n + 1, #calls do
+        assert(calls[i] == "added")
+    end
+    runloop.offPressureChange(added)
+end
@@ -0,0 +1,127 @@
+local serial = require "serial"
+local time = require "time"
+
+---Test serial.open() with invalid parameters.
+do
+    assert(pcall(serial.open, "/dev/nonexistent") == false)
+    local _, path = serial.openpty()
+    for _, cfg in ipairs({
+        { baudrate = 12345 },
+        { databits = 9 },
+        { parity = "mark" },
+        { stopbits = 3 },
+    }) do
+        assert(pcall(serial.open, path, cfg) == false)
+    end
+end
+
+---Test calling port:destroy() twice.
+do
+    local master = serial.openpty()
+    master:destroy()
+    assert(pcall(master.destroy, master) == false)
+end
+
+---Test reading the frames from a pseudo-terminal pair.
+do
+    local master <close>, path = serial.openpty()
+    local port <close> = serial.open(path, {
+        baudrate = 9600,
+        databits = 8,
+        parity = "even",
+        stopbits = 1,
+    })
+
+    master:write("hello\r\nworld\n")
+    assert(port:readuntil("\r\n", 64) == "hello\r\n")
+    assert(port:readexactly(6) == "world\n")
+
+    port:write("ping")
+    assert(master:readexactly(4) == "ping")
+end
+
+---Test a frame split across the writes.
+do
+    local master <close>, path = serial.openpty()
+    local port <close> = serial.open(path)
+
+    local frame
+    master:write("ab")
+    time.createTimer(function ()
+        frame = port:readexactly(4)
+    end):start(0)
+    time.sleep(10)
+    assert(frame == nil)
+    master:write("cdef")
+    while frame == nil do
+        time.sleep(10)
+    end
+    assert(frame == "abcd")
+    assert(port:readexactly(2) == "ef")
+end
+
+---Test the delimiter not found within the max length.
+do
+    local master <close>, path = serial.openpty()
+    local port <close> = serial.open(path)
+
+    master:write("0123456789")
+    local success, err = pcall(port.readuntil, port, "\n", 8)
+    assert(success == false)
+    assert(err:find("delimiter"))
+    assert(port:readexactly(10) == "0123456789")
+end
+
+---Test the read timeout.
+do
+    local master <close>, path = serial.openpty()
+    local port <close> = serial.open(path)
+
+    port:settimeout(100)
+    local success, err = pcall(port.read, port, 1)
+    assert(success == false)
+    assert(err:find("timeout"))
+    master:write("x")
+    assert(port:read(1024) == "x")
+end
+
+---Test writing a large chunk of data with backpressure.
+do
+    local master <close>, path = serial.openpty()
+    local port <close> = serial.open(path)
+
+    local data = string.rep("0123456789", 20000)
+    local done = false
+    time.createTimer(function ()
+        port:write(data)
+        port:write("END")
+        done = true
+    end):start(0)
+    assert(master:readexactly(#data + 3) == data .. "END")
+    while not done do
+        time.sleep(10)
+    end
+end
+
+---Test destroying a port with a pending read.
+do
+    local master <close>, path = serial.openpty()
+    local port = serial.open(path)
+    local result
+    coroutine.wrap(function ()
+        result = { pcall(port.read, port, 16) }
+    end)()
+    time.sleep(10)
+    port:destroy()
+    assert(result[1] == false)
+    assert(result[2]:find("closed"), result[2])
+end
+
+---Test a read of any length takes what is buffered, however large its max length.
+do
+    local master <close>, path = serial.openpty()
+    local port <close> = serial.open(path)
+    master:write("hello")
+    time.sleep(10)
+    assert(port:read(1024 * 1024) == "hello")
+end
@@ -0,0 +1,194 @@
+local socket = require "socket"
+local time = require "time"
+local mq = require "mq"
+local wsframe = require "wsframe"
+local websocket = require "websocket"
+local pack = string.pack
+
+local PORT = 8891
+
+---Test the accept key (RFC 6455 1.3).
+do
+    assert(wsframe.accept("dGhlIHNhbXBsZSBub25jZQ==") == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=")
+end
+
+---Test frame encoding and parsing.
+do
+    local parser = wsframe.parser(1 << 20)
+    for _, len in ipairs({ 0, 7, 125, 126, 65535, 65536 }) do
+        local data = string.rep("x", len)
+        parser:feed(wsframe.encode("binary", data))
+        local op, payload = parser:next()
+        assert(op == "binary")
+        assert(payload == data)
+    end
+
+    -- A fragmented message with a control frame in the middle, fed byte by byte.
+    local frames = wsframe.encode("text", "hello ", false) .. wsframe.encode("ping", "p") ..
+        wsframe.encode("continuation", "world", true, false)
+    local msgs = {}
+    for i = 1, #frames do
+        parser:feed(frames:sub(i, i))
+        while true do
+            local op, payload = parser:next()
+            if op == nil then
+                break
+            end
+            msgs[#msgs + 1] = op .. ":" .. payload
+        end
+    end
+    assert(#msgs == 2)
+    assert(msgs[1] == "ping:p")
+    assert(msgs[2] == "text:hello world")
+
+    parser = wsframe.parser(10)
+    parser:feed(wsframe.encode("text", string.rep("x", 11)))
+    assert(pcall(parser.next, parser) == false)
+end
+
+---A WebSocket stand-in server.
+---
+---Messages:
+---  "fragment" Reply "fragment" in 2 fragments with a ping "x" in the middle.
+---  "bye"      Close the connection with 1001.
+---  others     Echo the message.
+---
+---A pong is replied with a text message "pong:<payload>".
+---Pings are not answered on path "/mute".
+local function startServer()
+    local listener = socket.create("TCP", "IPV4")
+    listener:bind("127.0.0.1", PORT)
+    listener:listen(1)
+
+    local function serve(sock)
+        local buf = ""
+        while not buf:find("\r\n\r\n", 1, true) do
+            buf = buf .. sock:recv(1024)
+        end
+        local path = buf:match("^GET (%S+)")
+        local key = buf:match("Sec%-WebSocket%-Key: ([^\r\n]+)")
+        local protocol = buf:match("Sec%-WebSocket%-Protocol: ([^,\r\n]+)")
+        sock:sendall("HTTP/1.1 101 Switching Protocols\r\n" ..
+            "Upgrade: websocket\r\nConnection: Upgrade\r\n" ..
+            "Sec-WebSocket-Accept: " .. wsframe.accept(key) .. "\r\n" ..
+            (protocol and "Sec-WebSocket-Protocol: " .. protocol .. "\r\n" or "") .. "\r\n")
+
+        local parser = wsframe.parser(1 << 20)
+        local function send(op, data, fin)
+            sock:sendall(wsframe.encode(op, data, fin, false))
+        end
+        while true do
+            local data = sock:recv(16384)
+            if #data == 0 then
+                sock:destroy()
+                return
+            end
+            parser:feed(data)
+            while true do
+                local op, payload = parser:next()
+                if op == nil then
+                    break
+                end
+                if op == "close" then
+                    send("close", payload:sub(1, 2))
+                    sock:destroy()
+                    return
+                elseif op == "ping" then
+                    if path ~= "/mute" then
+                        send("pong", payload)
+                    end
+                elseif op == "pong" then
+                    send("text", "pong:" .. payload)
+                elseif payload == "fragment" then
+                    send("text", "frag", false)
+                    send("ping", "x")
+                    send("continuation", "ment", true)
+                elseif payload == "bye" then
+                    send("close", pack(">I2", 1001) .. "bye")
+                else
+                    send(op, payload)
+                end
+            end
+        end
+    end
+
+    time.createTimer(function ()
+        while true do
+            local success, sock = pcall(listener.accept, listener)
+            if success == false then
+                return
+            end
+            time.createTimer(serve, sock):start(0)
+        end
+    end):start(0)
+    return listener
+end
+
+local listener = startServer()
+
+---Test messages over a connection.
+do
+    local ws = websocket.connect("ws://127.0.0.1:" .. PORT .. "/echo", {
+        protocols = { "chat" },
+        maxMessageSize = 1 << 20,
+    })
+    assert(ws.protocol == "chat")
+
+    ws:send("hello")
+    local data, type = ws:recv()
+    assert(data == "hello")
+    assert(type == "text")
+
+    local content = string.rep("0123456789", 20000)
+    ws:send(content, true)
+    data, type = ws:recv()
+    assert(data == content)
+    assert(type == "binary")
+
+    -- The ping from the server is answered automatically.
+    ws:send("fragment")
+    assert(ws:recv() == "fragment")
+    assert(ws:recv() == "pong:x")
+
+    ws:close()
+    assert(pcall(ws.recv, ws) == false)
+    assert(pcall(ws.send, ws, "hello") == false)
+end
+
+---Test the callbacks and the close from the server.
+do
+    local done = mq.create(1)
+    local msgs = {}
+    local ws = websocket.connect("ws://127.0.0.1:" .. PORT .. "/echo", {
+        onMessage = function (_, data)
+            msgs[#msgs + 1] = data
+        end,
+        onClose = function (_, code, reason)
+            done:send(code, reason)
+        end,
+    })
+    ws:send("1")
+    ws:send("2")
+    ws:send("bye")
+    local code, reason = done:recv()
+    assert(code == 1001)
+    assert(reason == "bye")
+    assert(#msgs == 2)
+    assert(msgs[1] == "1" and msgs[2] == "2")
+end
+
+---Test the connection is aborted if the server stops answering pings.
+do
+    local done = mq.create(1)
+    websocket.connect("ws://127.0.0.1:" .. PORT .. "/mute", {
+        pingInterval = 100,
+        onClose = function (_, code, reason)
+            done:send(code, reason)
+        end,
+    })
+    local code, reason = done:recv()
+    assert(code == 1006)
+    assert(reason == "ping timeout")
+end
+
+listener:destroy()